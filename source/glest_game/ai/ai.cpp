@@ -938,6 +938,10 @@ void Ai::massiveAttack(const Vec2i &pos, Field field, bool ultraAttack){
 					}
 				}
 			}
+			// don't send units that can never walk to the target
+			if(shouldAttack && aiInterface->isPathReachable(unit, pos) == false) {
+				shouldAttack= false;
+			}
 			if(shouldAttack) {
 				if(unitGroupCommandId == -1) {
 					unitGroupCommandId = aiInterface->getWorld()->getNextCommandGroupId();
@@ -983,7 +987,9 @@ void Ai::returnBase(int unitIndex) {
 
     if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
     //r= aiInterface->giveCommand(unitIndex, ccMove, pos);
-    aiInterface->giveCommand(unitIndex, ccMove, pos);
+    if(aiInterface->isPathReachable(aiInterface->getMyUnit(unitIndex), pos) == true) {
+    	aiInterface->giveCommand(unitIndex, ccMove, pos);
+    }
 
     //aiInterface->printLog(1, "Order return to base pos:" + intToStr(pos.x)+", "+intToStr(pos.y)+": "+rrToStr(r)+"\n");
 }
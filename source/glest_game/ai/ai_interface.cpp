@@ -21,6 +21,8 @@
 #include "config.h"
 #include "network_manager.h"
 #include "platform_util.h"
+#include "path_finder.h"
+#include "cluster_map.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Util;
@@ -833,6 +835,27 @@ bool AiInterface::isFreeCells(const Vec2i &pos, int size, Field field){
     return world->getMap()->isFreeCells(pos, size, field);
 }
 
+// Connectivity region of the cell for units of that field and size, cells
+// with different regions can never be joined by a path. Without region
+// labels the whole map counts as one region.
+int AiInterface::getPathRegion(Field field, int unitSize, const Vec2i &pos) const {
+	const Map *map = world->getMap();
+	const ClusterMap *clusterMap = map->getClusterMap();
+	if(clusterMap == NULL || clusterMap->hasRegionLabels() == false) {
+		return (map->isInside(pos) ? 0 : ClusterMap::regionBlocked);
+	}
+	return clusterMap->getRegion(field, unitSize, pos);
+}
+
+bool AiInterface::isPathReachable(const Unit *unit, const Vec2i &pos) const {
+	const ClusterMap *clusterMap = world->getMap()->getClusterMap();
+	if(clusterMap == NULL) {
+		return true;
+	}
+	return clusterMap->isReachable(unit->getCurrField(), unit->getType()->getSize(),
+			unit->getPosNotThreadSafe(), pos, PathFinder::maxFreeSearchRadius);
+}
+
 void AiInterface::removeEnemyWarningPositionFromList(Vec2i &checkPos) {
 	for(int i = (int)enemyWarningPositionList.size() - 1; i >= 0; --i) {
 		Vec2i &pos = enemyWarningPositionList[i];
@@ -151,6 +151,8 @@ public:
 	bool reqsOk(const CommandType *ct);
     bool checkCosts(const ProducibleType *pt, const CommandType *ct);
 	bool isFreeCells(const Vec2i &pos, int size, Field field);
+	int getPathRegion(Field field, int unitSize, const Vec2i &pos) const;
+	bool isPathReachable(const Unit *unit, const Vec2i &pos) const;
 	const Unit *getFirstOnSightEnemyUnit(Vec2i &pos, Field &field, int radius);
 	Map * getMap();
 	World * getWorld() { return world; }
@@ -0,0 +1,850 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "cluster_map.h"
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <functional>
+#include "map.h"
+#include "util.h"
+#include "leak_dumper.h"
+
+using namespace std;
+using namespace Shared::Util;
+
+namespace Glest{ namespace Game{
+
+// =====================================================
+// 	class ClusterMap
+// =====================================================
+
+const int ClusterMap::clusterSize			= 16;
+const int ClusterMap::maxUnitSize			= 3;
+const int ClusterMap::longEntranceLength	= 6;
+const int ClusterMap::straightCost			= 10;
+const int ClusterMap::diagonalCost			= 14;
+const int ClusterMap::regionBlocked			= -1;
+
+static const int infiniteDistance			= 0x7FFFFFFF;
+static const int maxAbstractNodesPerCluster	= 1024;
+static const int maxAbstractSearchNodes		= 20000;
+static const int nearestPassableRadius		= 10;
+// how far around a changed area connectivity is first checked locally
+// before a possible split is resolved by relabelling the whole region
+static const int regionLocalMargin			= 6;
+
+int ClusterMap::Cluster::findNode(const Vec2i &pos) const {
+	for(unsigned int i = 0; i < nodes.size(); ++i) {
+		if(nodes[i].pos == pos) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+ClusterMap::ClusterMap(const Map *map) {
+	this->map = map;
+	w = 0;
+	h = 0;
+	clusterCountW = 0;
+	clusterCountH = 0;
+	version = 0;
+	abstractGraph = false;
+	regionLabels = false;
+}
+
+ClusterMap::~ClusterMap() {
+	layers.clear();
+	map = NULL;
+}
+
+void ClusterMap::init(bool buildAbstractGraph, bool buildRegionLabels) {
+	Chrono chrono;
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) chrono.start();
+
+	w = map->getW();
+	h = map->getH();
+	clusterCountW = (w + clusterSize - 1) / clusterSize;
+	clusterCountH = (h + clusterSize - 1) / clusterSize;
+	int clusterCount = clusterCountW * clusterCountH;
+	abstractGraph = buildAbstractGraph;
+	regionLabels = buildRegionLabels;
+
+	layers.clear();
+	layers.resize(maxUnitSize);
+	for(int index = 0; index < maxUnitSize; ++index) {
+		Layer &layer = layers[index];
+		layer.unitSize = index + 1;
+		layer.passable.resize(w * h, 0);
+		if(abstractGraph == true) {
+			layer.clusters.resize(clusterCount);
+			layer.eastTransitions.resize(clusterCount);
+			layer.southTransitions.resize(clusterCount);
+		}
+	}
+
+	computePassable(0, 0, w - 1, h - 1);
+
+	for(int index = 0; index < maxUnitSize; ++index) {
+		Layer &layer = layers[index];
+		if(regionLabels == true) {
+			labelRegions(layer);
+		}
+		if(abstractGraph == false) {
+			continue;
+		}
+		for(int clusterY = 0; clusterY < clusterCountH; ++clusterY) {
+			for(int clusterX = 0; clusterX < clusterCountW; ++clusterX) {
+				computeTransitions(layer, clusterX, clusterY, true);
+				computeTransitions(layer, clusterX, clusterY, false);
+			}
+		}
+		for(int clusterY = 0; clusterY < clusterCountH; ++clusterY) {
+			for(int clusterX = 0; clusterX < clusterCountW; ++clusterX) {
+				computeCluster(layer, clusterX, clusterY);
+			}
+		}
+	}
+	version++;
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] built %d x %d clusters, nodes = %d, regions = %d took msecs: %lld\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,clusterCountW,clusterCountH,getNodeCount(1),getRegionCount(1),(long long int)chrono.getMillis());
+}
+
+// Repairs the abstraction after the static obstacles inside the given
+// area changed (building placed or removed, resource exhausted)
+void ClusterMap::update(const Vec2i &pos, int size) {
+	if(layers.empty() == true) {
+		return;
+	}
+
+	int x0 = max(0, pos.x);
+	int y0 = max(0, pos.y);
+	int x1 = min(w - 1, pos.x + size - 1);
+	int y1 = min(h - 1, pos.y + size - 1);
+	if(x0 > x1 || y0 > y1) {
+		return;
+	}
+
+	// remember the old passability of every cell that may change so the
+	// region labels only need to be touched around real changes
+	vector<vector<unsigned char> > oldPassable;
+	if(regionLabels == true) {
+		oldPassable.resize(layers.size());
+		for(int index = 0; index < (int)layers.size(); ++index) {
+			const Layer &layer = layers[index];
+			for(int y = max(0, y0 - (layer.unitSize - 1)); y <= y1; ++y) {
+				for(int x = max(0, x0 - (layer.unitSize - 1)); x <= x1; ++x) {
+					oldPassable[index].push_back(layer.passable[y * w + x]);
+				}
+			}
+		}
+	}
+	computePassable(x0, y0, x1, y1);
+
+	if(regionLabels == true) {
+		for(int index = 0; index < (int)layers.size(); ++index) {
+			Layer &layer = layers[index];
+			updateRegions(layer, max(0, x0 - (layer.unitSize - 1)), max(0, y0 - (layer.unitSize - 1)),
+					x1, y1, oldPassable[index]);
+		}
+	}
+	if(abstractGraph == false) {
+		version++;
+		return;
+	}
+
+	// larger units have their footprint anchored at the top left cell
+	int dirtyX0 = max(0, x0 - (maxUnitSize - 1)) / clusterSize;
+	int dirtyY0 = max(0, y0 - (maxUnitSize - 1)) / clusterSize;
+	int dirtyX1 = x1 / clusterSize;
+	int dirtyY1 = y1 / clusterSize;
+
+	for(int index = 0; index < maxUnitSize; ++index) {
+		Layer &layer = layers[index];
+
+		for(int clusterY = dirtyY0; clusterY <= dirtyY1; ++clusterY) {
+			for(int clusterX = dirtyX0; clusterX <= dirtyX1; ++clusterX) {
+				computeTransitions(layer, clusterX, clusterY, true);
+				computeTransitions(layer, clusterX, clusterY, false);
+				if(clusterX > 0) {
+					computeTransitions(layer, clusterX - 1, clusterY, true);
+				}
+				if(clusterY > 0) {
+					computeTransitions(layer, clusterX, clusterY - 1, false);
+				}
+			}
+		}
+
+		// neighbours share the rebuilt borders so their nodes change too
+		for(int clusterY = max(0, dirtyY0 - 1); clusterY <= min(clusterCountH - 1, dirtyY1 + 1); ++clusterY) {
+			for(int clusterX = max(0, dirtyX0 - 1); clusterX <= min(clusterCountW - 1, dirtyX1 + 1); ++clusterX) {
+				computeCluster(layer, clusterX, clusterY);
+			}
+		}
+	}
+	version++;
+}
+
+bool ClusterMap::canAbstract(Field field, int unitSize) const {
+	return (abstractGraph == true && field == fLand && unitSize >= 1 && unitSize <= (int)layers.size());
+}
+
+bool ClusterMap::canLabelRegions(Field field, int unitSize) const {
+	return (regionLabels == true && field == fLand && unitSize >= 1 && unitSize <= (int)layers.size());
+}
+
+// Returns the region of the cell or regionBlocked if a unit of that size
+// can never stand there. Fields without obstacles (air) are one region.
+int ClusterMap::getRegion(Field field, int unitSize, const Vec2i &pos) const {
+	if(pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h) {
+		return regionBlocked;
+	}
+	if(canLabelRegions(field, unitSize) == false) {
+		return 0;
+	}
+	return layers[unitSize - 1].regions[pos.y * w + pos.x];
+}
+
+// Returns false only if no path can exist from fromPos to toPos or to any
+// cell within searchRadius of it (the PathFinder also walks to the nearest
+// free cell around blocked targets). Unknown cases are reported reachable.
+bool ClusterMap::isReachable(Field field, int unitSize, const Vec2i &fromPos,
+		const Vec2i &toPos, int searchRadius) const {
+	if(canLabelRegions(field, unitSize) == false) {
+		return true;
+	}
+	int fromRegion = getRegion(field, unitSize, fromPos);
+	if(fromRegion == regionBlocked) {
+		return true;
+	}
+
+	for(int radius = 0; radius <= searchRadius; ++radius) {
+		for(int j = -radius; j <= radius; ++j) {
+			for(int i = -radius; i <= radius; ++i) {
+				if(abs(i) != radius && abs(j) != radius) {
+					continue;
+				}
+				if(getRegion(field, unitSize, Vec2i(toPos.x + i, toPos.y + j)) == fromRegion) {
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+int ClusterMap::getRegionCount(int unitSize) const {
+	if(regionLabels == false || unitSize < 1 || unitSize > (int)layers.size()) {
+		return 0;
+	}
+	return (int)layers[unitSize - 1].regionSizes.size();
+}
+
+bool ClusterMap::isPassable(Field field, int unitSize, const Vec2i &pos) const {
+	if(canAbstract(field, unitSize) == false) {
+		return true;
+	}
+	return isPassable(layers[unitSize - 1], pos.x, pos.y);
+}
+
+int ClusterMap::getNodeCount(int unitSize) const {
+	int result = 0;
+	if(unitSize >= 1 && unitSize <= (int)layers.size()) {
+		const Layer &layer = layers[unitSize - 1];
+		for(unsigned int i = 0; i < layer.clusters.size(); ++i) {
+			result += (int)layer.clusters[i].nodes.size();
+		}
+	}
+	return result;
+}
+
+bool ClusterMap::computeCellPassable(int x, int y) const {
+	return map->isStaticallyFreeCell(Vec2i(x, y), fLand);
+}
+
+void ClusterMap::computePassable(int x0, int y0, int x1, int y1) {
+	Layer &baseLayer = layers[0];
+	for(int y = y0; y <= y1; ++y) {
+		for(int x = x0; x <= x1; ++x) {
+			baseLayer.passable[y * w + x] = (computeCellPassable(x, y) ? 1 : 0);
+		}
+	}
+
+	for(int index = 1; index < (int)layers.size(); ++index) {
+		Layer &layer = layers[index];
+		int unitSize = layer.unitSize;
+		for(int y = max(0, y0 - (unitSize - 1)); y <= y1; ++y) {
+			for(int x = max(0, x0 - (unitSize - 1)); x <= x1; ++x) {
+				bool passable = true;
+				for(int j = 0; j < unitSize && passable == true; ++j) {
+					for(int i = 0; i < unitSize && passable == true; ++i) {
+						passable = isPassable(baseLayer, x + i, y + j);
+					}
+				}
+				layer.passable[y * w + x] = (passable ? 1 : 0);
+			}
+		}
+	}
+}
+
+void ClusterMap::computeTransitions(Layer &layer, int clusterX, int clusterY, bool east) {
+	int clusterIndex = clusterY * clusterCountW + clusterX;
+	Transitions &transitions = (east ? layer.eastTransitions[clusterIndex] : layer.southTransitions[clusterIndex]);
+	transitions.clear();
+
+	if((east == true && clusterX + 1 >= clusterCountW) ||
+	   (east == false && clusterY + 1 >= clusterCountH)) {
+		return;
+	}
+
+	// walk along the shared border, cell a is inside this cluster and cell b
+	// is the matching cell inside the neighbour
+	int borderLength = 0;
+	Vec2i borderStart;
+	Vec2i borderStep;
+	Vec2i crossStep;
+	if(east == true) {
+		borderStart = Vec2i((clusterX + 1) * clusterSize - 1, clusterY * clusterSize);
+		borderStep = Vec2i(0, 1);
+		crossStep = Vec2i(1, 0);
+		borderLength = min(clusterSize, h - borderStart.y);
+	}
+	else {
+		borderStart = Vec2i(clusterX * clusterSize, (clusterY + 1) * clusterSize - 1);
+		borderStep = Vec2i(1, 0);
+		crossStep = Vec2i(0, 1);
+		borderLength = min(clusterSize, w - borderStart.x);
+	}
+
+	int runStart = -1;
+	for(int i = 0; i <= borderLength; ++i) {
+		bool open = false;
+		if(i < borderLength) {
+			Vec2i posA = borderStart + borderStep * i;
+			Vec2i posB = posA + crossStep;
+			open = isPassable(layer, posA.x, posA.y) && isPassable(layer, posB.x, posB.y);
+		}
+
+		if(open == true && runStart < 0) {
+			runStart = i;
+		}
+		else if(open == false && runStart >= 0) {
+			int runEnd = i - 1;
+			if(runEnd - runStart + 1 >= longEntranceLength) {
+				Vec2i posA = borderStart + borderStep * runStart;
+				transitions.push_back(make_pair(posA, posA + crossStep));
+				posA = borderStart + borderStep * runEnd;
+				transitions.push_back(make_pair(posA, posA + crossStep));
+			}
+			else {
+				Vec2i posA = borderStart + borderStep * ((runStart + runEnd) / 2);
+				transitions.push_back(make_pair(posA, posA + crossStep));
+			}
+			runStart = -1;
+		}
+	}
+}
+
+static bool compareNodePos(const ClusterMap::Node &node1, const ClusterMap::Node &node2) {
+	if(node1.pos.y != node2.pos.y) {
+		return node1.pos.y < node2.pos.y;
+	}
+	return node1.pos.x < node2.pos.x;
+}
+
+void ClusterMap::computeCluster(Layer &layer, int clusterX, int clusterY) {
+	int clusterIndex = clusterY * clusterCountW + clusterX;
+	Cluster &cluster = layer.clusters[clusterIndex];
+	cluster.nodes.clear();
+
+	// collect the entrances on all four borders
+	std::map<Vec2i, vector<Vec2i> > entrances;
+	const Transitions &east = layer.eastTransitions[clusterIndex];
+	for(unsigned int i = 0; i < east.size(); ++i) {
+		entrances[east[i].first].push_back(east[i].second);
+	}
+	const Transitions &south = layer.southTransitions[clusterIndex];
+	for(unsigned int i = 0; i < south.size(); ++i) {
+		entrances[south[i].first].push_back(south[i].second);
+	}
+	if(clusterX > 0) {
+		const Transitions &west = layer.eastTransitions[clusterIndex - 1];
+		for(unsigned int i = 0; i < west.size(); ++i) {
+			entrances[west[i].second].push_back(west[i].first);
+		}
+	}
+	if(clusterY > 0) {
+		const Transitions &north = layer.southTransitions[clusterIndex - clusterCountW];
+		for(unsigned int i = 0; i < north.size(); ++i) {
+			entrances[north[i].second].push_back(north[i].first);
+		}
+	}
+
+	for(std::map<Vec2i, vector<Vec2i> >::iterator iterMap = entrances.begin();
+		iterMap != entrances.end() && (int)cluster.nodes.size() < maxAbstractNodesPerCluster; ++iterMap) {
+		Node node;
+		node.pos = iterMap->first;
+		node.links = iterMap->second;
+		cluster.nodes.push_back(node);
+	}
+	std::sort(cluster.nodes.begin(), cluster.nodes.end(), compareNodePos);
+
+	// connect the entrances that can reach each other inside the cluster
+	vector<int> dist;
+	for(unsigned int i = 0; i < cluster.nodes.size(); ++i) {
+		computeDistances(layer, clusterIndex, cluster.nodes[i].pos, dist);
+		for(unsigned int j = 0; j < cluster.nodes.size(); ++j) {
+			if(i == j) {
+				continue;
+			}
+			const Vec2i &pos = cluster.nodes[j].pos;
+			int localIndex = (pos.y % clusterSize) * clusterSize + (pos.x % clusterSize);
+			if(dist[localIndex] != infiniteDistance) {
+				cluster.nodes[i].edges.push_back(Edge(j, dist[localIndex]));
+			}
+		}
+	}
+}
+
+// Dijkstra restricted to one cluster, dist is indexed by the cell offset
+// inside the cluster
+void ClusterMap::computeDistances(const Layer &layer, int clusterIndex, const Vec2i &fromPos, vector<int> &dist) const {
+	dist.assign(clusterSize * clusterSize, infiniteDistance);
+
+	int clusterX0 = (clusterIndex % clusterCountW) * clusterSize;
+	int clusterY0 = (clusterIndex / clusterCountW) * clusterSize;
+	int clusterX1 = min(w, clusterX0 + clusterSize) - 1;
+	int clusterY1 = min(h, clusterY0 + clusterSize) - 1;
+
+	if(isPassable(layer, fromPos.x, fromPos.y) == false) {
+		return;
+	}
+
+	typedef pair<int,int> QueueEntry;
+	std::priority_queue<QueueEntry, vector<QueueEntry>, std::greater<QueueEntry> > open;
+
+	int startIndex = (fromPos.y - clusterY0) * clusterSize + (fromPos.x - clusterX0);
+	dist[startIndex] = 0;
+	open.push(make_pair(0, startIndex));
+
+	while(open.empty() == false) {
+		QueueEntry entry = open.top();
+		open.pop();
+
+		int currentIndex = entry.second;
+		if(entry.first > dist[currentIndex]) {
+			continue;
+		}
+		int x = clusterX0 + currentIndex % clusterSize;
+		int y = clusterY0 + currentIndex / clusterSize;
+
+		for(int j = -1; j <= 1; ++j) {
+			for(int i = -1; i <= 1; ++i) {
+				if(i == 0 && j == 0) {
+					continue;
+				}
+				int nextX = x + i;
+				int nextY = y + j;
+				if(nextX < clusterX0 || nextY < clusterY0 || nextX > clusterX1 || nextY > clusterY1) {
+					continue;
+				}
+				if(isPassable(layer, nextX, nextY) == false) {
+					continue;
+				}
+				int cost = straightCost;
+				if(i != 0 && j != 0) {
+					// single cell units may not cut corners (see Map::canMove)
+					if(layer.unitSize == 1 &&
+						(isPassable(layer, x + i, y) == false || isPassable(layer, x, y + j) == false)) {
+						continue;
+					}
+					cost = diagonalCost;
+				}
+
+				int nextIndex = (nextY - clusterY0) * clusterSize + (nextX - clusterX0);
+				int nextDist = entry.first + cost;
+				if(nextDist < dist[nextIndex]) {
+					dist[nextIndex] = nextDist;
+					open.push(make_pair(nextDist, nextIndex));
+				}
+			}
+		}
+	}
+}
+
+// Connected component labelling of the whole layer, labels are handed out
+// in scan order so every client ends up with the same numbers
+void ClusterMap::labelRegions(Layer &layer) {
+	layer.regions.assign(w * h, regionBlocked);
+	layer.regionSizes.clear();
+	layer.nextRegion = 0;
+
+	for(int y = 0; y < h; ++y) {
+		for(int x = 0; x < w; ++x) {
+			if(layer.passable[y * w + x] != 0 && layer.regions[y * w + x] == regionBlocked) {
+				int region = layer.nextRegion++;
+				layer.regionSizes[region] = floodRegion(layer, Vec2i(x, y), regionBlocked, region);
+			}
+		}
+	}
+}
+
+// Relabels every passable cell connected to startPos that currently has
+// fromRegion, returns the number of cells changed
+int ClusterMap::floodRegion(Layer &layer, const Vec2i &startPos, int fromRegion, int toRegion) {
+	if(fromRegion == toRegion || layer.regions[startPos.y * w + startPos.x] != fromRegion) {
+		return 0;
+	}
+
+	int count = 1;
+	vector<Vec2i> pending;
+	pending.push_back(startPos);
+	layer.regions[startPos.y * w + startPos.x] = toRegion;
+
+	while(pending.empty() == false) {
+		Vec2i pos = pending.back();
+		pending.pop_back();
+
+		for(int j = -1; j <= 1; ++j) {
+			for(int i = -1; i <= 1; ++i) {
+				if((i == 0 && j == 0) || canStep(layer, pos.x, pos.y, i, j) == false) {
+					continue;
+				}
+				int &region = layer.regions[(pos.y + j) * w + (pos.x + i)];
+				if(region == fromRegion) {
+					region = toRegion;
+					pending.push_back(Vec2i(pos.x + i, pos.y + j));
+					count++;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+void ClusterMap::changeRegionSize(Layer &layer, int region, int delta) {
+	int &size = layer.regionSizes[region];
+	size += delta;
+	if(size <= 0) {
+		layer.regionSizes.erase(region);
+	}
+}
+
+// Repairs the labels after the passability of the cells x0,y0 - x1,y1
+// changed. Connectivity is first checked inside a small window around the
+// change: opened cells join (and merge) the regions they touch, while
+// regions that fall apart inside the window are only relabelled globally
+// if they really were split.
+void ClusterMap::updateRegions(Layer &layer, int x0, int y0, int x1, int y1, const vector<unsigned char> &oldPassable) {
+	bool anyBlocked = false;
+	bool anyChanged = false;
+	int rectW = x1 - x0 + 1;
+	for(int y = y0; y <= y1; ++y) {
+		for(int x = x0; x <= x1; ++x) {
+			bool wasPassable = (oldPassable[(y - y0) * rectW + (x - x0)] != 0);
+			bool passable = (layer.passable[y * w + x] != 0);
+			if(wasPassable == passable) {
+				continue;
+			}
+			anyChanged = true;
+			if(wasPassable == true) {
+				int &region = layer.regions[y * w + x];
+				changeRegionSize(layer, region, -1);
+				region = regionBlocked;
+				anyBlocked = true;
+			}
+		}
+	}
+	if(anyChanged == false) {
+		return;
+	}
+
+	// find the local components around the change
+	int seedX0 = max(0, x0 - 1);
+	int seedY0 = max(0, y0 - 1);
+	int seedX1 = min(w - 1, x1 + 1);
+	int seedY1 = min(h - 1, y1 + 1);
+	int windowX0 = max(0, x0 - regionLocalMargin);
+	int windowY0 = max(0, y0 - regionLocalMargin);
+	int windowX1 = min(w - 1, x1 + regionLocalMargin);
+	int windowY1 = min(h - 1, y1 + regionLocalMargin);
+	int windowW = windowX1 - windowX0 + 1;
+	localVisited.assign(windowW * (windowY1 - windowY0 + 1), 0);
+
+	vector<Vec2i> componentCells;
+	for(int seedY = seedY0; seedY <= seedY1; ++seedY) {
+		for(int seedX = seedX0; seedX <= seedX1; ++seedX) {
+			int seedIndex = (seedY - windowY0) * windowW + (seedX - windowX0);
+			if(isPassable(layer, seedX, seedY) == false || localVisited[seedIndex] != 0) {
+				continue;
+			}
+
+			// one representative per old region plus the newly opened cells
+			vector<Vec2i> regionCells;
+			vector<int> regionIds;
+			vector<Vec2i> newCells;
+			vector<Vec2i> pending;
+			pending.push_back(Vec2i(seedX, seedY));
+			localVisited[seedIndex] = 1;
+			while(pending.empty() == false) {
+				Vec2i pos = pending.back();
+				pending.pop_back();
+
+				int region = layer.regions[pos.y * w + pos.x];
+				if(region == regionBlocked) {
+					newCells.push_back(pos);
+				}
+				else if(std::find(regionIds.begin(), regionIds.end(), region) == regionIds.end()) {
+					regionIds.push_back(region);
+					regionCells.push_back(pos);
+				}
+
+				for(int j = -1; j <= 1; ++j) {
+					for(int i = -1; i <= 1; ++i) {
+						int nextX = pos.x + i;
+						int nextY = pos.y + j;
+						if((i == 0 && j == 0) ||
+							nextX < windowX0 || nextY < windowY0 || nextX > windowX1 || nextY > windowY1) {
+							continue;
+						}
+						int nextIndex = (nextY - windowY0) * windowW + (nextX - windowX0);
+						if(localVisited[nextIndex] == 0 && canStep(layer, pos.x, pos.y, i, j) == true) {
+							localVisited[nextIndex] = 1;
+							pending.push_back(Vec2i(nextX, nextY));
+						}
+					}
+				}
+			}
+
+			// the largest region absorbs the others, a component made only
+			// of opened cells becomes a new region
+			int target = regionBlocked;
+			for(unsigned int i = 0; i < regionCells.size(); ++i) {
+				int region = layer.regions[regionCells[i].y * w + regionCells[i].x];
+				if(target == regionBlocked || layer.regionSizes[region] > layer.regionSizes[target] ||
+					(layer.regionSizes[region] == layer.regionSizes[target] && region < target)) {
+					target = region;
+				}
+			}
+			if(target == regionBlocked) {
+				target = layer.nextRegion++;
+			}
+			for(unsigned int i = 0; i < regionCells.size(); ++i) {
+				int region = layer.regions[regionCells[i].y * w + regionCells[i].x];
+				if(region != target) {
+					int count = floodRegion(layer, regionCells[i], region, target);
+					changeRegionSize(layer, region, -count);
+					changeRegionSize(layer, target, count);
+				}
+			}
+			for(unsigned int i = 0; i < newCells.size(); ++i) {
+				changeRegionSize(layer, target, floodRegion(layer, newCells[i], regionBlocked, target));
+			}
+			componentCells.push_back(Vec2i(seedX, seedY));
+		}
+	}
+
+	// blocked cells may have cut a region in two: local components that
+	// still share a label are relabelled from scratch, parts that turn out
+	// to be connected outside the window simply end up with the same label
+	if(anyBlocked == false) {
+		return;
+	}
+	int firstSplitRegion = layer.nextRegion;
+	for(unsigned int i = 0; i < componentCells.size(); ++i) {
+		int region = layer.regions[componentCells[i].y * w + componentCells[i].x];
+		if(region >= firstSplitRegion) {
+			continue;
+		}
+		bool shared = false;
+		for(unsigned int j = i + 1; j < componentCells.size() && shared == false; ++j) {
+			shared = (layer.regions[componentCells[j].y * w + componentCells[j].x] == region);
+		}
+		if(shared == false) {
+			continue;
+		}
+		for(unsigned int j = i; j < componentCells.size(); ++j) {
+			const Vec2i &pos = componentCells[j];
+			if(layer.regions[pos.y * w + pos.x] == region) {
+				int newRegion = layer.nextRegion++;
+				int count = floodRegion(layer, pos, region, newRegion);
+				changeRegionSize(layer, region, -count);
+				changeRegionSize(layer, newRegion, count);
+			}
+		}
+	}
+}
+
+bool ClusterMap::findNearestPassable(const Layer &layer, const Vec2i &pos, Vec2i &result) const {
+	if(isPassable(layer, pos.x, pos.y) == true) {
+		result = pos;
+		return true;
+	}
+
+	for(int radius = 1; radius <= nearestPassableRadius; ++radius) {
+		for(int j = -radius; j <= radius; ++j) {
+			for(int i = -radius; i <= radius; ++i) {
+				if(abs(i) != radius && abs(j) != radius) {
+					continue;
+				}
+				if(isPassable(layer, pos.x + i, pos.y + j) == true) {
+					result = Vec2i(pos.x + i, pos.y + j);
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+int ClusterMap::heuristic(const Vec2i &pos1, const Vec2i &pos2) {
+	int dx = abs(pos1.x - pos2.x);
+	int dy = abs(pos1.y - pos2.y);
+	return straightCost * max(dx, dy) + (diagonalCost - straightCost) * min(dx, dy);
+}
+
+// Plans a path on the abstract graph. On success waypoints holds the
+// entrances to pass through followed by the (possibly adjusted) goal.
+// Only integer costs and stable tie breaking are used so every client
+// computes the same waypoints.
+bool ClusterMap::findAbstractPath(Field field, int unitSize, const Vec2i &startPos,
+		const Vec2i &goalPos, vector<Vec2i> &waypoints) const {
+	waypoints.clear();
+	if(canAbstract(field, unitSize) == false) {
+		return false;
+	}
+
+	const Layer &layer = layers[unitSize - 1];
+	if(map->isInside(startPos) == false || isPassable(layer, startPos.x, startPos.y) == false) {
+		return false;
+	}
+	Vec2i finalPos;
+	if(findNearestPassable(layer, goalPos, finalPos) == false) {
+		return false;
+	}
+
+	int startCluster = getClusterIndex(startPos);
+	int goalCluster = getClusterIndex(finalPos);
+
+	vector<int> startDist;
+	computeDistances(layer, startCluster, startPos, startDist);
+	if(startCluster == goalCluster) {
+		int localIndex = (finalPos.y % clusterSize) * clusterSize + (finalPos.x % clusterSize);
+		if(startDist[localIndex] != infiniteDistance) {
+			waypoints.push_back(finalPos);
+			return true;
+		}
+	}
+	vector<int> goalDist;
+	computeDistances(layer, goalCluster, finalPos, goalDist);
+
+	// A* over (cluster, node) keys, the goal is a virtual node with key -1
+	const int goalKey = -1;
+	typedef pair<pair<int,uint32>, int> OpenEntry;
+	std::priority_queue<OpenEntry, vector<OpenEntry>, std::greater<OpenEntry> > open;
+	std::map<int,int> costSoFar;
+	std::map<int,int> cameFrom;
+	uint32 sequence = 0;
+
+	const Cluster &start = layer.clusters[startCluster];
+	for(unsigned int i = 0; i < start.nodes.size(); ++i) {
+		const Vec2i &pos = start.nodes[i].pos;
+		int cost = startDist[(pos.y % clusterSize) * clusterSize + (pos.x % clusterSize)];
+		if(cost != infiniteDistance) {
+			int key = startCluster * maxAbstractNodesPerCluster + i;
+			costSoFar[key] = cost;
+			cameFrom[key] = -2;
+			open.push(make_pair(make_pair(cost + heuristic(pos, finalPos), sequence++), key));
+		}
+	}
+
+	bool found = false;
+	int expanded = 0;
+	while(open.empty() == false && expanded < maxAbstractSearchNodes) {
+		OpenEntry entry = open.top();
+		open.pop();
+
+		int key = entry.second;
+		if(key == goalKey) {
+			found = true;
+			break;
+		}
+
+		int clusterIndex = key / maxAbstractNodesPerCluster;
+		int nodeIndex = key % maxAbstractNodesPerCluster;
+		const Node &node = layer.clusters[clusterIndex].nodes[nodeIndex];
+		int cost = costSoFar[key];
+		if(entry.first.first != cost + heuristic(node.pos, finalPos)) {
+			// stale entry, a cheaper route was found after it was queued
+			continue;
+		}
+		expanded++;
+
+		if(clusterIndex == goalCluster) {
+			int toGoal = goalDist[(node.pos.y % clusterSize) * clusterSize + (node.pos.x % clusterSize)];
+			if(toGoal != infiniteDistance) {
+				int newCost = cost + toGoal;
+				std::map<int,int>::iterator iterFind = costSoFar.find(goalKey);
+				if(iterFind == costSoFar.end() || newCost < iterFind->second) {
+					costSoFar[goalKey] = newCost;
+					cameFrom[goalKey] = key;
+					open.push(make_pair(make_pair(newCost, sequence++), goalKey));
+				}
+			}
+		}
+
+		for(unsigned int i = 0; i < node.edges.size(); ++i) {
+			const Edge &edge = node.edges[i];
+			int nextKey = clusterIndex * maxAbstractNodesPerCluster + edge.target;
+			int newCost = cost + edge.cost;
+			std::map<int,int>::iterator iterFind = costSoFar.find(nextKey);
+			if(iterFind == costSoFar.end() || newCost < iterFind->second) {
+				costSoFar[nextKey] = newCost;
+				cameFrom[nextKey] = key;
+				const Vec2i &nextPos = layer.clusters[clusterIndex].nodes[edge.target].pos;
+				open.push(make_pair(make_pair(newCost + heuristic(nextPos, finalPos), sequence++), nextKey));
+			}
+		}
+		for(unsigned int i = 0; i < node.links.size(); ++i) {
+			const Vec2i &nextPos = node.links[i];
+			int nextCluster = getClusterIndex(nextPos);
+			int nextNode = layer.clusters[nextCluster].findNode(nextPos);
+			if(nextNode < 0) {
+				continue;
+			}
+			int nextKey = nextCluster * maxAbstractNodesPerCluster + nextNode;
+			int newCost = cost + straightCost;
+			std::map<int,int>::iterator iterFind = costSoFar.find(nextKey);
+			if(iterFind == costSoFar.end() || newCost < iterFind->second) {
+				costSoFar[nextKey] = newCost;
+				cameFrom[nextKey] = key;
+				open.push(make_pair(make_pair(newCost + heuristic(nextPos, finalPos), sequence++), nextKey));
+			}
+		}
+	}
+
+	if(found == false) {
+		return false;
+	}
+
+	waypoints.push_back(finalPos);
+	for(int key = cameFrom[goalKey]; key >= 0; key = cameFrom[key]) {
+		int clusterIndex = key / maxAbstractNodesPerCluster;
+		int nodeIndex = key % maxAbstractNodesPerCluster;
+		waypoints.push_back(layer.clusters[clusterIndex].nodes[nodeIndex].pos);
+	}
+	std::reverse(waypoints.begin(), waypoints.end());
+	return true;
+}
+
+}}//end namespace
@@ -0,0 +1,180 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_CLUSTERMAP_H_
+#define _GLEST_GAME_CLUSTERMAP_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "vec.h"
+#include <vector>
+#include <map>
+#include "skill_type.h"
+#include "data_types.h"
+#include "leak_dumper.h"
+
+using std::vector;
+using std::pair;
+using Shared::Graphics::Vec2i;
+using Shared::Platform::uint32;
+
+namespace Glest { namespace Game {
+
+class Map;
+
+// =====================================================
+// 	class ClusterMap
+//
+///	Hierarchical (HPA*) abstraction of the static obstacles of a Map.
+///	The map is split into square clusters, the entrances between
+///	neighbouring clusters become abstract nodes and long paths are
+///	planned on that much smaller graph and then refined locally by
+///	the PathFinder. Only buildings, map objects and deep water are
+///	considered, so the graph only changes when those change.
+///	The same passability also feeds the region labels: every connected
+///	area a land unit of a given size can walk gets its own label, so
+///	two cells with different labels can never be joined by a path.
+// =====================================================
+
+class ClusterMap {
+public:
+	static const int clusterSize;
+	static const int maxUnitSize;
+	static const int longEntranceLength;
+	static const int straightCost;
+	static const int diagonalCost;
+	static const int regionBlocked;
+
+	class Edge {
+	public:
+		Edge() {
+			target = -1;
+			cost = 0;
+		}
+		Edge(int target, int cost) {
+			this->target = target;
+			this->cost = cost;
+		}
+		int target;
+		int cost;
+	};
+
+	class Node {
+	public:
+		Vec2i pos;
+		vector<Edge> edges;
+		vector<Vec2i> links;
+	};
+
+	class Cluster {
+	public:
+		vector<Node> nodes;
+
+		int findNode(const Vec2i &pos) const;
+	};
+
+	typedef vector<pair<Vec2i,Vec2i> > Transitions;
+
+	// The abstraction for one unit size (land units only)
+	class Layer {
+	public:
+		Layer() {
+			unitSize = 1;
+			nextRegion = 0;
+		}
+		int unitSize;
+		vector<unsigned char> passable;
+		vector<int> regions;
+		std::map<int,int> regionSizes;
+		int nextRegion;
+		vector<Cluster> clusters;
+		vector<Transitions> eastTransitions;
+		vector<Transitions> southTransitions;
+	};
+
+private:
+	const Map *map;
+	int w;
+	int h;
+	int clusterCountW;
+	int clusterCountH;
+	uint32 version;
+	bool abstractGraph;
+	bool regionLabels;
+	vector<Layer> layers;
+	vector<unsigned char> localVisited;
+
+public:
+	ClusterMap(const Map *map);
+	~ClusterMap();
+
+	void init(bool buildAbstractGraph, bool buildRegionLabels);
+	void update(const Vec2i &pos, int size);
+
+	bool hasAbstractGraph() const	{ return abstractGraph; }
+	bool hasRegionLabels() const	{ return regionLabels; }
+
+	bool canAbstract(Field field, int unitSize) const;
+	bool canLabelRegions(Field field, int unitSize) const;
+	int getRegion(Field field, int unitSize, const Vec2i &pos) const;
+	bool isReachable(Field field, int unitSize, const Vec2i &fromPos,
+			const Vec2i &toPos, int searchRadius) const;
+	int getRegionCount(int unitSize) const;
+	bool isPassable(Field field, int unitSize, const Vec2i &pos) const;
+	bool findAbstractPath(Field field, int unitSize, const Vec2i &startPos,
+			const Vec2i &goalPos, vector<Vec2i> &waypoints) const;
+
+	uint32 getVersion() const	{ return version; }
+	int getClusterCountW() const	{ return clusterCountW; }
+	int getClusterCountH() const	{ return clusterCountH; }
+	int getNodeCount(int unitSize) const;
+
+private:
+	inline int getClusterIndex(const Vec2i &pos) const {
+		return (pos.y / clusterSize) * clusterCountW + (pos.x / clusterSize);
+	}
+	inline bool isPassable(const Layer &layer, int x, int y) const {
+		if(x < 0 || y < 0 || x >= w || y >= h) {
+			return false;
+		}
+		return layer.passable[y * w + x] != 0;
+	}
+	// single cell units may not cut corners, so for them the diagonal step
+	// needs both orthogonal neighbours free (see Map::canMove)
+	inline bool canStep(const Layer &layer, int x, int y, int i, int j) const {
+		if(isPassable(layer, x + i, y + j) == false) {
+			return false;
+		}
+		if(i != 0 && j != 0 && layer.unitSize == 1) {
+			return isPassable(layer, x + i, y) && isPassable(layer, x, y + j);
+		}
+		return true;
+	}
+
+	bool computeCellPassable(int x, int y) const;
+	void computePassable(int x0, int y0, int x1, int y1);
+	void computeTransitions(Layer &layer, int clusterX, int clusterY, bool east);
+	void computeCluster(Layer &layer, int clusterX, int clusterY);
+	void computeDistances(const Layer &layer, int clusterIndex, const Vec2i &fromPos, vector<int> &dist) const;
+	bool findNearestPassable(const Layer &layer, const Vec2i &pos, Vec2i &result) const;
+	void labelRegions(Layer &layer);
+	int floodRegion(Layer &layer, const Vec2i &startPos, int fromRegion, int toRegion);
+	void changeRegionSize(Layer &layer, int region, int delta);
+	void updateRegions(Layer &layer, int x0, int y0, int x1, int y1, const vector<unsigned char> &oldPassable);
+	static int heuristic(const Vec2i &pos1, const Vec2i &pos2);
+};
+
+}}//end namespace
+
+#endif
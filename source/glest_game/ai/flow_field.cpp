@@ -0,0 +1,204 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "flow_field.h"
+
+#include <queue>
+#include <functional>
+#include "map.h"
+#include "path_finder.h"
+#include "util.h"
+#include "leak_dumper.h"
+
+using namespace std;
+using namespace Shared::Util;
+
+namespace Glest{ namespace Game{
+
+// =====================================================
+// 	class FlowField
+// =====================================================
+
+const int FlowField::unreachableCost	= 0x7FFFFFFF;
+const int FlowField::straightCost		= 10;
+const int FlowField::diagonalCost		= 14;
+
+// fixed neighbour order, ties between equally cheap neighbours are always
+// resolved the same way on every client
+static const int neighbourCount = 8;
+static const int neighbourX[neighbourCount] = {  0, 1, 0, -1, 1, 1, -1, -1 };
+static const int neighbourY[neighbourCount] = { -1, 0, 1,  0, -1, 1, 1, -1 };
+
+FlowField::FlowField() {
+	w = 0;
+	h = 0;
+	field = fLand;
+	unitSize = 1;
+	version = 0;
+}
+
+void FlowField::init(const Map *map, Field field, int unitSize, const Vec2i &goalPos) {
+	Chrono chrono;
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) chrono.start();
+
+	this->w = map->getW();
+	this->h = map->getH();
+	this->field = field;
+	this->unitSize = unitSize;
+	this->goalPos = goalPos;
+	this->version = map->getStaticObstaclesVersion();
+
+	computePassable(map);
+	computeCosts();
+	computeDirections();
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] flow field to [%s] field = %d size = %d took msecs: %lld\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,goalPos.getString().c_str(),field,unitSize,(long long int)chrono.getMillis());
+}
+
+// The field stays usable until a building, object or resource changes
+bool FlowField::isValid(const Map *map, Field field, int unitSize, const Vec2i &goalPos) const {
+	return (costs.empty() == false &&
+			this->field == field &&
+			this->unitSize == unitSize &&
+			this->goalPos == goalPos &&
+			this->version == map->getStaticObstaclesVersion());
+}
+
+int FlowField::getCost(const Vec2i &pos) const {
+	if(pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h) {
+		return unreachableCost;
+	}
+	return costs[pos.y * w + pos.x];
+}
+
+bool FlowField::getNextPos(const Vec2i &pos, Vec2i &nextPos) const {
+	if(pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h) {
+		return false;
+	}
+	int direction = directions[pos.y * w + pos.x];
+	if(direction < 0) {
+		return false;
+	}
+	nextPos = Vec2i(pos.x + neighbourX[direction], pos.y + neighbourY[direction]);
+	return true;
+}
+
+// single cell units may not cut corners (see Map::canMove)
+bool FlowField::canStep(int x, int y, int i, int j) const {
+	if(isPassable(x + i, y + j) == false) {
+		return false;
+	}
+	if(i != 0 && j != 0 && unitSize == 1) {
+		return isPassable(x + i, y) && isPassable(x, y + j);
+	}
+	return true;
+}
+
+void FlowField::computePassable(const Map *map) {
+	vector<unsigned char> cellFree(w * h, 0);
+	for(int y = 0; y < h; ++y) {
+		for(int x = 0; x < w; ++x) {
+			cellFree[y * w + x] = (map->isStaticallyFreeCell(Vec2i(x, y), field) ? 1 : 0);
+		}
+	}
+
+	// units bigger than one cell are anchored at their top left cell
+	passable.assign(w * h, 0);
+	for(int y = 0; y <= h - unitSize; ++y) {
+		for(int x = 0; x <= w - unitSize; ++x) {
+			bool free = true;
+			for(int j = 0; j < unitSize && free == true; ++j) {
+				for(int i = 0; i < unitSize && free == true; ++i) {
+					free = (cellFree[(y + j) * w + (x + i)] != 0);
+				}
+			}
+			passable[y * w + x] = (free ? 1 : 0);
+		}
+	}
+}
+
+// Dijkstra from the goal over the static obstacles. A blocked goal (a
+// building, a tree) is replaced by the nearest free cells around it, the
+// same way the PathFinder looks for the nearest free position.
+void FlowField::computeCosts() {
+	costs.assign(w * h, unreachableCost);
+
+	typedef pair<int,int> QueueEntry;
+	std::priority_queue<QueueEntry, vector<QueueEntry>, std::greater<QueueEntry> > open;
+
+	for(int radius = 0; radius <= PathFinder::maxFreeSearchRadius && open.empty() == true; ++radius) {
+		for(int j = -radius; j <= radius; ++j) {
+			for(int i = -radius; i <= radius; ++i) {
+				if(abs(i) != radius && abs(j) != radius) {
+					continue;
+				}
+				int x = goalPos.x + i;
+				int y = goalPos.y + j;
+				if(isPassable(x, y) == false) {
+					continue;
+				}
+				int cost = straightCost * max(abs(i), abs(j)) + (diagonalCost - straightCost) * min(abs(i), abs(j));
+				costs[y * w + x] = cost;
+				open.push(make_pair(cost, y * w + x));
+			}
+		}
+	}
+
+	while(open.empty() == false) {
+		QueueEntry entry = open.top();
+		open.pop();
+
+		int index = entry.second;
+		if(entry.first > costs[index]) {
+			continue;
+		}
+		int x = index % w;
+		int y = index / w;
+
+		for(int n = 0; n < neighbourCount; ++n) {
+			int i = neighbourX[n];
+			int j = neighbourY[n];
+			if(canStep(x, y, i, j) == false) {
+				continue;
+			}
+			int nextIndex = (y + j) * w + (x + i);
+			int nextCost = entry.first + ((i != 0 && j != 0) ? diagonalCost : straightCost);
+			if(nextCost < costs[nextIndex]) {
+				costs[nextIndex] = nextCost;
+				open.push(make_pair(nextCost, nextIndex));
+			}
+		}
+	}
+}
+
+void FlowField::computeDirections() {
+	directions.assign(w * h, -1);
+	for(int y = 0; y < h; ++y) {
+		for(int x = 0; x < w; ++x) {
+			int bestCost = costs[y * w + x];
+			if(bestCost == unreachableCost) {
+				continue;
+			}
+			for(int n = 0; n < neighbourCount; ++n) {
+				if(canStep(x, y, neighbourX[n], neighbourY[n]) == false) {
+					continue;
+				}
+				int cost = costs[(y + neighbourY[n]) * w + (x + neighbourX[n])];
+				if(cost < bestCost) {
+					bestCost = cost;
+					directions[y * w + x] = n;
+				}
+			}
+		}
+	}
+}
+
+}}//end namespace
@@ -0,0 +1,87 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_FLOWFIELD_H_
+#define _GLEST_GAME_FLOWFIELD_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "vec.h"
+#include <vector>
+#include "skill_type.h"
+#include "data_types.h"
+#include "leak_dumper.h"
+
+using std::vector;
+using Shared::Graphics::Vec2i;
+using Shared::Platform::uint32;
+
+namespace Glest { namespace Game {
+
+class Map;
+
+// =====================================================
+// 	class FlowField
+//
+///	Integration and direction field toward one goal, shared by all
+///	units of a group move. The integration field holds the walking
+///	cost from every cell to the goal over the static obstacles of the
+///	map, the direction field the neighbour each cell should step to.
+// =====================================================
+
+class FlowField {
+public:
+	static const int unreachableCost;
+	static const int straightCost;
+	static const int diagonalCost;
+
+private:
+	int w;
+	int h;
+	Field field;
+	int unitSize;
+	Vec2i goalPos;
+	uint32 version;
+	vector<unsigned char> passable;
+	vector<int> costs;
+	vector<signed char> directions;
+
+public:
+	FlowField();
+
+	void init(const Map *map, Field field, int unitSize, const Vec2i &goalPos);
+	bool isValid(const Map *map, Field field, int unitSize, const Vec2i &goalPos) const;
+
+	int getCost(const Vec2i &pos) const;
+	bool getNextPos(const Vec2i &pos, Vec2i &nextPos) const;
+
+	const Vec2i &getGoalPos() const	{ return goalPos; }
+	int getCellCount() const		{ return (int)costs.size(); }
+
+private:
+	inline bool isPassable(int x, int y) const {
+		if(x < 0 || y < 0 || x >= w || y >= h) {
+			return false;
+		}
+		return passable[y * w + x] != 0;
+	}
+	bool canStep(int x, int y, int i, int j) const;
+	void computePassable(const Map *map);
+	void computeCosts();
+	void computeDirections();
+};
+
+}}//end namespace
+
+#endif
@@ -37,6 +37,7 @@ namespace Glest{ namespace Game{
 // ===================== PUBLIC ======================== 
 
 const int PathFinder::maxFreeSearchRadius	= 10;
+const int PathFinder::maxCachedFlowFields	= 8;
 
 int PathFinder::pathFindNodesAbsoluteMax	= 900;
 int PathFinder::pathFindNodesMax			= 2000;
@@ -44,10 +45,15 @@ const int PathFinder::pathFindBailoutRadius	= 20;
 const int PathFinder::pathFindExtendRefreshForNodeCount	= 25;
 const int PathFinder::pathFindExtendRefreshNodeCountMin	= 40;
 const int PathFinder::pathFindExtendRefreshNodeCountMax	= 40;
+const int PathFinder::maxSearchThreads		= 16;
 
 PathFinder::PathFinder() {
 	minorDebugPathfinder = false;
 	map=NULL;
+	resetOpenSetVerifyStats();
+	resetGroupMoveStats();
+	pathRequestMutex = new Mutex(CODE_AT_LINE);
+	nextPendingRequest = 0;
 }
 
 int PathFinder::getPathFindExtendRefreshNodeCount(FactionState &faction) {
@@ -57,27 +63,127 @@ int PathFinder::getPathFindExtendRefreshNodeCount(FactionState &faction) {
 
 PathFinder::PathFinder(const Map *map) {
 	minorDebugPathfinder = false;
+	resetOpenSetVerifyStats();
+	resetGroupMoveStats();
+	pathRequestMutex = new Mutex(CODE_AT_LINE);
+	nextPendingRequest = 0;
 
 	map=NULL;
 	init(map);
 }
 
 void PathFinder::init(const Map *map) {
+	Config &config = Config::getInstance();
+	bool useBinaryHeapOpenSet = config.getBool("PathFinderBinaryHeapOpenSet","true");
+	resetOpenSetVerifyStats();
+	resetGroupMoveStats();
+	verifyOpenSet = config.getBool("PathFinderVerifyOpenSet","false");
+
 	for(int factionIndex = 0; factionIndex < GameConstants::maxPlayers; ++factionIndex) {
 		FactionState &faction = factions.getFactionState(factionIndex);
 
 		faction.nodePool.resize(pathFindNodesAbsoluteMax);
 		faction.useMaxNodeCount = PathFinder::pathFindNodesMax;
+
+		faction.useBinaryHeapOpenSet = useBinaryHeapOpenSet;
+		faction.openNodesHeap.reserve(pathFindNodesAbsoluteMax);
+		if(map != NULL) {
+			faction.openPosStamps.init(map->getW(), map->getH());
+		}
 	}
 	this->map= map;
+
+	// one search state per thread draining the queued pre-cache searches,
+	// each with its own node pool so no locking is needed while searching
+	shutdownSearchThreads();
+	int threadCount = config.getInt("PathFinderSearchThreads",intToStr(getCpuCount() - 1).c_str());
+	threadCount = max(0, min(threadCount, maxSearchThreads));
+	for(int index = 0; index <= threadCount; ++index) {
+		FactionState *searchState = new FactionState();
+		searchState->nodePool.resize(pathFindNodesAbsoluteMax);
+		searchState->useMaxNodeCount = PathFinder::pathFindNodesMax;
+		searchState->useBinaryHeapOpenSet = useBinaryHeapOpenSet;
+		searchState->openNodesHeap.reserve(pathFindNodesAbsoluteMax);
+		if(map != NULL) {
+			searchState->openPosStamps.init(map->getW(), map->getH());
+		}
+		searchStates.push_back(searchState);
+	}
+	initSearchThreads(threadCount);
 }
 
 void PathFinder::init() {
 	minorDebugPathfinder = false;
 	map=NULL;
+	resetOpenSetVerifyStats();
+	resetGroupMoveStats();
+	pathRequestMutex = new Mutex(CODE_AT_LINE);
+	nextPendingRequest = 0;
+}
+
+void PathFinder::initSearchThreads(int threadCount) {
+	for(int index = 0; index < threadCount; ++index) {
+		static string mutexOwnerId = string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+		PathFinderThread *searchThread = new PathFinderThread(this, searchStates[index + 1]);
+		searchThread->setUniqueID(mutexOwnerId);
+		searchThread->start();
+		searchThreads.push_back(searchThread);
+	}
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] path finder search threads: %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,threadCount);
+}
+
+void PathFinder::shutdownSearchThreads() {
+	for(unsigned int index = 0; index < (unsigned int)searchThreads.size(); ++index) {
+		PathFinderThread *searchThread = searchThreads[index];
+		searchThread->signalQuit();
+		if(searchThread->shutdownAndWait() == true) {
+			delete searchThread;
+		}
+	}
+	searchThreads.clear();
+
+	for(unsigned int index = 0; index < (unsigned int)searchStates.size(); ++index) {
+		delete searchStates[index];
+	}
+	searchStates.clear();
+	pendingRequests.clear();
+	nextPendingRequest = 0;
+}
+
+void PathFinder::resetOpenSetVerifyStats() {
+	verifyOpenSet			= false;
+	verifySearchCount		= 0;
+	verifyMismatchCount		= 0;
+	verifyLegacyNodeCount	= 0;
+	verifyLegacyMicros		= 0;
+	verifyHeapNodeCount		= 0;
+	verifyHeapMicros		= 0;
+}
+
+void PathFinder::resetGroupMoveStats() {
+	flowFieldBuildCount		= 0;
+	flowFieldBuildMicros	= 0;
+	flowFieldStepCount		= 0;
+	flowFieldStepMicros		= 0;
+	searchCount				= 0;
+	searchMicros			= 0;
+}
+
+// Time spent on group moves (flow fields) against regular searches, to
+// compare both when many units are ordered around at once
+void PathFinder::logGroupMoveStats() {
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] flow fields built: %lld (%.2f ms) flow steps: %lld (%.2f ms) searches: %lld (%.2f ms)\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,
+			(long long int)flowFieldBuildCount,flowFieldBuildMicros / 1000.0,
+			(long long int)flowFieldStepCount,flowFieldStepMicros / 1000.0,
+			(long long int)searchCount,searchMicros / 1000.0);
 }
 
 PathFinder::~PathFinder() {
+	shutdownSearchThreads();
+	delete pathRequestMutex;
+	pathRequestMutex = NULL;
+
 	for(int factionIndex = 0; factionIndex < GameConstants::maxPlayers; ++factionIndex) {
 		FactionState &faction = factions.getFactionState(factionIndex);
 
@@ -95,6 +201,9 @@ void PathFinder::clearCaches() {
 
 		faction.precachedTravelState.clear();
 		faction.precachedPath.clear();
+		faction.hierarchicalPaths.clear();
+		faction.flowFields.clear();
+		faction.pathRequests.clear();
 	}
 }
 
@@ -123,10 +232,13 @@ void PathFinder::removeUnitPrecache(Unit *unit) {
 		if(faction.precachedPath.find(unit->getId()) != faction.precachedPath.end()) {
 			faction.precachedPath.erase(unit->getId());
 		}
+		if(faction.hierarchicalPaths.find(unit->getId()) != faction.hierarchicalPaths.end()) {
+			faction.hierarchicalPaths.erase(unit->getId());
+		}
 	}
 }
 
-TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStuck, int frameIndex) {
+TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStuck, int frameIndex, int unitCommandGroupId) {
 	TravelState ts = tsImpossible;
 
 	try {
@@ -245,6 +357,77 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 		return tsBlocked;
 	}
 
+	// group moves follow the flow field shared by the whole group, the
+	// pre-cache pass only builds the field
+	if(canUseFlowField(unit, finalPos, unitCommandGroupId) == true) {
+		if(frameIndex >= 0) {
+			getFlowField(faction, unitCommandGroupId,
+					unit->getCurrField(), unit->getType()->getSize(), finalPos);
+			return tsImpossible;
+		}
+
+		Chrono chronoFlow;
+		bool collectStats = SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled;
+		if(collectStats) chronoFlow.start();
+
+		Vec2i pos;
+		bool followed = followFlowField(unit, finalPos, unitCommandGroupId, pos);
+
+		if(collectStats) {
+			flowFieldStepMicros += chronoFlow.getMicros();
+			flowFieldStepCount++;
+			if(flowFieldStepCount % 500 == 0) {
+				logGroupMoveStats();
+			}
+		}
+
+		if(followed == true) {
+			unit->setTargetPos(pos);
+
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == true) {
+				char szBuf[8096]="";
+				snprintf(szBuf,8096,"flow field group [%d] to pos [%s] from [%s]",unitCommandGroupId,pos.getString().c_str(),unit->getPos().getString().c_str());
+				unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
+			}
+			return tsMoving;
+		}
+	}
+
+	// the pre-cache searches of all factions are queued and run together
+	// once every faction thread is done, see processPathRequests
+	if(frameIndex >= 0) {
+		queuePathRequest(faction, unit, finalPos, frameIndex);
+		return tsImpossible;
+	}
+
+	ts = searchPath(faction, unit, finalPos, wasStuck, frameIndex);
+
+	}
+	catch(const exception &ex) {
+		//setRunningStatus(false);
+
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
+
+		throw megaglest_runtime_error(ex.what());
+	}
+	catch(...) {
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"In [%s::%s %d] UNKNOWN error\n",__FILE__,__FUNCTION__,__LINE__);
+		SystemFlags::OutputDebug(SystemFlags::debugError,szBuf);
+		throw megaglest_runtime_error(szBuf);
+	}
+
+	return ts;
+}
+
+TravelState PathFinder::searchPath(FactionState &faction, Unit *unit, const Vec2i &finalPos, bool *wasStuck, int frameIndex) {
+	TravelState ts = tsImpossible;
+
+	try {
+
+	UnitPathInterface *path= unit->getPath();
+
 	//route cache miss
 	int maxNodeCount=-1;
 	if(unit->getUsePathfinderExtendedMaxNodes() == true) {
@@ -263,7 +446,6 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 	if(minorDebugPathfinderPerformance) chrono.start();
 
 	uint32 searched_node_count = 0;
-	minorDebugPathfinder = false;
 	if(minorDebugPathfinder) printf("Legacy Pathfind Unit [%d - %s] from = %s to = %s frameIndex = %d\n",unit->getId(),unit->getType()->getName(false).c_str(),unit->getPos().getString().c_str(),finalPos.getString().c_str(),frameIndex);
 
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == true && frameIndex < 0) {
@@ -272,7 +454,22 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 		unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
 	}
 
-	ts = aStar(unit, finalPos, false, frameIndex, maxNodeCount,&searched_node_count);
+	// long routes are planned on the cluster abstraction and only the next
+	// leg up to the following waypoint is searched cell by cell
+	Chrono chronoSearch;
+	bool collectStats = (frameIndex < 0 && SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled);
+	if(collectStats) chronoSearch.start();
+
+	const Vec2i searchPos = computeHierarchicalWaypoint(faction, unit, finalPos);
+	ts = aStar(faction, unit, searchPos, false, frameIndex, maxNodeCount,&searched_node_count);
+
+	if(collectStats) {
+		searchMicros += chronoSearch.getMicros();
+		searchCount++;
+	}
+	if(ts == tsBlocked && searchPos != finalPos) {
+		clearHierarchicalPath(faction, unit);
+	}
 	//post actions
 	switch(ts) {
 		case tsBlocked:
@@ -317,10 +514,6 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 				}
 				unitImmediatelyBlocked = (failureCount == cellCount);
 				if(unitImmediatelyBlocked == false) {
-
-					int factionIndex = unit->getFactionIndex();
-					FactionState &faction = factions.getFactionState(factionIndex);
-
 					int tryRadius = faction.random.randRange(0,1);
 
 					// Try to bail out up to PathFinder::pathFindBailoutRadius cells away
@@ -347,7 +540,7 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 										unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
 									}
 
-									ts= aStar(unit, newFinalPos, true, frameIndex, maxBailoutNodeCount,&searched_node_count);
+									ts= aStar(faction, unit, newFinalPos, true, frameIndex, maxBailoutNodeCount,&searched_node_count);
 								}
 							}
 						}
@@ -374,7 +567,7 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 										unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
 									}
 
-									ts= aStar(unit, newFinalPos, true, frameIndex, maxBailoutNodeCount,&searched_node_count);
+									ts= aStar(faction, unit, newFinalPos, true, frameIndex, maxBailoutNodeCount,&searched_node_count);
 								}
 							}
 						}
@@ -482,18 +675,177 @@ TravelState PathFinder::findPath(Unit *unit, const Vec2i &finalPos, bool *wasStu
 	return ts;
 }
 
+// Runs the pre-cache searches the faction threads queued this frame. The
+// calling thread and the search threads take requests from one shared list
+// until it is empty, every search runs on the search state of the thread
+// that took it and writes only to its request. The results are copied to
+// the factions afterwards in faction and queue order, so the outcome is the
+// same no matter how many threads took part or which one took what.
+void PathFinder::processPathRequests(int frameIndex) {
+	pendingRequests.clear();
+	for(int factionIndex = 0; factionIndex < GameConstants::maxPlayers; ++factionIndex) {
+		FactionState &faction = factions.getFactionState(factionIndex);
+		for(unsigned int index = 0; index < (unsigned int)faction.pathRequests.size(); ++index) {
+			pendingRequests.push_back(&faction.pathRequests[index]);
+		}
+	}
+	if(pendingRequests.empty() == true) {
+		return;
+	}
+	if(searchStates.empty() == true) {
+		throw megaglest_runtime_error("searchStates.empty() == true");
+	}
+
+	Chrono chrono;
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) chrono.start();
+
+	nextPendingRequest = 0;
+	pathRequestError = "";
+
+	// the open set verification and the threaded synch log are not safe to
+	// share, keep those searches on the calling thread
+	int signalledThreads = 0;
+	if(verifyOpenSet == false &&
+		SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == false) {
+		for(unsigned int index = 0; index < (unsigned int)searchThreads.size() &&
+				(int)index + 1 < (int)pendingRequests.size(); ++index) {
+			searchThreads[index]->signalPathRequests();
+			signalledThreads++;
+		}
+	}
+
+	for(;processNextPathRequest(*searchStates[0]) == true;) {
+	}
+	for(int index = 0; index < signalledThreads; ++index) {
+		semPathRequestsDone.waitTillSignalled();
+	}
+
+	if(pathRequestError != "") {
+		string error = pathRequestError;
+		for(int factionIndex = 0; factionIndex < GameConstants::maxPlayers; ++factionIndex) {
+			factions.getFactionState(factionIndex).pathRequests.clear();
+		}
+		pendingRequests.clear();
+		throw megaglest_runtime_error(error);
+	}
+
+	for(unsigned int index = 0; index < (unsigned int)pendingRequests.size(); ++index) {
+		applyPathRequest(*pendingRequests[index]);
+	}
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled && chrono.getMillis() > 0) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] frame: %d path requests: %d threads: %d took msecs: %lld\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,frameIndex,(int)pendingRequests.size(),signalledThreads + 1,(long long int)chrono.getMillis());
+
+	pendingRequests.clear();
+	for(int factionIndex = 0; factionIndex < GameConstants::maxPlayers; ++factionIndex) {
+		factions.getFactionState(factionIndex).pathRequests.clear();
+	}
+}
+
 // ==================== PRIVATE ==================== 
 
+// Only called from the thread of the unit's faction, so the faction queue
+// needs no locking. A unit searched twice in one frame keeps the last
+// request like the direct pre-cache did.
+void PathFinder::queuePathRequest(FactionState &faction, Unit *unit, const Vec2i &finalPos, int frameIndex) {
+	PathRequest *request = NULL;
+	for(unsigned int index = 0; index < (unsigned int)faction.pathRequests.size(); ++index) {
+		if(faction.pathRequests[index].unit == unit) {
+			request = &faction.pathRequests[index];
+			break;
+		}
+	}
+	if(request == NULL) {
+		faction.pathRequests.push_back(PathRequest());
+		request = &faction.pathRequests.back();
+	}
+	request->unit 		= unit;
+	request->finalPos 	= finalPos;
+	request->frameIndex = frameIndex;
+}
+
+bool PathFinder::processNextPathRequest(FactionState &searchState) {
+	static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+	MutexSafeWrapper safeMutex(pathRequestMutex,mutexOwnerId);
+	if(nextPendingRequest >= (int)pendingRequests.size() || pathRequestError != "") {
+		return false;
+	}
+	PathRequest *request = pendingRequests[nextPendingRequest++];
+	safeMutex.ReleaseLock();
+
+	try {
+		processPathRequest(searchState, *request);
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+
+		static string mutexOwnerId2 = string(__FILE__) + string("_") + intToStr(__LINE__);
+		MutexSafeWrapper safeMutexError(pathRequestMutex,mutexOwnerId2);
+		if(pathRequestError == "") {
+			pathRequestError = ex.what();
+		}
+		safeMutexError.ReleaseLock();
+	}
+	return true;
+}
+
+// Searches one request on the given search state. Everything the search
+// reads from the unit's faction is copied in first and the random numbers
+// are seeded from the frame and unit so the result does not depend on the
+// searches done before on the same state.
+void PathFinder::processPathRequest(FactionState &searchState, PathRequest &request) {
+	Unit *unit = request.unit;
+	const int unitId = unit->getId();
+	FactionState &faction = factions.getFactionState(unit->getFactionIndex());
+
+	searchState.precachedTravelState.clear();
+	searchState.precachedPath.clear();
+	searchState.hierarchicalPaths.clear();
+	std::map<int,HierarchicalPath>::const_iterator iterFind = faction.hierarchicalPaths.find(unitId);
+	if(iterFind != faction.hierarchicalPaths.end()) {
+		searchState.hierarchicalPaths[unitId] = iterFind->second;
+	}
+	searchState.useMaxNodeCount = PathFinder::pathFindNodesMax;
+	searchState.random.init((int)(((uint32)request.frameIndex * 7919u + (uint32)unitId) & 0x7FFFFFFF));
+
+	searchPath(searchState, unit, request.finalPos, NULL, request.frameIndex);
+
+	std::map<int,TravelState>::iterator iterTravelState = searchState.precachedTravelState.find(unitId);
+	request.travelState = (iterTravelState != searchState.precachedTravelState.end() ? iterTravelState->second : tsImpossible);
+	request.path.clear();
+	std::map<int,std::vector<Vec2i> >::iterator iterPath = searchState.precachedPath.find(unitId);
+	if(iterPath != searchState.precachedPath.end()) {
+		request.path.swap(iterPath->second);
+	}
+	std::map<int,HierarchicalPath>::iterator iterHierarchicalPath = searchState.hierarchicalPaths.find(unitId);
+	request.hasHierarchicalPath = (iterHierarchicalPath != searchState.hierarchicalPaths.end());
+	if(request.hasHierarchicalPath == true) {
+		request.hierarchicalPath = iterHierarchicalPath->second;
+	}
+}
+
+void PathFinder::applyPathRequest(const PathRequest &request) {
+	const int unitId = request.unit->getId();
+	FactionState &faction = factions.getFactionState(request.unit->getFactionIndex());
+
+	faction.precachedTravelState[unitId] = request.travelState;
+	faction.precachedPath[unitId] = request.path;
+	if(request.hasHierarchicalPath == true) {
+		faction.hierarchicalPaths[unitId] = request.hierarchicalPath;
+	}
+	else {
+		faction.hierarchicalPaths.erase(unitId);
+	}
+}
+
+
 //route a unit using A* algorithm
-TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout,
+TravelState PathFinder::aStar(FactionState &faction, Unit *unit, const Vec2i &targetPos, bool inBailout,
 		int frameIndex, int maxNodeCount, uint32 *searched_node_count) {
 	TravelState ts = tsImpossible;
 
 	try {
 
 	int unitFactionIndex = unit->getFactionIndex();
-	int factionIndex = unit->getFactionIndex();
-	FactionState &faction = factions.getFactionState(factionIndex);
 
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == true && frameIndex >= 0) {
 		char szBuf[8096]="";
@@ -510,10 +862,6 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 
 
 	if(maxNodeCount < 0) {
-
-		int factionIndex = unit->getFactionIndex();
-		FactionState &faction = factions.getFactionState(factionIndex);
-
 		maxNodeCount = faction.useMaxNodeCount;
 	}
 
@@ -524,9 +872,7 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	UnitPathInterface *path= unit->getPath();
 
 	faction.nodePoolCount= 0;
-	faction.openNodesList.clear();
-	faction.openPosList.clear();
-	faction.closedNodesList.clear();
+	clearOpenAndClosedNodes(faction);
 
 	// check the pre-cache to see if we can re-use a cached path
 	if(frameIndex < 0) {
@@ -603,7 +949,7 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 					return faction.precachedTravelState[unit->getId()];
 				}
 				else {
-					clearUnitPrecache(unit);
+					clearUnitPrecache(faction, unit->getId());
 				}
 			}
 			else {
@@ -626,7 +972,7 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 		}
 	}
 	else {
-		clearUnitPrecache(unit);
+		clearUnitPrecache(faction, unit->getId());
 
 		if(SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == true && frameIndex < 0) {
 			char szBuf[8096]="";
@@ -657,11 +1003,7 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	firstNode->pos= unitPos;
 	firstNode->heuristic= heuristic(unitPos, finalPos);
 	firstNode->exploredCell= true;
-	if(faction.openNodesList.find(firstNode->heuristic) == faction.openNodesList.end()) {
-		faction.openNodesList[firstNode->heuristic].clear();
-	}
-	faction.openNodesList[firstNode->heuristic].push_back(firstNode);
-	faction.openPosList[firstNode->pos] = true;
+	addOpenNode(faction, firstNode);
 
 	//b) loop
 	bool pathFound			= true;
@@ -698,6 +1040,18 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 
 		if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled == true && chrono.getMillis() > 1) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] **Check if dest blocked, distance for unit [%d - %s] from [%s] to [%s] is %.2f took msecs: %lld nodeLimitReached = %d, failureCount = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,unit->getId(),unit->getFullName(false).c_str(), unitPos.getString().c_str(), finalPos.getString().c_str(), dist,(long long int)chrono.getMillis(),nodeLimitReached,failureCount);
 
+		if(nodeLimitReached == false && isStaticallyReachable(unit, finalPos) == false) {
+			// Final destination is in another region, no path can exist
+			nodeLimitReached = true;
+			pathFound = false;
+
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugWorldSynch).enabled == true && frameIndex < 0) {
+				char szBuf[8096]="";
+				snprintf(szBuf,8096,"nodeLimitReached: %d unreachable region finalPos [%s]",nodeLimitReached,finalPos.getString().c_str());
+				unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
+			}
+		}
+
 		if(nodeLimitReached == false) {
 			// First check if final destination blocked
 			failureCount = 0;
@@ -737,11 +1091,6 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	//
 
 	// START
-	std::map<std::pair<Vec2i,Vec2i> ,bool> canAddNode;
-	std::map<Vec2i,bool> closedNodes;
-	std::map<Vec2i,Vec2i> cameFrom;
-	cameFrom[unitPos] = Vec2i(-1,-1);
-
 	// Do the a-star base pathfind work if required
 	int whileLoopCount = 0;
 	if(nodeLimitReached == false) {
@@ -753,9 +1102,16 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 			unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
 		}
 
-		doAStarPathSearch(nodeLimitReached, whileLoopCount, unitFactionIndex,
-							pathFound, node, finalPos,
-							closedNodes, cameFrom, canAddNode, unit, maxNodeCount,frameIndex);
+		if(verifyOpenSet == true) {
+			doAStarPathSearchVerified(nodeLimitReached, whileLoopCount, faction,
+								pathFound, node, finalPos,
+								firstNode, unit, maxNodeCount,frameIndex);
+		}
+		else {
+			doAStarPathSearch(nodeLimitReached, whileLoopCount, faction,
+								pathFound, node, finalPos,
+								unit, maxNodeCount,frameIndex);
+		}
 
 		if(searched_node_count != NULL) {
 			*searched_node_count = whileLoopCount;
@@ -789,7 +1145,7 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 					unit->logSynchData(extractFileFromDirectoryPath(__FILE__).c_str(),__LINE__,szBuf);
 				}
 
-				return aStar(unit, targetPos, false, frameIndex, pathFindNodesAbsoluteMax);
+				return aStar(faction, unit, targetPos, false, frameIndex, pathFindNodesAbsoluteMax);
 			}
 		}
 	}
@@ -807,10 +1163,10 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	//if consumed all nodes find best node (to avoid strange behaviour)
 	if(nodeLimitReached == true) {
 
-		if(faction.closedNodesList.empty() == false) {
-			float bestHeuristic = faction.closedNodesList.begin()->first;
-			if(lastNode != NULL && bestHeuristic < lastNode->heuristic) {
-				lastNode= faction.closedNodesList.begin()->second[0];
+		Node *bestClosedNode = getBestClosedNode(faction);
+		if(bestClosedNode != NULL) {
+			if(lastNode != NULL && bestClosedNode->heuristic < lastNode->heuristic) {
+				lastNode= bestClosedNode;
 			}
 		}
 	}
@@ -934,15 +1290,11 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	}
 
 
-	faction.openNodesList.clear();
-	faction.openPosList.clear();
-	faction.closedNodesList.clear();
+	clearOpenAndClosedNodes(faction);
 
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled == true && chrono.getMillis() > 4) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s] Line: %d took msecs: %lld --------------------------- [END OF METHOD] ---------------------------\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
 
 	if(frameIndex >= 0) {
-
-		FactionState &faction = factions.getFactionState(factionIndex);
 		faction.precachedTravelState[unit->getId()] = ts;
 	}
 	else {
@@ -973,11 +1325,128 @@ TravelState PathFinder::aStar(Unit *unit, const Vec2i &targetPos, bool inBailout
 	return ts;
 }
 
-void PathFinder::processNearestFreePos(const Vec2i &finalPos, int i, int j, int size, Field field, int teamIndex,Vec2i unitPos, Vec2i &nearestPos, float &nearestDist) {
+// Runs the same search with the legacy std::map open list and the binary heap
+// open set and reports any difference in the result. The binary heap result is
+// the one used by the caller.
+void PathFinder::doAStarPathSearchVerified(bool & nodeLimitReached, int & whileLoopCount,
+		FactionState & faction, bool & pathFound, Node *& node, const Vec2i & finalPos,
+		Node *firstNode, Unit *& unit, int & maxNodeCount, int curFrameIndex) {
+
+	const bool useBinaryHeapOpenSet = faction.useBinaryHeapOpenSet;
+	const int randomLastNumber 		= faction.random.getLastNumber();
+	const int startNodePoolCount 	= faction.nodePoolCount;
+	const bool startNodeLimitReached= nodeLimitReached;
+	const bool startPathFound 		= pathFound;
+	const int startWhileLoopCount 	= whileLoopCount;
+
+	// legacy run
+	faction.useBinaryHeapOpenSet = false;
+	clearOpenAndClosedNodes(faction);
+	addOpenNode(faction, firstNode);
+
+	Chrono chrono(true);
+	doAStarPathSearch(nodeLimitReached, whileLoopCount, faction,
+						pathFound, node, finalPos, unit, maxNodeCount, curFrameIndex);
+	int64 legacyMicros = chrono.getMicros();
+
+	const bool legacyNodeLimitReached 	= nodeLimitReached;
+	const bool legacyPathFound 			= pathFound;
+	const int legacyWhileLoopCount 		= whileLoopCount;
+	const int legacyNodePoolCount		= faction.nodePoolCount;
+	vector<Vec2i> legacyPath;
+	for(Node *curNode = node; curNode != NULL; curNode = curNode->prev) {
+		legacyPath.push_back(curNode->pos);
+	}
+	Node *legacyBestClosed = getBestClosedNode(faction);
+	Vec2i legacyBestClosedPos = (legacyBestClosed != NULL ? legacyBestClosed->pos : Vec2i(-1,-1));
+
+	// binary heap run from the exact same starting state
+	faction.useBinaryHeapOpenSet = true;
+	clearOpenAndClosedNodes(faction);
+	faction.nodePoolCount = startNodePoolCount;
+	faction.random.setLastNumber(randomLastNumber);
+	nodeLimitReached 	= startNodeLimitReached;
+	pathFound 			= startPathFound;
+	whileLoopCount 		= startWhileLoopCount;
+	node 				= NULL;
+	addOpenNode(faction, firstNode);
+
+	chrono.start();
+	doAStarPathSearch(nodeLimitReached, whileLoopCount, faction,
+						pathFound, node, finalPos, unit, maxNodeCount, curFrameIndex);
+	int64 heapMicros = chrono.getMicros();
+
+	vector<Vec2i> heapPath;
+	for(Node *curNode = node; curNode != NULL; curNode = curNode->prev) {
+		heapPath.push_back(curNode->pos);
+	}
+	Node *heapBestClosed = getBestClosedNode(faction);
+	Vec2i heapBestClosedPos = (heapBestClosed != NULL ? heapBestClosed->pos : Vec2i(-1,-1));
+
+	bool matched = (legacyNodeLimitReached == nodeLimitReached &&
+					legacyPathFound == pathFound &&
+					legacyWhileLoopCount == whileLoopCount &&
+					legacyNodePoolCount == faction.nodePoolCount &&
+					legacyPath == heapPath &&
+					legacyBestClosedPos == heapBestClosedPos);
+
+	verifySearchCount++;
+	verifyLegacyNodeCount	+= legacyWhileLoopCount;
+	verifyLegacyMicros		+= legacyMicros;
+	verifyHeapNodeCount		+= whileLoopCount;
+	verifyHeapMicros		+= heapMicros;
+
+	if(matched == false) {
+		verifyMismatchCount++;
+
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"PathFinder open set MISMATCH unit [%d - %s] from [%s] to [%s] legacy: found = %d limit = %d loops = %d path = %d heap: found = %d limit = %d loops = %d path = %d",
+				unit->getId(),unit->getType()->getName(false).c_str(),unit->getPos().getString().c_str(),finalPos.getString().c_str(),
+				legacyPathFound,legacyNodeLimitReached,legacyWhileLoopCount,(int)legacyPath.size(),
+				pathFound,nodeLimitReached,whileLoopCount,(int)heapPath.size());
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("%s\n",szBuf);
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugPathFinder).enabled) SystemFlags::OutputDebug(SystemFlags::debugPathFinder,"In [%s::%s Line: %d] %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,szBuf);
+	}
+
+	if(verifySearchCount % 500 == 0) {
+		double legacyNodesPerSec = (verifyLegacyMicros > 0 ? (double)verifyLegacyNodeCount * 1000000.0 / (double)verifyLegacyMicros : 0.0);
+		double heapNodesPerSec 	 = (verifyHeapMicros > 0 ? (double)verifyHeapNodeCount * 1000000.0 / (double)verifyHeapMicros : 0.0);
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("PathFinder open set verify: searches = %lld mismatches = %lld legacy nodes/sec = %.0f binary heap nodes/sec = %.0f\n",
+				(long long int)verifySearchCount,(long long int)verifyMismatchCount,legacyNodesPerSec,heapNodesPerSec);
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugPathFinder).enabled) SystemFlags::OutputDebug(SystemFlags::debugPathFinder,"In [%s::%s Line: %d] open set verify: searches = %lld mismatches = %lld legacy nodes/sec = %.0f binary heap nodes/sec = %.0f\n",
+				extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,
+				(long long int)verifySearchCount,(long long int)verifyMismatchCount,legacyNodesPerSec,heapNodesPerSec);
+	}
+
+	faction.useBinaryHeapOpenSet = useBinaryHeapOpenSet;
+	if(useBinaryHeapOpenSet == false) {
+		// keep the configured structure consistent with the result we hand back
+		clearOpenAndClosedNodes(faction);
+		faction.nodePoolCount = startNodePoolCount;
+		faction.random.setLastNumber(randomLastNumber);
+		nodeLimitReached 	= startNodeLimitReached;
+		pathFound 			= startPathFound;
+		whileLoopCount 		= startWhileLoopCount;
+		node 				= NULL;
+		addOpenNode(faction, firstNode);
+
+		doAStarPathSearch(nodeLimitReached, whileLoopCount, faction,
+							pathFound, node, finalPos, unit, maxNodeCount, curFrameIndex);
+	}
+}
+
+void PathFinder::processNearestFreePos(const Vec2i &finalPos, int i, int j, int size, Field field, int teamIndex,Vec2i unitPos, Vec2i &nearestPos, float &nearestDist,
+		const ClusterMap *clusterMap, int unitRegion) {
 
 	try {
 	Vec2i currPos= finalPos + Vec2i(i, j);
 
+	//skip cells the unit can never reach
+	if(unitRegion != ClusterMap::regionBlocked &&
+		clusterMap->getRegion(field, size, currPos) != unitRegion) {
+		return;
+	}
+
 	if(map->isAproxFreeCells(currPos, size, field, teamIndex)) {
 		float dist= currPos.dist(finalPos);
 
@@ -1024,21 +1493,30 @@ Vec2i PathFinder::computeNearestFreePos(const Unit *unit, const Vec2i &finalPos)
 	int size= unit->getType()->getSize();
 	Field field= unit->getCurrField();
 	int teamIndex= unit->getTeam();
+	Vec2i unitPos= unit->getPosNotThreadSafe();
+
+	//region of the unit if the map is labelled, only cells in the same
+	//region can ever be reached
+	const ClusterMap *clusterMap= map->getClusterMap();
+	int unitRegion= ClusterMap::regionBlocked;
+	if(clusterMap != NULL && clusterMap->canLabelRegions(field, size) == true) {
+		unitRegion= clusterMap->getRegion(field, size, unitPos);
+	}
 
 	//if finalPos is free return it
-	if(map->isAproxFreeCells(finalPos, size, field, teamIndex)) {
+	if(map->isAproxFreeCells(finalPos, size, field, teamIndex) &&
+		(unitRegion == ClusterMap::regionBlocked || clusterMap->getRegion(field, size, finalPos) == unitRegion)) {
 		return finalPos;
 	}
 
 	//find nearest pos
-	Vec2i unitPos= unit->getPosNotThreadSafe();
 	nearestPos= unitPos;
 
 	float nearestDist= unitPos.dist(finalPos);
 
 	for(int i= -maxFreeSearchRadius; i <= maxFreeSearchRadius; ++i) {
 		for(int j= -maxFreeSearchRadius; j <= maxFreeSearchRadius; ++j) {
-			processNearestFreePos(finalPos, i, j, size, field, teamIndex, unitPos, nearestPos, nearestDist);
+			processNearestFreePos(finalPos, i, j, size, field, teamIndex, unitPos, nearestPos, nearestDist, clusterMap, unitRegion);
 		}
 	}
 
@@ -1060,6 +1538,167 @@ Vec2i PathFinder::computeNearestFreePos(const Unit *unit, const Vec2i &finalPos)
 	return nearestPos;
 }
 
+// Checks the region labels of the map, false means no path to finalPos
+// can exist no matter how many nodes are searched
+bool PathFinder::isStaticallyReachable(const Unit *unit, const Vec2i &finalPos) const {
+	const ClusterMap *clusterMap = map->getClusterMap();
+	if(clusterMap == NULL) {
+		return true;
+	}
+	return clusterMap->isReachable(unit->getCurrField(), unit->getType()->getSize(), unit->getPosNotThreadSafe(), finalPos, 0);
+}
+
+Vec2i PathFinder::computeHierarchicalWaypoint(FactionState &faction, Unit *unit, const Vec2i &finalPos) {
+	const ClusterMap *clusterMap = map->getClusterMap();
+	if(clusterMap == NULL) {
+		return finalPos;
+	}
+
+	int unitSize = unit->getType()->getSize();
+	Field field = unit->getCurrField();
+	if(clusterMap->canAbstract(field, unitSize) == false) {
+		return finalPos;
+	}
+
+	const Vec2i unitPos = unit->getPos();
+	if(abs(unitPos.x - finalPos.x) <= ClusterMap::clusterSize &&
+	   abs(unitPos.y - finalPos.y) <= ClusterMap::clusterSize) {
+		clearHierarchicalPath(faction, unit);
+		return finalPos;
+	}
+
+	HierarchicalPath &hierarchicalPath = faction.hierarchicalPaths[unit->getId()];
+	if(hierarchicalPath.waypoints.empty() == true ||
+		hierarchicalPath.finalPos != finalPos ||
+		hierarchicalPath.version != clusterMap->getVersion() ||
+		hierarchicalPath.field != field ||
+		hierarchicalPath.unitSize != unitSize) {
+
+		hierarchicalPath.finalPos		= finalPos;
+		hierarchicalPath.version		= clusterMap->getVersion();
+		hierarchicalPath.field			= field;
+		hierarchicalPath.unitSize		= unitSize;
+		hierarchicalPath.nextWaypoint	= 0;
+		if(clusterMap->isReachable(field, unitSize, unitPos, finalPos, maxFreeSearchRadius) == false ||
+			clusterMap->findAbstractPath(field, unitSize, unitPos, finalPos, hierarchicalPath.waypoints) == false) {
+			// statically unreachable, let the regular search get as close as it can
+			faction.hierarchicalPaths.erase(unit->getId());
+			return finalPos;
+		}
+	}
+
+	// skip the waypoints the unit already reached
+	const int waypointReachedDistance = 2;
+	int lastWaypoint = (int)hierarchicalPath.waypoints.size() - 1;
+	while(hierarchicalPath.nextWaypoint < lastWaypoint) {
+		const Vec2i &waypoint = hierarchicalPath.waypoints[hierarchicalPath.nextWaypoint];
+		if(abs(unitPos.x - waypoint.x) > waypointReachedDistance ||
+		   abs(unitPos.y - waypoint.y) > waypointReachedDistance) {
+			break;
+		}
+		hierarchicalPath.nextWaypoint++;
+	}
+
+	if(hierarchicalPath.nextWaypoint >= lastWaypoint) {
+		return finalPos;
+	}
+	return hierarchicalPath.waypoints[hierarchicalPath.nextWaypoint];
+}
+
+// Flow fields are only worth it for group moves and only while the unit is
+// still far from the goal, close to it the group members crowd around the
+// goal and the regular search picks free cells around it
+bool PathFinder::canUseFlowField(const Unit *unit, const Vec2i &finalPos, int unitCommandGroupId) const {
+	if(unitCommandGroupId <= 0) {
+		return false;
+	}
+	const Vec2i unitPos = unit->getPosNotThreadSafe();
+	return (abs(unitPos.x - finalPos.x) > maxFreeSearchRadius ||
+			abs(unitPos.y - finalPos.y) > maxFreeSearchRadius);
+}
+
+const FlowField &PathFinder::getFlowField(FactionState &faction, int unitCommandGroupId, Field field, int unitSize, const Vec2i &finalPos) {
+	FlowFieldKey key(unitCommandGroupId, std::make_pair((int)field, unitSize));
+	FlowFieldMap::iterator iterFind = faction.flowFields.find(key);
+	if(iterFind == faction.flowFields.end()) {
+		// the oldest groups (lowest ids) are dropped first
+		while((int)faction.flowFields.size() >= maxCachedFlowFields) {
+			faction.flowFields.erase(faction.flowFields.begin());
+		}
+		iterFind = faction.flowFields.insert(std::make_pair(key, FlowField())).first;
+	}
+
+	FlowField &flowField = iterFind->second;
+	if(flowField.isValid(map, field, unitSize, finalPos) == false) {
+		Chrono chrono;
+		bool collectStats = SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled;
+		if(collectStats) chrono.start();
+
+		flowField.init(map, field, unitSize, finalPos);
+
+		if(collectStats) {
+			flowFieldBuildMicros += chrono.getMicros();
+			flowFieldBuildCount++;
+		}
+	}
+	return flowField;
+}
+
+// Picks the next cell from the flow field. The first step goes to the
+// cheapest neighbour the unit can enter right now so group members flow
+// around each other, the unit path is then filled from the direction
+// field. Returns false if the field offers no way forward, the regular
+// search takes over then.
+bool PathFinder::followFlowField(Unit *unit, const Vec2i &finalPos, int unitCommandGroupId, Vec2i &nextStepPos) {
+	FactionState &faction = factions.getFactionState(unit->getFactionIndex());
+	const FlowField &flowField = getFlowField(faction, unitCommandGroupId,
+			unit->getCurrField(), unit->getType()->getSize(), finalPos);
+
+	const Vec2i unitPos = unit->getPos();
+	int currentCost = flowField.getCost(unitPos);
+	if(currentCost == FlowField::unreachableCost) {
+		return false;
+	}
+
+	Vec2i bestPos = unitPos;
+	int bestCost = currentCost;
+	for(int i = -1; i <= 1; ++i) {
+		for(int j = -1; j <= 1; ++j) {
+			Vec2i pos = unitPos + Vec2i(i, j);
+			if(pos == unitPos) {
+				continue;
+			}
+			int cost = flowField.getCost(pos);
+			if(cost < bestCost && map->canMove(unit, unitPos, pos) == true) {
+				bestCost = cost;
+				bestPos = pos;
+			}
+		}
+	}
+	if(bestPos == unitPos) {
+		return false;
+	}
+
+	UnitPathInterface *path = unit->getPath();
+	path->clear();
+	nextStepPos = bestPos;
+
+	Vec2i pos = bestPos;
+	Vec2i nextPos;
+	for(int i = 1; i < unit->getPathFindRefreshCellCount() && flowField.getNextPos(pos, nextPos) == true; ++i) {
+		path->add(nextPos);
+		pos = nextPos;
+	}
+	return true;
+}
+
+void PathFinder::clearHierarchicalPath(FactionState &faction, Unit *unit) {
+	std::map<int,HierarchicalPath>::iterator iterFind = faction.hierarchicalPaths.find(unit->getId());
+	if(iterFind != faction.hierarchicalPaths.end()) {
+		faction.hierarchicalPaths.erase(iterFind);
+	}
+}
+
 int PathFinder::findNodeIndex(Node *node, Nodes &nodeList) {
 	int index = -1;
 	if(node != NULL) {
@@ -1133,12 +1772,15 @@ bool PathFinder::unitCannotMove(Unit *unit) {
 void PathFinder::saveGame(XmlNode *rootNode) {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *pathfinderNode = rootNode->addChild("PathFinder");
+	pathfinderNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 	pathfinderNode->addAttribute("pathFindNodesMax",intToStr(pathFindNodesMax), mapTagReplacements);
 	pathfinderNode->addAttribute("pathFindNodesAbsoluteMax",intToStr(pathFindNodesAbsoluteMax), mapTagReplacements);
 	for(unsigned int i = 0; i < (unsigned int)factions.size(); ++i) {
 		FactionState &factionState = factions.getFactionState(i);
 		XmlNode *factionsNode = pathfinderNode->addChild("factions");
+		// the node pool of a faction can hold thousands of nodes
+		factionsNode->setStreamChildren(true, pathfinderNode->getStreamFormat());
 
 		for(unsigned int j = 0; j < (unsigned int)factionState.nodePool.size(); ++j) {
 			Node *curNode = &factionState.nodePool[j];
@@ -1198,4 +1840,68 @@ void PathFinder::loadGame(const XmlNode *rootNode) {
 	}
 }
 
+// =====================================================
+// 	class PathFinderThread
+// =====================================================
+
+PathFinderThread::PathFinderThread(PathFinder *pathFinder, PathFinder::FactionState *searchState) : BaseThread() {
+	this->pathFinder = pathFinder;
+	this->searchState = searchState;
+	uniqueID = "PathFinderThread";
+}
+
+PathFinderThread::~PathFinderThread() {
+	this->pathFinder = NULL;
+	this->searchState = NULL;
+}
+
+void PathFinderThread::setQuitStatus(bool value) {
+	BaseThread::setQuitStatus(value);
+	if(value == true) {
+		semTaskSignalled.signal();
+	}
+}
+
+void PathFinderThread::signalPathRequests() {
+	semTaskSignalled.signal();
+}
+
+void PathFinderThread::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	try {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
+
+		for(;this->pathFinder != NULL;) {
+			if(getQuitStatus() == true) {
+				break;
+			}
+
+			semTaskSignalled.waitTillSignalled();
+
+			if(getQuitStatus() == true) {
+				break;
+			}
+
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			for(;pathFinder->processNextPathRequest(*searchState) == true;) {
+			}
+			pathFinder->semPathRequestsDone.signal();
+		}
+
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
+
+		throw megaglest_runtime_error(ex.what());
+	}
+	catch(...) {
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"In [%s::%s %d] UNKNOWN error\n",__FILE__,__FUNCTION__,__LINE__);
+		SystemFlags::OutputDebug(SystemFlags::debugError,szBuf);
+		throw megaglest_runtime_error(szBuf);
+	}
+}
+
 }} //end namespace
@@ -24,14 +24,20 @@
 #include "skill_type.h"
 #include "map.h"
 #include "unit.h"
+#include "cluster_map.h"
+#include "flow_field.h"
+#include "base_thread.h"
 
 #include "leak_dumper.h"
 
 using std::vector;
 using Shared::Graphics::Vec2i;
+using Shared::PlatformCommon::BaseThread;
 
 namespace Glest { namespace Game {
 
+class PathFinderThread;
+
 // =====================================================
 // 	class PathFinder
 //
@@ -86,6 +92,175 @@ public:
 	};
 	typedef vector<Node*> Nodes;
 
+	// Binary heap open set ordered by (heuristic, insertion order) so nodes with
+	// the same heuristic are popped in the same FIFO order as the legacy
+	// std::map<float, Nodes> list. Paths must be identical on every client.
+	class OpenNodeHeap {
+	protected:
+		class Entry {
+		public:
+			float heuristic;
+			uint32 sequence;
+			Node *node;
+		};
+		std::vector<Entry> heap;
+		uint32 nextSequence;
+
+		inline static bool isLess(const Entry &a, const Entry &b) {
+			if(a.heuristic != b.heuristic) {
+				return a.heuristic < b.heuristic;
+			}
+			return a.sequence < b.sequence;
+		}
+
+	public:
+		OpenNodeHeap() {
+			nextSequence = 0;
+		}
+		void reserve(int size) {
+			heap.reserve(size);
+		}
+		inline void clear() {
+			heap.clear();
+			nextSequence = 0;
+		}
+		inline bool empty() const {
+			return heap.empty();
+		}
+		inline int size() const {
+			return (int)heap.size();
+		}
+		inline void push(Node *node) {
+			Entry entry;
+			entry.heuristic = node->heuristic;
+			entry.sequence 	= nextSequence++;
+			entry.node 		= node;
+
+			int index = (int)heap.size();
+			heap.push_back(entry);
+			while(index > 0) {
+				int parent = (index - 1) / 2;
+				if(isLess(entry, heap[parent]) == false) {
+					break;
+				}
+				heap[index] = heap[parent];
+				index = parent;
+			}
+			heap[index] = entry;
+		}
+		inline Node * pop() {
+			Node *result = heap[0].node;
+			Entry last = heap.back();
+			heap.pop_back();
+
+			int count = (int)heap.size();
+			if(count > 0) {
+				int index = 0;
+				for(;;) {
+					int child = index * 2 + 1;
+					if(child >= count) {
+						break;
+					}
+					if(child + 1 < count && isLess(heap[child + 1], heap[child]) == true) {
+						child++;
+					}
+					if(isLess(heap[child], last) == false) {
+						break;
+					}
+					heap[index] = heap[child];
+					index = child;
+				}
+				heap[index] = last;
+			}
+			return result;
+		}
+	};
+
+	// Flat per cell lookup of positions already added to the open list. Each
+	// search bumps the generation instead of clearing the whole array.
+	class OpenPosStamps {
+	protected:
+		std::vector<uint32> stamps;
+		int w;
+		int h;
+		uint32 generation;
+
+	public:
+		OpenPosStamps() {
+			w = 0;
+			h = 0;
+			generation = 1;
+		}
+		void init(int w, int h) {
+			this->w = w;
+			this->h = h;
+			stamps.clear();
+			stamps.resize(w * h, 0);
+			generation = 1;
+		}
+		inline void nextGeneration() {
+			generation++;
+			if(generation == 0) {
+				std::fill(stamps.begin(), stamps.end(), 0);
+				generation = 1;
+			}
+		}
+		inline bool isSet(const Vec2i &pos) const {
+			if(pos.x < 0 || pos.y < 0 || pos.x >= w || pos.y >= h) {
+				return false;
+			}
+			return stamps[pos.y * w + pos.x] == generation;
+		}
+		inline void set(const Vec2i &pos) {
+			if(pos.x >= 0 && pos.y >= 0 && pos.x < w && pos.y < h) {
+				stamps[pos.y * w + pos.x] = generation;
+			}
+		}
+	};
+
+	// Abstract route of a unit planned on the ClusterMap
+	class HierarchicalPath {
+	public:
+		HierarchicalPath() {
+			version = 0;
+			field = fLand;
+			unitSize = 0;
+			nextWaypoint = 0;
+		}
+		Vec2i finalPos;
+		uint32 version;
+		Field field;
+		int unitSize;
+		vector<Vec2i> waypoints;
+		int nextWaypoint;
+	};
+
+	// Flow fields of the group moves of a faction, keyed by command group
+	// id, field and unit size
+	typedef std::pair<int,std::pair<int,int> > FlowFieldKey;
+	typedef std::map<FlowFieldKey,FlowField> FlowFieldMap;
+
+	// A pre-cache search queued by a faction thread. The result is filled in
+	// by whichever search thread takes it and copied to the faction when all
+	// requests of the frame are done.
+	class PathRequest {
+	public:
+		PathRequest() {
+			unit = NULL;
+			frameIndex = -1;
+			travelState = tsImpossible;
+			hasHierarchicalPath = false;
+		}
+		Unit *unit;
+		Vec2i finalPos;
+		int frameIndex;
+		TravelState travelState;
+		std::vector<Vec2i> path;
+		bool hasHierarchicalPath;
+		HierarchicalPath hierarchicalPath;
+	};
+	typedef vector<PathRequest> PathRequests;
+
 	class FactionState {
 	protected:
 		Mutex *factionMutexPrecache;
@@ -100,6 +275,9 @@ public:
 			nodePool.clear();
 			nodePoolCount = 0;
 			useMaxNodeCount = 0;
+			useBinaryHeapOpenSet = true;
+			closedNodesBest = NULL;
+			closedNodesCount = 0;
 
 			precachedTravelState.clear();
 			precachedPath.clear();
@@ -118,12 +296,21 @@ public:
 		std::map<float, Nodes> closedNodesList;
 		std::vector<Node> nodePool;
 
+		bool useBinaryHeapOpenSet;
+		OpenNodeHeap openNodesHeap;
+		OpenPosStamps openPosStamps;
+		Node *closedNodesBest;
+		int closedNodesCount;
+
 		int nodePoolCount;
 		RandomGen random;
 		int useMaxNodeCount;
 
 		std::map<int,TravelState> precachedTravelState;
 		std::map<int,std::vector<Vec2i> > precachedPath;
+		std::map<int,HierarchicalPath> hierarchicalPaths;
+		FlowFieldMap flowFields;
+		PathRequests pathRequests;
 	};
 
 	class FactionStateManager {
@@ -163,13 +350,16 @@ public:
 
 public:
 	static const int maxFreeSearchRadius;
+	static const int maxCachedFlowFields;
 
 	static const int pathFindBailoutRadius;
 	static const int pathFindExtendRefreshForNodeCount;
 	static const int pathFindExtendRefreshNodeCountMin;
 	static const int pathFindExtendRefreshNodeCountMax;
+	static const int maxSearchThreads;
 
 private:
+	friend class PathFinderThread;
 
 	static int pathFindNodesMax;
 	static int pathFindNodesAbsoluteMax;
@@ -179,6 +369,31 @@ private:
 	const Map *map;
 	bool minorDebugPathfinder;
 
+	bool verifyOpenSet;
+	int64 verifySearchCount;
+	int64 verifyMismatchCount;
+	int64 verifyLegacyNodeCount;
+	int64 verifyLegacyMicros;
+	int64 verifyHeapNodeCount;
+	int64 verifyHeapMicros;
+
+	int64 flowFieldBuildCount;
+	int64 flowFieldBuildMicros;
+	int64 flowFieldStepCount;
+	int64 flowFieldStepMicros;
+	int64 searchCount;
+	int64 searchMicros;
+
+	// search state of the threads draining the queued pre-cache requests,
+	// the first one is used by the calling thread itself
+	vector<FactionState *> searchStates;
+	vector<PathFinderThread *> searchThreads;
+	Mutex *pathRequestMutex;
+	Semaphore semPathRequestsDone;
+	vector<PathRequest *> pendingRequests;
+	int nextPendingRequest;
+	string pathRequestError;
+
 public:
 	PathFinder();
 	PathFinder(const Map *map);
@@ -194,10 +409,11 @@ public:
 	}
 
 	void init(const Map *map);
-	TravelState findPath(Unit *unit, const Vec2i &finalPos, bool *wasStuck=NULL,int frameIndex=-1);
+	TravelState findPath(Unit *unit, const Vec2i &finalPos, bool *wasStuck=NULL,int frameIndex=-1,int unitCommandGroupId=-1);
 	void clearUnitPrecache(Unit *unit);
 	void removeUnitPrecache(Unit *unit);
 	void clearCaches();
+	void processPathRequests(int frameIndex);
 
 	bool unitCannotMove(Unit *unit);
 
@@ -209,9 +425,24 @@ public:
 
 private:
 	void init();
-
-	TravelState aStar(Unit *unit, const Vec2i &finalPos, bool inBailout,
+	void resetOpenSetVerifyStats();
+	void resetGroupMoveStats();
+	void logGroupMoveStats();
+	void initSearchThreads(int threadCount);
+	void shutdownSearchThreads();
+
+	void queuePathRequest(FactionState &faction, Unit *unit, const Vec2i &finalPos, int frameIndex);
+	bool processNextPathRequest(FactionState &searchState);
+	void processPathRequest(FactionState &searchState, PathRequest &request);
+	void applyPathRequest(const PathRequest &request);
+
+	TravelState searchPath(FactionState &faction, Unit *unit, const Vec2i &finalPos, bool *wasStuck, int frameIndex);
+	TravelState aStar(FactionState &faction, Unit *unit, const Vec2i &finalPos, bool inBailout,
 			int frameIndex, int maxNodeCount=-1,uint32 *searched_node_count=NULL);
+	inline static void clearUnitPrecache(FactionState &faction, int unitId) {
+		faction.precachedTravelState[unitId] = tsImpossible;
+		faction.precachedPath[unitId].clear();
+	}
 	inline static Node *newNode(FactionState &faction, int maxNodeCount) {
 		if( faction.nodePoolCount < (int)faction.nodePool.size() &&
 			faction.nodePoolCount < maxNodeCount) {
@@ -224,18 +455,88 @@ private:
 	}
 
 	Vec2i computeNearestFreePos(const Unit *unit, const Vec2i &targetPos);
+	Vec2i computeHierarchicalWaypoint(FactionState &faction, Unit *unit, const Vec2i &finalPos);
+	void clearHierarchicalPath(FactionState &faction, Unit *unit);
+	bool canUseFlowField(const Unit *unit, const Vec2i &finalPos, int unitCommandGroupId) const;
+	const FlowField &getFlowField(FactionState &faction, int unitCommandGroupId, Field field, int unitSize, const Vec2i &finalPos);
+	bool followFlowField(Unit *unit, const Vec2i &finalPos, int unitCommandGroupId, Vec2i &nextStepPos);
 	inline static float heuristic(const Vec2i &pos, const Vec2i &finalPos) {
 		return pos.dist(finalPos);
 	}
 
 	inline static bool openPos(const Vec2i &sucPos, FactionState &faction) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			return faction.openPosStamps.isSet(sucPos);
+		}
 		if(faction.openPosList.find(sucPos) == faction.openPosList.end()) {
 			return false;
 		}
 		return true;
 	}
 
+	inline static void clearOpenAndClosedNodes(FactionState &faction) {
+		faction.openNodesList.clear();
+		faction.openPosList.clear();
+		faction.closedNodesList.clear();
+
+		faction.openNodesHeap.clear();
+		faction.openPosStamps.nextGeneration();
+		faction.closedNodesBest = NULL;
+		faction.closedNodesCount = 0;
+	}
+
+	inline static bool openNodesEmpty(FactionState &faction) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			return faction.openNodesHeap.empty();
+		}
+		return faction.openNodesList.empty();
+	}
+
+	inline static void addOpenNode(FactionState &faction, Node *node) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			faction.openNodesHeap.push(node);
+			faction.openPosStamps.set(node->pos);
+		}
+		else {
+			faction.openNodesList[node->heuristic].push_back(node);
+			faction.openPosList[node->pos] = true;
+		}
+	}
+
+	inline static void addClosedNode(FactionState &faction, Node *node) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			// only the first node with the lowest heuristic is ever looked up
+			if(faction.closedNodesBest == NULL ||
+				node->heuristic < faction.closedNodesBest->heuristic) {
+				faction.closedNodesBest = node;
+			}
+			faction.closedNodesCount++;
+			faction.openPosStamps.set(node->pos);
+		}
+		else {
+			faction.closedNodesList[node->heuristic].push_back(node);
+			faction.openPosList[node->pos] = true;
+		}
+	}
+
+	inline static Node * getBestClosedNode(FactionState &faction) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			return faction.closedNodesBest;
+		}
+		if(faction.closedNodesList.empty() == true) {
+			return NULL;
+		}
+		return faction.closedNodesList.begin()->second[0];
+	}
+
 	inline static Node * minHeuristicFastLookup(FactionState &faction) {
+		if(faction.useBinaryHeapOpenSet == true) {
+			if(faction.openNodesHeap.empty() == true) {
+				throw megaglest_runtime_error("openNodesHeap.empty() == true");
+			}
+			return faction.openNodesHeap.pop();
+		}
+
 		if(faction.openNodesList.empty() == true) {
 			throw megaglest_runtime_error("openNodesList.empty() == true");
 		}
@@ -248,14 +549,11 @@ private:
 		return result;
 	}
 
-	inline bool processNode(Unit *unit, Node *node,const Vec2i finalPos,
+	inline bool processNode(FactionState &faction, Unit *unit, Node *node,const Vec2i finalPos,
 			int i, int j, bool &nodeLimitReached,int maxNodeCount) {
 		bool result = false;
 		Vec2i sucPos= node->pos + Vec2i(i, j);
 
-		int unitFactionIndex = unit->getFactionIndex();
-		FactionState &faction = factions.getFactionState(unitFactionIndex);
-
 		if(openPos(sucPos, faction) == false &&
 				canUnitMoveSoon(unit, node->pos, sucPos) == true) {
 			//if node is not open and canMove then generate another node
@@ -267,11 +565,7 @@ private:
 				sucNode->next= NULL;
 				sucNode->exploredCell = map->getSurfaceCell(
 						Map::toSurfCoords(sucPos))->isExplored(unit->getTeam());
-				if(faction.openNodesList.find(sucNode->heuristic) == faction.openNodesList.end()) {
-					faction.openNodesList[sucNode->heuristic].clear();
-				}
-				faction.openNodesList[sucNode->heuristic].push_back(sucNode);
-				faction.openPosList[sucNode->pos] = true;
+				addOpenNode(faction, sucNode);
 
 				result = true;
 			}
@@ -284,7 +578,9 @@ private:
 	}
 
 	void processNearestFreePos(const Vec2i &finalPos, int i, int j, int size,
-			Field field, int teamIndex,Vec2i unitPos, Vec2i &nearestPos, float &nearestDist);
+			Field field, int teamIndex,Vec2i unitPos, Vec2i &nearestPos, float &nearestDist,
+			const ClusterMap *clusterMap, int unitRegion);
+	bool isStaticallyReachable(const Unit *unit, const Vec2i &finalPos) const;
 	int getPathFindExtendRefreshNodeCount(FactionState &faction);
 
 	inline bool canUnitMoveSoon(const Unit *unit, const Vec2i &pos1, const Vec2i &pos2) {
@@ -292,17 +588,17 @@ private:
 		return result;
 	}
 
-	inline void doAStarPathSearch(bool & nodeLimitReached, int & whileLoopCount,
-			int & unitFactionIndex, bool & pathFound, Node *& node, const Vec2i & finalPos,
-			std::map<Vec2i,bool> closedNodes,
-			std::map<Vec2i,Vec2i> cameFrom, std::map<std::pair<Vec2i,Vec2i> ,
-			bool> canAddNode, Unit *& unit, int & maxNodeCount, int curFrameIndex)  {
+	void doAStarPathSearchVerified(bool & nodeLimitReached, int & whileLoopCount,
+			FactionState & faction, bool & pathFound, Node *& node, const Vec2i & finalPos,
+			Node *firstNode, Unit *& unit, int & maxNodeCount, int curFrameIndex);
 
-		FactionState &faction = factions.getFactionState(unitFactionIndex);
+	inline void doAStarPathSearch(bool & nodeLimitReached, int & whileLoopCount,
+			FactionState & faction, bool & pathFound, Node *& node, const Vec2i & finalPos,
+			Unit *& unit, int & maxNodeCount, int curFrameIndex)  {
 
 		while(nodeLimitReached == false) {
 			whileLoopCount++;
-			if(faction.openNodesList.empty() == true) {
+			if(openNodesEmpty(faction) == true) {
 				pathFound = false;
 				break;
 			}
@@ -312,11 +608,7 @@ private:
 				break;
 			}
 
-			if(faction.closedNodesList.find(node->heuristic) == faction.closedNodesList.end()) {
-				faction.closedNodesList[node->heuristic].clear();
-			}
-			faction.closedNodesList[node->heuristic].push_back(node);
-			faction.openPosList[node->pos] = true;
+			addClosedNode(faction, node);
 
 			int failureCount 	= 0;
 			int cellCount 		= 0;
@@ -325,7 +617,7 @@ private:
 			if(tryDirection == 3) {
 				for(int i = 1;i >= -1 && nodeLimitReached == false;--i) {
 					for(int j = -1;j <= 1 && nodeLimitReached == false;++j) {
-						if(processNode(unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
+						if(processNode(faction, unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
 							failureCount++;
 						}
 						cellCount++;
@@ -335,7 +627,7 @@ private:
 			else if(tryDirection == 2) {
 				for(int i = -1;i <= 1 && nodeLimitReached == false;++i) {
 					for(int j = 1;j >= -1 && nodeLimitReached == false;--j) {
-						if(processNode(unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
+						if(processNode(faction, unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
 							failureCount++;
 						}
 						cellCount++;
@@ -345,7 +637,7 @@ private:
 			else if(tryDirection == 1) {
 				for(int i = -1;i <= 1 && nodeLimitReached == false;++i) {
 					for(int j = -1;j <= 1 && nodeLimitReached == false;++j) {
-						if(processNode(unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
+						if(processNode(faction, unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
 							failureCount++;
 						}
 						cellCount++;
@@ -355,7 +647,7 @@ private:
 			else {
 				for(int i = 1;i >= -1 && nodeLimitReached == false;--i) {
 					for(int j = 1;j >= -1 && nodeLimitReached == false;--j) {
-						if(processNode(unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
+						if(processNode(faction, unit, node, finalPos, i, j, nodeLimitReached, maxNodeCount) == false) {
 							failureCount++;
 						}
 						cellCount++;
@@ -367,6 +659,29 @@ private:
 
 };
 
+// =====================================================
+// 	class PathFinderThread
+//
+///	Takes queued pre-cache path requests and searches them with its own
+///	search state (node pool, open set), one thread per spare core
+// =====================================================
+
+class PathFinderThread : public BaseThread {
+protected:
+	PathFinder *pathFinder;
+	PathFinder::FactionState *searchState;
+	Semaphore semTaskSignalled;
+
+	virtual void setQuitStatus(bool value);
+
+public:
+	PathFinderThread(PathFinder *pathFinder, PathFinder::FactionState *searchState);
+	virtual ~PathFinderThread();
+	virtual void execute();
+
+	void signalPathRequests();
+};
+
 }}//end namespace
 
 #endif
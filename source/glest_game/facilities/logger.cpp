@@ -61,9 +61,14 @@ Logger::Logger() {
 	buttonCancel.setEnabled(false);
 
 	buttonNextHint.setEnabled(false);
+
+	mutexDeferredAdds = new Mutex(CODE_AT_LINE);
+	deferAdds = false;
 }
 
 Logger::~Logger() {
+	delete mutexDeferredAdds;
+	mutexDeferredAdds = NULL;
 }
 
 Logger & Logger::getInstance() {
@@ -72,6 +77,12 @@ Logger & Logger::getInstance() {
 }
 
 void Logger::add(const string str,  bool renderScreen, const string statusText) {
+	if(deferAdds == true) {
+		MutexSafeWrapper safeMutex(mutexDeferredAdds,CODE_AT_LINE);
+		deferredAdds.push_back(make_pair(str,statusText));
+		return;
+	}
+
 #ifdef WIN32
 	FILE *f= _wfopen(utf8_decode(fileName).c_str(), L"at+");
 #else
@@ -89,6 +100,48 @@ void Logger::add(const string str,  bool renderScreen, const string statusText)
 	}
 }
 
+// While set every line is only queued, for parts of the loading that run
+// on other threads. Turning it off writes the queued lines.
+void Logger::setDeferAdds(bool value) {
+	{
+		MutexSafeWrapper safeMutex(mutexDeferredAdds,CODE_AT_LINE);
+		deferAdds = value;
+	}
+	if(value == false) {
+		flushDeferredAdds();
+	}
+}
+
+// Writes the queued lines to the log file and shows the last of them
+void Logger::flushDeferredAdds() {
+	vector<pair<string,string> > lines;
+	{
+		MutexSafeWrapper safeMutex(mutexDeferredAdds,CODE_AT_LINE);
+		lines.swap(deferredAdds);
+	}
+	if(lines.empty() == true) {
+		return;
+	}
+
+#ifdef WIN32
+	FILE *f= _wfopen(utf8_decode(fileName).c_str(), L"at+");
+#else
+	FILE *f = fopen(fileName.c_str(), "at+");
+#endif
+	if(f != NULL) {
+		for(unsigned int i = 0; i < lines.size(); ++i) {
+			fprintf(f, "%s\n", lines[i].first.c_str());
+		}
+		fclose(f);
+	}
+	this->current= lines.back().first;
+	this->statusText = lines.back().second;
+
+	if(GlobalStaticFlags::getIsNonGraphicalModeEnabled() == false) {
+		renderLoadingScreen();
+	}
+}
+
 void Logger::clear() {
     string s = "Log file\n";
 
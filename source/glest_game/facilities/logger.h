@@ -19,6 +19,7 @@
 
 #include <string>
 #include <deque>
+#include <vector>
 
 #include "texture.h"
 #include "properties.h"
@@ -27,8 +28,11 @@
 
 using std::string;
 using std::deque;
+using std::vector;
+using std::pair;
 using Shared::Graphics::Texture2D;
 using Shared::Util::Properties;
+using Shared::Platform::Mutex;
 
 namespace Glest{ namespace Game{
 
@@ -63,6 +67,12 @@ private:
 	Vec4f displayColor;
 	GraphicButton buttonNextHint;
 
+	// lines added by loading threads, the thread rendering the loading
+	// screen writes them out in flushDeferredAdds
+	Mutex *mutexDeferredAdds;
+	bool deferAdds;
+	vector<pair<string,string> > deferredAdds;
+
 private:
 	Logger();
 	~Logger();
@@ -81,6 +91,8 @@ public:
     void hideProgress() { showProgressBar = false;}
 
 	void add(const string str, bool renderScreen= false, const string statusText="");
+	void setDeferAdds(bool value);
+	void flushDeferredAdds();
 	void loadLoadingScreen(string filepath);
 	void loadGameHints(string filePathEnglish,string filePathTranslation,bool clearList);
 	void renderLoadingScreen();
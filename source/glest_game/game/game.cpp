@@ -76,8 +76,6 @@ Game::Game() : ProgramState(NULL) {
 	updateFps=0;
 	lastUpdateFps=0;
 	avgUpdateFps=0;
-	framesToCatchUpAsClient=0;
-	framesToSlowDownAsClient=0;
 	totalRenderFps=0;
 	renderFps=0;
 	lastRenderFps=0;
@@ -171,11 +169,6 @@ Game::Game() : ProgramState(NULL) {
 	quitGameCalled = false;
 	disableSpeedChange = false;
 
-	for( int i=0;i<GameConstants::networkSmoothInterval;i++){
-		receivedTooEarlyInFrames[i]=-1;
-		framesNeededToWaitForServerMessage[i]=-1;
-	}
-
 	fadeMusicMilliseconds = Config::getInstance().getInt("GameStartStopFadeSoundMilliseconds",intToStr(fadeMusicMilliseconds).c_str());
 	GAME_STATS_DUMP_INTERVAL = Config::getInstance().getInt("GameStatsDumpIntervalSeconds",intToStr(GAME_STATS_DUMP_INTERVAL).c_str());
 }
@@ -248,8 +241,6 @@ void Game::resetMembers() {
 	updateFps=0;
 	renderFps=0;
 	lastUpdateFps=0;
-	framesToCatchUpAsClient=0;
-	framesToSlowDownAsClient=0;
 	lastRenderFps=-1;
 	avgUpdateFps=-1;
 	avgRenderFps=-1;
@@ -287,11 +278,6 @@ void Game::resetMembers() {
 	quitGameCalled = false;
 	disableSpeedChange = false;
 
-	for( int i=0;i<GameConstants::networkSmoothInterval;i++){
-		receivedTooEarlyInFrames[i]=-1;
-		framesNeededToWaitForServerMessage[i]=-1;
-	}
-
 
 	fadeMusicMilliseconds = Config::getInstance().getInt("GameStartStopFadeSoundMilliseconds",intToStr(fadeMusicMilliseconds).c_str());
 	GAME_STATS_DUMP_INTERVAL = Config::getInstance().getInt("GameStatsDumpIntervalSeconds",intToStr(GAME_STATS_DUMP_INTERVAL).c_str());
@@ -1748,17 +1734,14 @@ void Game::processNetworkSynchChecksIfRequired() {
 				for(int index = 0; index < GameConstants::maxPlayers; ++index) {
 					if(index < world.getFactionCount()) {
 						Faction *faction = world.getFaction(index);
-						netIntf->setNetworkPlayerFactionCRC(index,faction->getCRC().getSum());
+						netIntf->setNetworkPlayerFactionCRC(index,faction->updateSynchDigest());
 
-						if(settings != NULL) {
-							if(isFlagType1BitEnabled(ft1_network_synch_checks_verbose) == true) {
-								faction->addCRC_DetailsForWorldFrame(world.getFrameCount(),role == nrServer);
-							}
-							else if(isFlagType1BitEnabled(ft1_network_synch_checks) == true &&
-									world.getFrameCount() % 20 == 0) {
-								faction->addCRC_DetailsForWorldFrame(world.getFrameCount(),role == nrServer);
-							}
+						// the text details are only built in verbose mode, the
+						// binary digests are kept every frame
+						if(isFlagType1BitEnabled(ft1_network_synch_checks_verbose) == true) {
+							faction->addCRC_DetailsForWorldFrame(world.getFrameCount(),role == nrServer);
 						}
+						faction->addSynchDigestsForWorldFrame(world.getFrameCount(),role == nrServer);
 					}
 					else {
 						netIntf->setNetworkPlayerFactionCRC(index,0);
@@ -1860,110 +1843,19 @@ void Game::update() {
 		chronoGamePerformanceCounts.start();
 		bool enableServerControlledAI 	= this->gameSettings.getEnableServerControlledAI();
 
-		if(role == nrClient && updateLoops == 1 && world.getFrameCount() >= (gameSettings.getNetworkFramePeriod() * 2) ) {
+		if(role == nrClient) {
 			ClientInterface *clientInterface = dynamic_cast<ClientInterface *>(networkManager.getClientInterface());
 			if(clientInterface != NULL) {
-				uint64 lastNetworkFrameFromServer = clientInterface->getCachedLastPendingFrameCount();
-
-				/////////////////////////////////
-				// TTTT new attempt to make things smoother:
-				///////////////
-
-				////////////////////////////////////////////
-				//get stats of received/waiting for packages
-				////////////////////////////////////////////
-				// calculate current receive Index slot:
-				int index = ((world.getFrameCount()
-						- (world.getFrameCount()
-								% gameSettings.getNetworkFramePeriod()))
-								/ gameSettings.getNetworkFramePeriod())
-						% GameConstants::networkSmoothInterval;
-
-				// clean the next frame slot
-				receivedTooEarlyInFrames[(index+1)%GameConstants::networkSmoothInterval]=-1;
-				framesNeededToWaitForServerMessage[(index+1)%GameConstants::networkSmoothInterval]=-1;
-
-				if(receivedTooEarlyInFrames[index]==-1){
-					// we need to check if we already received something for next frame
-					if(lastNetworkFrameFromServer > 0 && lastNetworkFrameFromServer > (uint64)world.getFrameCount()) {
-						receivedTooEarlyInFrames[index]= lastNetworkFrameFromServer-world.getFrameCount();
-					}
-				}
-				if(framesNeededToWaitForServerMessage[index]==-1){
-					// calc time waiting for message in milliseconds to frames
-					int64 timeClientWaitedForLastMessage=clientInterface->getTimeClientWaitedForLastMessage();
-					if(timeClientWaitedForLastMessage>0){
-						if(SystemFlags::VERBOSE_MODE_ENABLED) printf("world.getFrameCount():%d index %d Client waited:%d ms\n",world.getFrameCount(),index,(int)timeClientWaitedForLastMessage);
-						framesNeededToWaitForServerMessage[index]=timeClientWaitedForLastMessage*GameConstants::updateFps/1000;
-						if(SystemFlags::VERBOSE_MODE_ENABLED) printf("ClienttimeClientWaitedForLastMessage:%d ms  which is %d frames \n",(int)timeClientWaitedForLastMessage,framesNeededToWaitForServerMessage[index]);
-					}
-					else {
-						framesNeededToWaitForServerMessage[index]=0;
-					}
-				}
-
-				////////////////////////////////////////////
-				//use the recorded stats of received/waiting for packages
-				////////////////////////////////////////////
-				//lets see if the client is in front and had to wait for messages ...
-
-				//lets see if all last recorded frames where received too early
-				int minimum=0;
-				int allowedMaxFallback=5;
-				int countOfMessagesReceivedTooEarly=0;
-				int countOfMessagesReceivedTooLate=0;
-				int sumOfTooLateFrames=0;
-				bool cleanupStats=false;
-
-				for( int i=0;i<GameConstants::networkSmoothInterval;i++){
-					if(receivedTooEarlyInFrames[i]>allowedMaxFallback){
-						countOfMessagesReceivedTooEarly++;
-						if ( minimum == 0 || minimum > receivedTooEarlyInFrames[i]  ){
-							minimum=receivedTooEarlyInFrames[i];
-						}
-					}
-					if(framesNeededToWaitForServerMessage[i]>0){
-						countOfMessagesReceivedTooLate++;
-						sumOfTooLateFrames+=framesNeededToWaitForServerMessage[i];
-					}
-				}
-
-				if( countOfMessagesReceivedTooEarly==GameConstants::networkSmoothInterval-1 ) // -1 because slot for next frame is already initialized
-				{// all packages where too early
-					// we catch up the minimum-catchupInterval of what we recorded
-					framesToCatchUpAsClient=minimum-allowedMaxFallback;
-					framesToSlowDownAsClient=0;
-					cleanupStats=true;
-					if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will speed up: %d frames\n",world.getFrameCount(),framesToCatchUpAsClient);
-				}
-				else if(countOfMessagesReceivedTooLate>3){
-					framesToSlowDownAsClient=sumOfTooLateFrames/countOfMessagesReceivedTooLate;
-					framesToCatchUpAsClient=0;
-					cleanupStats=true;
-					if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will slow down: %d frames\n",world.getFrameCount(),framesToSlowDownAsClient);
-				}
-
-				if(cleanupStats==true) {
-					// Once we decided to use the stats to do some correction, we reset/cleanup our recorded stats
-					for( int i=0;i<GameConstants::networkSmoothInterval;i++){
-						receivedTooEarlyInFrames[i]=-1;
-						framesNeededToWaitForServerMessage[i]=-1;
-					}
-				}
+				updateLoops = clientInterface->getFrameScheduler()->getClientUpdateLoops(
+						updateLoops, world.getFrameCount(), gameSettings.getNetworkFramePeriod(),
+						clientInterface->getCachedLastPendingFrameCount(),
+						clientInterface->getTimeClientWaitedForLastMessage());
 			}
 		}
-		// if game is paused don't try to catch up
-		if(updateLoops > 0) {
-			// we catch up a bit smoother with updateLoops = 2
-			if(framesToCatchUpAsClient>0)
-			{
-					updateLoops = 2;
-					framesToCatchUpAsClient=framesToCatchUpAsClient-1;
-			}
-			if(framesToSlowDownAsClient>0)
-			{// slowdown still the hard way.
-				updateLoops = 0;
-				framesToSlowDownAsClient=framesToSlowDownAsClient-1;
+		else if(role == nrServer) {
+			ServerInterface *server = dynamic_cast<ServerInterface *>(networkManager.getServerInterface());
+			if(server != NULL) {
+				updateLoops = server->getAdaptiveUpdateLoops(updateLoops, world.getFrameCount());
 			}
 		}
 
@@ -2340,6 +2232,14 @@ void Game::update() {
 			}
 
 			ServerInterface *server = NetworkManager::getInstance().getServerInterface();
+
+			// a spectator joined the relay, it starts from a saved game of this frame
+			SpectatorRelay *spectatorRelay = server->getSpectatorRelay();
+			if(spectatorRelay != NULL && spectatorRelay->getSavedGameRequested() == true) {
+				string file = this->saveGame(GameConstants::saveSpectatorGameFileServer,"temp/");
+				spectatorRelay->publishSavedGame(world.getFrameCount(),file);
+			}
+
 			if(server->getPauseForInGameConnection() == true) {
 
 				bool clientNeedsGameSetup = false;
@@ -5059,19 +4959,22 @@ void Game::DumpCRCWorldLogIfRequired(string fileSuffix) {
 		if(settings != NULL &&
 				(isFlagType1BitEnabled(ft1_network_synch_checks_verbose)  == true ||
 				 isFlagType1BitEnabled(ft1_network_synch_checks) 			== true)) {
-			string debugCRCWorldLogFile = Config::getInstance().getString("DebugCRCWorldLogFile","debugCRCWorld.log");
-			debugCRCWorldLogFile += fileSuffix;
-
-			if(getGameReadWritePath(GameConstants::path_logs_CacheLookupKey) != "") {
-				debugCRCWorldLogFile = getGameReadWritePath(GameConstants::path_logs_CacheLookupKey) + debugCRCWorldLogFile;
-			}
-			else {
-				string userData = Config::getInstance().getString("UserData_Root","");
-				if(userData != "") {
-					endPathWithSlash(userData);
+			string debugCRCWorldLogPath = getGameReadWritePath(GameConstants::path_logs_CacheLookupKey);
+			if(debugCRCWorldLogPath == "") {
+				debugCRCWorldLogPath = Config::getInstance().getString("UserData_Root","");
+				if(debugCRCWorldLogPath != "") {
+					endPathWithSlash(debugCRCWorldLogPath);
 				}
-				debugCRCWorldLogFile = userData + debugCRCWorldLogFile;
 			}
+			string debugCRCWorldLogFile = debugCRCWorldLogPath +
+					Config::getInstance().getString("DebugCRCWorldLogFile","debugCRCWorld.log") + fileSuffix;
+
+			// per unit digests of the last frames, compare the files of two
+			// players with --desync-bisect
+			string debugCRCWorldDigestFile = debugCRCWorldLogPath +
+					Config::getInstance().getString("DebugCRCWorldDigestFile","debugCRCWorld.digests") + fileSuffix;
+			printf("Save to log debugCRCWorldDigestFile = %s\n",debugCRCWorldDigestFile.c_str());
+			SynchDigestLog::save(debugCRCWorldDigestFile,&world);
 
 			printf("Save to log debugCRCWorldLogFile = %s\n",debugCRCWorldLogFile.c_str());
 
@@ -5315,9 +5218,10 @@ string Game::getDebugStats(std::map<int,string> &factionDebugInfo) {
 		str+= "Log buffer count: " + intToStr(SystemFlags::getLogEntryBufferCount())+"\n";
 	}
 
-	str+= "UnitRangeCellsLookupItemCache: " + world.getUnitUpdater()->getUnitRangeCellsLookupItemCacheStats()+"\n";
+	str+= "UnitIndex: " + world.getUnitIndexStats()+"\n";
+	str+= "UnitRangeQueries: " + world.getUnitUpdater()->getUnitRangeQueryStats()+"\n";
 	str+= "ExploredCellsLookupItemCache: " 	+ world.getExploredCellsLookupItemCacheStats()+"\n";
-	str+= "FowAlphaCellsLookupItemCache: "  + world.getFowAlphaCellsLookupItemCacheStats()+"\n";
+	str+= "SightStencilCache: "  + world.getSightStencilCacheStats()+"\n";
 
 	const string selectionType = toLower(Config::getInstance().getString("SelectionType",Config::colorPicking));
 	str += "Selection type: " + toLower(selectionType) + "\n";
@@ -6468,7 +6372,14 @@ string Game::saveGame(string name, string path) {
 	rootNode->addAttribute("version",glestVersionString, mapTagReplacements);
 	rootNode->addAttribute("timestamp",szBuf, mapTagReplacements);
 
+	// the binary form is a fraction of the size and faster to load, for
+	// servers that save often. Loading reads both forms the same way.
+	XmlSaveFormat saveFormat = (config.getBool("SaveGameBinary","false") == true ? xsfBinary : xsfXml);
+
 	XmlNode *gameNode = rootNode->addChild("Game");
+	// the parts of the game are written out once they are complete, past
+	// a megabyte to temporary files the save copies into the saved game
+	gameNode->setStreamChildren(true, saveFormat);
 	//World world;
 	world.saveGame(gameNode);
     //AiInterfaces aiInterfaces;
@@ -6614,7 +6525,9 @@ string Game::saveGame(string name, string path) {
 
 	gameNode->addAttribute("disableSpeedChange",intToStr(disableSpeedChange), mapTagReplacements);
 
-	xmlTree.save(saveGameFile);
+	Chrono chronoSave(true);
+	xmlTree.save(saveGameFile, saveFormat);
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s] Line: %d writing saved game [%s] binary = %d took msecs: %lld\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,saveGameFile.c_str(),(saveFormat == xsfBinary),(long long int)chronoSave.getMillis());
 
 	if(masterserverMode == false) {
 		// take Screenshot
@@ -6695,8 +6608,10 @@ void Game::loadGame(string name,Program *programPtr,bool isMasterserverMode,cons
 	XmlTree	xmlTree(XML_RAPIDXML_ENGINE);
 
 	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Before load of XML\n");
+	Chrono chronoLoad(true);
 	std::map<string,string> mapExtraTagReplacementValues;
 	xmlTree.load(name, Properties::getTagReplacementValues(&mapExtraTagReplacementValues),true);
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s] Line: %d reading saved game [%s] took msecs: %lld\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,name.c_str(),(long long int)chronoLoad.getMillis());
 	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("After load of XML\n");
 
 	const XmlNode *rootNode= xmlTree.getRootNode();
@@ -88,10 +88,6 @@ private:
     Vec2i mouseCellPos;
 
 	int updateFps, lastUpdateFps, avgUpdateFps;
-	int framesToCatchUpAsClient;
-	int framesToSlowDownAsClient;
-	int receivedTooEarlyInFrames[GameConstants::networkSmoothInterval];
-	int framesNeededToWaitForServerMessage[GameConstants::networkSmoothInterval];
 	int totalRenderFps, renderFps, lastRenderFps, avgRenderFps,currentAvgRenderFpsTotal;
 	uint64 tickCount;
 	bool paused;
@@ -212,7 +208,6 @@ private:
 	bool quitGameCalled;
 	bool disableSpeedChange;
 
-	std::map<int,FowAlphaCellsLookupItem> teamFowAlphaCellsLookupItem;
 	std::map<string,int64> gamePerformanceCounts;
 
 	bool networkPauseGameForLaggedClientsRequested;
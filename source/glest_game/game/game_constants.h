@@ -126,6 +126,8 @@ public:
 	static const int maxPlayers						= 8;
 	static const int serverPort						= 61357;
 	static const int serverAdminPort				= 61355;
+	static const int spectatorRelayPort				= 61356;
+	static const int contentTransferPort			= 61354;
 	static int updateFps;
 	static int cameraFps;
 
@@ -164,6 +166,7 @@ public:
 	
 	static const char *saveNetworkGameFileServerCompressed;
 	static const char *saveNetworkGameFileServer;
+	static const char *saveSpectatorGameFileServer;
 	static const char *saveNetworkGameFileClientCompressed;
 	static const char *saveNetworkGameFileClient;
 	static const char *saveGameFileDefault;
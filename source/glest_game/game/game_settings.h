@@ -67,8 +67,11 @@ enum FlagTypes1 {
     ft1_network_synch_checks_verbose 	= 0x08,
     ft1_network_synch_checks 			= 0x10,
     ft1_allow_shared_team_units         = 0x20,
-    ft1_allow_shared_team_resources     = 0x40
-    //ft1_xxx = 0x80
+    ft1_allow_shared_team_resources     = 0x40,
+    ft1_hierarchical_pathfinding        = 0x80,
+    ft1_pathfinder_region_checks        = 0x100,
+    ft1_flow_field_group_moves          = 0x200
+    //ft1_xxx = 0x400
 };
 
 inline static bool isFlagType1BitEnabled(uint32 flagValue,FlagTypes1 type) {
@@ -71,6 +71,7 @@ const char *GameConstants::path_ini_CacheLookupKey      = "ini";
 const char *GameConstants::path_logs_CacheLookupKey     = "logs";
 
 const char *GameConstants::saveNetworkGameFileServer			= "megaglest-saved-server.xml";
+const char *GameConstants::saveSpectatorGameFileServer			= "megaglest-saved-spectator.xml";
 const char *GameConstants::saveNetworkGameFileServerCompressed 	= "megaglest-saved-server.zip";
 
 const char *GameConstants::saveNetworkGameFileClient			= "megaglest-saved-client.xml";
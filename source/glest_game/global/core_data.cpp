@@ -1545,6 +1545,30 @@ bool CoreData::loadGameSettingsFromFile(std::string fileName, GameSettings *game
         gameSettings->setFlagTypes1(valueFlags1);
 
 	}
+	if(Config::getInstance().getBool("EnableHierarchicalPathfinding","false") == true) {
+        valueFlags1 |= ft1_hierarchical_pathfinding;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_hierarchical_pathfinding;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	if(Config::getInstance().getBool("EnablePathfinderRegionChecks","true") == true) {
+        valueFlags1 |= ft1_pathfinder_region_checks;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_pathfinder_region_checks;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	if(Config::getInstance().getBool("EnableFlowFieldGroupMoves","true") == true) {
+        valueFlags1 |= ft1_flow_field_group_moves;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_flow_field_group_moves;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
 
 
 	gameSettings->setEnableObserverModeAtEndGame(properties.getBool("EnableObserverModeAtEndGame"));
@@ -45,6 +45,12 @@ Lang::Lang() {
 	is_utf8_language 			= false;
 	allowNativeLanguageTechtree = true;
 	techNameLoaded				= "";
+	mutexStrings				= new Mutex(CODE_AT_LINE);
+}
+
+Lang::~Lang() {
+	delete mutexStrings;
+	mutexStrings = NULL;
 }
 
 Lang &Lang::getInstance() {
@@ -425,6 +431,7 @@ void Lang::loadTilesetStrings(string tileset) {
 }
 
 bool Lang::hasString(const string &s, string uselanguage, bool fallbackToDefault) {
+	MutexSafeWrapper safeMutex(mutexStrings,CODE_AT_LINE);
 	bool result = false;
 	try {
 		if(uselanguage != "") {
@@ -472,6 +479,7 @@ string Lang::parseResult(const string &key, const string &value) {
 	return result;
 }
 string Lang::getString(const string &s, string uselanguage, bool fallbackToDefault) {
+	MutexSafeWrapper safeMutex(mutexStrings,CODE_AT_LINE);
 	try {
 		string result = "";
 
@@ -539,6 +547,7 @@ bool Lang::hasScenarioString(const string &s) {
 }
 
 string Lang::getTechTreeString(const string &s,const char *defaultValue) {
+	MutexSafeWrapper safeMutex(mutexStrings,CODE_AT_LINE);
 	try{
 		string result = "";
 		string default_language = "default";
@@ -18,11 +18,13 @@
 #endif
 
 #include "properties.h"
+#include "thread.h"
 #include "leak_dumper.h"
 
 namespace Glest{ namespace Game{
 
 using Shared::Util::Properties;
+using Shared::Platform::Mutex;
 
 // =====================================================
 // 	class Lang
@@ -46,8 +48,13 @@ private:
 	string techNameLoaded;
 	bool allowNativeLanguageTechtree;
 
+	// string lookups may add missing languages, they also come from the
+	// threads loading a tech tree
+	Mutex *mutexStrings;
+
 private:
 	Lang();
+	~Lang();
 	void loadGameStringProperties(string language, Properties &properties, bool fileMustExist,bool fallbackToDefault=false);
 	bool fileMatchesISO630Code(string uselanguage, string testLanguageFile);
 	string getNativeLanguageName(string uselanguage, string testLanguageFile);
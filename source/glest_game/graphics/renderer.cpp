@@ -893,6 +893,22 @@ void Renderer::endLastTexture(ResourceScope rs, bool mustExistInList) {
 	textureManager[rs]->endLastTexture(mustExistInList);
 }
 
+void Renderer::beginDeferredLoading(ResourceScope rs) {
+	if(GlobalStaticFlags::getIsNonGraphicalModeEnabled() == true) {
+		return;
+	}
+
+	textureManager[rs]->beginDeferredLoading();
+}
+
+void Renderer::endDeferredLoading(ResourceScope rs) {
+	if(GlobalStaticFlags::getIsNonGraphicalModeEnabled() == true) {
+		return;
+	}
+
+	textureManager[rs]->endDeferredLoading();
+}
+
 Model *Renderer::newModel(ResourceScope rs,const string &path,bool deletePixMapAfterLoad,std::map<string,vector<pair<string, string> > > *loadedFileList, string *sourceLoader){
 	if(GlobalStaticFlags::getIsNonGraphicalModeEnabled() == true) {
 		return NULL;
@@ -457,6 +457,10 @@ public:
 	void initTexture(ResourceScope rs, Texture *texture);
 	void endTexture(ResourceScope rs, Texture *texture,bool mustExistInList=false);
 	void endLastTexture(ResourceScope rs, bool mustExistInList=false);
+	// lets loading threads create models and textures of the scope, their
+	// uploads run on this thread when the deferred loading ends
+	void beginDeferredLoading(ResourceScope rs);
+	void endDeferredLoading(ResourceScope rs);
 
 	Model *newModel(ResourceScope rs,const string &path,bool deletePixMapAfterLoad=false,std::map<string,vector<pair<string, string> > > *loadedFileList=NULL, string *sourceLoader=NULL);
 	void endModel(ResourceScope rs, Model *model, bool mustExistInList=false);
@@ -70,6 +70,7 @@
 
 #ifndef WIN32
   #include <poll.h>
+  #include <sys/resource.h>
 
   #define stricmp strcasecmp
   #define strnicmp strncasecmp
@@ -79,6 +80,8 @@
 #include <stdlib.h>
 #include "network_message.h"
 #include "network_protocol.h"
+#include "network_frame_scheduler.h"
+#include "unit_synch_digest.h"
 #include "conversion.h"
 #include "gen_uuid.h"
 #include "leak_dumper.h"
@@ -270,6 +273,8 @@ static void cleanupProcessObjects() {
 
 	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
 
+	Checksum::saveFileIndex();
+
 	SystemFlags::globalCleanupHTTP();
 	CacheManager::cleanupMutexes();
 }
@@ -3516,6 +3521,548 @@ int handleCreateDataArchivesCommand(int argc, char** argv) {
 	return return_value;
 }
 
+// Replays the commands of a recorded game through both command list formats,
+// one list per network keyframe like the server sends them
+int handleCommandListSizeBenchmarkCommand(int argc, char** argv) {
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex < 0) {
+		hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]),&foundParamIndIndex);
+	}
+
+	string paramValue = argv[foundParamIndIndex];
+	vector<string> paramPartTokens;
+	Tokenize(paramValue,paramPartTokens,"=");
+	if(paramPartTokens.size() < 2 || paramPartTokens[1].length() == 0) {
+		printf("\nInvalid missing replay file specified on commandline [%s]\n\n",argv[foundParamIndIndex]);
+		return 1;
+	}
+	string replayFile = paramPartTokens[1];
+	if(fileExists(replayFile) == false) {
+		printf("Replay file [%s] was NOT FOUND\n",replayFile.c_str());
+		return 1;
+	}
+
+	XmlTree xmlTree(XML_RAPIDXML_ENGINE);
+	std::map<string,string> mapExtraTagReplacementValues;
+	xmlTree.load(replayFile, Properties::getTagReplacementValues(&mapExtraTagReplacementValues),true);
+	const XmlNode *gameNode = xmlTree.getRootNode()->getChild("Game");
+
+	GameSettings replaySettings;
+	replaySettings.loadGame(gameNode);
+	int networkFramePeriod = max(1,replaySettings.getNetworkFramePeriod());
+	int lastWorldFrameCount = gameNode->getAttribute("LastWorldFrameCount")->getIntValue();
+
+	std::map<int,vector<NetworkCommand> > commandsForFrame;
+	for(int frame = 0; frame <= lastWorldFrameCount; frame += networkFramePeriod) {
+		commandsForFrame[frame].clear();
+	}
+	vector<XmlNode *> networkCommandNodeList = gameNode->getChildList("NetworkCommand");
+	for(unsigned int i = 0; i < networkCommandNodeList.size(); ++i) {
+		NetworkCommand command;
+		command.loadGame(networkCommandNodeList[i]);
+		commandsForFrame[networkCommandNodeList[i]->getAttribute("worldFrameCount")->getIntValue()].push_back(command);
+	}
+
+	// index 0 is a normal game, index 1 has network synch checks on
+	uint64 fixedBytes[2] = { 0, 0 };
+	uint64 compactBytes[2] = { 0, 0 };
+	int mismatchCount = 0;
+	for(std::map<int,vector<NetworkCommand> >::iterator iterMap = commandsForFrame.begin();
+		iterMap != commandsForFrame.end(); ++iterMap) {
+		for(int withCRC = 0; withCRC <= 1; ++withCRC) {
+			NetworkMessageCommandList commandList(iterMap->first);
+			for(unsigned int i = 0; i < iterMap->second.size(); ++i) {
+				commandList.addCommand(&iterMap->second[i]);
+			}
+			for(int index = 0; withCRC == 1 && index < replaySettings.getFactionCount(); ++index) {
+				commandList.setNetworkPlayerFactionCRC(index,(iterMap->first + 1) * 2654435761u + index);
+			}
+
+			std::vector<unsigned char> buf;
+			commandList.packCompact(buf);
+			fixedBytes[withCRC] += commandList.getFixedSizeByteCount();
+			compactBytes[withCRC] += buf.size();
+
+			NetworkMessageCommandList decodedList;
+			if(decodedList.unpackCompact(&buf[0],(unsigned int)buf.size()) == false ||
+				decodedList.getCommandCount() != commandList.getCommandCount()) {
+				mismatchCount++;
+				continue;
+			}
+			for(int i = 0; i < commandList.getCommandCount(); ++i) {
+				if(decodedList.getCommand(i)->toString() != commandList.getCommand(i)->toString()) {
+					mismatchCount++;
+					break;
+				}
+			}
+		}
+	}
+
+	printf("Replay [%s] frames: %d network frame period: %d command lists: " MG_SIZE_T_SPECIFIER " commands: " MG_SIZE_T_SPECIFIER "\n",
+			replayFile.c_str(),lastWorldFrameCount,networkFramePeriod,commandsForFrame.size(),networkCommandNodeList.size());
+	for(int withCRC = 0; withCRC <= 1; ++withCRC) {
+		printf("%s fixed size bytes: %s compact bytes: %s (%.1f%%)\n",
+				(withCRC == 1 ? "With synch checks:   " : "Without synch checks:"),
+				formatNumber(fixedBytes[withCRC]).c_str(),formatNumber(compactBytes[withCRC]).c_str(),
+				(fixedBytes[withCRC] > 0 ? (double)compactBytes[withCRC] * 100.0 / (double)fixedBytes[withCRC] : 0.0));
+	}
+	if(mismatchCount > 0) {
+		printf("ERROR: %d command lists did not decode to the original commands!\n",mismatchCount);
+		return 1;
+	}
+	return 0;
+}
+
+// Every frame each loopback client sends one message and the server side
+// finds and reads all of them, once polling every socket with select() like
+// the slot threads do and once with the epoll socket reactor reading all
+// sockets into their receive buffers like the server's reactor thread does
+int handleServerSocketBenchmarkCommand(int argc, char** argv) {
+	int clientCount = 8;
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_SERVER_SOCKETS]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex >= 0) {
+		vector<string> paramPartTokens;
+		Tokenize(argv[foundParamIndIndex],paramPartTokens,"=");
+		if(paramPartTokens.size() >= 2 && paramPartTokens[1].length() > 0) {
+			clientCount = strToInt(paramPartTokens[1]);
+		}
+	}
+	if(clientCount < 1 || clientCount > GameConstants::maxPlayers) {
+		printf("\nInvalid client count specified on commandline [%d], use 1 to %d\n\n",clientCount,GameConstants::maxPlayers);
+		return 1;
+	}
+
+	const int benchmarkPort = GameConstants::serverPort + 100;
+	const int frameCount = 2000;
+	const int messageSize = 64;
+
+	ServerSocket serverSocket(true);
+	serverSocket.setBindSpecificAddress("127.0.0.1");
+	serverSocket.setBindPort(benchmarkPort);
+	serverSocket.listen(clientCount);
+
+	vector<ClientSocket *> clients;
+	vector<Socket *> connections;
+	std::map<PLATFORM_SOCKET,int> connectionIndexes;
+	for(int index = 0; index < clientCount; ++index) {
+		ClientSocket *client = new ClientSocket();
+		client->connect(Ip("127.0.0.1"),benchmarkPort);
+		clients.push_back(client);
+
+		Socket *connection = NULL;
+		for(Chrono waitForConnect(true); connection == NULL && waitForConnect.getMillis() < 5000;) {
+			if(serverSocket.hasDataToReadWithWait(100000) == true) {
+				connection = serverSocket.accept(false);
+			}
+		}
+		if(connection == NULL) {
+			printf("Loopback client %d could not connect on port %d\n",index,benchmarkPort);
+			return 1;
+		}
+		connection->setBlock(false);
+		connection->setReceiveBufferSize(65536);
+		connections.push_back(connection);
+		connectionIndexes[connection->getSocketId()] = index;
+	}
+
+	char message[messageSize];
+	memset(message,1,messageSize);
+	char buf[messageSize];
+
+	const char *modeNames[] = { "select() per socket", "epoll socket reactor" };
+	for(int mode = 0; mode <= 1; ++mode) {
+		SocketReactor socketReactor;
+		if(mode == 1) {
+			if(socketReactor.isValid() == false) {
+				printf("%s: not supported on this platform\n",modeNames[mode]);
+				break;
+			}
+			for(int index = 0; index < clientCount; ++index) {
+				socketReactor.addSocket(connections[index]->getSocketId());
+			}
+		}
+
+		int64 totalMicros = 0;
+		int64 maxMicros = 0;
+		for(int frame = 0; frame < frameCount; ++frame) {
+			Chrono chrono(true);
+			for(int index = 0; index < clientCount; ++index) {
+				clients[index]->send(message,messageSize);
+			}
+
+			int receivedCount = 0;
+			vector<bool> received(clientCount,false);
+			std::vector<PLATFORM_SOCKET> readyList;
+			std::vector<PLATFORM_SOCKET> stillReadyList;
+			for(;receivedCount < clientCount;) {
+				if(mode == 0) {
+					for(int index = 0; index < clientCount; ++index) {
+						if(received[index] == false &&
+							Socket::hasDataToReadWithWait(connections[index]->getSocketId(),1000) == true) {
+							connections[index]->receive(buf,messageSize,true);
+							received[index] = true;
+							receivedCount++;
+						}
+					}
+				}
+				else {
+					socketReactor.waitForData(readyList,(stillReadyList.empty() == true ? 1 : 0));
+					readyList.insert(readyList.end(),stillReadyList.begin(),stillReadyList.end());
+					stillReadyList.clear();
+					for(unsigned int readyIndex = 0; readyIndex < readyList.size(); ++readyIndex) {
+						int index = connectionIndexes[readyList[readyIndex]];
+						connections[index]->readAvailableData();
+						if(received[index] == false &&
+							connections[index]->getBufferedDataSize() >= messageSize) {
+							connections[index]->receive(buf,messageSize,true);
+							received[index] = true;
+							receivedCount++;
+						}
+						if(socketReactor.setDataProcessed(readyList[readyIndex]) == true) {
+							stillReadyList.push_back(readyList[readyIndex]);
+						}
+					}
+				}
+			}
+
+			int64 micros = chrono.getMicros();
+			totalMicros += micros;
+			maxMicros = max(maxMicros,micros);
+		}
+		printf("%s: %d clients %d frames average %.1f us max " MG_I64_SPECIFIER " us per frame\n",
+				modeNames[mode],clientCount,frameCount,(double)totalMicros / (double)frameCount,maxMicros);
+	}
+
+	for(int index = 0; index < clientCount; ++index) {
+		delete connections[index];
+		delete clients[index];
+	}
+	return 0;
+}
+
+// A client following a server over a link with the given delay and jitter,
+// played out on a simulated clock so two minutes of game take no time and
+// both schedulers see exactly the same command list arrivals. The client
+// blocks at a keyframe whose command list has not arrived yet, like
+// ClientInterface::getNetworkCommand does.
+int handleNetworkJitterBenchmarkCommand(int argc, char** argv) {
+	int delayMillis = 60;
+	int jitterMillis = 40;
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_NETWORK_JITTER]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex >= 0) {
+		vector<string> paramPartTokens;
+		Tokenize(argv[foundParamIndIndex],paramPartTokens,"=");
+		if(paramPartTokens.size() >= 2 && paramPartTokens[1].length() > 0) {
+			vector<string> valueTokens;
+			Tokenize(paramPartTokens[1],valueTokens,",");
+			delayMillis = strToInt(valueTokens[0]);
+			if(valueTokens.size() >= 2) {
+				jitterMillis = strToInt(valueTokens[1]);
+			}
+		}
+	}
+	if(delayMillis < 0 || jitterMillis < 0) {
+		printf("\nInvalid delay [%d] or jitter [%d] specified on commandline\n\n",delayMillis,jitterMillis);
+		return 1;
+	}
+
+	const int framePeriod = GameConstants::networkFramePeriod;
+	const int frameCount = GameConstants::updateFps * 120;
+	const double frameMillis = 1000.0 / GameConstants::updateFps;
+
+	// the server sends the list for a keyframe when it reaches it, a few
+	// lists get held up much longer and tcp delivers them all in order
+	RandomGen random;
+	random.init(delayMillis * 1000 + jitterMillis);
+	vector<double> arrivalMillis;
+	for(int frame = 0; frame <= frameCount + framePeriod; frame += framePeriod) {
+		double arrival = frame * frameMillis + delayMillis;
+		arrival += (jitterMillis > 0 ? random.randRange(0,jitterMillis) : 0);
+		if(jitterMillis > 0 && random.randRange(0,99) < 3) {
+			arrival += jitterMillis * 4;
+		}
+		if(arrivalMillis.empty() == false) {
+			arrival = max(arrival,arrivalMillis.back());
+		}
+		arrivalMillis.push_back(arrival);
+	}
+
+	const char *modeNames[] = { "legacy", "adaptive" };
+	for(int mode = 0; mode <= 1; ++mode) {
+		NetworkFrameScheduler scheduler;
+		scheduler.setMode(mode == 0 ? NetworkFrameScheduler::nfsmLegacy : NetworkFrameScheduler::nfsmAdaptive);
+
+		double now = arrivalMillis[0];
+		int frame = 0;
+		int arrivedCount = 0;
+		int64 timeWaited = 0;
+		int stallCount = 0;
+		double stallMillis = 0;
+		double maxStallMillis = 0;
+		double behindServerFrames = 0;
+		int tickCount = 0;
+		for(;frame < frameCount; ++tickCount) {
+			for(;arrivedCount < (int)arrivalMillis.size() && arrivalMillis[arrivedCount] <= now; ++arrivedCount) {
+				scheduler.addCommandListArrival(arrivedCount * framePeriod,(int64)arrivalMillis[arrivedCount]);
+			}
+			uint64 lastReceivedFrame = (arrivedCount > 0 ? (arrivedCount - 1) * framePeriod : 0);
+			behindServerFrames += now / frameMillis - frame;
+			int updateLoops = scheduler.getClientUpdateLoops(1,frame,framePeriod,lastReceivedFrame,timeWaited);
+
+			for(int loop = 0; loop < updateLoops && frame < frameCount; ++loop) {
+				if(frame % framePeriod == 0) {
+					timeWaited = 0;
+					double arrival = arrivalMillis[frame / framePeriod];
+					if(arrival > now) {
+						stallCount++;
+						stallMillis += arrival - now;
+						maxStallMillis = max(maxStallMillis,arrival - now);
+						timeWaited = (int64)(arrival - now + 0.5);
+						now = arrival;
+						for(;arrivedCount < (int)arrivalMillis.size() && arrivalMillis[arrivedCount] <= now; ++arrivedCount) {
+							scheduler.addCommandListArrival(arrivedCount * framePeriod,(int64)arrivalMillis[arrivedCount]);
+						}
+					}
+				}
+				frame++;
+			}
+			now += frameMillis;
+		}
+
+		printf("%s: delay %d ms jitter %d ms, %d frames: stalls %d stalled %.0f ms (max %.0f ms) average %.1f frames behind the server\n",
+				modeNames[mode],delayMillis,jitterMillis,frameCount,stallCount,stallMillis,maxStallMillis,
+				(tickCount > 0 ? behindServerFrames / tickCount : 0.0));
+		printf("%s: %s\n",modeNames[mode],scheduler.getStats().c_str());
+	}
+	return 0;
+}
+
+// Compares the synch digest files two players wrote at the end of an out
+// of synch game and prints the first frame, faction, unit and fields that
+// differ.
+int handleDesyncBisectCommand(int argc, char** argv) {
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_DESYNC_BISECT]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex < 0) {
+		printf("\nNo digest files specified on commandline\n\n");
+		return 1;
+	}
+	vector<string> paramPartTokens;
+	Tokenize(argv[foundParamIndIndex],paramPartTokens,"=");
+	vector<string> fileTokens;
+	if(paramPartTokens.size() >= 2) {
+		Tokenize(paramPartTokens[1],fileTokens,",");
+	}
+	if(fileTokens.size() != 2) {
+		printf("\nInvalid digest files specified on commandline [%s]\n\n",argv[foundParamIndIndex]);
+		return 1;
+	}
+
+	SynchDigestLog::FrameList frames[2];
+	for(unsigned int index = 0; index < fileTokens.size(); ++index) {
+		if(SynchDigestLog::load(fileTokens[index],frames[index]) == false) {
+			printf("\nCould not read digest file [%s]\n\n",fileTokens[index].c_str());
+			return 1;
+		}
+		printf("%s: %d world frames",fileTokens[index].c_str(),(int)frames[index].size());
+		if(frames[index].empty() == false) {
+			printf(" (%d to %d)",frames[index].begin()->first,frames[index].rbegin()->first);
+		}
+		printf("\n");
+	}
+
+	string result = SynchDigestLog::findFirstDifference(frames[0],frames[1]);
+	if(result == "") {
+		printf("\nNo difference in the world frames both files have\n\n");
+	}
+	else {
+		printf("\n%s\n",result.c_str());
+	}
+	return 0;
+}
+
+int handleConvertSavedGameCommand(int argc, char** argv) {
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_CONVERT_SAVED_GAME]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex < 0) {
+		printf("\nNo saved game files specified on commandline\n\n");
+		return 1;
+	}
+	vector<string> paramPartTokens;
+	Tokenize(argv[foundParamIndIndex],paramPartTokens,"=");
+	vector<string> fileTokens;
+	if(paramPartTokens.size() >= 2) {
+		Tokenize(paramPartTokens[1],fileTokens,",");
+	}
+	if(fileTokens.size() != 2) {
+		printf("\nInvalid saved game files specified on commandline [%s]\n\n",argv[foundParamIndIndex]);
+		return 1;
+	}
+	const string &inputFile = fileTokens[0];
+	const string &outputFile = fileTokens[1];
+
+	char fileHeader[8] = "";
+	size_t headerSize = 0;
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(inputFile).c_str(), L"rb");
+#else
+	FILE *fp = fopen(inputFile.c_str(), "rb");
+#endif
+	if(fp != NULL) {
+		headerSize = fread(fileHeader, 1, sizeof(fileHeader), fp);
+		fclose(fp);
+	}
+	if(fp == NULL || headerSize == 0) {
+		printf("\nCould not read saved game [%s]\n\n",inputFile.c_str());
+		return 1;
+	}
+	bool inputIsBinary = XmlBinaryIo::isBinaryData(fileHeader, headerSize);
+	XmlSaveFormat outputFormat = (inputIsBinary == true ? xsfXml : xsfBinary);
+
+	// no tags are replaced, the values are written back as they were
+	std::map<string,string> mapTagReplacementValues;
+	try {
+		Chrono chrono(true);
+		XmlTree xmlTree(XML_RAPIDXML_ENGINE);
+		xmlTree.load(inputFile, mapTagReplacementValues, true);
+		int64 loadMillis = chrono.getMillis();
+
+		chrono.start();
+		xmlTree.save(outputFile, outputFormat);
+		int64 saveMillis = chrono.getMillis();
+
+		chrono.start();
+		XmlTree xmlTreeOutput(XML_RAPIDXML_ENGINE);
+		xmlTreeOutput.load(outputFile, mapTagReplacementValues, true);
+		int64 reloadMillis = chrono.getMillis();
+
+		printf("%s (%s): " MG_I64_SPECIFIER " bytes, loaded in " MG_I64_SPECIFIER " msecs\n",
+				inputFile.c_str(),(inputIsBinary == true ? "binary" : "xml"),(int64)getFileSize(inputFile),loadMillis);
+		printf("%s (%s): " MG_I64_SPECIFIER " bytes, saved in " MG_I64_SPECIFIER " msecs, loaded in " MG_I64_SPECIFIER " msecs\n",
+				outputFile.c_str(),(outputFormat == xsfBinary ? "binary" : "xml"),(int64)getFileSize(outputFile),saveMillis,reloadMillis);
+	}
+	catch(const exception &ex) {
+		printf("\nCould not convert saved game [%s]: %s\n\n",inputFile.c_str(),ex.what());
+		return 1;
+	}
+	return 0;
+}
+
+// peak resident memory of the process in kilobytes, -1 where it is not known
+static int64 getPeakMemoryKilobytes() {
+#ifndef WIN32
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+		return (int64)usage.ru_maxrss / 1024;
+#else
+		return (int64)usage.ru_maxrss;
+#endif
+	}
+#endif
+	return -1;
+}
+
+// reads every text and attribute value, which replaces the tags in them
+static int64 readXmlLoadBenchmarkValues(const XmlNode *node) {
+	int64 valueCount = 1;
+	node->getText();
+	for(unsigned int i = 0; i < node->getAttributeCount(); ++i) {
+		node->getAttribute(i)->getValue();
+		valueCount++;
+	}
+	for(unsigned int i = 0; i < node->getChildCount(); ++i) {
+		valueCount += readXmlLoadBenchmarkValues(node->getChild(i));
+	}
+	return valueCount;
+}
+
+// Loads every xml file below a folder, like a tech tree, with the tag values
+// the game uses and keeps all trees until the end, so the peak memory shows
+// what the parsed trees take
+int handleXmlLoadBenchmarkCommand(int argc, char** argv) {
+	int foundParamIndIndex = -1;
+	hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]) + string("="),&foundParamIndIndex);
+	if(foundParamIndIndex < 0) {
+		hasCommandArgument(argc, argv,string(GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]),&foundParamIndIndex);
+	}
+
+	string paramValue = argv[foundParamIndIndex];
+	vector<string> paramPartTokens;
+	Tokenize(paramValue,paramPartTokens,"=");
+	if(paramPartTokens.size() < 2 || paramPartTokens[1].length() == 0) {
+		printf("\nInvalid missing folder specified on commandline [%s]\n\n",argv[foundParamIndIndex]);
+		return 1;
+	}
+	string folder = paramPartTokens[1];
+	endPathWithSlash(folder);
+	if(folderExists(folder) == false) {
+		printf("Folder [%s] was NOT FOUND\n",folder.c_str());
+		return 1;
+	}
+
+	vector<string> xmlFiles = getFolderTreeContentsListRecursively(folder + "*.", ".xml");
+	std::map<string,string> mapExtraTagReplacementValues;
+	std::map<string,string> mapTagReplacementValues = Properties::getTagReplacementValues(&mapExtraTagReplacementValues);
+
+	int64 peakMemoryBefore = getPeakMemoryKilobytes();
+	vector<XmlTree *> xmlTrees;
+	int64 totalBytes = 0;
+	int failedCount = 0;
+
+	Chrono chrono(true);
+	for(unsigned int i = 0; i < xmlFiles.size(); ++i) {
+		XmlTree *xmlTree = new XmlTree(XML_RAPIDXML_ENGINE);
+		try {
+			xmlTree->load(xmlFiles[i], mapTagReplacementValues, true, false, true);
+			xmlTrees.push_back(xmlTree);
+		}
+		catch(const exception &ex) {
+			printf("Could not load [%s]: %s\n",xmlFiles[i].c_str(),ex.what());
+			delete xmlTree;
+			failedCount++;
+		}
+	}
+	int64 loadMillis = chrono.getMillis();
+	int64 peakMemoryLoaded = getPeakMemoryKilobytes();
+
+	chrono.start();
+	int64 valueCount = 0;
+	for(unsigned int i = 0; i < xmlTrees.size(); ++i) {
+		valueCount += readXmlLoadBenchmarkValues(xmlTrees[i]->getRootNode());
+	}
+	int64 readMillis = chrono.getMillis();
+	int64 peakMemoryRead = getPeakMemoryKilobytes();
+
+	for(unsigned int i = 0; i < xmlFiles.size(); ++i) {
+		totalBytes += (int64)getFileSize(xmlFiles[i]);
+	}
+	chrono.start();
+	for(unsigned int i = 0; i < xmlTrees.size(); ++i) {
+		delete xmlTrees[i];
+	}
+	xmlTrees.clear();
+	int64 freeMillis = chrono.getMillis();
+
+	printf("Folder [%s] xml files: " MG_SIZE_T_SPECIFIER " (%s bytes), failed: %d\n",
+			folder.c_str(),xmlFiles.size(),formatNumber(totalBytes).c_str(),failedCount);
+	printf("Load time: " MG_I64_SPECIFIER " msecs, reading " MG_I64_SPECIFIER " values: " MG_I64_SPECIFIER " msecs, freeing the trees: " MG_I64_SPECIFIER " msecs\n",
+			loadMillis,valueCount,readMillis,freeMillis);
+	if(peakMemoryBefore >= 0) {
+		printf("Peak memory: %s KB before loading, %s KB after loading (+%s KB), %s KB after reading the values (+%s KB)\n",
+				formatNumber(peakMemoryBefore).c_str(),
+				formatNumber(peakMemoryLoaded).c_str(),formatNumber(peakMemoryLoaded - peakMemoryBefore).c_str(),
+				formatNumber(peakMemoryRead).c_str(),formatNumber(peakMemoryRead - peakMemoryLoaded).c_str());
+	}
+	else {
+		printf("Peak memory is not measured on this platform\n");
+	}
+	return (failedCount > 0 ? 1 : 0);
+}
+
 int handleShowCRCValuesCommand(int argc, char** argv) {
 	int return_value = 1;
 	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_SHOW_MAP_CRC]) == true) {
@@ -3983,6 +4530,8 @@ int glestMain(int argc, char** argv) {
 	//char *ptr = new char[200];
 //	printf("END ALLOC char 200\n");
 //	return -1;
+	Thread::initThreadMain();
+
     SystemFlags::VERBOSE_MODE_ENABLED  = false;
     if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_VERBOSE_MODE]) == true) {
         SystemFlags::VERBOSE_MODE_ENABLED  = true;
@@ -4090,7 +4639,13 @@ int glestMain(int argc, char** argv) {
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_SCENARIOS]) 		== true ||
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_TILESETS]) 		== true ||
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_TUTORIALS]) 		== true ||
-		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CREATE_DATA_ARCHIVES]) == true) {
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CREATE_DATA_ARCHIVES]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_SERVER_SOCKETS]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_NETWORK_JITTER]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_DESYNC_BISECT]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CONVERT_SAVED_GAME]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]) == true) {
 		haveSpecialOutputCommandLineOption = true;
 	}
 
@@ -4224,7 +4779,13 @@ int glestMain(int argc, char** argv) {
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_SCENARIOS]) 		== true ||
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_TILESETS]) 		== true ||
 		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_LIST_TUTORIALS]) 		== true ||
-		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CREATE_DATA_ARCHIVES]) == true) {
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CREATE_DATA_ARCHIVES]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_SERVER_SOCKETS]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_NETWORK_JITTER]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_DESYNC_BISECT]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CONVERT_SAVED_GAME]) == true ||
+		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]) == true) {
 		VideoPlayer::setDisabled(true);
 	}
 
@@ -4376,6 +4937,10 @@ int glestMain(int argc, char** argv) {
 		}
 
 		Socket::setBroadCastPort(config.getInt("BroadcastPort",intToStr(Socket::getBroadCastPort()).c_str()));
+		Checksum::setFileHashThreadCount(config.getInt("ChecksumFileHashThreads",intToStr(Checksum::getFileHashThreadCount()).c_str()));
+		Checksum::setFileIndexEnabled(config.getBool("EnableCRCFileIndex","true"));
+		FactionType::setTypeLoadThreadCount(config.getInt("TechTreeLoadThreads",intToStr(FactionType::getTypeLoadThreadCount()).c_str()));
+		TechTree::setXmlCacheEnabled(config.getBool("EnableTechTreeCache","true"));
 
 		Socket::disableNagle = config.getBool("DisableNagle","false");
 		if(Socket::disableNagle) {
@@ -4911,6 +5476,30 @@ int glestMain(int argc, char** argv) {
     		return handleCreateDataArchivesCommand(argc, argv);
     	}
 
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]) == true) {
+    		return handleCommandListSizeBenchmarkCommand(argc, argv);
+    	}
+
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_SERVER_SOCKETS]) == true) {
+    		return handleServerSocketBenchmarkCommand(argc, argv);
+    	}
+
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_NETWORK_JITTER]) == true) {
+    		return handleNetworkJitterBenchmarkCommand(argc, argv);
+    	}
+
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_DESYNC_BISECT]) == true) {
+    		return handleDesyncBisectCommand(argc, argv);
+    	}
+
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_CONVERT_SAVED_GAME]) == true) {
+    		return handleConvertSavedGameCommand(argc, argv);
+    	}
+
+    	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]) == true) {
+    		return handleXmlLoadBenchmarkCommand(argc, argv);
+    	}
+
     	if(hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_SHOW_MAP_CRC]) == true ||
     		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_SHOW_TILESET_CRC]) == true ||
     		hasCommandArgument(argc, argv,GAME_ARGS[GAME_ARG_SHOW_TECHTREE_CRC]) == true ||
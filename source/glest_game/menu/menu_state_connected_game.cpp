@@ -597,6 +597,11 @@ MenuStateConnectedGame::MenuStateConnectedGame(Program *program, MainMenu *mainM
         		fileArchiveExtractCommandParameters,
         		fileArchiveExtractCommandSuccessResult,
         		tempFilePath);
+        if(config.getBool("EnableContentTransfer","true") == true) {
+        	ftpClientThread->setContentTransfer(
+        			config.getInt("ContentTransferPort",intToStr(GameConstants::contentTransferPort).c_str()),
+        			config.getInt("ContentTransferStreams","4"));
+        }
         ftpClientThread->start();
     }
 	// Start http meta data thread
@@ -1467,6 +1472,11 @@ void MenuStateConnectedGame::mouseClick(int x, int y, MouseButton mouseButton){
             		fileArchiveExtractCommandParameters,
             		fileArchiveExtractCommandSuccessResult,
             		tempFilePath);
+            if(config.getBool("EnableContentTransfer","true") == true) {
+            	ftpClientThread->setContentTransfer(
+            			config.getInt("ContentTransferPort",intToStr(GameConstants::contentTransferPort).c_str()),
+            			config.getInt("ContentTransferStreams","4"));
+            }
             ftpClientThread->start();
 
 	    	Lang &lang= Lang::getInstance();
@@ -3546,6 +3546,30 @@ void MenuStateCustomGame::loadGameSettings(GameSettings *gameSettings,bool force
         valueFlags1 &= ~ft1_network_synch_checks;
         gameSettings->setFlagTypes1(valueFlags1);
 
+	}
+	if(Config::getInstance().getBool("EnableHierarchicalPathfinding","false") == true) {
+        valueFlags1 |= ft1_hierarchical_pathfinding;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_hierarchical_pathfinding;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	if(Config::getInstance().getBool("EnablePathfinderRegionChecks","true") == true) {
+        valueFlags1 |= ft1_pathfinder_region_checks;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_pathfinder_region_checks;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	if(Config::getInstance().getBool("EnableFlowFieldGroupMoves","true") == true) {
+        valueFlags1 |= ft1_flow_field_group_moves;
+        gameSettings->setFlagTypes1(valueFlags1);
+	}
+	else {
+        valueFlags1 &= ~ft1_flow_field_group_moves;
+        gameSettings->setFlagTypes1(valueFlags1);
 	}
 
 	gameSettings->setNetworkAllowNativeLanguageTechtree(checkBoxAllowNativeLanguageTechtree.getValue());
@@ -188,6 +188,8 @@ ClientInterface::ClientInterface() : GameNetworkInterface() {
 	cachedPendingCommandsIndex 			= 0;
 	cachedLastPendingFrameCount 		= 0;
 	timeClientWaitedForLastMessage 		= 0;
+	frameScheduler.setMode(NetworkFrameScheduler::isAdaptiveSchedulingEnabled() == true ?
+			NetworkFrameScheduler::nfsmAdaptive : NetworkFrameScheduler::nfsmLegacy);
 
 	flagAccessor 						= new Mutex(CODE_AT_LINE);
 
@@ -399,6 +401,7 @@ void ClientInterface::connect(const Ip &ip, int port) {
 
 	clientSocket = new ClientSocket();
 	clientSocket->setBlock(false);
+	clientSocket->setReceiveBufferSize(Config::getInstance().getInt("NetworkSocketReceiveBufferSize","65536"));
 	clientSocket->connect(ip, port);
 	connectedTime = time(NULL);
 	//clientSocket->setBlock(true);
@@ -544,6 +547,9 @@ void ClientInterface::updateLobby() {
 				serverUUID 		= networkMessageIntro.getPlayerUUID();
 				serverPlatform 	= networkMessageIntro.getPlayerPlatform();
 				serverFTPPort 	= networkMessageIntro.getFtpPort();
+				// plain messages until the server sends its capabilities
+				setCommandListProtocol(nclpFixedSize);
+				setMessageCompression(nmctNone);
 
 				if(playerIndex < 0 || playerIndex >= GameConstants::maxPlayers) {
 					throw megaglest_runtime_error("playerIndex < 0 || playerIndex >= GameConstants::maxPlayers");
@@ -613,7 +619,7 @@ void ClientInterface::updateLobby() {
 							sessionKey,getNetworkVersionGITString(),
 							getHumanPlayerName(),
 							-1,
-							nmgstOk,
+							nmgstOkCapabilities,
 							this->getSocket()->getConnectedIPAddress(),
 							serverFTPPort,
 							lang.getLanguage(),
@@ -991,6 +997,24 @@ void ClientInterface::updateLobby() {
 			}
 			break;
 
+		case nmtCapabilities:
+			{
+				NetworkMessageCapabilities networkMessageCapabilities;
+				if(receiveMessage(&networkMessageCapabilities)) {
+					// answer with what both sides support, the server switches
+					// when it reads the answer and our messages after it
+					uint8 commandListProtocol = min(networkMessageCapabilities.getCommandListProtocol(),getMaxCommandListProtocol());
+					uint8 messageCompression = min(networkMessageCapabilities.getMessageCompression(),getMaxMessageCompression());
+
+					NetworkMessageCapabilities sendNetworkMessageCapabilities(commandListProtocol,messageCompression);
+					sendMessage(&sendNetworkMessageCapabilities);
+
+					setCommandListProtocol(commandListProtocol);
+					setMessageCompression(messageCompression);
+				}
+			}
+			break;
+
         default:
             {
             string sErr = string(extractFileFromDirectoryPath(__FILE__).c_str()) + "::" + string(__FUNCTION__) + " Unexpected network message: " + intToStr(networkMessageType);
@@ -1068,6 +1092,8 @@ void ClientInterface::updateFrame(int *checkFrame) {
 
 					//printf("Client Thread getFrameCount(): %d getCommandCount(): %d\n",networkMessageCommandList.getFrameCount(),networkMessageCommandList.getCommandCount());
 
+					frameScheduler.addCommandListArrival(networkMessageCommandList.getFrameCount(),Chrono::getCurMillis());
+
 					MutexSafeWrapper safeMutex(networkCommandListThreadAccessor,CODE_AT_LINE);
 					cachedLastPendingFrameCount = networkMessageCommandList.getFrameCount();
 					//printf("cachedLastPendingFrameCount = %lld\n",(long long int)cachedLastPendingFrameCount);
@@ -1138,7 +1164,13 @@ void ClientInterface::updateFrame(int *checkFrame) {
 					NetworkMessagePing networkMessagePing;
 					if(receiveMessage(&networkMessagePing)) {
 						if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
-						this->setLastPingInfo(networkMessagePing);
+						// the server measures the round trip with these, send it straight back
+						if(networkMessagePing.getPingFrequency() == NetworkFrameScheduler::pingEchoRequest) {
+							sendPingMessage(NetworkFrameScheduler::pingEchoReply,networkMessagePing.getPingTime());
+						}
+						else {
+							this->setLastPingInfo(networkMessagePing);
+						}
 					}
 				}
 				break;
@@ -1433,6 +1465,7 @@ void ClientInterface::updateKeyframe(int frameCount) {
 	if(getQuit() == false && getQuitThread() == false) {
 		if(networkCommandListThread == NULL) {
 			static string mutexOwnerId 	= string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+			frameScheduler.reset();
 			networkCommandListThread 	= new ClientInterfaceThread(this);
 			networkCommandListThread->setUniqueID(mutexOwnerId);
 			networkCommandListThread->start();
@@ -2101,6 +2134,14 @@ bool ClientInterface::shouldDiscardNetworkMessage(NetworkMessageType networkMess
 			}
 			break;
 
+		case nmtCapabilities:
+			{
+			discard = true;
+			NetworkMessageCapabilities networkMessageCapabilities;
+			receiveMessage(&networkMessageCapabilities);
+			}
+			break;
+
 		case nmtSynchNetworkGameData:
 			{
 			discard = true;
@@ -19,6 +19,7 @@
 
 #include <vector>
 #include "network_interface.h"
+#include "network_frame_scheduler.h"
 #include "socket.h"
 #include "leak_dumper.h"
 
@@ -92,6 +93,7 @@ private:
 	uint64 cachedPendingCommandsIndex;
 	uint64 cachedLastPendingFrameCount;
 	int64 timeClientWaitedForLastMessage;
+	NetworkFrameScheduler frameScheduler;
 
 	Mutex *flagAccessor;
 	bool joinGameInProgress;
@@ -125,6 +127,7 @@ public:
 
 	uint64 getCachedLastPendingFrameCount();
 	int64 getTimeClientWaitedForLastMessage();
+	NetworkFrameScheduler *getFrameScheduler()	{return &frameScheduler;}
 
 	//message processing
 	virtual void update();
@@ -193,6 +193,14 @@ void ConnectionSlotThread::execute() {
 				break;
 			}
 
+			// Once the slot's game runs the server's socket reactor thread
+			// reads this slot's socket, so this thread is done
+			if(getGameStarted() == true &&
+				this->slotInterface->getSocketReactor() != NULL) {
+				if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] slot %d handed over to the socket reactor\n",__FILE__,__FUNCTION__,__LINE__,slotIndex);
+				break;
+			}
+
 			// Does this game allow joining in progress play and is this slot
 			// not already connected to a client?
 			if( this->slotInterface->getAllowInGameConnections() == true &&
@@ -244,11 +252,15 @@ void ConnectionSlotThread::execute() {
 					}
 
 					PLATFORM_SOCKET socketId = socket->getSocketId();
+					bool socketHasBufferedData = (socket->getBufferedDataSize() > 0);
 					safeMutex.ReleaseLock();
 
 					// Avoid mutex locking
 					//bool socketHasReadData = Socket::hasDataToRead(socket->getSocketId());
-					bool socketHasReadData = Socket::hasDataToReadWithWait(socketId,150000);
+					// Messages read ahead into the socket receive buffer
+					// don't wake select
+					bool socketHasReadData = (socketHasBufferedData == true ||
+							Socket::hasDataToReadWithWait(socketId,150000) == true);
 
 					ConnectionSlotEvent eventCopy;
 					eventCopy.eventType 		= eReceiveSocketData;
@@ -561,6 +573,7 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 					if(newSocket != NULL) {
 						// Set Socket as non-blocking
 						newSocket->setBlock(false);
+						newSocket->setReceiveBufferSize(Config::getInstance().getInt("NetworkSocketReceiveBufferSize","65536"));
 
 						MutexSafeWrapper safeMutex(mutexCloseConnection,CODE_AT_LINE);
 						this->setSocket(newSocket);
@@ -604,6 +617,9 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 						srand((unsigned int)seed.getCurTicks() / (this->playerIndex + 1));
 
 						sessionKey = rand() % 1000000;
+						// plain messages until the client answers our capabilities
+						setCommandListProtocol(nclpFixedSize);
+						setMessageCompression(nmctNone);
 
 						if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] accepted new client connection, serverInterface->getOpenSlotCount() = %d, sessionKey = %d\n",__FILE__,__FUNCTION__,__LINE__,serverInterface->getOpenSlotCount(),sessionKey);
 						if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] client will be assigned to the next open slot\n",__FILE__,__FUNCTION__,__LINE__);
@@ -639,11 +655,14 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 				bool gotCellMarkerMsg = true;
 				bool waitForLaggingClient = false;
 				bool waitedForLaggingClient = false;
+				// The reactor thread serves every slot, it only reads whole
+				// buffered messages and never waits here for a lagging client
+				bool readBySocketReactor = isReadBySocketReactor();
 
 				//printf("Update slot: %d this->hasDataToRead(): %d\n",this->playerIndex,this->hasDataToRead());
 
 				for(;waitForLaggingClient == true ||
-						(this->hasDataToRead() == true &&
+						((readBySocketReactor == true ? this->hasCompleteMessage() : this->hasDataToRead()) == true &&
 						 (gotTextMsg == true || gotCellMarkerMsg == true));) {
 
 					//printf("Server slot checking for waitForLaggingClient = %d this->hasDataToRead() = %d gotTextMsg = %d gotCellMarkerMsg = %d\n",waitForLaggingClient,this->hasDataToRead(),gotTextMsg,gotCellMarkerMsg);
@@ -673,7 +692,12 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 							NetworkMessagePing networkMessagePing;
 							if(receiveMessage(&networkMessagePing)) {
 								if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
-								lastPingInfo = networkMessagePing;
+								if(networkMessagePing.getPingFrequency() == NetworkFrameScheduler::pingEchoReply) {
+									frameScheduler.addRoundTripTime(Chrono::getCurMillis() - networkMessagePing.getPingTime());
+								}
+								else {
+									lastPingInfo = networkMessagePing;
+								}
 							}
 							else {
 								if(SystemFlags::getSystemSettingType(SystemFlags::debugError).enabled) SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d]\nInvalid message type before intro handshake [%d]\nDisconnecting socket for slot: %d [%s].\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,networkMessageType,this->playerIndex,this->getIpAddress().c_str());
@@ -800,6 +824,33 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 						}
 						break;
 
+						case nmtCapabilities:
+						{
+							if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] got nmtCapabilities gotIntro = %d\n",__FILE__,__FUNCTION__,__LINE__,gotIntro);
+
+							if(gotIntro == true) {
+								NetworkMessageCapabilities networkMessageCapabilities;
+								if(receiveMessage(&networkMessageCapabilities)) {
+									// the client already switched to these before it answered
+									setCommandListProtocol(min(networkMessageCapabilities.getCommandListProtocol(),getMaxCommandListProtocol()));
+									setMessageCompression(min(networkMessageCapabilities.getMessageCompression(),getMaxMessageCompression()));
+								}
+								else {
+									if(SystemFlags::getSystemSettingType(SystemFlags::debugError).enabled) SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d]\nInvalid message type before intro handshake [%d]\nDisconnecting socket for slot: %d [%s].\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,networkMessageType,this->playerIndex,this->getIpAddress().c_str());
+									this->serverInterface->notifyBadClientConnectAttempt(this->getIpAddress());
+									close();
+									return;
+								}
+							}
+							else {
+								if(SystemFlags::getSystemSettingType(SystemFlags::debugError).enabled) SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d]\nInvalid message type before intro handshake [%d]\nDisconnecting socket for slot: %d [%s].\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,networkMessageType,this->playerIndex,this->getIpAddress().c_str());
+								this->serverInterface->notifyBadClientConnectAttempt(this->getIpAddress());
+								close();
+								return;
+							}
+						}
+						break;
+
 						//command list
 						case nmtCommandList: {
 
@@ -921,6 +972,12 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 									if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
 									gotIntro = true;
 
+									// older clients never asked, they keep plain messages
+									if(networkMessageIntro.getGameState() == nmgstOkCapabilities) {
+										NetworkMessageCapabilities networkMessageCapabilities(getMaxCommandListProtocol(),getMaxMessageCompression());
+										sendMessage(&networkMessageCapabilities);
+									}
+
 									int factionIndex = this->serverInterface->gameSettings.getFactionIndexForStartLocation(playerIndex);
 									this->serverInterface->addClientToServerIPAddress(this->getSocket()->getConnectedIPAddress(this->getSocket()->getIpAddress()),this->connectedRemoteIPAddress);
 
@@ -1391,8 +1448,8 @@ void ConnectionSlot::update(bool checkForNewClients,int lockedSlotIndex) {
 								if((maxFrameCountLagAllowed > 0 && clientLagCount > maxFrameCountLagAllowed) ||
 									(maxClientLagTimeAllowed > 0 && clientLagTime > maxClientLagTimeAllowed)) {
 
-									waitForLaggingClient = true;
-									if(waitedForLaggingClient == false) {
+									waitForLaggingClient = (readBySocketReactor == false);
+									if(waitForLaggingClient == true && waitedForLaggingClient == false) {
 										waitedForLaggingClient = true;
 										printf("*TESTING*: START Waiting for lagging client playerIndex = %d [%s] clientLagCount = %f [%f]\n",playerIndex,name.c_str(),clientLagCount,clientLagTime);
 									}
@@ -1503,6 +1560,11 @@ void ConnectionSlot::close() {
 
 	//printf("ConnectionSlot::close() #3 this->getSocket() = %p updateServerListener = %d\n",this->getSocket(),updateServerListener);
 
+	// the next connection can get the same descriptor number
+	SocketReactor *socketReactor = (serverInterface != NULL ? serverInterface->getSocketReactor() : NULL);
+	if(socketReactor != NULL && updateServerListener == true) {
+		socketReactor->removeSocket(this->getSocketId());
+	}
 	this->deleteSocket();
 	safeMutex.ReleaseLock();
 
@@ -1633,6 +1695,52 @@ void ConnectionSlot::deleteSocket() {
 	socket = NULL;
 }
 
+bool ConnectionSlot::hasBufferedData() {
+	return (getBufferedDataSize() > 0);
+}
+
+int ConnectionSlot::getBufferedDataSize() {
+	MutexSafeWrapper safeMutexSlot(mutexSocket,CODE_AT_LINE);
+	return (socket != NULL ? socket->getBufferedDataSize() : 0);
+}
+
+// Called by the socket reactor thread when the socket has data
+bool ConnectionSlot::readSocketData() {
+	MutexSafeWrapper safeMutexSlot(mutexSocket,CODE_AT_LINE);
+	return (socket != NULL && socket->readAvailableData() == true);
+}
+
+// True when a whole message is buffered, so reading it can't block the
+// reactor thread. Messages whose size isn't known from their first bytes,
+// or that don't fit the buffer, are read the usual way.
+bool ConnectionSlot::hasCompleteMessage() {
+	MutexSafeWrapper safeMutexSlot(mutexSocket,CODE_AT_LINE);
+	if(socket == NULL) {
+		return false;
+	}
+	if(socket->getReceiveBufferSize() <= 0) {
+		return socket->hasDataToRead();
+	}
+
+	int bufferedSize = socket->getBufferedDataSize();
+	if(bufferedSize <= 0) {
+		return false;
+	}
+	unsigned char messageStart[64];
+	int messageStartSize = socket->peekBufferedData(messageStart, sizeof(messageStart));
+	int framedSize = NetworkMessage::getFramedSize(messageStart, messageStartSize, getCommandListProtocol());
+	if(framedSize == 0) {
+		return false;
+	}
+	return (framedSize < 0 || framedSize <= bufferedSize ||
+			framedSize > socket->getReceiveBufferSize());
+}
+
+bool ConnectionSlot::isReadBySocketReactor() {
+	return (serverInterface != NULL && serverInterface->getSocketReactor() != NULL &&
+			getGameStarted() == true);
+}
+
 bool ConnectionSlot::hasDataToRead() {
     bool result = false;
 
@@ -14,6 +14,7 @@
 
 #include "socket.h"
 #include "network_interface.h"
+#include "network_frame_scheduler.h"
 #include "base_thread.h"
 #include <time.h>
 #include <vector>
@@ -22,6 +23,7 @@
 
 using Shared::Platform::ServerSocket;
 using Shared::Platform::Socket;
+using Shared::Platform::SocketReactor;
 using std::vector;
 
 namespace Glest{ namespace Game{
@@ -73,6 +75,9 @@ public:
 	virtual Mutex *getSlotMutex(int index) = 0;
 
 	virtual void slotUpdateTask(ConnectionSlotEvent *event) = 0;
+	// when set the reactor thread reads the sockets of all slots whose game
+	// has started and their slot threads end
+	virtual SocketReactor *getSocketReactor() { return NULL; }
 	virtual ~ConnectionSlotCallbackInterface() {}
 };
 
@@ -164,6 +169,7 @@ private:
 	bool sentSavedGameInfo;
 
 	int autoPauseGameCountForLag;
+	NetworkFrameScheduler frameScheduler;
 
 public:
 	ConnectionSlot(ServerInterface* serverInterface, int playerIndex);
@@ -229,6 +235,7 @@ public:
 
 	virtual void sendMessage(NetworkMessage* networkMessage);
 	int getCurrentFrameCount() const { return currentFrameCount; }
+	NetworkFrameScheduler *getFrameScheduler() { return &frameScheduler; }
 
 	int getCurrentLagCount() const { return currentLagCount; }
 	void setCurrentLagCount(int value) { currentLagCount = value; }
@@ -255,6 +262,10 @@ public:
 	virtual bool isConnected();
 
 	PLATFORM_SOCKET getSocketId();
+	bool hasBufferedData();
+	int getBufferedDataSize();
+	bool readSocketData();
+	bool hasCompleteMessage();
 
 	void setCanAcceptConnections(bool value) { canAcceptConnections = value; }
 	bool getCanAcceptConnections() const { return canAcceptConnections; }
@@ -275,6 +286,7 @@ protected:
 	virtual void update() {}
 
 	bool hasDataToRead();
+	bool isReadBySocketReactor();
 };
 
 }}//end namespace
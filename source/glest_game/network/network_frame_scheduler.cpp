@@ -0,0 +1,380 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "network_frame_scheduler.h"
+
+#include "config.h"
+#include "util.h"
+#include "conversion.h"
+#include "platform_util.h"
+#include <cmath>
+#include "leak_dumper.h"
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+
+namespace Glest { namespace Game {
+
+// =====================================================
+// 	class NetworkFrameScheduler
+// =====================================================
+
+NetworkFrameScheduler::NetworkFrameScheduler() {
+	mode = nfsmLegacy;
+	mutexScheduler = new Mutex(CODE_AT_LINE);
+	reset();
+}
+
+NetworkFrameScheduler::~NetworkFrameScheduler() {
+	delete mutexScheduler;
+	mutexScheduler = NULL;
+}
+
+void NetworkFrameScheduler::reset() {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+
+	framesToCatchUp = 0;
+	framesToSlowDown = 0;
+	updateCounter = 0;
+
+	for(int i = 0; i < GameConstants::networkSmoothInterval; ++i) {
+		receivedTooEarlyInFrames[i] = -1;
+		framesNeededToWaitForServerMessage[i] = -1;
+	}
+
+	lastArrivalMillis = 0;
+	lastArrivalFrame = -1;
+	arrivalJitterMillis = 0;
+	arrivalCount = 0;
+
+	roundTripMillis = 0;
+	roundTripJitterMillis = 0;
+	roundTripCount = 0;
+
+	leadFrame = -1;
+	leadPeriod = -1;
+	leadWindow.clear();
+
+	stallCount = 0;
+	slowDownFrameCount = 0;
+	catchUpFrameCount = 0;
+}
+
+void NetworkFrameScheduler::setMode(SchedulerMode value) {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	mode = value;
+}
+
+bool NetworkFrameScheduler::isAdaptiveSchedulingEnabled() {
+	return Config::getInstance().getBool("EnableAdaptiveNetworkFrameScheduling","false");
+}
+
+// Command lists are sent every network frame period, the difference between
+// how far apart two lists arrived and how far apart they were sent is
+// smoothed into a jitter estimate the same way RTP does it.
+void NetworkFrameScheduler::addCommandListArrival(int frameCount, int64 arrivalMillis) {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+
+	if(lastArrivalFrame >= 0 && frameCount > lastArrivalFrame) {
+		double expectedMillis = (double)(frameCount - lastArrivalFrame) * 1000.0 / GameConstants::updateFps;
+		double deviation = std::fabs((double)(arrivalMillis - lastArrivalMillis) - expectedMillis);
+		arrivalJitterMillis += (deviation - arrivalJitterMillis) / 16.0;
+	}
+	lastArrivalFrame = frameCount;
+	lastArrivalMillis = arrivalMillis;
+	arrivalCount++;
+
+	// how many frames the client can still run before it needs this list,
+	// only looked at while the pace is not being corrected
+	if(mode == nfsmAdaptive && leadFrame >= 0 &&
+		framesToCatchUp == 0 && framesToSlowDown == 0) {
+		leadWindow.push_back(frameCount - leadFrame);
+		if((int)leadWindow.size() > leadWindowSize) {
+			leadWindow.pop_front();
+		}
+	}
+}
+
+void NetworkFrameScheduler::addRoundTripTime(int64 roundTripTime) {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+
+	if(roundTripCount == 0) {
+		roundTripMillis = (double)roundTripTime;
+	}
+	else {
+		double deviation = std::fabs((double)roundTripTime - roundTripMillis);
+		roundTripJitterMillis += (deviation - roundTripJitterMillis) / 4.0;
+		roundTripMillis += ((double)roundTripTime - roundTripMillis) / 8.0;
+	}
+	roundTripCount++;
+}
+
+double NetworkFrameScheduler::getArrivalJitterMillis() {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	return arrivalJitterMillis;
+}
+
+double NetworkFrameScheduler::getRoundTripMillis() {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	return roundTripMillis;
+}
+
+double NetworkFrameScheduler::getRoundTripJitterMillis() {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	return roundTripJitterMillis;
+}
+
+int NetworkFrameScheduler::getTargetLeadFramesInternal(int framePeriod) const {
+	double jitterFrames = arrivalJitterMillis * GameConstants::updateFps / 1000.0;
+	int target = (int)std::ceil(jitterFrames * 3.0) + 1;
+	return max(1, min(target, max(1, framePeriod * 2)));
+}
+
+int NetworkFrameScheduler::getTargetLeadFrames(int framePeriod) {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	return getTargetLeadFramesInternal(framePeriod);
+}
+
+// A client reports its frame once per network frame period and the report
+// takes half a round trip to get here, on top of that the client keeps its
+// own buffer of up to a period.
+int NetworkFrameScheduler::getAllowedLagFrames(int framePeriod) {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	if(roundTripCount == 0) {
+		return -1;
+	}
+	double delayMillis = roundTripMillis / 2.0 + roundTripJitterMillis * 3.0;
+	return framePeriod * 2 + (int)std::ceil(delayMillis * GameConstants::updateFps / 1000.0);
+}
+
+int NetworkFrameScheduler::getClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+		uint64 lastReceivedFrame, int64 timeWaitedForLastMessage) {
+	if(framePeriod <= 0) {
+		return updateLoops;
+	}
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+	if(mode == nfsmAdaptive) {
+		return getAdaptiveClientUpdateLoops(updateLoops, frameCount, framePeriod,
+				lastReceivedFrame, timeWaitedForLastMessage);
+	}
+	return getLegacyClientUpdateLoops(updateLoops, frameCount, framePeriod,
+			lastReceivedFrame, timeWaitedForLastMessage);
+}
+
+int NetworkFrameScheduler::getLegacyClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+		uint64 lastNetworkFrameFromServer, int64 timeClientWaitedForLastMessage) {
+	if(updateLoops == 1 && frameCount >= (framePeriod * 2) ) {
+		/////////////////////////////////
+		// TTTT new attempt to make things smoother:
+		///////////////
+
+		////////////////////////////////////////////
+		//get stats of received/waiting for packages
+		////////////////////////////////////////////
+		// calculate current receive Index slot:
+		int index = ((frameCount - (frameCount % framePeriod)) / framePeriod)
+				% GameConstants::networkSmoothInterval;
+
+		// clean the next frame slot
+		receivedTooEarlyInFrames[(index+1)%GameConstants::networkSmoothInterval]=-1;
+		framesNeededToWaitForServerMessage[(index+1)%GameConstants::networkSmoothInterval]=-1;
+
+		if(receivedTooEarlyInFrames[index]==-1){
+			// we need to check if we already received something for next frame
+			if(lastNetworkFrameFromServer > 0 && lastNetworkFrameFromServer > (uint64)frameCount) {
+				receivedTooEarlyInFrames[index]= lastNetworkFrameFromServer-frameCount;
+			}
+		}
+		if(framesNeededToWaitForServerMessage[index]==-1){
+			// calc time waiting for message in milliseconds to frames
+			if(timeClientWaitedForLastMessage>0){
+				if(SystemFlags::VERBOSE_MODE_ENABLED) printf("world.getFrameCount():%d index %d Client waited:%d ms\n",frameCount,index,(int)timeClientWaitedForLastMessage);
+				framesNeededToWaitForServerMessage[index]=timeClientWaitedForLastMessage*GameConstants::updateFps/1000;
+				if(SystemFlags::VERBOSE_MODE_ENABLED) printf("ClienttimeClientWaitedForLastMessage:%d ms  which is %d frames \n",(int)timeClientWaitedForLastMessage,framesNeededToWaitForServerMessage[index]);
+				stallCount++;
+			}
+			else {
+				framesNeededToWaitForServerMessage[index]=0;
+			}
+		}
+
+		////////////////////////////////////////////
+		//use the recorded stats of received/waiting for packages
+		////////////////////////////////////////////
+		//lets see if the client is in front and had to wait for messages ...
+
+		//lets see if all last recorded frames where received too early
+		int minimum=0;
+		int allowedMaxFallback=5;
+		int countOfMessagesReceivedTooEarly=0;
+		int countOfMessagesReceivedTooLate=0;
+		int sumOfTooLateFrames=0;
+		bool cleanupStats=false;
+
+		for( int i=0;i<GameConstants::networkSmoothInterval;i++){
+			if(receivedTooEarlyInFrames[i]>allowedMaxFallback){
+				countOfMessagesReceivedTooEarly++;
+				if ( minimum == 0 || minimum > receivedTooEarlyInFrames[i]  ){
+					minimum=receivedTooEarlyInFrames[i];
+				}
+			}
+			if(framesNeededToWaitForServerMessage[i]>0){
+				countOfMessagesReceivedTooLate++;
+				sumOfTooLateFrames+=framesNeededToWaitForServerMessage[i];
+			}
+		}
+
+		if( countOfMessagesReceivedTooEarly==GameConstants::networkSmoothInterval-1 ) // -1 because slot for next frame is already initialized
+		{// all packages where too early
+			// we catch up the minimum-catchupInterval of what we recorded
+			framesToCatchUp=minimum-allowedMaxFallback;
+			framesToSlowDown=0;
+			cleanupStats=true;
+			if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will speed up: %d frames\n",frameCount,framesToCatchUp);
+		}
+		else if(countOfMessagesReceivedTooLate>3){
+			framesToSlowDown=sumOfTooLateFrames/countOfMessagesReceivedTooLate;
+			framesToCatchUp=0;
+			cleanupStats=true;
+			if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will slow down: %d frames\n",frameCount,framesToSlowDown);
+		}
+
+		if(cleanupStats==true) {
+			// Once we decided to use the stats to do some correction, we reset/cleanup our recorded stats
+			for( int i=0;i<GameConstants::networkSmoothInterval;i++){
+				receivedTooEarlyInFrames[i]=-1;
+				framesNeededToWaitForServerMessage[i]=-1;
+			}
+		}
+	}
+	// if game is paused don't try to catch up
+	if(updateLoops > 0) {
+		// we catch up a bit smoother with updateLoops = 2
+		if(framesToCatchUp>0)
+		{
+				updateLoops = 2;
+				framesToCatchUp=framesToCatchUp-1;
+				catchUpFrameCount++;
+		}
+		if(framesToSlowDown>0)
+		{// slowdown still the hard way.
+			updateLoops = 0;
+			framesToSlowDown=framesToSlowDown-1;
+			slowDownFrameCount++;
+		}
+	}
+	return updateLoops;
+}
+
+// The lead is measured when a command list arrives: the number of frames
+// the client could still run before it would have to wait for that list.
+// The lowest lead of the last few lists is compared with the target the
+// arrival jitter asks for. A client that had to wait at a keyframe slows
+// down right away, one with too much in hand catches up, and either
+// correction is spread over several updates instead of freezing or
+// doubling up for a run of frames.
+int NetworkFrameScheduler::getAdaptiveClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+		uint64 lastReceivedFrame, int64 timeWaitedForLastMessage) {
+	leadFrame = frameCount;
+
+	// if game is paused don't try to catch up
+	if(updateLoops <= 0) {
+		return updateLoops;
+	}
+
+	int period = frameCount / framePeriod;
+	if(period != leadPeriod) {
+		// the keyframe wait is kept until the next keyframe, look at it once
+		if(leadPeriod >= 0 && timeWaitedForLastMessage > 0) {
+			int waitedFrames = (int)((timeWaitedForLastMessage * GameConstants::updateFps + 999) / 1000);
+			leadWindow.push_back(-waitedFrames);
+			stallCount++;
+			if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client waited: %d ms which is %d frames\n",frameCount,(int)timeWaitedForLastMessage,waitedFrames);
+		}
+		leadPeriod = period;
+	}
+
+	if(framesToCatchUp == 0 && framesToSlowDown == 0 && leadWindow.empty() == false) {
+		int lowestLead = leadWindow.front();
+		for(std::deque<int>::const_iterator iterLead = leadWindow.begin(); iterLead != leadWindow.end(); ++iterLead) {
+			lowestLead = min(lowestLead, *iterLead);
+		}
+		int targetLead = getTargetLeadFramesInternal(framePeriod);
+		int hysteresis = max(2, framePeriod / 4);
+
+		if(lowestLead < 0 ||
+			((int)leadWindow.size() >= leadWindowSize && lowestLead < targetLead)) {
+			framesToSlowDown = min(targetLead - lowestLead, framePeriod * 2);
+			leadWindow.clear();
+			if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will slow down: %d frames (lead %d target %d)\n",frameCount,framesToSlowDown,lowestLead,targetLead);
+		}
+		else if((int)leadWindow.size() >= leadWindowSize && lowestLead > targetLead + hysteresis) {
+			framesToCatchUp = lowestLead - targetLead;
+			leadWindow.clear();
+			if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Worldframe %d : Client will speed up: %d frames (lead %d target %d)\n",frameCount,framesToCatchUp,lowestLead,targetLead);
+		}
+	}
+
+	updateCounter++;
+	if((updateCounter % clientStretchInterval) == 0) {
+		if(framesToSlowDown > 0) {
+			updateLoops--;
+			framesToSlowDown--;
+			slowDownFrameCount++;
+		}
+		else if(framesToCatchUp > 0) {
+			// never run past the frames that already arrived
+			if(lastReceivedFrame > (uint64)frameCount + updateLoops) {
+				updateLoops++;
+				catchUpFrameCount++;
+			}
+			framesToCatchUp--;
+		}
+	}
+	return updateLoops;
+}
+
+// Skip an update every few updates while a client is further behind than
+// its round trip allows, and go back to full pace as soon as none is.
+int NetworkFrameScheduler::getServerUpdateLoops(int updateLoops, int excessLagFrames) {
+	if(updateLoops <= 0) {
+		return updateLoops;
+	}
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+
+	if(excessLagFrames <= 0) {
+		framesToSlowDown = 0;
+	}
+	else if(framesToSlowDown == 0) {
+		framesToSlowDown = excessLagFrames;
+	}
+
+	updateCounter++;
+	if(framesToSlowDown > 0 && (updateCounter % serverStretchInterval) == 0) {
+		updateLoops--;
+		framesToSlowDown--;
+		slowDownFrameCount++;
+	}
+	return updateLoops;
+}
+
+string NetworkFrameScheduler::getStats() {
+	MutexSafeWrapper safeMutex(mutexScheduler,CODE_AT_LINE);
+
+	char szBuf[8096]="";
+	snprintf(szBuf,8096,"mode [%s] arrival jitter [%.1f ms] round trip [%.1f ms +- %.1f ms] stalls [%lld] slowed frames [%lld] caught up frames [%lld]",
+			(mode == nfsmAdaptive ? "adaptive" : "legacy"),arrivalJitterMillis,
+			roundTripMillis,roundTripJitterMillis,
+			(long long int)stallCount,(long long int)slowDownFrameCount,(long long int)catchUpFrameCount);
+	return szBuf;
+}
+
+}}//end namespace
@@ -0,0 +1,142 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_NETWORKFRAMESCHEDULER_H_
+#define _GLEST_GAME_NETWORKFRAMESCHEDULER_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "game_constants.h"
+#include "data_types.h"
+#include "platform_common.h"
+#include <deque>
+#include <string>
+#include "leak_dumper.h"
+
+using std::string;
+using Shared::Platform::int64;
+using Shared::Platform::Mutex;
+
+namespace Glest { namespace Game {
+
+// =====================================================
+// 	class NetworkFrameScheduler
+//
+///	Decides how many world updates a network game runs per game update.
+///	A client keeps a small buffer of command lists ahead of its own frame:
+///	the network thread reports when every list arrives, the jitter of
+///	those arrivals decides how many frames the client keeps in hand, and
+///	the client slows down or catches up a frame at a time to hold that
+///	buffer. The server uses the round trip times of its clients to decide
+///	how far behind a client may be, and stretches its own pacing a little
+///	while one of them is further behind than that.
+///	The legacy mode is the smoothing clients always did, kept for games
+///	where the adaptive scheduling is switched off.
+// =====================================================
+
+class NetworkFrameScheduler {
+public:
+	enum SchedulerMode {
+		nfsmLegacy,
+		nfsmAdaptive
+	};
+
+	// ping frequency values of the in game round trip pings, lobby pings
+	// carry the (positive) ping interval instead
+	static const int pingEchoRequest			= -1;
+	static const int pingEchoReply				= -2;
+	static const int pingIntervalMillis			= 1000;
+
+private:
+	// one correction frame is spread over this many updates
+	static const int clientStretchInterval		= 4;
+	static const int serverStretchInterval		= 8;
+	// lead samples (one per network frame period) looked at before changing
+	// the client pace
+	static const int leadWindowSize				= 4;
+
+	SchedulerMode mode;
+	Mutex *mutexScheduler;
+
+	int framesToCatchUp;
+	int framesToSlowDown;
+	int updateCounter;
+
+	// legacy smoothing
+	int receivedTooEarlyInFrames[GameConstants::networkSmoothInterval];
+	int framesNeededToWaitForServerMessage[GameConstants::networkSmoothInterval];
+
+	// command list arrivals
+	int64 lastArrivalMillis;
+	int lastArrivalFrame;
+	double arrivalJitterMillis;
+	int arrivalCount;
+
+	// round trip of the in game pings
+	double roundTripMillis;
+	double roundTripJitterMillis;
+	int roundTripCount;
+
+	// client frame at the last game update, lead of the last command lists
+	int leadFrame;
+	int leadPeriod;
+	std::deque<int> leadWindow;
+
+	int64 stallCount;
+	int64 slowDownFrameCount;
+	int64 catchUpFrameCount;
+
+	NetworkFrameScheduler(const NetworkFrameScheduler &obj);
+	NetworkFrameScheduler &operator=(const NetworkFrameScheduler &obj);
+
+	int getLegacyClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+			uint64 lastReceivedFrame, int64 timeWaitedForLastMessage);
+	int getAdaptiveClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+			uint64 lastReceivedFrame, int64 timeWaitedForLastMessage);
+	int getTargetLeadFramesInternal(int framePeriod) const;
+
+public:
+	NetworkFrameScheduler();
+	~NetworkFrameScheduler();
+
+	void reset();
+	void setMode(SchedulerMode value);
+	SchedulerMode getMode() const						{return mode;}
+
+	// network thread: the command list for frameCount has arrived
+	void addCommandListArrival(int frameCount, int64 arrivalMillis);
+	// an in game ping came back after this many milliseconds
+	void addRoundTripTime(int64 roundTripTime);
+
+	double getArrivalJitterMillis();
+	double getRoundTripMillis();
+	double getRoundTripJitterMillis();
+	int getTargetLeadFrames(int framePeriod);
+	// how many frames a client may be behind the server before the server
+	// slows down for it
+	int getAllowedLagFrames(int framePeriod);
+
+	// game thread, once per game update with the loops the game speed asks for
+	int getClientUpdateLoops(int updateLoops, int frameCount, int framePeriod,
+			uint64 lastReceivedFrame, int64 timeWaitedForLastMessage);
+	int getServerUpdateLoops(int updateLoops, int excessLagFrames);
+
+	string getStats();
+
+	static bool isAdaptiveSchedulingEnabled();
+};
+
+}}//end namespace
+
+#endif
@@ -19,6 +19,7 @@
 #include "platform_util.h"
 #include <fstream>
 #include "util.h"
+#include "config.h"
 #include "network_protocol.h"
 #include "leak_dumper.h"
 
@@ -52,6 +53,9 @@ NetworkInterface::NetworkInterface() {
 	for(unsigned int index = 0; index < (unsigned int)GameConstants::maxPlayers; ++index) {
 		networkPlayerFactionCRC[index] = 0;
 	}
+	commandListProtocol = nclpFixedSize;
+	messageCompression = nmctNone;
+	messageCompressionThreshold = Config::getInstance().getInt("NetworkMessageCompressionThreshold","256");
 }
 
 void NetworkInterface::init() {
@@ -68,6 +72,9 @@ void NetworkInterface::init() {
 	for(unsigned int index = 0; index < (unsigned int)GameConstants::maxPlayers; ++index) {
 		networkPlayerFactionCRC[index] = 0;
 	}
+	commandListProtocol = nclpFixedSize;
+	messageCompression = nmctNone;
+	messageCompressionThreshold = Config::getInstance().getInt("NetworkMessageCompressionThreshold","256");
 }
 
 NetworkInterface::~NetworkInterface() {
@@ -91,6 +98,21 @@ void NetworkInterface::setNetworkPlayerFactionCRC(int index, uint32 crc) {
 	networkPlayerFactionCRC[index]=crc;
 }
 
+// Highest command list format this side offers in its intro message
+uint8 NetworkInterface::getMaxCommandListProtocol() {
+	if(Config::getInstance().getBool("EnableCompactCommandList","true") == false) {
+		return nclpFixedSize;
+	}
+	return nclpCompact;
+}
+
+uint8 NetworkInterface::getMaxMessageCompression() {
+	if(Config::getInstance().getBool("EnableNetworkMessageCompression","true") == false) {
+		return nmctNone;
+	}
+	return nmctZlib;
+}
+
 void NetworkInterface::addChatInfo(const ChatMsgInfo &msg) {
 	static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
 	MutexSafeWrapper safeMutex(networkAccessMutex,mutexOwnerId);
@@ -114,7 +136,21 @@ void NetworkInterface::addUnMarkedCell(const UnMarkedCell &msg) {
 void NetworkInterface::sendMessage(NetworkMessage* networkMessage){
 	Socket* socket= getSocket(false);
 
-	networkMessage->send(socket);
+	// Command lists use the format negotiated for this connection
+	NetworkMessageCommandList *commandListMsg = dynamic_cast<NetworkMessageCommandList *>(networkMessage);
+	if(commandListMsg != NULL) {
+		commandListMsg->setCommandListProtocol(getCommandListProtocol());
+	}
+
+	// Large messages go compressed to peers that said they can read them
+	if(getMessageCompression() != nmctNone) {
+		if(networkMessage->getDataSize() >= messageCompressionThreshold) {
+			networkMessage->sendCompressed(socket,messageCompressionThreshold);
+			return;
+		}
+	}
+	// one send call per message instead of one per part
+	networkMessage->sendCoalesced(socket);
 }
 
 NetworkMessageType NetworkInterface::getNextMessageType(int waitMilliseconds)
@@ -138,6 +174,11 @@ NetworkMessageType NetworkInterface::getNextMessageType(int waitMilliseconds)
 			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] PEEK WARNING, socket->getDataToRead() messageType = %d [size = %d], dataSize = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,messageType,sizeof(messageType),dataSize);
 		}
 
+        // compressed messages carry the type of the message inside
+        if((static_cast<uint8>(messageType) & NetworkMessage::compressedMessageFlag) != 0) {
+        	messageType = static_cast<int8>(static_cast<uint8>(messageType) & ~NetworkMessage::compressedMessageFlag);
+        }
+
         //sanity check new message type
         if(messageType < 0 || messageType >= nmtCount) {
         	if(getConnectHasHandshaked() == true) {
@@ -158,6 +199,18 @@ bool NetworkInterface::receiveMessage(NetworkMessage* networkMessage){
 
 	Socket* socket= getSocket(false);
 
+	NetworkMessageCommandList *commandListMsg = dynamic_cast<NetworkMessageCommandList *>(networkMessage);
+	if(commandListMsg != NULL) {
+		commandListMsg->setCommandListProtocol(getCommandListProtocol());
+	}
+
+	if(socket != NULL) {
+		int8 messageType = nmtInvalid;
+		if(socket->peek(&messageType, sizeof(messageType)) == (int)sizeof(messageType) &&
+			(static_cast<uint8>(messageType) & NetworkMessage::compressedMessageFlag) != 0) {
+			return networkMessage->receiveCompressed(socket);
+		}
+	}
 	return networkMessage->receive(socket);
 }
 
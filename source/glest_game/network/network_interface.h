@@ -202,6 +202,10 @@ protected:
 	Mutex *networkPlayerFactionCRCMutex;
 	uint32 networkPlayerFactionCRC[GameConstants::maxPlayers];
 
+	uint8 commandListProtocol;
+	uint8 messageCompression;
+	unsigned int messageCompressionThreshold;
+
 public:
 	static const int readyWaitTimeout;
 	GameSettings gameSettings;
@@ -222,6 +226,14 @@ public:
 	uint32 getNetworkPlayerFactionCRC(int index);
 	void setNetworkPlayerFactionCRC(int index, uint32 crc);
 
+	static uint8 getMaxCommandListProtocol();
+	uint8 getCommandListProtocol() const { return commandListProtocol; }
+	void setCommandListProtocol(uint8 value) { commandListProtocol = value; }
+
+	static uint8 getMaxMessageCompression();
+	uint8 getMessageCompression() const { return messageCompression; }
+	void setMessageCompression(uint8 value) { messageCompression = value; }
+
 	virtual Socket* getSocket(bool mutexLock=true)= 0;
 
 	virtual void close()= 0;
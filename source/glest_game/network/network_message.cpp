@@ -18,6 +18,7 @@
 #include "platform_util.h"
 #include "config.h"
 #include "network_protocol.h"
+#include "compression_utils.h"
 #include <algorithm>
 #include <cassert>
 #include <stdexcept>
@@ -26,6 +27,7 @@
 
 using namespace Shared::Platform;
 using namespace Shared::Util;
+using namespace Shared::CompressionUtil;
 using namespace std;
 using std::min;
 
@@ -38,12 +40,29 @@ Chrono NetworkMessage::statsTimer;
 Chrono NetworkMessage::lastSend;
 Chrono NetworkMessage::lastRecv;
 std::map<NetworkMessageStatisticType,int64> NetworkMessage::mapMessageStats;
+std::map<int,NetworkMessageCompressionStats> NetworkMessage::mapCompressionStats;
 
 // =====================================================
 //	class NetworkMessage
 // =====================================================
 
+NetworkMessage::NetworkMessage() {
+	envelopeSendBuffer = NULL;
+	envelopeReceiveBuffer = NULL;
+	envelopeReceiveSize = 0;
+	envelopeReceivePos = 0;
+}
+
 bool NetworkMessage::receive(Socket* socket, void* data, int dataSize, bool tryReceiveUntilDataSizeMet) {
+	if(envelopeReceiveBuffer != NULL) {
+		if(dataSize < 0 || envelopeReceivePos + (unsigned int)dataSize > envelopeReceiveSize) {
+			throw megaglest_runtime_error("Error receiving compressed NetworkMessage, dataSize = " + intToStr(dataSize) + ", remaining = " + uIntToStr(envelopeReceiveSize - envelopeReceivePos));
+		}
+		memcpy(data, &envelopeReceiveBuffer[envelopeReceivePos], dataSize);
+		envelopeReceivePos += dataSize;
+		return true;
+	}
+
 	if(socket != NULL) {
 		int dataReceived = socket->receive(data, dataSize, tryReceiveUntilDataSizeMet);
 		if(dataReceived != dataSize) {
@@ -68,7 +87,41 @@ bool NetworkMessage::receive(Socket* socket, void* data, int dataSize, bool tryR
 
 }
 
+// Returns dataSize bytes of the message, read in place from the compressed
+// envelope or the socket receive buffer when possible. The data is only
+// valid until the next read, NULL means nothing was received.
+unsigned char * NetworkMessage::receiveData(Socket* socket, int dataSize) {
+	if(envelopeReceiveBuffer != NULL) {
+		if(dataSize < 0 || envelopeReceivePos + (unsigned int)dataSize > envelopeReceiveSize) {
+			throw megaglest_runtime_error("Error receiving compressed NetworkMessage, dataSize = " + intToStr(dataSize) + ", remaining = " + uIntToStr(envelopeReceiveSize - envelopeReceivePos));
+		}
+		unsigned char *data = &envelopeReceiveBuffer[envelopeReceivePos];
+		envelopeReceivePos += dataSize;
+		return data;
+	}
+
+	if(socket != NULL) {
+		unsigned char *data = reinterpret_cast<unsigned char *>(socket->receiveView(dataSize));
+		if(data != NULL) {
+			dump_packet("\nINCOMING PACKET:\n",data, dataSize, false);
+			return data;
+		}
+	}
+
+	receiveScratchBuffer.resize(dataSize + 1);
+	if(receive(socket, &receiveScratchBuffer[0], dataSize, true) == false) {
+		return NULL;
+	}
+	return &receiveScratchBuffer[0];
+}
+
 void NetworkMessage::send(Socket* socket, const void* data, int dataSize) {
+	if(envelopeSendBuffer != NULL) {
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		envelopeSendBuffer->insert(envelopeSendBuffer->end(), bytes, bytes + dataSize);
+		return;
+	}
+
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] socket = %p, data = %p, dataSize = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,socket,data,dataSize);
 
 	if(socket != NULL) {
@@ -87,11 +140,135 @@ void NetworkMessage::send(Socket* socket, const void* data, int dataSize) {
 	}
 }
 
+// Writes the whole message into memory instead of the socket
+void NetworkMessage::captureMessage(Socket* socket, std::vector<unsigned char> &messageData) {
+	envelopeSendBuffer = &messageData;
+	try {
+		send(socket);
+	}
+	catch(...) {
+		envelopeSendBuffer = NULL;
+		throw;
+	}
+	envelopeSendBuffer = NULL;
+}
+
+// Sends all parts of the message with a single send call
+void NetworkMessage::sendCoalesced(Socket* socket) {
+	std::vector<unsigned char> messageData;
+	captureMessage(socket, messageData);
+	if(messageData.empty() == false) {
+		send(socket, &messageData[0], (int)messageData.size());
+	}
+}
+
+// Writes the message into memory, then sends it compressed when it is at
+// least compressionThreshold bytes and compression makes it smaller
+void NetworkMessage::sendCompressed(Socket* socket, unsigned int compressionThreshold) {
+	std::vector<unsigned char> plainData;
+	captureMessage(socket, plainData);
+
+	if(plainData.empty() == true) {
+		return;
+	}
+
+	std::vector<unsigned char> envelope;
+	if(plainData.size() >= compressionThreshold &&
+		plainData.size() <= maxCompressedPlainSize &&
+		compressMemoryBuffer(&plainData[0], (unsigned int)plainData.size(), envelope) == true &&
+		envelope.size() + compressedHeaderSize < plainData.size()) {
+
+		uint32 plainSize = (uint32)plainData.size();
+		uint32 compressedSize = (uint32)envelope.size();
+		unsigned char header[compressedHeaderSize];
+		header[0] = plainData[0] | compressedMessageFlag;
+		header[1] = nmctZlib;
+		for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+			header[2 + byteIndex] = static_cast<unsigned char>(plainSize >> (byteIndex * 8));
+			header[6 + byteIndex] = static_cast<unsigned char>(compressedSize >> (byteIndex * 8));
+		}
+		envelope.insert(envelope.begin(), header, header + compressedHeaderSize);
+
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] compressed messageType = %d from %u to %u bytes\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,plainData[0],plainSize,compressedSize);
+
+		MutexSafeWrapper safeMutex(NetworkMessage::mutexMessageStats.get());
+		NetworkMessageCompressionStats &stats = mapCompressionStats[plainData[0]];
+		stats.sendCount++;
+		stats.sendPlainBytes += plainSize;
+		stats.sendCompressedBytes += envelope.size();
+		safeMutex.ReleaseLock();
+
+		send(socket, &envelope[0], (int)envelope.size());
+	}
+	else {
+		send(socket, &plainData[0], (int)plainData.size());
+	}
+}
+
+// Reads a compressed envelope and lets the message read its data from
+// the extracted buffer
+bool NetworkMessage::receiveCompressed(Socket* socket) {
+	unsigned char header[compressedHeaderSize];
+	if(receive(socket, header, compressedHeaderSize, true) == false) {
+		return false;
+	}
+
+	uint32 plainSize = 0;
+	uint32 compressedSize = 0;
+	for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+		plainSize |= static_cast<uint32>(header[2 + byteIndex]) << (byteIndex * 8);
+		compressedSize |= static_cast<uint32>(header[6 + byteIndex]) << (byteIndex * 8);
+	}
+	if(header[1] != nmctZlib || plainSize == 0 || plainSize > maxCompressedPlainSize ||
+		compressedSize == 0 || compressedSize > plainSize) {
+		throw megaglest_runtime_error("Invalid compressed NetworkMessage header, type = " + intToStr(header[1]) + ", plainSize = " + uIntToStr(plainSize) + ", compressedSize = " + uIntToStr(compressedSize));
+	}
+
+	std::vector<unsigned char> compressedData(compressedSize);
+	if(receive(socket, &compressedData[0], compressedSize, true) == false) {
+		return false;
+	}
+	std::vector<unsigned char> plainData(plainSize);
+	if(extractMemoryBuffer(&compressedData[0], compressedSize, &plainData[0], plainSize) == false ||
+		plainData[0] != (header[0] & ~compressedMessageFlag)) {
+		throw megaglest_runtime_error("Error extracting compressed NetworkMessage, messageType = " + intToStr(header[0] & ~compressedMessageFlag));
+	}
+
+	MutexSafeWrapper safeMutex(NetworkMessage::mutexMessageStats.get());
+	NetworkMessageCompressionStats &stats = mapCompressionStats[plainData[0]];
+	stats.recvCount++;
+	stats.recvPlainBytes += plainSize;
+	stats.recvCompressedBytes += compressedSize + compressedHeaderSize;
+	safeMutex.ReleaseLock();
+
+	envelopeReceiveBuffer = &plainData[0];
+	envelopeReceiveSize = plainSize;
+	envelopeReceivePos = 0;
+	bool result = false;
+	try {
+		result = receive(socket);
+	}
+	catch(...) {
+		envelopeReceiveBuffer = NULL;
+		throw;
+	}
+	envelopeReceiveBuffer = NULL;
+
+	if(envelopeReceivePos != envelopeReceiveSize) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] WARNING, messageType = %d used %u of %u extracted bytes\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,plainData[0],envelopeReceivePos,envelopeReceiveSize);
+	}
+	return result;
+}
+
 void NetworkMessage::resetNetworkPacketStats() {
 	NetworkMessage::statsTimer.stop();
 	NetworkMessage::lastSend.stop();
 	NetworkMessage::lastRecv.stop();
 	NetworkMessage::mapMessageStats.clear();
+	NetworkMessage::mapCompressionStats.clear();
+
+	Socket::resetIOStats();
+	Socket::setIOStatsEnabled(Config::getInstance().getBool("DebugNetworkPacketStats","false"));
 }
 
 string  NetworkMessage::getNetworkPacketStats() {
@@ -122,9 +299,93 @@ string  NetworkMessage::getNetworkPacketStats() {
 
 		}
 	}
+
+	for(std::map<int,NetworkMessageCompressionStats>::iterator iterMap = mapCompressionStats.begin();
+			iterMap != mapCompressionStats.end(); ++iterMap) {
+		const NetworkMessageCompressionStats &stats = iterMap->second;
+		if(stats.sendCount > 0) {
+			result += "compressed send type " + intToStr(iterMap->first) + ": " + intToStr(stats.sendCount) +
+					  " msgs " + intToStr(stats.sendPlainBytes) + " -> " + intToStr(stats.sendCompressedBytes) + " bytes\n";
+		}
+		if(stats.recvCount > 0) {
+			result += "compressed recv type " + intToStr(iterMap->first) + ": " + intToStr(stats.recvCount) +
+					  " msgs " + intToStr(stats.recvPlainBytes) + " -> " + intToStr(stats.recvCompressedBytes) + " bytes\n";
+		}
+	}
+	result += Socket::getIOStats();
 	return result;
 }
 
+int NetworkMessage::getFixedFramedSize(NetworkMessage &message) {
+	return (useOldProtocol == true ? (int)message.getDataSize() : (int)message.getPackedSize());
+}
+
+int NetworkMessage::getFramedSize(const unsigned char *data, int dataSize, uint8 commandListProtocol) {
+	if(data == NULL || dataSize < 1) {
+		return 0;
+	}
+
+	if((data[0] & compressedMessageFlag) != 0) {
+		if(dataSize < compressedHeaderSize) {
+			return 0;
+		}
+		uint32 compressedSize = 0;
+		for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+			compressedSize |= static_cast<uint32>(data[6 + byteIndex]) << (byteIndex * 8);
+		}
+		if(compressedSize > maxCompressedPlainSize) {
+			return -1;
+		}
+		return compressedHeaderSize + (int)compressedSize;
+	}
+
+	switch(data[0]) {
+		case nmtCommandList:
+			return NetworkMessageCommandList::getFramedSize(data, dataSize, commandListProtocol);
+		case nmtIntro: {
+			NetworkMessageIntro message;
+			return getFixedFramedSize(message);
+		}
+		case nmtPing: {
+			NetworkMessagePing message;
+			return getFixedFramedSize(message);
+		}
+		case nmtReady: {
+			NetworkMessageReady message;
+			return getFixedFramedSize(message);
+		}
+		case nmtText: {
+			NetworkMessageText message;
+			return getFixedFramedSize(message);
+		}
+		case nmtQuit: {
+			NetworkMessageQuit message;
+			return getFixedFramedSize(message);
+		}
+		case nmtLoadingStatusMessage: {
+			NetworkMessageLoadingStatus message(nmls_NONE);
+			return getFixedFramedSize(message);
+		}
+		case nmtMarkCell: {
+			NetworkMessageMarkCell message;
+			return getFixedFramedSize(message);
+		}
+		case nmtUnMarkCell: {
+			NetworkMessageUnMarkCell message;
+			return getFixedFramedSize(message);
+		}
+		case nmtHighlightCell: {
+			NetworkMessageHighlightCell message;
+			return getFixedFramedSize(message);
+		}
+		case nmtCapabilities: {
+			NetworkMessageCapabilities message;
+			return getFixedFramedSize(message);
+		}
+	}
+	return -1;
+}
+
 void NetworkMessage::dump_packet(string label, const void* data, int dataSize, bool isSend) {
 	Config &config = Config::getInstance();
 	if( config.getBool("DebugNetworkPacketStats","false") == true) {
@@ -374,11 +635,11 @@ bool NetworkMessageIntro::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -496,11 +757,11 @@ bool NetworkMessagePing::receive(Socket* socket){
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -594,12 +855,10 @@ bool NetworkMessageReady::receive(Socket* socket){
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		//bool result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 	return result;
@@ -1298,11 +1557,11 @@ bool NetworkMessageLaunch::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -1448,6 +1707,7 @@ NetworkMessageCommandList::NetworkMessageCommandList(int32 frameCount) {
 	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
 		data.header.networkPlayerFactionCRC[index]=0;
 	}
+	commandListProtocol= nclpFixedSize;
 }
 
 bool NetworkMessageCommandList::addCommand(const NetworkCommand* networkCommand){
@@ -1602,6 +1862,10 @@ unsigned char * NetworkMessageCommandList::packMessageDetail(uint16 totalCommand
 bool NetworkMessageCommandList::receive(Socket* socket) {
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
 
+	if(commandListProtocol == nclpCompact) {
+		return receiveCompact(socket);
+	}
+
 	unsigned char *buf = NULL;
 	bool result = false;
 	if(useOldProtocol == true) {
@@ -1609,11 +1873,12 @@ bool NetworkMessageCommandList::receive(Socket* socket) {
 		//printf("!!! =====> IN Network hdr cmd get frame: %d data.header.commandCount: %u\n",data.header.frameCount,data.header.commandCount);
 	}
 	else {
-		buf = new unsigned char[getPackedSizeHeader()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSizeHeader(), true);
-		unpackMessageHeader(buf);
+		buf = receiveData(socket, getPackedSizeHeader());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessageHeader(buf);
+		}
 		//if(data.header.commandCount) printf("\n\nGot packet size = %u data.messageType = %d\n%s\ncommandcount [%u] framecount [%d]\n",getPackedSizeHeader(),data.header.messageType,buf,data.header.commandCount,data.header.frameCount);
-		delete [] buf;
 	}
 	fromEndianHeader();
 
@@ -1636,11 +1901,11 @@ bool NetworkMessageCommandList::receive(Socket* socket) {
 			else {
 				//int totalMsgSize = (sizeof(NetworkCommand) * data.header.commandCount);
 				//result = NetworkMessage::receive(socket, &data.commands[0], totalMsgSize, true);
-				buf = new unsigned char[getPackedSizeDetail(data.header.commandCount)+1];
-				result = NetworkMessage::receive(socket, buf, getPackedSizeDetail(data.header.commandCount), true);
-				unpackMessageDetail(buf,data.header.commandCount);
-				//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-				delete [] buf;
+				buf = receiveData(socket, getPackedSizeDetail(data.header.commandCount));
+				result = (buf != NULL);
+				if(buf != NULL) {
+					unpackMessageDetail(buf,data.header.commandCount);
+				}
 			}
 			fromEndianDetail();
 
@@ -1676,6 +1941,11 @@ void NetworkMessageCommandList::send(Socket* socket) {
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] nmtCommandList, frameCount = %d, data.header.commandCount = %d, data.header.messageType = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,data.header.frameCount,data.header.commandCount,data.header.messageType);
 
 	assert(data.header.messageType==nmtCommandList);
+	if(commandListProtocol == nclpCompact) {
+		sendCompact(socket);
+		return;
+	}
+
 	uint16 totalCommand = data.header.commandCount;
 	toEndianHeader();
 
@@ -1738,6 +2008,327 @@ void NetworkMessageCommandList::send(Socket* socket) {
 	}
 }
 
+// Fields of a command in the order the compact format flags them, the ones
+// that change between the commands of a group order come first so the
+// field mask of those commands stays within one byte
+enum CompactCommandField {
+	ccfNetworkCommandType,
+	ccfUnitTypeId,
+	ccfCommandTypeId,
+	ccfPositionX,
+	ccfPositionY,
+	ccfTargetId,
+	ccfUnitCommandGroupId,
+	ccfWantQueue,
+	ccfFromFactionIndex,
+	ccfUnitFactionUnitCount,
+	ccfUnitFactionIndex,
+	ccfCommandStateType,
+	ccfCommandStateValue,
+
+	ccfCount
+};
+
+static void getCompactCommandFields(const NetworkCommand &command, int32 *fields) {
+	fields[ccfNetworkCommandType]	= command.networkCommandType;
+	fields[ccfUnitTypeId]			= command.unitTypeId;
+	fields[ccfCommandTypeId]		= command.commandTypeId;
+	fields[ccfPositionX]			= command.positionX;
+	fields[ccfPositionY]			= command.positionY;
+	fields[ccfTargetId]				= command.targetId;
+	fields[ccfUnitCommandGroupId]	= command.unitCommandGroupId;
+	fields[ccfWantQueue]			= command.wantQueue;
+	fields[ccfFromFactionIndex]		= command.fromFactionIndex;
+	fields[ccfUnitFactionUnitCount]	= command.unitFactionUnitCount;
+	fields[ccfUnitFactionIndex]		= command.unitFactionIndex;
+	fields[ccfCommandStateType]		= command.commandStateType;
+	fields[ccfCommandStateValue]	= command.commandStateValue;
+}
+
+static void setCompactCommandFields(NetworkCommand &command, const int32 *fields) {
+	command.networkCommandType		= static_cast<int16>(fields[ccfNetworkCommandType]);
+	command.unitTypeId				= static_cast<int16>(fields[ccfUnitTypeId]);
+	command.commandTypeId			= static_cast<int16>(fields[ccfCommandTypeId]);
+	command.positionX				= static_cast<int16>(fields[ccfPositionX]);
+	command.positionY				= static_cast<int16>(fields[ccfPositionY]);
+	command.targetId				= fields[ccfTargetId];
+	command.unitCommandGroupId		= fields[ccfUnitCommandGroupId];
+	command.wantQueue				= static_cast<int8>(fields[ccfWantQueue]);
+	command.fromFactionIndex		= static_cast<int8>(fields[ccfFromFactionIndex]);
+	command.unitFactionUnitCount	= static_cast<uint16>(fields[ccfUnitFactionUnitCount]);
+	command.unitFactionIndex		= static_cast<int8>(fields[ccfUnitFactionIndex]);
+	command.commandStateType		= static_cast<int8>(fields[ccfCommandStateType]);
+	command.commandStateValue		= fields[ccfCommandStateValue];
+}
+
+static void writeCompactUInt(std::vector<unsigned char> &buf, uint32 value) {
+	while(value >= 0x80) {
+		buf.push_back(static_cast<unsigned char>(value | 0x80));
+		value >>= 7;
+	}
+	buf.push_back(static_cast<unsigned char>(value));
+}
+
+// zigzag so small negative values like -1 stay one byte
+static void writeCompactInt(std::vector<unsigned char> &buf, int32 value) {
+	writeCompactUInt(buf, (static_cast<uint32>(value) << 1) ^ static_cast<uint32>(value >> 31));
+}
+
+static void writeCompactUInt32Fixed(std::vector<unsigned char> &buf, uint32 value) {
+	for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+		buf.push_back(static_cast<unsigned char>(value >> (byteIndex * 8)));
+	}
+}
+
+static bool readCompactUInt(const unsigned char *buf, unsigned int bufSize, unsigned int &pos, uint32 &value) {
+	value = 0;
+	for(unsigned int shift = 0; shift < 35; shift += 7) {
+		if(pos >= bufSize) {
+			return false;
+		}
+		unsigned char byte = buf[pos++];
+		value |= static_cast<uint32>(byte & 0x7f) << shift;
+		if((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool readCompactInt(const unsigned char *buf, unsigned int bufSize, unsigned int &pos, int32 &value) {
+	uint32 encoded = 0;
+	if(readCompactUInt(buf, bufSize, pos, encoded) == false) {
+		return false;
+	}
+	value = static_cast<int32>((encoded >> 1) ^ (0 - (encoded & 1)));
+	return true;
+}
+
+static bool readCompactUInt32Fixed(const unsigned char *buf, unsigned int bufSize, unsigned int &pos, uint32 &value) {
+	if(pos + 4 > bufSize) {
+		return false;
+	}
+	value = 0;
+	for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+		value |= static_cast<uint32>(buf[pos++]) << (byteIndex * 8);
+	}
+	return true;
+}
+
+unsigned int NetworkMessageCommandList::getFixedSizeByteCount() {
+	if(useOldProtocol == true) {
+		return commandListHeaderSize + (unsigned int)sizeof(NetworkCommand) * data.header.commandCount;
+	}
+	return getPackedSizeHeader() + getPackedSizeDetail(data.header.commandCount);
+}
+
+void NetworkMessageCommandList::packCompact(std::vector<unsigned char> &buf) const {
+	buf.clear();
+	buf.reserve(compactPrefixSize + 16 + data.header.commandCount * 4);
+	buf.push_back(static_cast<unsigned char>(data.header.messageType));
+	// body size, filled in at the end
+	writeCompactUInt32Fixed(buf, 0);
+
+	writeCompactInt(buf, data.header.frameCount);
+	writeCompactUInt(buf, data.header.commandCount);
+
+	// CRCs are only set while network synch checks run
+	unsigned char crcMask = 0;
+	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+		if(data.header.networkPlayerFactionCRC[index] != 0) {
+			crcMask |= (1 << index);
+		}
+	}
+	buf.push_back(crcMask);
+	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+		if(data.header.networkPlayerFactionCRC[index] != 0) {
+			writeCompactUInt32Fixed(buf, data.header.networkPlayerFactionCRC[index]);
+		}
+	}
+
+	NetworkCommand previousCommand;
+	int32 previousFields[ccfCount];
+	getCompactCommandFields(previousCommand, previousFields);
+	for(unsigned int commandIndex = 0; commandIndex < data.header.commandCount; ++commandIndex) {
+		const NetworkCommand &command = data.commands[commandIndex];
+		int32 fields[ccfCount];
+		getCompactCommandFields(command, fields);
+
+		uint32 fieldMask = 0;
+		for(int fieldIndex = 0; fieldIndex < ccfCount; ++fieldIndex) {
+			if(fields[fieldIndex] != previousFields[fieldIndex]) {
+				fieldMask |= (1 << fieldIndex);
+			}
+		}
+		writeCompactUInt(buf, fieldMask);
+		// unit ids can be anything a peer sends, so the delta wraps
+		writeCompactInt(buf, static_cast<int32>(static_cast<uint32>(command.unitId) - static_cast<uint32>(previousCommand.unitId)));
+		for(int fieldIndex = 0; fieldIndex < ccfCount; ++fieldIndex) {
+			if((fieldMask & (1 << fieldIndex)) != 0) {
+				writeCompactInt(buf, fields[fieldIndex]);
+			}
+		}
+
+		previousCommand = command;
+		memcpy(previousFields, fields, sizeof(fields));
+	}
+
+	uint32 bodySize = (uint32)buf.size() - compactPrefixSize;
+	for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+		buf[1 + byteIndex] = static_cast<unsigned char>(bodySize >> (byteIndex * 8));
+	}
+}
+
+bool NetworkMessageCommandList::unpackCompact(const unsigned char *buf, unsigned int bufSize) {
+	if(bufSize < (unsigned int)compactPrefixSize) {
+		return false;
+	}
+	unsigned int pos = 1;
+	uint32 bodySize = 0;
+	readCompactUInt32Fixed(buf, bufSize, pos, bodySize);
+	if(bodySize != bufSize - compactPrefixSize) {
+		return false;
+	}
+
+	int32 frameCount = 0;
+	uint32 commandCount = 0;
+	if(readCompactInt(buf, bufSize, pos, frameCount) == false ||
+		readCompactUInt(buf, bufSize, pos, commandCount) == false ||
+		commandCount > 0xffff || commandCount > bodySize || pos >= bufSize) {
+		return false;
+	}
+	data.header.messageType = static_cast<int8>(buf[0]);
+	data.header.frameCount = frameCount;
+	data.header.commandCount = static_cast<uint16>(commandCount);
+
+	unsigned char crcMask = buf[pos++];
+	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+		data.header.networkPlayerFactionCRC[index] = 0;
+		if((crcMask & (1 << index)) != 0 &&
+			readCompactUInt32Fixed(buf, bufSize, pos, data.header.networkPlayerFactionCRC[index]) == false) {
+			return false;
+		}
+	}
+
+	data.commands.clear();
+	data.commands.resize(commandCount);
+	NetworkCommand previousCommand;
+	int32 fields[ccfCount];
+	getCompactCommandFields(previousCommand, fields);
+	for(unsigned int commandIndex = 0; commandIndex < commandCount; ++commandIndex) {
+		uint32 fieldMask = 0;
+		int32 unitIdDelta = 0;
+		if(readCompactUInt(buf, bufSize, pos, fieldMask) == false ||
+			fieldMask >= (1u << ccfCount) ||
+			readCompactInt(buf, bufSize, pos, unitIdDelta) == false) {
+			return false;
+		}
+		for(int fieldIndex = 0; fieldIndex < ccfCount; ++fieldIndex) {
+			if((fieldMask & (1 << fieldIndex)) != 0 &&
+				readCompactInt(buf, bufSize, pos, fields[fieldIndex]) == false) {
+				return false;
+			}
+		}
+
+		NetworkCommand &command = data.commands[commandIndex];
+		setCompactCommandFields(command, fields);
+		command.unitId = static_cast<int32>(static_cast<uint32>(previousCommand.unitId) + static_cast<uint32>(unitIdDelta));
+		previousCommand = command;
+	}
+	return (pos == bufSize);
+}
+
+int NetworkMessageCommandList::getFramedSize(const unsigned char *buf, int bufSize, uint8 commandListProtocol) {
+	if(commandListProtocol == nclpCompact) {
+		if(bufSize < compactPrefixSize) {
+			return 0;
+		}
+		uint32 bodySize = 0;
+		for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+			bodySize |= static_cast<uint32>(buf[1 + byteIndex]) << (byteIndex * 8);
+		}
+		if(bodySize == 0 || bodySize > maxCompactBodySize) {
+			return -1;
+		}
+		return compactPrefixSize + (int)bodySize;
+	}
+
+	NetworkMessageCommandList message;
+	if(useOldProtocol == true) {
+		if(bufSize < commandListHeaderSize) {
+			return 0;
+		}
+		memcpy(&message.data.header, buf, commandListHeaderSize);
+		message.fromEndianHeader();
+		return commandListHeaderSize + (int)(sizeof(NetworkCommand) * message.data.header.commandCount);
+	}
+
+	int headerSize = (int)message.getPackedSizeHeader();
+	if(bufSize < headerSize) {
+		return 0;
+	}
+	std::vector<unsigned char> header(buf, buf + headerSize);
+	message.unpackMessageHeader(&header[0]);
+	message.fromEndianHeader();
+	if(message.data.header.commandCount == 0) {
+		return headerSize;
+	}
+	return headerSize + (int)message.getPackedSizeDetail(1) * message.data.header.commandCount;
+}
+
+bool NetworkMessageCommandList::receiveCompact(Socket* socket) {
+	std::vector<unsigned char> buf(compactPrefixSize);
+	bool result = NetworkMessage::receive(socket, &buf[0], compactPrefixSize, true);
+	if(result == true) {
+		uint32 bodySize = 0;
+		for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+			bodySize |= static_cast<uint32>(buf[1 + byteIndex]) << (byteIndex * 8);
+		}
+		if(bodySize == 0 || bodySize > maxCompactBodySize) {
+			throw megaglest_runtime_error("Invalid compact command list body size: " + uIntToStr(bodySize));
+		}
+
+		buf.resize(compactPrefixSize + bodySize);
+		result = NetworkMessage::receive(socket, &buf[compactPrefixSize], bodySize, true);
+		if(result == true) {
+			if(unpackCompact(&buf[0], (unsigned int)buf.size()) == false) {
+				throw megaglest_runtime_error("Invalid compact command list received, size: " + uIntToStr(bodySize));
+			}
+
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled == true) {
+				SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] got compact command list, size = %u, commandCount = %u, frameCount = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,bodySize,data.header.commandCount,data.header.frameCount);
+				for(int idx = 0 ; idx < data.header.commandCount; ++idx) {
+					const NetworkCommand &cmd = data.commands[idx];
+
+					SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] index = %d, received networkCommand [%s]\n",
+							extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,idx, cmd.toString().c_str());
+				}
+			}
+		}
+	}
+	if(result == false) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] ERROR compact command list not received as expected\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
+	}
+	return result;
+}
+
+void NetworkMessageCommandList::sendCompact(Socket* socket) {
+	std::vector<unsigned char> buf;
+	packCompact(buf);
+	NetworkMessage::send(socket, &buf[0], (int)buf.size());
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled == true) {
+		SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] sent compact command list, size = " MG_SIZE_T_SPECIFIER ", fixed size = %u, frameCount = %d, commandCount = %d\n",
+				extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,buf.size(),getFixedSizeByteCount(),data.header.frameCount,data.header.commandCount);
+		for(int idx = 0 ; idx < data.header.commandCount; ++idx) {
+			const NetworkCommand &cmd = data.commands[idx];
+
+			SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] index = %d, sent networkCommand [%s]\n",
+					extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,idx, cmd.toString().c_str());
+		}
+	}
+}
+
 void NetworkMessageCommandList::toEndianHeader() {
 	static bool bigEndianSystem = Shared::PlatformByteOrder::isBigEndian();
 	if(bigEndianSystem == true) {
@@ -1856,11 +2447,11 @@ bool NetworkMessageText::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -1947,11 +2538,11 @@ bool NetworkMessageQuit::receive(Socket* socket) {
 	}
 	else {
 		//fromEndian();
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -2589,11 +3180,11 @@ bool NetworkMessageSynchNetworkGameDataFileCRCCheck::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data),true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 	data.fileName.nullTerminate();
@@ -2683,11 +3274,11 @@ bool NetworkMessageSynchNetworkGameDataFileGet::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data),true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 	data.fileName.nullTerminate();
@@ -2821,11 +3412,11 @@ bool SwitchSetupRequest::receive(Socket* socket) {
 	}
 	else {
 		//fromEndian();
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\nTeam = %d faction [%s] currentFactionIndex = %d toFactionIndex = %d\n",getPackedSize(),data.messageType,buf,data.toTeam,data.selectedFactionName.getBuffer(),data.currentFactionIndex,data.toFactionIndex);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -2925,11 +3516,11 @@ bool PlayerIndexMessage::receive(Socket* socket) {
 	}
 	else {
 		//fromEndian();
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -3015,11 +3606,11 @@ bool NetworkMessageLoadingStatus::receive(Socket* socket) {
 	}
 	else {
 		//fromEndian();
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -3135,11 +3726,11 @@ bool NetworkMessageMarkCell::receive(Socket* socket){
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -3257,11 +3848,11 @@ bool NetworkMessageUnMarkCell::receive(Socket* socket){
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 
@@ -3370,11 +3961,11 @@ bool NetworkMessageHighlightCell::receive(Socket* socket) {
 		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
 	}
 	else {
-		unsigned char *buf = new unsigned char[getPackedSize()+1];
-		result = NetworkMessage::receive(socket, buf, getPackedSize(), true);
-		unpackMessage(buf);
-		//printf("Got packet size = %u data.messageType = %d\n%s\n",getPackedSize(),data.messageType,buf);
-		delete [] buf;
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
 	}
 	fromEndian();
 	return result;
@@ -3416,4 +4007,108 @@ void NetworkMessageHighlightCell::fromEndian() {
 	}
 }
 
+// =====================================================
+//	class NetworkMessageCapabilities
+// =====================================================
+
+NetworkMessageCapabilities::NetworkMessageCapabilities() {
+	data.messageType			= nmtCapabilities;
+	data.commandListProtocol	= nclpFixedSize;
+	data.messageCompression		= nmctNone;
+}
+
+NetworkMessageCapabilities::NetworkMessageCapabilities(uint8 commandListProtocol, uint8 messageCompression) {
+	data.messageType			= nmtCapabilities;
+	data.commandListProtocol	= commandListProtocol;
+	data.messageCompression		= messageCompression;
+}
+
+const char * NetworkMessageCapabilities::getPackedMessageFormat() const {
+	return "cCC";
+}
+
+unsigned int NetworkMessageCapabilities::getPackedSize() {
+	static unsigned int result = 0;
+	if(result == 0) {
+		Data packedData;
+		packedData.messageType = 0;
+		packedData.commandListProtocol = 0;
+		packedData.messageCompression = 0;
+		unsigned char *buf = new unsigned char[sizeof(packedData)*3];
+		result = pack(buf, getPackedMessageFormat(),
+				packedData.messageType,
+				packedData.commandListProtocol,
+				packedData.messageCompression);
+		delete [] buf;
+	}
+	return result;
+}
+void NetworkMessageCapabilities::unpackMessage(unsigned char *buf) {
+	unpack(buf, getPackedMessageFormat(),
+			&data.messageType,
+			&data.commandListProtocol,
+			&data.messageCompression);
+}
+
+unsigned char * NetworkMessageCapabilities::packMessage() {
+	unsigned char *buf = new unsigned char[getPackedSize()+1];
+	pack(buf, getPackedMessageFormat(),
+			data.messageType,
+			data.commandListProtocol,
+			data.messageCompression);
+
+	return buf;
+}
+
+bool NetworkMessageCapabilities::receive(Socket* socket) {
+	bool result = false;
+	if(useOldProtocol == true) {
+		result = NetworkMessage::receive(socket, &data, sizeof(data), true);
+	}
+	else {
+		unsigned char *buf = receiveData(socket, getPackedSize());
+		result = (buf != NULL);
+		if(buf != NULL) {
+			unpackMessage(buf);
+		}
+	}
+	fromEndian();
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] got nmtCapabilities, commandListProtocol = %d, messageCompression = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,data.commandListProtocol,data.messageCompression);
+	return result;
+}
+
+void NetworkMessageCapabilities::send(Socket* socket) {
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] sending nmtCapabilities, commandListProtocol = %d, messageCompression = %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,data.commandListProtocol,data.messageCompression);
+
+	assert(data.messageType == nmtCapabilities);
+	toEndian();
+
+	if(useOldProtocol == true) {
+		NetworkMessage::send(socket, &data, sizeof(data));
+	}
+	else {
+		unsigned char *buf = packMessage();
+		NetworkMessage::send(socket, buf, getPackedSize());
+		delete [] buf;
+	}
+}
+
+void NetworkMessageCapabilities::toEndian() {
+	static bool bigEndianSystem = Shared::PlatformByteOrder::isBigEndian();
+	if(bigEndianSystem == true) {
+		data.messageType = Shared::PlatformByteOrder::toCommonEndian(data.messageType);
+		data.commandListProtocol = Shared::PlatformByteOrder::toCommonEndian(data.commandListProtocol);
+		data.messageCompression = Shared::PlatformByteOrder::toCommonEndian(data.messageCompression);
+	}
+}
+void NetworkMessageCapabilities::fromEndian() {
+	static bool bigEndianSystem = Shared::PlatformByteOrder::isBigEndian();
+	if(bigEndianSystem == true) {
+		data.messageType = Shared::PlatformByteOrder::fromCommonEndian(data.messageType);
+		data.commandListProtocol = Shared::PlatformByteOrder::fromCommonEndian(data.commandListProtocol);
+		data.messageCompression = Shared::PlatformByteOrder::fromCommonEndian(data.messageCompression);
+	}
+}
+
 }}//end namespace
@@ -49,6 +49,7 @@ enum NetworkMessageType {
 	nmtMarkCell,
 	nmtUnMarkCell,
 	nmtHighlightCell,
+	nmtCapabilities,
 
 	nmtCount
 };
@@ -57,10 +58,31 @@ enum NetworkGameStateType {
 	nmgstInvalid,
 	nmgstOk,
 	nmgstNoSlots,
+	// a client intro with this state also reads NetworkMessageCapabilities,
+	// older servers never look at the state a client sends
+	nmgstOkCapabilities,
 
 	nmgstCount
 };
 
+// Wire formats for NetworkMessageCommandList, both sides announce the
+// highest one they support in NetworkMessageCapabilities and use the lower one
+enum NetworkCommandListProtocol {
+	nclpFixedSize,
+	nclpCompact,
+
+	nclpCount
+};
+
+// Compression both sides of a connection support for large messages,
+// negotiated in NetworkMessageCapabilities like NetworkCommandListProtocol
+enum NetworkMessageCompressionType {
+	nmctNone,
+	nmctZlib,
+
+	nmctCount
+};
+
 static const int maxLanguageStringSize= 60;
 
 // =====================================================
@@ -93,6 +115,24 @@ enum NetworkMessageStatisticType {
 
 };
 
+struct NetworkMessageCompressionStats {
+	int64 sendCount;
+	int64 sendPlainBytes;
+	int64 sendCompressedBytes;
+	int64 recvCount;
+	int64 recvPlainBytes;
+	int64 recvCompressedBytes;
+
+	NetworkMessageCompressionStats() {
+		sendCount = 0;
+		sendPlainBytes = 0;
+		sendCompressedBytes = 0;
+		recvCount = 0;
+		recvPlainBytes = 0;
+		recvCompressedBytes = 0;
+	}
+};
+
 class NetworkMessage {
 private:
 
@@ -101,22 +141,55 @@ private:
 	static Chrono lastSend;
 	static Chrono lastRecv;
 	static std::map<NetworkMessageStatisticType,int64> mapMessageStats;
+	static std::map<int,NetworkMessageCompressionStats> mapCompressionStats;
+
+	// While a message is sent or received through a compressed envelope
+	// its data goes to or comes from these buffers instead of the socket
+	std::vector<unsigned char> *envelopeSendBuffer;
+	unsigned char *envelopeReceiveBuffer;
+	unsigned int envelopeReceiveSize;
+	unsigned int envelopeReceivePos;
+
+	// Holds received data when it can't be read in place
+	std::vector<unsigned char> receiveScratchBuffer;
+
+	void captureMessage(Socket* socket, std::vector<unsigned char> &messageData);
+	static int getFixedFramedSize(NetworkMessage &message);
 
 public:
+	// A compressed envelope starts with the type of the message it holds
+	// with this bit set, then compression type, plain and compressed size
+	static const uint8 compressedMessageFlag = 0x80;
+	static const int compressedHeaderSize = 10;
+	static const unsigned int maxCompressedPlainSize = 64 * 1024 * 1024;
+
 	static void resetNetworkPacketStats();
 	static string getNetworkPacketStats();
 
+	// Bytes the message at the front of data takes on the wire, worked out
+	// from its type and size fields only: 0 while more data is needed to
+	// tell and -1 for types whose size is only known by reading all of it
+	static int getFramedSize(const unsigned char *data, int dataSize, uint8 commandListProtocol);
+
 	static bool useOldProtocol;
+	NetworkMessage();
 	virtual ~NetworkMessage(){}
 	virtual bool receive(Socket* socket)= 0;
 	virtual void send(Socket* socket) = 0;
 	virtual size_t getDataSize() const = 0;
 
+	void sendCompressed(Socket* socket, unsigned int compressionThreshold);
+	bool receiveCompressed(Socket* socket);
+	void sendCoalesced(Socket* socket);
+	// the data send() writes, for messages passed on without a socket
+	void getMessageData(std::vector<unsigned char> &messageData) { captureMessage(NULL, messageData); }
+
 	void dump_packet(string label, const void* data, int dataSize, bool isSend);
 
 protected:
 	//bool peek(Socket* socket, void* data, int dataSize);
 	bool receive(Socket* socket, void* data, int dataSize,bool tryReceiveUntilDataSizeMet);
+	unsigned char * receiveData(Socket* socket, int dataSize);
 	void send(Socket* socket, const void* data, int dataSize);
 
 	virtual const char * getPackedMessageFormat() const = 0;
@@ -139,7 +212,10 @@ private:
 	static const int maxNameSize= 32;
 	static const int maxSmallStringSize= 60;
 
-private:
+public:
+	// Peers of every version read this before they can tell each other
+	// apart, so it must never change. New settings go in
+	// NetworkMessageCapabilities instead.
 	struct Data {
 		int8 messageType;
 		int32 sessionId;
@@ -154,6 +230,8 @@ private:
 		NetworkString<maxSmallStringSize> playerUUID;
 		NetworkString<maxSmallStringSize> platform;
 	};
+
+private:
 	void toEndian();
 	void fromEndian();
 
@@ -379,6 +457,11 @@ public:
 //	class CommandList
 //
 //	Message to order a commands to several units
+//
+//	With nclpCompact the list is sent as: message type,
+//	body size and a body of varints where each command only
+//	carries the fields that differ from the one before it
+//	and faction CRCs are only sent when they are set
 // =====================================================
 
 #pragma pack(push, 1)
@@ -411,8 +494,15 @@ private:
 	void toEndianDetail(uint16 totalCommand);
 	void fromEndianDetail();
 
+	static const int32 compactPrefixSize = 5;
+	static const uint32 maxCompactBodySize = 1024 * 1024;
+
+	bool receiveCompact(Socket* socket);
+	void sendCompact(Socket* socket);
+
 private:
 	Data data;
+	uint8 commandListProtocol;
 
 protected:
 	virtual const char * getPackedMessageFormat() const { return NULL; }
@@ -445,6 +535,14 @@ public:
 
 	const NetworkCommand* getCommand(int i) const	{return &data.commands[i];}
 
+	uint8 getCommandListProtocol() const				{return commandListProtocol;}
+	void setCommandListProtocol(uint8 value)			{commandListProtocol= value;}
+
+	unsigned int getFixedSizeByteCount();
+	void packCompact(std::vector<unsigned char> &buf) const;
+	bool unpackCompact(const unsigned char *buf, unsigned int bufSize);
+	static int getFramedSize(const unsigned char *buf, int bufSize, uint8 commandListProtocol);
+
 	virtual bool receive(Socket* socket);
 	virtual void send(Socket* socket);
 };
@@ -1110,6 +1208,48 @@ public:
 };
 #pragma pack(pop)
 
+// =====================================================
+//	class NetworkMessageCapabilities
+//
+//	Sent by the server after a client intro that asked
+//	for it, the client answers with the settings both
+//	sides use from then on. Peers that never get one
+//	keep fixed size command lists and no compression.
+// =====================================================
+
+#pragma pack(push, 1)
+class NetworkMessageCapabilities: public NetworkMessage {
+private:
+	struct Data{
+		int8 messageType;
+		uint8 commandListProtocol;
+		uint8 messageCompression;
+	};
+	void toEndian();
+	void fromEndian();
+
+private:
+	Data data;
+
+protected:
+	virtual const char * getPackedMessageFormat() const;
+	virtual unsigned int getPackedSize();
+	virtual void unpackMessage(unsigned char *buf);
+	virtual unsigned char * packMessage();
+
+public:
+	NetworkMessageCapabilities();
+	NetworkMessageCapabilities(uint8 commandListProtocol, uint8 messageCompression);
+
+	virtual size_t getDataSize() const { return sizeof(Data); }
+
+	uint8 getCommandListProtocol() const	{ return data.commandListProtocol; }
+	uint8 getMessageCompression() const		{ return data.messageCompression; }
+
+	virtual bool receive(Socket* socket);
+	virtual void send(Socket* socket);
+};
+#pragma pack(pop)
 
 }}//end namespace
 
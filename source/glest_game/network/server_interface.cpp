@@ -23,6 +23,7 @@
 #include "util.h"
 #include "game_util.h"
 #include "miniftpserver.h"
+#include "content_transfer.h"
 #include "map_preview.h"
 #include "stats.h"
 #include <time.h>
@@ -55,6 +56,32 @@ const int MASTERSERVER_HEARTBEAT_GAME_STATUS_SECONDS 		= 30;
 
 const int MAX_EMPTY_NETWORK_COMMAND_LIST_BROADCAST_INTERVAL_MILLISECONDS = 4000;
 
+// =====================================================
+//	class ServerSocketReactorThread
+// =====================================================
+
+ServerSocketReactorThread::ServerSocketReactorThread(ServerInterface *serverInterface) : BaseThread() {
+	this->serverInterface = serverInterface;
+	uniqueID = "ServerSocketReactorThread";
+}
+
+void ServerSocketReactorThread::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	try {
+		for(;getQuitStatus() == false;) {
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			serverInterface->dispatchSocketReactorEvents(100);
+		}
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,ex.what());
+	}
+}
+
+// =====================================================
+//	class ServerInterface
+// =====================================================
+
 ServerInterface::ServerInterface(bool publishEnabled, ClientLagCallbackInterface *clientLagCallbackInterface) : GameNetworkInterface() {
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
 
@@ -87,10 +114,13 @@ ServerInterface::ServerInterface(bool publishEnabled, ClientLagCallbackInterface
 	lastMasterserverHeartbeatTime 	= 0;
 	needToRepublishToMasterserver 	= false;
 	ftpServer 						= NULL;
+	contentTransferServer			= NULL;
 	inBroadcastMessage				= false;
 	lastGlobalLagCheckTime			= 0;
 	masterserverAdminRequestLaunch	= false;
 	lastListenerSlotCheckTime		= 0;
+	adaptiveFrameScheduling			= NetworkFrameScheduler::isAdaptiveSchedulingEnabled();
+	lastRoundTripPingMillis			= 0;
 
 	// This is an admin port listening only on the localhost intended to
 	// give current connection status info
@@ -122,6 +152,42 @@ ServerInterface::ServerInterface(bool publishEnabled, ClientLagCallbackInterface
 	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
 		slots[index]				= NULL;
 		switchSetupRequests[index]	= NULL;
+		socketReactorSlotSockets[index] = 0;
+	}
+
+	// Epoll reactor thread reading the sockets of all slots during the game
+	// in place of one receiving thread per slot, on by default for headless
+	// servers
+	socketReactor 		= NULL;
+	socketReactorThread = NULL;
+	if(Config::getInstance().getBool("EnableServerSocketReactor",
+			GlobalStaticFlags::getIsNonGraphicalModeEnabled() == true ? "true" : "false") == true &&
+		SocketReactor::isSupported() == true) {
+		socketReactor = new SocketReactor();
+		if(socketReactor->isValid() == true) {
+			static string mutexOwnerId = string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+			socketReactorThread = new ServerSocketReactorThread(this);
+			socketReactorThread->setUniqueID(mutexOwnerId);
+			socketReactorThread->start();
+		}
+		else {
+			delete socketReactor;
+			socketReactor = NULL;
+		}
+	}
+
+	// Read only spectators of a headless server get the command lists from
+	// a relay instead of taking up slots in the lockstep
+	spectatorRelay = NULL;
+	if(SpectatorRelay::isRelayEnabled() == true) {
+		spectatorRelay = new SpectatorRelay(
+				Config::getInstance().getInt("SpectatorRelayPort", intToStr(GameConstants::spectatorRelayPort).c_str()),
+				Config::getInstance().getInt("SpectatorRelayDelaySeconds","0"),
+				Config::getInstance().getInt("SpectatorRelayMaxBufferMegabytes","64"));
+		if(spectatorRelay->isListening() == false) {
+			delete spectatorRelay;
+			spectatorRelay = NULL;
+		}
 	}
 
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
@@ -219,6 +285,35 @@ ServerInterface::ServerInterface(bool publishEnabled, ClientLagCallbackInterface
 				allowInternetTechtreeFileTransfers,portNumber,GameConstants::maxPlayers,
 				this,tempFilePath);
 		ftpServer->start();
+
+		// maps, tilesets and techtrees in chunks over parallel connections,
+		// the user data folders are searched first like the ftp client does.
+		// This opens another port, so hosts turn it on themselves
+		if(Config::getInstance().getBool("EnableContentTransferServer","false") == true) {
+			int contentTransferPort = Config::getInstance().getInt("ContentTransferPort",intToStr(GameConstants::contentTransferPort).c_str());
+			contentTransferServer = new ContentTransferServer(contentTransferPort,
+					GameConstants::maxPlayers * Config::getInstance().getInt("ContentTransferStreams","4"),this);
+
+			vector<string> rootPaths;
+			rootPaths.push_back(mapsPath.second);
+			rootPaths.push_back(mapsPath.first);
+			contentTransferServer->addRoot("maps",rootPaths,true);
+
+			rootPaths.clear();
+			rootPaths.push_back(tilesetsPath.second);
+			rootPaths.push_back(tilesetsPath.first);
+			contentTransferServer->addRoot("tilesets",rootPaths,allowInternetTilesetFileTransfers);
+
+			rootPaths.clear();
+			rootPaths.push_back(techtreesPath.second);
+			rootPaths.push_back(techtreesPath.first);
+			contentTransferServer->addRoot("techs",rootPaths,allowInternetTechtreeFileTransfers);
+
+			contentTransferServer->setInternetEnabled(publishEnabled);
+			if(contentTransferServer->isListening() == true) {
+				contentTransferServer->start();
+			}
+		}
 	}
 
 	if(publishToMasterserverThread == NULL) {
@@ -239,6 +334,9 @@ void ServerInterface::setPublishEnabled(bool value) {
 	if(ftpServer != NULL) {
 		ftpServer->setInternetEnabled(value);
 	}
+	if(contentTransferServer != NULL) {
+		contentTransferServer->setInternetEnabled(value);
+	}
 }
 
 void ServerInterface::shutdownMasterserverPublishThread() {
@@ -264,6 +362,9 @@ ServerInterface::~ServerInterface() {
 
 	masterController.clearSlaves(true);
 	exitServer = true;
+	shutdownSocketReactorThread();
+	delete spectatorRelay;
+	spectatorRelay = NULL;
 	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
 		if(slots[index] != NULL) {
 			MutexSafeWrapper safeMutex(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
@@ -319,6 +420,9 @@ ServerInterface::~ServerInterface() {
 	}
 	broadcastMessageQueue.clear();
 
+	delete socketReactor;
+	socketReactor = NULL;
+
 	delete switchSetupRequestsSynchAccessor;
 	switchSetupRequestsSynchAccessor = NULL;
 
@@ -331,6 +435,136 @@ ServerInterface::~ServerInterface() {
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
 }
 
+void ServerInterface::shutdownSocketReactorThread() {
+	if(socketReactorThread != NULL) {
+		time_t elapsed = time(NULL);
+		socketReactorThread->signalQuit();
+		for(;socketReactorThread->canShutdown(false) == false &&
+			difftime((long int)time(NULL),elapsed) <= 15;) {
+			sleep(10);
+		}
+		if(socketReactorThread->canShutdown(true)) {
+			delete socketReactorThread;
+		}
+		socketReactorThread = NULL;
+	}
+}
+
+// Once a slot's game has started its slot thread ends and this thread does
+// its receiving: it reads whatever each ready socket has into the socket's
+// receive buffer and updates the slot for every whole message in there
+void ServerInterface::dispatchSocketReactorEvents(int waitMilliseconds) {
+	if(socketReactor == NULL || exitServer == true) {
+		return;
+	}
+	if(gameHasBeenInitiated == false) {
+		sleep(waitMilliseconds);
+		return;
+	}
+
+	for(int index = 0; exitServer == false && index < GameConstants::maxPlayers; ++index) {
+		MutexSafeWrapper safeMutexSlot(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
+		ConnectionSlot *connectionSlot = slots[index];
+		PLATFORM_SOCKET clientSocket = 0;
+		if(isSlotReadBySocketReactor(connectionSlot) == true) {
+			if(connectionSlot->isConnected() == true) {
+				clientSocket = connectionSlot->getSocketId();
+			}
+			// stands in for the ended slot thread waiting for a client
+			// to join the game in progress
+			else if(this->getAllowInGameConnections() == true) {
+				ConnectionSlotEvent event;
+				event.eventType 		= eReceiveSocketData;
+				event.connectionSlot 	= connectionSlot;
+				event.triggerId 		= index;
+				event.eventId 			= getNextEventId();
+				connectionSlot->updateSlot(&event);
+			}
+		}
+		safeMutexSlot.ReleaseLock();
+
+		// a new connection can reuse the descriptor number of a closed one
+		if(clientSocket != socketReactorSlotSockets[index] ||
+			(Socket::isSocketValid(&clientSocket) == true && socketReactor->hasSocket(clientSocket) == false)) {
+			if(Socket::isSocketValid(&socketReactorSlotSockets[index]) == true) {
+				socketReactor->removeSocket(socketReactorSlotSockets[index]);
+			}
+			socketReactorSlotSockets[index] = 0;
+			if(Socket::isSocketValid(&clientSocket) == true && socketReactor->addSocket(clientSocket) == true) {
+				socketReactorSlotSockets[index] = clientSocket;
+				// data that came before the socket was watched gives no edge
+				readSocketReactorSlot(index);
+			}
+		}
+	}
+
+	std::vector<PLATFORM_SOCKET> readyList;
+	if(socketReactor->waitForData(readyList, waitMilliseconds) <= 0) {
+		return;
+	}
+
+	for(unsigned int readyIndex = 0; exitServer == false && readyIndex < readyList.size(); ++readyIndex) {
+		bool dispatched = false;
+		for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+			if(socketReactorSlotSockets[index] != readyList[readyIndex]) {
+				continue;
+			}
+			// edge triggered: read until the reactor reports nothing is left
+			do {
+				dispatched = readSocketReactorSlot(index);
+			}
+			while(dispatched == true && exitServer == false &&
+				  socketReactor->setDataProcessed(readyList[readyIndex]) == true);
+			break;
+		}
+		if(dispatched == false) {
+			socketReactor->removeSocket(readyList[readyIndex]);
+		}
+	}
+}
+
+bool ServerInterface::isSlotReadBySocketReactor(ConnectionSlot *connectionSlot) {
+	return (connectionSlot != NULL && connectionSlot->getWorkerThread() != NULL &&
+			connectionSlot->getGameStarted() == true &&
+			connectionSlot->getWorkerThread()->getRunningStatus() == false);
+}
+
+// Returns false if the slot is gone or no longer read by the reactor
+bool ServerInterface::readSocketReactorSlot(int index) {
+	MutexSafeWrapper safeMutexSlot(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
+	ConnectionSlot *connectionSlot = slots[index];
+	if(isSlotReadBySocketReactor(connectionSlot) == false) {
+		return false;
+	}
+
+	connectionSlot->readSocketData();
+
+	// one update per whole message, the slot reads a single message per
+	// update unless it is chat or a cell marker
+	for(int bufferedSize = -1; exitServer == false &&
+		(connectionSlot->hasCompleteMessage() == true || connectionSlot->isConnected() == false);) {
+		// stop if the last update didn't read anything
+		int nextBufferedSize = connectionSlot->getBufferedDataSize();
+		if(nextBufferedSize == bufferedSize) {
+			break;
+		}
+		bufferedSize = nextBufferedSize;
+
+		ConnectionSlotEvent event;
+		event.eventType 		= eReceiveSocketData;
+		event.connectionSlot 	= connectionSlot;
+		event.socketTriggered 	= true;
+		event.triggerId 		= index;
+		event.eventId 			= getNextEventId();
+		connectionSlot->updateSlot(&event);
+
+		if(connectionSlot->isConnected() == false) {
+			break;
+		}
+	}
+	return true;
+}
+
 SwitchSetupRequest ** ServerInterface::getSwitchSetupRequests() {
 	MutexSafeWrapper safeMutex(switchSetupRequestsSynchAccessor,CODE_AT_LINE);
     return &switchSetupRequests[0];
@@ -850,6 +1084,63 @@ void ServerInterface::updateSocketTriggeredList(std::map<PLATFORM_SOCKET,bool> &
 	}
 }
 
+// Data already read into a slot's receive buffer doesn't wake select
+bool ServerInterface::markSocketsWithBufferedData(std::map<PLATFORM_SOCKET,bool> & socketTriggeredList) {
+	bool result = false;
+	for(int index = 0; exitServer == false && index < GameConstants::maxPlayers; ++index) {
+		MutexSafeWrapper safeMutexSlot(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
+		ConnectionSlot *connectionSlot = slots[index];
+		if(connectionSlot != NULL && connectionSlot->hasBufferedData() == true) {
+			PLATFORM_SOCKET clientSocket = connectionSlot->getSocketId();
+			if(socketTriggeredList.find(clientSocket) != socketTriggeredList.end()) {
+				socketTriggeredList[clientSocket] = true;
+				result = true;
+			}
+		}
+	}
+	return result;
+}
+
+// Clients answer these right away, the answers give the round trip time of
+// every slot
+void ServerInterface::sendRoundTripPings() {
+	int64 now = Chrono::getCurMillis();
+	if(now - lastRoundTripPingMillis < NetworkFrameScheduler::pingIntervalMillis) {
+		return;
+	}
+	lastRoundTripPingMillis = now;
+
+	NetworkMessagePing networkMessagePing(NetworkFrameScheduler::pingEchoRequest,now);
+	broadcastPing(&networkMessagePing);
+}
+
+// The server runs a little slower while the client furthest behind is
+// later than its round trip explains, well before the lag check would
+// pause the game for it
+int ServerInterface::getAdaptiveUpdateLoops(int updateLoops, int frameCount) {
+	if(adaptiveFrameScheduling == false) {
+		return updateLoops;
+	}
+	int framePeriod = gameSettings.getNetworkFramePeriod();
+	int excessLagFrames = 0;
+	if(framePeriod > 0 && frameCount >= framePeriod * 2) {
+		for(int index = 0; exitServer == false && index < GameConstants::maxPlayers; ++index) {
+			MutexSafeWrapper safeMutexSlot(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
+			ConnectionSlot *connectionSlot = slots[index];
+			if(connectionSlot != NULL && connectionSlot->isConnected() == true &&
+				connectionSlot->getSkipLagCheck() == false &&
+				connectionSlot->getConnectHasHandshaked() == true) {
+				int allowedLagFrames = connectionSlot->getFrameScheduler()->getAllowedLagFrames(framePeriod);
+				if(allowedLagFrames >= 0) {
+					int clientLagFrames = frameCount - connectionSlot->getCurrentFrameCount();
+					excessLagFrames = max(excessLagFrames, clientLagFrames - allowedLagFrames);
+				}
+			}
+		}
+	}
+	return frameScheduler.getServerUpdateLoops(updateLoops, excessLagFrames);
+}
+
 void ServerInterface::validateConnectedClients() {
 	for(int index = 0; exitServer == false && index < GameConstants::maxPlayers; ++index) {
 		MutexSafeWrapper safeMutexSlot(slotAccessorMutexes[index],CODE_AT_LINE_X(index));
@@ -1494,6 +1785,9 @@ void ServerInterface::update() {
 			bool hasData = false;
 			if(gameHasBeenInitiated == false) {
 				hasData = Socket::hasDataToRead(socketTriggeredList);
+				if(markSocketsWithBufferedData(socketTriggeredList) == true) {
+					hasData = true;
+				}
 			}
 			else {
 				hasData = true;
@@ -1594,6 +1888,10 @@ void ServerInterface::update() {
 		}
 		//printf("START Server update #13\n");
 
+		if(gameHasBeenInitiated == true && adaptiveFrameScheduling == true) {
+			sendRoundTripPings();
+		}
+
 		// Check if we need to switch masterserver admin to a new player because original admin disconnected
 		if(gameHasBeenInitiated == true &&
 			this->gameSettings.getMasterserver_admin() > 0) {
@@ -1720,6 +2018,9 @@ void ServerInterface::updateKeyframe(int frameCount) {
 				lastBroadcastCommandsTimer.start();
 			}
 			broadcastMessage(&networkMessageCommandList);
+			if(spectatorRelay != NULL) {
+				spectatorRelay->publishCommandList(&networkMessageCommandList);
+			}
 		}
 	}
 	catch(const exception &ex) {
@@ -1849,6 +2150,17 @@ bool ServerInterface::shouldDiscardNetworkMessage(NetworkMessageType networkMess
 				}
 				break;
 
+			case nmtCapabilities:
+				{
+				discard = true;
+				NetworkMessageCapabilities msg = NetworkMessageCapabilities();
+				connectionSlot->receiveMessage(&msg);
+				// the client already switched to these before it answered
+				connectionSlot->setCommandListProtocol(min(msg.getCommandListProtocol(),getMaxCommandListProtocol()));
+				connectionSlot->setMessageCompression(min(msg.getMessageCompression(),getMaxMessageCompression()));
+				}
+				break;
+
 			case nmtSynchNetworkGameData:
 				{
 				discard = true;
@@ -2249,6 +2561,10 @@ void ServerInterface::quitGame(bool userManuallyQuit) {
 	NetworkMessageQuit networkMessageQuit;
 	broadcastMessage(&networkMessageQuit);
 
+	if(spectatorRelay != NULL) {
+		spectatorRelay->publishGameOver(currentFrameCount);
+	}
+
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s] Line: %d\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__);
 }
 
@@ -2411,6 +2727,11 @@ void ServerInterface::shutdownFTPServer() {
 		delete ftpServer;
 		ftpServer = NULL;
 	}
+	if(contentTransferServer != NULL) {
+		contentTransferServer->shutdownAndWait();
+		delete contentTransferServer;
+		contentTransferServer = NULL;
+	}
 }
 
 void ServerInterface::checkListenerSlots() {
@@ -3126,6 +3447,10 @@ std::string ServerInterface::DumpStatsToLog(bool dumpToStringOnly) const {
 		}
 	}
 	out << "Total Slot Count: " << connectedSlotCount 	<< std::endl;
+	if(spectatorRelay != NULL) {
+		out << "Spectators: " << spectatorRelay->getSubscriberCount() << std::endl;
+		out << "Spectator buffer bytes: " << spectatorRelay->getBufferedBytes() << std::endl;
+	}
 	out << "========================================="  << std::endl;
 
 	std::string result = out.str();
@@ -22,16 +22,34 @@
 #include "network_interface.h"
 #include "connection_slot.h"
 #include "socket.h"
+#include "spectator_relay.h"
 #include "leak_dumper.h"
 
 using std::vector;
 using Shared::Platform::ServerSocket;
 
-namespace Shared {  namespace PlatformCommon {  class FTPServerThread;  }}
+namespace Shared {  namespace PlatformCommon {  class FTPServerThread; class ContentTransferServer;  }}
 
 namespace Glest{ namespace Game{
 
 class Stats;
+class ServerInterface;
+
+// =====================================================
+//	class ServerSocketReactorThread
+// =====================================================
+
+/// Waits on the socket reactor of a server and wakes the connection slot
+/// threads whose socket got data
+class ServerSocketReactorThread : public BaseThread {
+protected:
+	ServerInterface *serverInterface;
+
+public:
+	ServerSocketReactorThread(ServerInterface *serverInterface);
+	virtual void execute();
+};
+
 // =====================================================
 //	class ServerInterface
 // =====================================================
@@ -72,6 +90,7 @@ private:
 	bool needToRepublishToMasterserver;
 
     ::Shared::PlatformCommon::FTPServerThread *ftpServer;
+    ::Shared::PlatformCommon::ContentTransferServer *contentTransferServer;
     bool exitServer;
     int64 nextEventId;
 
@@ -107,11 +126,21 @@ private:
 	Mutex *gameStatsThreadAccessor;
 	Stats *gameStats;
 
+	SocketReactor *socketReactor;
+	ServerSocketReactorThread *socketReactorThread;
+	PLATFORM_SOCKET socketReactorSlotSockets[GameConstants::maxPlayers];
+
 	bool clientsAutoPausedDueToLag;
 	Chrono clientsAutoPausedDueToLagTimer;
 	Chrono lastBroadcastCommandsTimer;
 	ClientLagCallbackInterface *clientLagCallbackInterface;
 
+	bool adaptiveFrameScheduling;
+	NetworkFrameScheduler frameScheduler;
+	int64 lastRoundTripPingMillis;
+
+	SpectatorRelay *spectatorRelay;
+
 public:
 	ServerInterface(bool publishEnabled, ClientLagCallbackInterface *clientLagCallbackInterface);
 	virtual ~ServerInterface();
@@ -139,6 +168,7 @@ public:
     virtual void updateLobby()  { };
     virtual void updateKeyframe(int frameCount);
     virtual void setKeyframe(int frameCount) { currentFrameCount = frameCount; }
+    int getAdaptiveUpdateLoops(int updateLoops, int frameCount);
 
     virtual void waitUntilReady(Checksum *checksum);
     virtual void sendTextMessage(const string & text, int teamIndex, bool echoLocal, string targetLanguage);
@@ -191,6 +221,9 @@ public:
     }
 
     virtual void slotUpdateTask(ConnectionSlotEvent *event) { };
+    virtual SocketReactor *getSocketReactor() { return socketReactor; }
+    SpectatorRelay *getSpectatorRelay() { return spectatorRelay; }
+    void dispatchSocketReactorEvents(int waitMilliseconds);
     bool hasClientConnection();
     virtual bool isClientConnected(int index);
 
@@ -201,6 +234,8 @@ public:
     std::pair<bool,bool> clientLagCheck(ConnectionSlot *connectionSlot, bool skipNetworkBroadCast = false);
     bool signalClientReceiveCommands(ConnectionSlot *connectionSlot, int slotIndex, bool socketTriggered, ConnectionSlotEvent & event);
     void updateSocketTriggeredList(std::map<PLATFORM_SOCKET,bool> & socketTriggeredList);
+    bool markSocketsWithBufferedData(std::map<PLATFORM_SOCKET,bool> & socketTriggeredList);
+    void sendRoundTripPings();
     bool isPortBound() const {
         return serverSocket.isPortBound();
     }
@@ -285,7 +320,9 @@ protected:
     void dispatchPendingHighlightCellMessages(std::vector <string> &errorMsgList);
 
     void shutdownMasterserverPublishThread();
-
+    void shutdownSocketReactorThread();
+    bool isSlotReadBySocketReactor(ConnectionSlot *connectionSlot);
+    bool readSocketReactorSlot(int index);
 
 };
 
@@ -0,0 +1,461 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "spectator_relay.h"
+
+#include "network_message.h"
+#include "network_interface.h"
+#include "config.h"
+#include "conversion.h"
+#include "util.h"
+#include "byte_order.h"
+#include "platform_util.h"
+#include "compression_utils.h"
+#include <cstdio>
+#include "leak_dumper.h"
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+using namespace Shared::CompressionUtil;
+
+namespace Glest { namespace Game {
+
+template<class T> static void writeRelayValue(vector<unsigned char> &data, T value) {
+	value = ::Shared::PlatformByteOrder::toCommonEndian(value);
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+// Socket::isConnected() fails as well while the send buffer is full, which
+// only means the spectator is slow. Spectators never send anything, so a
+// readable socket without data was closed.
+static bool isSpectatorConnected(Socket *socket) {
+	if(socket->isSocketValid() == false) {
+		return false;
+	}
+	if(socket->isReadable(true) == false) {
+		return true;
+	}
+	char data = 0;
+	int lastSocketError = 0;
+	int result = socket->peek(&data, 1, false, &lastSocketError);
+	return (result > 0 || (result < 0 && lastSocketError == PLATFORM_SOCKET_TRY_AGAIN));
+}
+
+// =====================================================
+//	class SpectatorRelayThread
+// =====================================================
+
+SpectatorRelayThread::SpectatorRelayThread(SpectatorRelay *relay) : BaseThread() {
+	this->relay = relay;
+	uniqueID = "SpectatorRelayThread";
+}
+
+void SpectatorRelayThread::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	try {
+		for(;getQuitStatus() == false;) {
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			if(relay->update() == false) {
+				safeExecutingTaskMutex.Disable();
+				sleep(10);
+			}
+		}
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,ex.what());
+	}
+}
+
+// =====================================================
+//	class SpectatorRelay
+// =====================================================
+
+const char SpectatorRelay::streamId[4] = { 'M', 'G', 'S', 'R' };
+
+SpectatorRelay::SpectatorRelay(int port, int delaySeconds, int maxBufferedMegabytes, bool startThread) {
+	mutexRecords 		= new Mutex(CODE_AT_LINE);
+	nextRecordSequence 	= 0;
+	bufferedBytes 		= 0;
+	savedGameRequested 	= false;
+	subscriberCount 	= 0;
+	delayMillis 		= (int64)max(delaySeconds,0) * 1000;
+	maxBufferedBytes 	= (int64)max(maxBufferedMegabytes,1) * 1024 * 1024;
+	commandListProtocol = NetworkInterface::getMaxCommandListProtocol();
+
+	// stream header: id, version, command list format and delay
+	streamHeader.insert(streamHeader.end(), streamId, streamId + sizeof(streamId));
+	writeRelayValue<uint32>(streamHeader, streamVersion);
+	writeRelayValue<uint8>(streamHeader, commandListProtocol);
+	writeRelayValue<int32>(streamHeader, max(delaySeconds,0));
+
+	relayThread 	= NULL;
+	serverSocket 	= NULL;
+	try {
+		serverSocket = new ServerSocket(true);
+		serverSocket->setBlock(false);
+		serverSocket->setBindPort(port);
+		serverSocket->listen(SOMAXCONN);
+	}
+	catch(const std::exception &ex) {
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"In [%s::%s Line: %d] Warning spectator relay port %d bind/listen error:\n%s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,port,ex.what());
+		SystemFlags::OutputDebug(SystemFlags::debugError,szBuf);
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("%s",szBuf);
+
+		delete serverSocket;
+		serverSocket = NULL;
+	}
+
+	if(serverSocket != NULL) {
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Spectator relay listening on port %d, delay %d seconds\n",port,max(delaySeconds,0));
+	}
+	if(serverSocket != NULL && startThread == true) {
+		static string mutexOwnerId = string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+		relayThread = new SpectatorRelayThread(this);
+		relayThread->setUniqueID(mutexOwnerId);
+		relayThread->start();
+	}
+}
+
+SpectatorRelay::~SpectatorRelay() {
+	if(relayThread != NULL) {
+		time_t elapsed = time(NULL);
+		relayThread->signalQuit();
+		for(;relayThread->canShutdown(false) == false &&
+			difftime((long int)time(NULL),elapsed) <= 15;) {
+			sleep(10);
+		}
+		if(relayThread->canShutdown(true)) {
+			delete relayThread;
+		}
+		relayThread = NULL;
+	}
+
+	for(unsigned int index = 0; index < subscribers.size(); ++index) {
+		delete subscribers[index].socket;
+	}
+	subscribers.clear();
+
+	for(unsigned int index = 0; index < records.size(); ++index) {
+		delete records[index];
+	}
+	records.clear();
+
+	delete serverSocket;
+	serverSocket = NULL;
+
+	delete mutexRecords;
+	mutexRecords = NULL;
+}
+
+bool SpectatorRelay::isListening() const {
+	return (serverSocket != NULL);
+}
+
+bool SpectatorRelay::isRelayEnabled() {
+	return (GlobalStaticFlags::getIsNonGraphicalModeEnabled() == true &&
+			Config::getInstance().getBool("EnableSpectatorRelay","false") == true);
+}
+
+void SpectatorRelay::publishRecord(uint8 type, int frameCount, const unsigned char *payload,
+		size_t payloadSize, const vector<unsigned char> *payloadPrefix) {
+	size_t prefixSize = (payloadPrefix != NULL ? payloadPrefix->size() : 0);
+
+	Record *record = new Record();
+	record->type = type;
+	record->data.reserve(sizeof(uint8) + sizeof(int32) + sizeof(uint32) + prefixSize + payloadSize);
+	writeRelayValue<uint8>(record->data, type);
+	writeRelayValue<int32>(record->data, frameCount);
+	writeRelayValue<uint32>(record->data, (uint32)(prefixSize + payloadSize));
+	if(prefixSize > 0) {
+		record->data.insert(record->data.end(), payloadPrefix->begin(), payloadPrefix->end());
+	}
+	if(payloadSize > 0) {
+		record->data.insert(record->data.end(), payload, payload + payloadSize);
+	}
+	record->releaseMillis = Chrono::getCurMillis() + delayMillis;
+
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	record->sequence = nextRecordSequence++;
+	records.push_back(record);
+	bufferedBytes += (int64)record->data.size();
+}
+
+// The list is serialized once for all spectators, nothing is kept while
+// nobody watches since a new spectator starts with a fresh saved game
+void SpectatorRelay::publishCommandList(NetworkMessageCommandList *networkMessageCommandList) {
+	if(getSubscriberCount() <= 0) {
+		return;
+	}
+
+	networkMessageCommandList->setCommandListProtocol(commandListProtocol);
+	vector<unsigned char> messageData;
+	networkMessageCommandList->getMessageData(messageData);
+	publishRecord(srrtCommandList, networkMessageCommandList->getFrameCount(),
+			(messageData.empty() == false ? &messageData[0] : NULL), messageData.size());
+}
+
+void SpectatorRelay::publishSavedGame(int frameCount, const string &file) {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	savedGameRequested = false;
+	safeMutex.ReleaseLock();
+
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(file).c_str(), L"rb");
+#else
+	FILE *fp = fopen(file.c_str(),"rb");
+#endif
+	if(fp == NULL) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] cannot read saved game [%s] for spectators\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,file.c_str());
+		return;
+	}
+	vector<unsigned char> fileData;
+	unsigned char buf[64 * 1024];
+	for(size_t readBytes = 0; (readBytes = fread(buf, 1, sizeof(buf), fp)) > 0;) {
+		fileData.insert(fileData.end(), buf, buf + readBytes);
+	}
+	fclose(fp);
+
+	vector<unsigned char> compressedData;
+	if(fileData.empty() == true ||
+		compressMemoryBuffer(&fileData[0], (unsigned int)fileData.size(), compressedData) == false) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] cannot compress saved game [%s] for spectators\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,file.c_str());
+		return;
+	}
+
+	vector<unsigned char> plainSize;
+	writeRelayValue<uint32>(plainSize, (uint32)fileData.size());
+	publishRecord(srrtSavedGame, frameCount, &compressedData[0], compressedData.size(), &plainSize);
+}
+
+void SpectatorRelay::publishGameOver(int frameCount) {
+	if(getSubscriberCount() <= 0) {
+		return;
+	}
+	publishRecord(srrtGameOver, frameCount, NULL, 0);
+}
+
+bool SpectatorRelay::getSavedGameRequested() {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	return savedGameRequested;
+}
+
+int SpectatorRelay::getSubscriberCount() {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	return subscriberCount;
+}
+
+int64 SpectatorRelay::getBufferedBytes() {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	return bufferedBytes;
+}
+
+void SpectatorRelay::acceptSubscribers() {
+	for(;serverSocket->isReadable(true) == true;) {
+		Socket *socket = serverSocket->accept(false);
+		if(socket == NULL) {
+			break;
+		}
+		socket->setBlock(false);
+
+		Subscriber subscriber;
+		subscriber.socket 			= socket;
+		subscriber.ipAddress 		= socket->getIpAddress();
+		subscriber.nextSequence 	= -1;
+		subscriber.sendSequence 	= -1;
+		subscriber.sendBuffer 		= &streamHeader;
+		subscriber.sendOffset 		= 0;
+		subscriber.closeAfterSend 	= false;
+
+		MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+		subscriber.joinSequence = nextRecordSequence;
+		savedGameRequested = true;
+		subscriberCount++;
+		safeMutex.ReleaseLock();
+
+		subscribers.push_back(subscriber);
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Spectator connected from [%s], %d spectators\n",subscriber.ipAddress.c_str(),(int)subscribers.size());
+	}
+}
+
+void SpectatorRelay::removeSubscriber(unsigned int index, const char *reason) {
+	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Spectator [%s] removed: %s\n",subscribers[index].ipAddress.c_str(),reason);
+
+	delete subscribers[index].socket;
+	subscribers.erase(subscribers.begin() + index);
+
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	subscriberCount--;
+}
+
+// Picks the record a spectator gets next: the first saved game published
+// after it joined, then every released record after that except the saved
+// games other spectators started with
+bool SpectatorRelay::startNextRecord(Subscriber &subscriber, int64 nowMillis) {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	if(records.empty() == true) {
+		return false;
+	}
+	int64 firstSequence = records.front()->sequence;
+
+	if(subscriber.joinSequence >= 0) {
+		for(int64 sequence = max(subscriber.joinSequence,firstSequence);
+			sequence < firstSequence + (int64)records.size(); ++sequence) {
+			Record *record = records[(size_t)(sequence - firstSequence)];
+			if(record->type == srrtSavedGame) {
+				if(record->releaseMillis > nowMillis) {
+					return false;
+				}
+				subscriber.joinSequence = -1;
+				subscriber.nextSequence = sequence + 1;
+				subscriber.sendSequence = sequence;
+				subscriber.sendBuffer 	= &record->data;
+				subscriber.sendOffset 	= 0;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	for(;subscriber.nextSequence < firstSequence + (int64)records.size();) {
+		Record *record = records[(size_t)(subscriber.nextSequence - firstSequence)];
+		if(record->releaseMillis > nowMillis) {
+			return false;
+		}
+		subscriber.nextSequence++;
+		if(record->type == srrtSavedGame) {
+			continue;
+		}
+		subscriber.sendSequence 	= record->sequence;
+		subscriber.sendBuffer 		= &record->data;
+		subscriber.sendOffset 		= 0;
+		subscriber.closeAfterSend 	= (record->type == srrtGameOver);
+		return true;
+	}
+	return false;
+}
+
+// Hands the socket one non blocking write per turn, whatever it does not
+// take (partial write or a full socket buffer) waits for the next turn
+bool SpectatorRelay::sendToSubscriber(Subscriber &subscriber, int64 nowMillis) {
+	if(subscriber.sendBuffer == NULL) {
+		if(subscriber.closeAfterSend == true ||
+			startNextRecord(subscriber, nowMillis) == false) {
+			return false;
+		}
+	}
+
+	const vector<unsigned char> &sendBuffer = *subscriber.sendBuffer;
+	int sendSize = (int)min(sendBuffer.size() - subscriber.sendOffset,(size_t)maxSendPerTurn);
+	const char *sendData = (const char *)&sendBuffer[subscriber.sendOffset];
+	PLATFORM_SOCKET sock = subscriber.socket->getSocketId();
+#if defined(WIN32)
+	int sentBytes = ::send(sock, sendData, sendSize, 0);
+#elif defined(__APPLE__)
+	int sentBytes = (int)::send(sock, sendData, sendSize, SO_NOSIGPIPE);
+#else
+	int sentBytes = (int)::send(sock, sendData, sendSize, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+	if(sentBytes < 0 && Socket::getLastSocketError() == PLATFORM_SOCKET_TRY_AGAIN) {
+		return false;
+	}
+	if(sentBytes <= 0) {
+		throw megaglest_runtime_error("Error sending spectator data, sendResult = " + intToStr(sentBytes) +
+				" error: " + Socket::getLastSocketErrorFormattedText());
+	}
+
+	subscriber.sendOffset += sentBytes;
+	if(subscriber.sendOffset >= sendBuffer.size()) {
+		subscriber.sendBuffer = NULL;
+		subscriber.sendOffset = 0;
+	}
+	return true;
+}
+
+int64 SpectatorRelay::getOldestNeededSequence(const Subscriber &subscriber) const {
+	if(subscriber.sendBuffer != NULL && subscriber.sendSequence >= 0) {
+		return subscriber.sendSequence;
+	}
+	if(subscriber.joinSequence >= 0) {
+		return subscriber.joinSequence;
+	}
+	return subscriber.nextSequence;
+}
+
+// Records every spectator is past are freed. When the rest grows past the
+// limit the spectator furthest behind is dropped to free its records.
+void SpectatorRelay::pruneRecords() {
+	MutexSafeWrapper safeMutex(mutexRecords,CODE_AT_LINE);
+	int64 oldestNeededSequence = nextRecordSequence;
+	int slowestSubscriber = -1;
+	for(unsigned int index = 0; index < subscribers.size(); ++index) {
+		int64 sequence = getOldestNeededSequence(subscribers[index]);
+		if(sequence < oldestNeededSequence) {
+			oldestNeededSequence = sequence;
+			slowestSubscriber = index;
+		}
+	}
+
+	for(;records.empty() == false && records.front()->sequence < oldestNeededSequence;) {
+		bufferedBytes -= (int64)records.front()->data.size();
+		delete records.front();
+		records.pop_front();
+	}
+	bool overLimit = (bufferedBytes > maxBufferedBytes);
+	safeMutex.ReleaseLock();
+
+	if(overLimit == true && slowestSubscriber >= 0) {
+		removeSubscriber(slowestSubscriber, "too far behind");
+	}
+}
+
+bool SpectatorRelay::update() {
+	return update(Chrono::getCurMillis());
+}
+
+bool SpectatorRelay::update(int64 nowMillis) {
+	if(serverSocket == NULL) {
+		return false;
+	}
+	acceptSubscribers();
+
+	bool sentData = false;
+	for(unsigned int index = 0; index < subscribers.size();) {
+		Subscriber &subscriber = subscribers[index];
+		if(isSpectatorConnected(subscriber.socket) == false) {
+			removeSubscriber(index, "disconnected");
+			continue;
+		}
+
+		try {
+			if(sendToSubscriber(subscriber, nowMillis) == true) {
+				sentData = true;
+			}
+		}
+		catch(const exception &ex) {
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] spectator [%s] error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,subscriber.ipAddress.c_str(),ex.what());
+			removeSubscriber(index, "send error");
+			continue;
+		}
+
+		if(subscriber.closeAfterSend == true && subscriber.sendBuffer == NULL) {
+			removeSubscriber(index, "game over");
+			continue;
+		}
+		++index;
+	}
+
+	pruneRecords();
+	return sentData;
+}
+
+}}//end namespace
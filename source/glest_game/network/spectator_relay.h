@@ -0,0 +1,167 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_SPECTATORRELAY_H_
+#define _GLEST_GAME_SPECTATORRELAY_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "socket.h"
+#include "base_thread.h"
+#include "data_types.h"
+#include <deque>
+#include <vector>
+#include <string>
+#include "leak_dumper.h"
+
+using std::string;
+using std::vector;
+using Shared::Platform::int64;
+using Shared::Platform::uint8;
+using Shared::Platform::uint32;
+using Shared::Platform::Mutex;
+using Shared::Platform::ServerSocket;
+using Shared::Platform::Socket;
+using Shared::PlatformCommon::BaseThread;
+
+namespace Glest { namespace Game {
+
+class NetworkMessageCommandList;
+class SpectatorRelay;
+
+// record types of the spectator stream, every record is the type (uint8),
+// world frame (int32), payload size (uint32) and the payload
+enum SpectatorRelayRecordType {
+	srrtSavedGame		= 1,	// plain size (uint32) and the zlib compressed saved game
+	srrtCommandList		= 2,	// a command list message as clients receive it
+	srrtGameOver		= 3		// no payload, the relay closes the stream after it
+};
+
+// =====================================================
+//	class SpectatorRelayThread
+// =====================================================
+
+/// Accepts spectators and writes the relay stream to them
+class SpectatorRelayThread : public BaseThread {
+protected:
+	SpectatorRelay *relay;
+
+public:
+	SpectatorRelayThread(SpectatorRelay *relay);
+	virtual void execute();
+};
+
+// =====================================================
+//	class SpectatorRelay
+//
+///	Read only spectators of a headless server. The server publishes every
+///	command list it broadcasts once, as a serialized record the relay
+///	thread writes to all spectators from the same buffer, and a spectator
+///	only gets a record once the configured delay has passed since it was
+///	published. A spectator joins with a saved game the game thread writes
+///	on request, followed by the command lists published after it, so it
+///	never takes part in the lockstep and a slow spectator is only ever
+///	behind itself. Spectators that fall so far behind that the buffered
+///	records pass the size limit are dropped.
+// =====================================================
+
+class SpectatorRelay {
+public:
+	static const char streamId[4];
+	static const uint32 streamVersion = 1;
+
+private:
+	class Record {
+	public:
+		int64 sequence;
+		int64 releaseMillis;
+		uint8 type;
+		vector<unsigned char> data;
+	};
+
+	class Subscriber {
+	public:
+		Socket *socket;
+		string ipAddress;
+		// first record a saved game can start with, -1 once started
+		int64 joinSequence;
+		int64 nextSequence;
+		// record being sent, -1 for the stream header
+		int64 sendSequence;
+		const vector<unsigned char> *sendBuffer;
+		size_t sendOffset;
+		bool closeAfterSend;
+	};
+
+	// most of a spectator's data handed to the socket per turn, whatever the
+	// socket does not take waits for the next turn
+	static const int maxSendPerTurn		= 65536;
+
+	ServerSocket *serverSocket;
+	SpectatorRelayThread *relayThread;
+
+	Mutex *mutexRecords;
+	std::deque<Record *> records;
+	int64 nextRecordSequence;
+	int64 bufferedBytes;
+	bool savedGameRequested;
+	int subscriberCount;
+
+	// only used by the relay thread
+	vector<Subscriber> subscribers;
+	vector<unsigned char> streamHeader;
+
+	int64 delayMillis;
+	int64 maxBufferedBytes;
+	uint8 commandListProtocol;
+
+	SpectatorRelay(const SpectatorRelay &obj);
+	SpectatorRelay &operator=(const SpectatorRelay &obj);
+
+	void publishRecord(uint8 type, int frameCount, const unsigned char *payload,
+			size_t payloadSize, const vector<unsigned char> *payloadPrefix=NULL);
+	void acceptSubscribers();
+	bool sendToSubscriber(Subscriber &subscriber, int64 nowMillis);
+	bool startNextRecord(Subscriber &subscriber, int64 nowMillis);
+	int64 getOldestNeededSequence(const Subscriber &subscriber) const;
+	void pruneRecords();
+	void removeSubscriber(unsigned int index, const char *reason);
+
+public:
+	// without startThread the owner calls update() itself
+	SpectatorRelay(int port, int delaySeconds, int maxBufferedMegabytes, bool startThread=true);
+	~SpectatorRelay();
+
+	bool isListening() const;
+
+	// game thread
+	void publishCommandList(NetworkMessageCommandList *networkMessageCommandList);
+	void publishSavedGame(int frameCount, const string &file);
+	void publishGameOver(int frameCount);
+	bool getSavedGameRequested();
+
+	// relay thread, returns true when it sent anything
+	bool update();
+	// the same with the time records are released by
+	bool update(int64 nowMillis);
+
+	int getSubscriberCount();
+	int64 getBufferedBytes();
+
+	static bool isRelayEnabled();
+};
+
+}}//end namespace
+
+#endif
@@ -523,8 +523,14 @@ Faction::~Faction() {
 	}
 
 	MutexSafeWrapper safeMutex(unitsMutex,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(world != NULL) {
+		for(int i = 0; i < (int)units.size(); ++i) {
+			world->removeUnitFromIndex(units[i]);
+		}
+	}
 	deleteValues(units.begin(), units.end());
 	units.clear();
+	unitMap.clear();
 
 	safeMutex.ReleaseLock();
 
@@ -550,8 +556,14 @@ void Faction::end() {
 	}
 
 	MutexSafeWrapper safeMutex(unitsMutex,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(world != NULL) {
+		for(int i = 0; i < (int)units.size(); ++i) {
+			world->removeUnitFromIndex(units[i]);
+		}
+	}
 	deleteValues(units.begin(), units.end());
 	units.clear();
+	unitMap.clear();
 
 	safeMutex.ReleaseLock();
 
@@ -1286,6 +1298,10 @@ void Faction::setResourceBalance(const ResourceType *rt, int balance){
 }
 
 Unit *Faction::findUnit(int id) const {
+	if(world != NULL) {
+		Unit *unit = world->findUnitById(id);
+		return (unit != NULL && unit->getFaction() == this ? unit : NULL);
+	}
 	UnitMap::const_iterator itFound = unitMap.find(id);
 	if(itFound == unitMap.end()) {
 		return NULL;
@@ -1297,6 +1313,9 @@ void Faction::addUnit(Unit *unit) {
 	MutexSafeWrapper safeMutex(unitsMutex,string(__FILE__) + "_" + intToStr(__LINE__));
 	units.push_back(unit);
 	unitMap[unit->getId()] = unit;
+	if(world != NULL) {
+		world->addUnitToIndex(unit);
+	}
 }
 
 void Faction::removeUnit(Unit *unit){
@@ -1309,6 +1328,9 @@ void Faction::removeUnit(Unit *unit){
 		if(units[i]->getId() == unitId) {
 			units.erase(units.begin()+i);
 			unitMap.erase(unitId);
+			if(world != NULL) {
+				world->removeUnitFromIndex(unit);
+			}
 			assert(units.size() == unitMap.size());
 			return;
 		}
@@ -2199,6 +2221,8 @@ std::string Faction::toString(bool crcMode) const {
 void Faction::saveGame(XmlNode *rootNode) {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *factionNode = rootNode->addChild("Faction");
+	// units are written out one by one instead of all kept as nodes
+	factionNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 	upgradeManager.saveGame(factionNode);
 	for(unsigned int i = 0; i < resources.size(); ++i) {
@@ -2433,6 +2457,56 @@ void Faction::addCRC_DetailsForWorldFrame(int worldFrameCount,bool isNetworkServ
 	}
 }
 
+// Binary replacement for getCRC() in network synch checks. Every active
+// unit advances its skill progress each frame, so every unit digest is
+// computed again, only the names in it are cached.
+uint32 Faction::updateSynchDigest() {
+	MutexSafeWrapper safeMutex(unitsMutex,string(__FILE__) + "_" + intToStr(__LINE__));
+
+	Checksum crcForFaction;
+	for(unsigned int i = 0; i < resources.size(); ++i) {
+		uint32 crc = resources[i].getCRC().getSum();
+		crcForFaction.addBytes(&crc,sizeof(uint32));
+	}
+	for(unsigned int i = 0; i < store.size(); ++i) {
+		uint32 crc = store[i].getCRC().getSum();
+		crcForFaction.addBytes(&crc,sizeof(uint32));
+	}
+	crcForFaction.addInt((int)units.size());
+	for(unsigned int i = 0; i < units.size(); ++i) {
+		Unit *unit = units[i];
+		unit->updateSynchDigest();
+		crcForFaction.addUInt(unit->getSynchDigestSum());
+	}
+	return crcForFaction.getSum();
+}
+
+// Keeps the digests updateSynchDigest() computed for the desync log, then
+// clears the per frame debug info of the units like
+// addCRC_DetailsForWorldFrame() does
+void Faction::addSynchDigestsForWorldFrame(int worldFrameCount,bool isNetworkServer) {
+	unsigned int MAX_FRAME_CACHE = 250;
+	if(isNetworkServer == true) {
+		MAX_FRAME_CACHE += 250;
+	}
+
+	MutexSafeWrapper safeMutex(unitsMutex,string(__FILE__) + "_" + intToStr(__LINE__));
+	vector<UnitSynchDigest> &digests = synchDigestFrames[worldFrameCount];
+	digests.resize(units.size());
+	for(unsigned int i = 0; i < units.size(); ++i) {
+		Unit *unit = units[i];
+		digests[i] = unit->getSynchDigest();
+
+		unit->getRandom()->clearLastCaller();
+		unit->clearNetworkCRCDecHpList();
+		unit->clearParticleInfo();
+	}
+
+	for(;(unsigned int)synchDigestFrames.size() > MAX_FRAME_CACHE;) {
+		synchDigestFrames.erase(synchDigestFrames.begin());
+	}
+}
+
 string Faction::getCRC_DetailsForWorldFrame(int worldFrameCount) {
 	if(crcWorldFrameDetails.empty()) {
 		return "";
@@ -27,6 +27,7 @@
 #include "base_thread.h"
 #include <set>
 #include "faction_type.h"
+#include "unit_synch_digest.h"
 #include "leak_dumper.h"
 
 using std::map;
@@ -52,12 +53,6 @@ class Faction;
 class GameSettings;
 class SurfaceCell;
 
-class FowAlphaCellsLookupItem {
-public:
-
-	std::map<Vec2i,float> surfPosAlphaList;
-};
-
 class ExploredCellsLookupItem {
 public:
 
@@ -181,6 +176,8 @@ private:
 
 	std::map<int,string> crcWorldFrameDetails;
 
+	std::map<int,vector<UnitSynchDigest> > synchDigestFrames;
+
 	std::map<int,const Unit *> aliveUnitListCache;
 	std::map<int,const Unit *> mobileUnitListCache;
 	std::map<int,const Unit *> beingBuiltUnitListCache;
@@ -378,6 +375,10 @@ public:
 	string getCRC_DetailsForWorldFrames() const;
 	uint64 getCRC_DetailsForWorldFrameCount() const;
 
+	uint32 updateSynchDigest();
+	void addSynchDigestsForWorldFrame(int worldFrameCount,bool isNetworkServer);
+	const std::map<int,vector<UnitSynchDigest> > &getSynchDigestFrames() const { return synchDigestFrames; }
+
 	void updateUnitTypeWithResourceCostCache(const ResourceType *rt);
 	bool hasUnitTypeWithResourceCostInCache(const ResourceType *rt) const;
 
@@ -26,6 +26,7 @@
 #include "game.h"
 #include "socket.h"
 #include "sound_renderer.h"
+#include "sight_stencil.h"
 
 #include "leak_dumper.h"
 
@@ -524,7 +525,13 @@ Unit::Unit(int id, UnitPathInterface *unitpath, const Vec2i &pos,
 	lastStuckFrame = 0;
 	lastStuckPos = Vec2i(0,0);
 	lastPathfindFailedFrame = 0;
+	cachedFowStencil = NULL;
 	lastPathfindFailedPos = Vec2i(0,0);
+	synchDigestSum = 0;
+	for(int index = 0; index < snCount; ++index) {
+		synchNameKeys[index] = NULL;
+		synchNameDigests[index] = 0;
+	}
 	usePathfinderExtendedMaxNodes = false;
 	this->currentAttackBoostOriginatorEffect.skillType = NULL;
 	lastAttackerUnitId = -1;
@@ -1387,50 +1394,13 @@ void Unit::refreshPos() {
 	calculateFogOfWarRadius();
 }
 
-FowAlphaCellsLookupItem Unit::getFogOfWarRadius(bool useCache) const {
-	if(useCache == true) {
-		return cachedFow;
-	}
-
-	//iterate through all cells
-	int sightRange= this->getType()->getSight();
-	int radius = sightRange + World::indirectSightRange;
-	PosCircularIterator pci(map, this->getPosNotThreadSafe(), radius);
-	FowAlphaCellsLookupItem result;
-	while(pci.next()){
-		const Vec2i sightpos= pci.getPos();
-		Vec2i surfPos= Map::toSurfCoords(sightpos);
-
-		//compute max alpha
-		float maxAlpha= 0.0f;
-		if(surfPos.x > 1 && surfPos.y > 1 &&
-			surfPos.x < map->getSurfaceW() -2 &&
-				surfPos.y < map->getSurfaceH() -2) {
-			maxAlpha= 1.f;
-		}
-		else if(surfPos.x > 0 && surfPos.y > 0 &&
-				surfPos.x < map->getSurfaceW() -1 &&
-				surfPos.y < map->getSurfaceH() -1) {
-			maxAlpha= 0.3f;
-		}
-
-		//compute alpha
-		float alpha = maxAlpha;
-		float dist = this->getPosNotThreadSafe().dist(sightpos);
-		if(dist > sightRange) {
-			alpha= clamp(1.f-(dist - sightRange) / (World::indirectSightRange), 0.f, maxAlpha);
-		}
-		result.surfPosAlphaList[surfPos] = alpha;
-	}
-	return result;
-}
-
 void Unit::calculateFogOfWarRadius() {
 	if(game->getWorld()->getFogOfWar() == true) {
-		if(this->pos != this->cachedFowPos) {
-			cachedFow = getFogOfWarRadius(false);
+		if(this->pos != this->cachedFowPos || this->cachedFowStencil == NULL) {
+			const SightStencil *stencil = SightStencil::getStencil(this->getType()->getSight(), this->pos);
 			static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
 			MutexSafeWrapper safeMutex(mutexCommands,mutexOwnerId);
+			this->cachedFowStencil = stencil;
 			this->cachedFowPos = this->pos;
 		}
 	}
@@ -4389,7 +4359,7 @@ Vec2i Unit::getPos() {
 }
 
 void Unit::clearCaches() {
-	cachedFow.surfPosAlphaList.clear();
+	cachedFowStencil = NULL;
 	cachedFowPos = Vec2i(0,0);
 
 	cacheExploredCells.exploredCellList.clear();
@@ -4573,6 +4543,7 @@ std::string Unit::toString(bool crcMode) const {
 void Unit::saveGame(XmlNode *rootNode) {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *unitNode = rootNode->addChild("Unit");
+	unitNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 //	const int id;
 	unitNode->addAttribute("id",intToStr(id), mapTagReplacements);
@@ -5585,4 +5556,172 @@ Checksum Unit::getCRC() {
 	return crcForUnit;
 }
 
+static uint32 getSynchNameDigest(const string &name) {
+	if(name == "") {
+		return 0;
+	}
+	Checksum crcForName;
+	crcForName.addString(name);
+	return crcForName.getSum();
+}
+
+// Same state getCRC() covers, in binary and split into groups of fields so
+// a desync can be traced to the part of the unit that differs. Only plain
+// values are hashed every time, names only when the pointer they come from
+// changes.
+void Unit::computeSynchDigest(UnitSynchDigest &digest) {
+	const void *nameKeys[snCount] = { type, preMorph_type, level, loadType, currSkill };
+	uint32 nameDigests[snCount];
+	for(int index = 0; index < snCount; ++index) {
+		if(nameKeys[index] == synchNameKeys[index]) {
+			nameDigests[index] = synchNameDigests[index];
+			continue;
+		}
+
+		string name = "";
+		switch(index) {
+			case snType:
+				if(type != NULL) name = type->getName(false);
+				break;
+			case snPreMorphType:
+				if(preMorph_type != NULL) name = preMorph_type->getName(false);
+				break;
+			case snLevel:
+				if(level != NULL) name = level->getName(false);
+				break;
+			case snLoadType:
+				if(loadType != NULL) name = loadType->getName(false);
+				break;
+			case snSkill:
+				if(currSkill != NULL) name = currSkill->getName();
+				break;
+		}
+		nameDigests[index] = getSynchNameDigest(name);
+		synchNameKeys[index] = nameKeys[index];
+		synchNameDigests[index] = nameDigests[index];
+	}
+
+	digest.unitId = id;
+	{
+		Checksum crcForField;
+		crcForField.addInt(id);
+		crcForField.addUInt(nameDigests[snType]);
+		crcForField.addUInt(nameDigests[snPreMorphType]);
+		crcForField.addUInt(nameDigests[snLevel]);
+		digest.fields[usfIdentity] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addInt(hp);
+		crcForField.addInt(ep);
+		crcForField.addInt(deadCount);
+		crcForField.addInt(alive);
+		crcForField.addInt(toBeUndertaken);
+		crcForField.addInt(fire != NULL ? fire->getActive() : -1);
+		digest.fields[usfHealth] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addInt(loadCount);
+		crcForField.addUInt(nameDigests[snLoadType]);
+		digest.fields[usfLoad] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addInt64(progress);
+		crcForField.addInt64(lastAnimProgress);
+		crcForField.addInt64(animProgress);
+		crcForField.addInt(progress2);
+		digest.fields[usfProgress] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addUInt(nameDigests[snSkill]);
+		crcForField.addInt(currField);
+		crcForField.addInt(targetField);
+		crcForField.addInt(modelFacing);
+		digest.fields[usfSkill] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addInt(pos.x);
+		crcForField.addInt(pos.y);
+		crcForField.addInt(lastPos.x);
+		crcForField.addInt(lastPos.y);
+		crcForField.addInt(targetPos.x);
+		crcForField.addInt(targetPos.y);
+		crcForField.addInt(meetingPos.x);
+		crcForField.addInt(meetingPos.y);
+		digest.fields[usfPosition] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addUInt(lastStuckFrame);
+		crcForField.addInt(lastStuckPos.x);
+		crcForField.addInt(lastStuckPos.y);
+		crcForField.addInt(inBailOutAttempt);
+		crcForField.addInt((int)badHarvestPosList.size());
+		crcForField.addInt(currentPathFinderDesiredFinalPos.x);
+		crcForField.addInt(currentPathFinderDesiredFinalPos.y);
+		crcForField.addInt(lastHarvestedResourcePos.x);
+		crcForField.addInt(lastHarvestedResourcePos.y);
+		digest.fields[usfMovement] = crcForField.getSum();
+	}
+	{
+		Checksum crcForField;
+		crcForField.addInt(kills);
+		crcForField.addInt(enemyKills);
+		crcForField.addInt(morphFieldsBlocked);
+		digest.fields[usfKills] = crcForField.getSum();
+	}
+	digest.fields[usfUpgrades] = totalUpgrade.getCRC().getSum();
+	digest.fields[usfPath] = (unitPath != NULL ? unitPath->getCRC().getSum() : 0);
+	{
+		Checksum crcForField;
+		crcForField.addInt((int)commands.size());
+		for(Commands::const_iterator it= commands.begin(); it != commands.end(); ++it) {
+			uint32 crc = (*it)->getCRC().getSum();
+			crcForField.addBytes(&crc,sizeof(uint32));
+		}
+		digest.fields[usfCommands] = crcForField.getSum();
+	}
+	digest.fields[usfRandom] = (uint32)random.getLastNumber();
+	{
+		Checksum crcForField;
+		crcForField.addInt((int)damageParticleSystems.size());
+		crcForField.addInt((int)currentAttackBoostOriginatorEffect.currentAttackBoostUnits.size());
+		crcForField.addInt((int)attackParticleSystems.size());
+		if(isNetworkCRCEnabled() == true) {
+			for(unsigned int index = 0; index < attackParticleSystems.size(); ++index) {
+				ParticleSystem *ps = attackParticleSystems[index];
+				if(ps != NULL &&
+						Renderer::getInstance().validateParticleSystemStillExists(ps,rsGame) == true) {
+					uint32 crc = ps->getCRC().getSum();
+					crcForField.addBytes(&crc,sizeof(uint32));
+				}
+			}
+		}
+		digest.fields[usfEffects] = crcForField.getSum();
+	}
+	{
+		// only filled in while network synch checks log them
+		Checksum crcForField;
+		if(random.getLastCaller() != "") {
+			crcForField.addString(random.getLastCaller());
+		}
+		if(networkCRCParticleInfoList.empty() == false) {
+			crcForField.addString(getParticleInfo());
+		}
+		if(networkCRCParticleLogInfo != "") {
+			crcForField.addString(networkCRCParticleLogInfo);
+		}
+		digest.fields[usfDebugInfo] = crcForField.getSum();
+	}
+}
+
+void Unit::updateSynchDigest() {
+	computeSynchDigest(synchDigest);
+	synchDigestSum = synchDigest.getSum();
+}
+
 }}//end namespace
@@ -24,6 +24,7 @@
 #include "platform_common.h"
 #include <vector>
 #include "faction.h"
+#include "unit_synch_digest.h"
 #include "leak_dumper.h"
 
 //#define LEAK_CHECK_UNITS
@@ -41,6 +42,7 @@ using Shared::PlatformCommon::Chrono;
 using Shared::PlatformCommon::ValueCheckerVault;
 
 class Map;
+class SightStencil;
 //class Faction;
 class Unit;
 class Command;
@@ -484,7 +486,7 @@ private:
 	RandomGen random;
 	int32 pathFindRefreshCellCount;
 
-	FowAlphaCellsLookupItem cachedFow;
+	const SightStencil *cachedFowStencil;
 	Vec2i cachedFowPos;
 
 	ExploredCellsLookupItem cacheExploredCells;
@@ -497,6 +499,22 @@ private:
 	vector<string> networkCRCDecHpList;
 	vector<string> networkCRCParticleInfoList;
 
+	// names in the synch digest, hashed again only when the type, level,
+	// load type or skill they come from changes
+	enum SynchName {
+		snType,
+		snPreMorphType,
+		snLevel,
+		snLoadType,
+		snSkill,
+
+		snCount
+	};
+	UnitSynchDigest synchDigest;
+	uint32 synchDigestSum;
+	const void *synchNameKeys[snCount];
+	uint32 synchNameDigests[snCount];
+
 public:
     Unit(int id, UnitPathInterface *path, const Vec2i &pos, const UnitType *type, Faction *faction, Map *map, CardinalDir placeFacing);
     virtual ~Unit();
@@ -517,8 +535,8 @@ public:
     inline void incrementPathfindFailedConsecutiveFrameCount() { pathfindFailedConsecutiveFrameCount++; }
     inline void resetPathfindFailedConsecutiveFrameCount() { pathfindFailedConsecutiveFrameCount=0; }
 
-    const FowAlphaCellsLookupItem & getCachedFow() const { return cachedFow; }
-    FowAlphaCellsLookupItem getFogOfWarRadius(bool useCache) const;
+    const SightStencil * getCachedFowStencil() const { return cachedFowStencil; }
+    Vec2i getCachedFowPos() const { return cachedFowPos; }
     void calculateFogOfWarRadius();
 
     //queries
@@ -796,6 +814,10 @@ public:
 	void addAttackParticleSystem(ParticleSystem *ps);
 
 	Checksum getCRC();
+	void computeSynchDigest(UnitSynchDigest &digest);
+	void updateSynchDigest();
+	const UnitSynchDigest &getSynchDigest() const	{ return synchDigest; }
+	uint32 getSynchDigestSum() const				{ return synchDigestSum; }
 
 	virtual void end(ParticleSystem *particleSystem);
 	virtual void logParticleInfo(string info);
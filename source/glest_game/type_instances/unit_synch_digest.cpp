@@ -0,0 +1,265 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "unit_synch_digest.h"
+
+#include "world.h"
+#include "faction.h"
+#include "checksum.h"
+#include "byte_order.h"
+#include "util.h"
+#include "conversion.h"
+#include "platform_util.h"
+#include <cstdio>
+#include <cstring>
+#include "leak_dumper.h"
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+
+namespace Glest { namespace Game {
+
+// =====================================================
+// 	class UnitSynchDigest
+// =====================================================
+
+static const char *unitSynchFieldNames[usfCount] = {
+	"identity (id, type, pre morph type, level)",
+	"health (hp, ep, dead count, alive, to be undertaken, fire)",
+	"load (load count, load type)",
+	"progress (progress, anim progress, progress2)",
+	"skill (current skill, fields, facing)",
+	"position (pos, last pos, target pos, meeting pos)",
+	"movement (stuck, bail out, harvest and path finder positions)",
+	"kills (kills, enemy kills, morph fields blocked)",
+	"upgrades",
+	"path",
+	"commands",
+	"random",
+	"effects (particle systems, attack boosts)",
+	"debug info (random callers, particle info)"
+};
+
+UnitSynchDigest::UnitSynchDigest() {
+	unitId = -1;
+	memset(fields, 0, sizeof(fields));
+}
+
+uint32 UnitSynchDigest::getSum() const {
+	Checksum crcForUnit;
+	crcForUnit.addInt(unitId);
+	crcForUnit.addBytes(fields, sizeof(fields));
+	return crcForUnit.getSum();
+}
+
+const char *UnitSynchDigest::getFieldName(UnitSynchField field) {
+	if(field < 0 || field >= usfCount) {
+		return "unknown";
+	}
+	return unitSynchFieldNames[field];
+}
+
+// =====================================================
+// 	class SynchDigestLog
+// =====================================================
+
+static const char synchDigestLogId[4] = { 'M', 'G', 'S', 'D' };
+static const uint32 synchDigestLogVersion = 1;
+
+template<class T> static T readSynchDigestValue(const char *data) {
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return ::Shared::PlatformByteOrder::fromCommonEndian(value);
+}
+
+template<class T> static void writeSynchDigestValue(vector<char> &data, T value) {
+	value = ::Shared::PlatformByteOrder::toCommonEndian(value);
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+// Layout: id, version, field count, faction count, then for every faction
+// its index and frame count, and for every frame the frame number, the unit
+// count and the unit id plus field digests of every unit
+void SynchDigestLog::save(const string &file, World *world) {
+	vector<char> data;
+	data.insert(data.end(), synchDigestLogId, synchDigestLogId + sizeof(synchDigestLogId));
+	writeSynchDigestValue<uint32>(data, synchDigestLogVersion);
+	writeSynchDigestValue<uint32>(data, usfCount);
+	writeSynchDigestValue<uint32>(data, world->getFactionCount());
+
+	for(int factionIndex = 0; factionIndex < world->getFactionCount(); ++factionIndex) {
+		const map<int, vector<UnitSynchDigest> > &frames = world->getFaction(factionIndex)->getSynchDigestFrames();
+		writeSynchDigestValue<int32>(data, factionIndex);
+		writeSynchDigestValue<uint32>(data, (uint32)frames.size());
+
+		for(map<int, vector<UnitSynchDigest> >::const_iterator iterMap = frames.begin();
+			iterMap != frames.end(); ++iterMap) {
+			writeSynchDigestValue<int32>(data, iterMap->first);
+			writeSynchDigestValue<uint32>(data, (uint32)iterMap->second.size());
+			for(unsigned int unitIndex = 0; unitIndex < iterMap->second.size(); ++unitIndex) {
+				const UnitSynchDigest &digest = iterMap->second[unitIndex];
+				writeSynchDigestValue<int32>(data, digest.unitId);
+				for(int field = 0; field < usfCount; ++field) {
+					writeSynchDigestValue<uint32>(data, digest.fields[field]);
+				}
+			}
+		}
+	}
+
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(file).c_str(), L"wb");
+#else
+	FILE *fp = fopen(file.c_str(),"wb");
+#endif
+	if(fp == NULL) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] cannot write synch digest log [%s]\n",__FILE__,__FUNCTION__,__LINE__,file.c_str());
+		return;
+	}
+	fwrite(&data[0], 1, data.size(), fp);
+	fclose(fp);
+}
+
+bool SynchDigestLog::load(const string &file, FrameList &frames) {
+	frames.clear();
+
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(file).c_str(), L"rb");
+#else
+	FILE *fp = fopen(file.c_str(),"rb");
+#endif
+	if(fp == NULL) {
+		return false;
+	}
+	vector<char> data;
+	char buf[64 * 1024];
+	for(size_t readBytes = 0; (readBytes = fread(buf, 1, sizeof(buf), fp)) > 0;) {
+		data.insert(data.end(), buf, buf + readBytes);
+	}
+	fclose(fp);
+
+	const size_t headerSize = sizeof(synchDigestLogId) + 3 * sizeof(uint32);
+	if(data.size() < headerSize || memcmp(&data[0], synchDigestLogId, sizeof(synchDigestLogId)) != 0 ||
+		readSynchDigestValue<uint32>(&data[4]) != synchDigestLogVersion ||
+		readSynchDigestValue<uint32>(&data[8]) != (uint32)usfCount) {
+		return false;
+	}
+	uint32 factionCount = readSynchDigestValue<uint32>(&data[12]);
+	size_t offset = headerSize;
+	const size_t unitSize = sizeof(int32) + usfCount * sizeof(uint32);
+
+	for(uint32 factionNumber = 0; factionNumber < factionCount; ++factionNumber) {
+		if(offset + 2 * sizeof(uint32) > data.size()) {
+			return false;
+		}
+		int factionIndex = readSynchDigestValue<int32>(&data[offset]);
+		uint32 frameCount = readSynchDigestValue<uint32>(&data[offset + 4]);
+		offset += 2 * sizeof(uint32);
+
+		for(uint32 frameNumber = 0; frameNumber < frameCount; ++frameNumber) {
+			if(offset + 2 * sizeof(uint32) > data.size()) {
+				return false;
+			}
+			int worldFrame = readSynchDigestValue<int32>(&data[offset]);
+			uint32 unitCount = readSynchDigestValue<uint32>(&data[offset + 4]);
+			offset += 2 * sizeof(uint32);
+			if(offset + (uint64)unitCount * unitSize > data.size()) {
+				return false;
+			}
+
+			vector<UnitSynchDigest> &units = frames[worldFrame][factionIndex];
+			units.resize(unitCount);
+			for(uint32 unitIndex = 0; unitIndex < unitCount; ++unitIndex) {
+				units[unitIndex].unitId = readSynchDigestValue<int32>(&data[offset]);
+				for(int field = 0; field < usfCount; ++field) {
+					units[unitIndex].fields[field] = readSynchDigestValue<uint32>(&data[offset + 4 + field * 4]);
+				}
+				offset += unitSize;
+			}
+		}
+	}
+	return true;
+}
+
+// Frames only one of the logs still has (each keeps a limited number) are
+// skipped, within a frame the units are compared by id
+string SynchDigestLog::findFirstDifference(const FrameList &frames1, const FrameList &frames2) {
+	for(FrameList::const_iterator iterFrame1 = frames1.begin(); iterFrame1 != frames1.end(); ++iterFrame1) {
+		FrameList::const_iterator iterFrame2 = frames2.find(iterFrame1->first);
+		if(iterFrame2 == frames2.end()) {
+			continue;
+		}
+
+		const map<int, vector<UnitSynchDigest> > &factions1 = iterFrame1->second;
+		const map<int, vector<UnitSynchDigest> > &factions2 = iterFrame2->second;
+		for(map<int, vector<UnitSynchDigest> >::const_iterator iterFaction1 = factions1.begin();
+			iterFaction1 != factions1.end(); ++iterFaction1) {
+			map<int, vector<UnitSynchDigest> >::const_iterator iterFaction2 = factions2.find(iterFaction1->first);
+			if(iterFaction2 == factions2.end()) {
+				continue;
+			}
+
+			map<int, const UnitSynchDigest *> units1;
+			map<int, const UnitSynchDigest *> units2;
+			for(unsigned int index = 0; index < iterFaction1->second.size(); ++index) {
+				units1[iterFaction1->second[index].unitId] = &iterFaction1->second[index];
+			}
+			for(unsigned int index = 0; index < iterFaction2->second.size(); ++index) {
+				units2[iterFaction2->second[index].unitId] = &iterFaction2->second[index];
+			}
+
+			string result = "";
+			int differentUnitCount = 0;
+			map<int, const UnitSynchDigest *>::const_iterator iter1 = units1.begin();
+			map<int, const UnitSynchDigest *>::const_iterator iter2 = units2.begin();
+			for(;iter1 != units1.end() || iter2 != units2.end();) {
+				string unitResult = "";
+				if(iter2 == units2.end() || (iter1 != units1.end() && iter1->first < iter2->first)) {
+					unitResult = "unit " + intToStr(iter1->first) + " only exists in the first log\n";
+					++iter1;
+				}
+				else if(iter1 == units1.end() || iter2->first < iter1->first) {
+					unitResult = "unit " + intToStr(iter2->first) + " only exists in the second log\n";
+					++iter2;
+				}
+				else {
+					for(int field = 0; field < usfCount; ++field) {
+						if(iter1->second->fields[field] != iter2->second->fields[field]) {
+							char szBuf[8096]="";
+							snprintf(szBuf,8096,"unit %d field %s: %08x vs %08x\n",iter1->first,
+									UnitSynchDigest::getFieldName((UnitSynchField)field),
+									iter1->second->fields[field],iter2->second->fields[field]);
+							unitResult += szBuf;
+						}
+					}
+					++iter1;
+					++iter2;
+				}
+
+				if(unitResult != "") {
+					if(differentUnitCount == 0) {
+						result += unitResult;
+					}
+					differentUnitCount++;
+				}
+			}
+
+			if(differentUnitCount > 0) {
+				return "First difference in world frame " + intToStr(iterFrame1->first) +
+						" faction " + intToStr(iterFaction1->first) + " (" +
+						intToStr(differentUnitCount) + " units differ)\n" + result;
+			}
+		}
+	}
+	return "";
+}
+
+}}//end namespace
@@ -0,0 +1,96 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_UNITSYNCHDIGEST_H_
+#define _GLEST_GAME_UNITSYNCHDIGEST_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "data_types.h"
+#include <map>
+#include <vector>
+#include <string>
+#include "leak_dumper.h"
+
+using std::map;
+using std::vector;
+using std::string;
+using Shared::Platform::uint32;
+
+namespace Glest { namespace Game {
+
+class World;
+
+// groups of synchronized unit fields, each one gets its own digest
+enum UnitSynchField {
+	usfIdentity,
+	usfHealth,
+	usfLoad,
+	usfProgress,
+	usfSkill,
+	usfPosition,
+	usfMovement,
+	usfKills,
+	usfUpgrades,
+	usfPath,
+	usfCommands,
+	usfRandom,
+	usfEffects,
+	usfDebugInfo,
+
+	usfCount
+};
+
+// =====================================================
+// 	class UnitSynchDigest
+//
+///	Binary digest of the synchronized state of one unit. Every group of
+///	fields has its own value so two digests tell which part of a unit
+///	went out of synch, the unit sums go into the faction checksum.
+// =====================================================
+
+class UnitSynchDigest {
+public:
+	int unitId;
+	uint32 fields[usfCount];
+
+	UnitSynchDigest();
+
+	uint32 getSum() const;
+	static const char *getFieldName(UnitSynchField field);
+};
+
+// =====================================================
+// 	class SynchDigestLog
+//
+///	Per frame unit digests of every faction, written when a game ends
+///	with network synch checks on and compared to find where two players
+///	went out of synch.
+// =====================================================
+
+class SynchDigestLog {
+public:
+	// world frame -> faction index -> unit digests
+	typedef map<int, map<int, vector<UnitSynchDigest> > > FrameList;
+
+	static void save(const string &file, World *world);
+	static bool load(const string &file, FrameList &frames);
+	// the first frame, faction, unit and fields that differ, empty when
+	// the frames both logs have are the same
+	static string findFirstDifference(const FrameList &frames1, const FrameList &frames2);
+};
+
+}}//end namespace
+
+#endif
@@ -19,17 +19,168 @@
 #include "platform_util.h"
 #include "game_util.h"
 #include "conversion.h"
+#include "renderer.h"
+#include "base_thread.h"
+#include "platform_common.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Util;
 using namespace Shared::Xml;
+using namespace Shared::PlatformCommon;
 
 namespace Glest{ namespace Game{
 
+// =====================================================
+//	class FactionTypeLoadTask
+//
+///	One unit or upgrade type of a faction. Each type is loaded into its
+///	own checksums and file list, these are merged in type order afterwards
+///	so the result does not depend on which thread loaded which type.
+// =====================================================
+
+class FactionTypeLoadTask {
+public:
+	UnitType *unitType;
+	UpgradeType *upgradeType;
+	int index;
+	string dir;
+	Checksum checksum;
+	Checksum techtreeChecksum;
+	std::map<string,vector<pair<string, string> > > loadedFileList;
+	string error;
+	bool errorIsRuntimeError;
+	bool errorWantsStackTrace;
+
+	FactionTypeLoadTask() {
+		unitType = NULL;
+		upgradeType = NULL;
+		index = 0;
+		errorIsRuntimeError = false;
+		errorWantsStackTrace = true;
+	}
+};
+
+// =====================================================
+//	class FactionTypeLoadJob
+//
+///	Unit and upgrade types of a faction, shared by the threads loading them
+// =====================================================
+
+class FactionTypeLoadJob {
+public:
+	const TechTree *techTree;
+	string techTreePath;
+	const FactionType *factionType;
+	bool validationMode;
+
+	vector<FactionTypeLoadTask> tasks;
+	unsigned int nextTask;
+	int loadedTasks;
+	int finishedThreads;
+	bool failed;
+	Mutex mutex;
+	Semaphore semTaskLoaded;
+
+	FactionTypeLoadJob() : mutex(CODE_AT_LINE) {
+		techTree = NULL;
+		factionType = NULL;
+		validationMode = false;
+		nextTask = 0;
+		loadedTasks = 0;
+		finishedThreads = 0;
+		failed = false;
+	}
+
+	bool loadNextType() {
+		FactionTypeLoadTask *task = NULL;
+		{
+			MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+			if(nextTask >= (unsigned int)tasks.size() || failed == true) {
+				return false;
+			}
+			task = &tasks[nextTask++];
+		}
+
+		try {
+			if(task->unitType != NULL) {
+				task->unitType->loaddd(task->index, task->dir, techTree, techTreePath,
+						factionType, &task->checksum, &task->techtreeChecksum,
+						task->loadedFileList, validationMode);
+			}
+			else {
+				task->upgradeType->load(task->dir, techTree, factionType,
+						&task->checksum, &task->techtreeChecksum,
+						task->loadedFileList, validationMode);
+			}
+		}
+		catch(megaglest_runtime_error& ex) {
+			task->error = ex.what();
+			task->errorIsRuntimeError = true;
+			task->errorWantsStackTrace = ex.wantStackTrace();
+		}
+		catch(const exception &ex) {
+			task->error = ex.what();
+		}
+
+		{
+			MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+			// validation goes on after a type failed, like loading on one thread
+			if(task->error != "" && (task->errorIsRuntimeError == false || validationMode == false)) {
+				failed = true;
+			}
+			loadedTasks++;
+		}
+		semTaskLoaded.signal();
+		return true;
+	}
+
+	void threadFinished() {
+		{
+			MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+			finishedThreads++;
+		}
+		semTaskLoaded.signal();
+	}
+
+	int getLoadedTaskCount() {
+		MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+		return loadedTasks;
+	}
+
+	int getFinishedThreadCount() {
+		MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+		return finishedThreads;
+	}
+};
+
+// =====================================================
+//	class FactionTypeLoadThread
+// =====================================================
+
+class FactionTypeLoadThread : public BaseThread {
+protected:
+	FactionTypeLoadJob *job;
+
+public:
+	FactionTypeLoadThread(FactionTypeLoadJob *job) : BaseThread() {
+		this->job = job;
+		uniqueID = "FactionTypeLoadThread";
+	}
+
+	virtual void execute() {
+		RunningStatusSafeWrapper runningStatus(this);
+		for(;getQuitStatus() == false && job->loadNextType() == true;) {
+		}
+		job->threadFinished();
+	}
+};
+
 // ======================================================
 //          Class FactionType
 // ======================================================
 
+int FactionType::typeLoadThreadCount = -1;
+
 FactionType::FactionType() {
 	music			= NULL;
 	personalityType = fpt_Normal;
@@ -158,63 +309,9 @@ void FactionType::load(const string &factionName, const TechTree *techTree, Chec
 			SDL_PumpEvents();
 		}
 
-		// b1) load units
-		try {
-			Logger &logger= Logger::getInstance();
-			int progressBaseValue=logger.getProgress();
-			for(int i = 0; i < (int)unitTypes.size(); ++i) {
-				string str= currentPath + "units/" + unitTypes[i].getName();
-
-				try {
-					unitTypes[i].loaddd(i, str, techTree,techTreePath, this, checksum,techtreeChecksum,
-						loadedFileList,validationMode);
-					logger.setProgress(progressBaseValue+(int)((((double)i + 1.0) / (double)unitTypes.size()) * 100.0/techTree->getTypeCount()));
-					SDL_PumpEvents();
-				}
-				catch(megaglest_runtime_error& ex) {
-					if(validationMode == false) {
-						throw;
-					}
-					else {
-						SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,ex.what());
-					}
-				}
-			}
-		}
-	    catch(megaglest_runtime_error& ex) {
-			SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,ex.what());
-			throw megaglest_runtime_error("Error loading units: "+ currentPath + "\nMessage: " + ex.what(),!ex.wantStackTrace());
-	    }
-		catch(const exception &e) {
-			SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,e.what());
-			throw megaglest_runtime_error("Error loading units: "+ currentPath + "\nMessage: " + e.what());
-		}
-
-		// b2) load upgrades
-		try{
-			for(int i = 0; i < (int)upgradeTypes.size(); ++i) {
-				string str= currentPath + "upgrades/" + upgradeTypes[i].getName();
-
-				try {
-					upgradeTypes[i].load(str, techTree, this, checksum,
-							techtreeChecksum,loadedFileList,validationMode);
-				}
-				catch(megaglest_runtime_error& ex) {
-					if(validationMode == false) {
-						throw;
-					}
-					else {
-						SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,ex.what());
-					}
-				}
-
-				SDL_PumpEvents();
-			}
-		}
-		catch(const exception &e){
-			SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,e.what());
-			throw megaglest_runtime_error("Error loading upgrades: "+ currentPath + "\n" + e.what());
-		}
+		// b) load units and upgrades
+		loadTypes(currentPath, techTreePath, techTree, checksum, techtreeChecksum,
+				loadedFileList, validationMode);
 
 		string tmppath= currentPath + factionName +".xml";
 
@@ -373,6 +470,126 @@ const std::vector<FactionType::PairPUnitTypeInt> FactionType::getAIBehaviorUnits
 	return std::vector<FactionType::PairPUnitTypeInt>();
 }
 
+// Loads the preloaded unit and upgrade types, on several threads when
+// there is more than one of them. Models and textures are still created
+// on the loading threads but uploaded on this one when they are done, and
+// only this thread pumps events and draws the log screen meanwhile.
+void FactionType::loadTypes(const string &currentPath, const string &techTreePath,
+		const TechTree *techTree, Checksum* checksum, Checksum *techtreeChecksum,
+		std::map<string,vector<pair<string, string> > > &loadedFileList,
+		bool validationMode) {
+	Chrono chrono;
+	chrono.start();
+
+	FactionTypeLoadJob job;
+	job.techTree = techTree;
+	job.techTreePath = techTreePath;
+	job.factionType = this;
+	job.validationMode = validationMode;
+
+	job.tasks.resize(unitTypes.size() + upgradeTypes.size());
+	for(int i = 0; i < (int)unitTypes.size(); ++i) {
+		FactionTypeLoadTask &task = job.tasks[i];
+		task.unitType = &unitTypes[i];
+		task.index = i;
+		task.dir = currentPath + "units/" + unitTypes[i].getName();
+	}
+	for(int i = 0; i < (int)upgradeTypes.size(); ++i) {
+		FactionTypeLoadTask &task = job.tasks[unitTypes.size() + i];
+		task.upgradeType = &upgradeTypes[i];
+		task.index = i;
+		task.dir = currentPath + "upgrades/" + upgradeTypes[i].getName();
+	}
+	if(job.tasks.empty() == true) {
+		return;
+	}
+
+	int threadCount = typeLoadThreadCount;
+	if(threadCount < 0) {
+		threadCount = getCpuCount();
+	}
+	if(threadCount > (int)job.tasks.size()) {
+		threadCount = (int)job.tasks.size();
+	}
+
+	Logger &logger= Logger::getInstance();
+	int progressBaseValue=logger.getProgress();
+	double progressPerTask = 100.0 / (double)job.tasks.size() / (double)techTree->getTypeCount();
+
+	if(threadCount <= 1) {
+		for(;job.loadNextType() == true;) {
+			logger.setProgress(progressBaseValue + (int)(job.getLoadedTaskCount() * progressPerTask));
+			SDL_PumpEvents();
+		}
+	}
+	else {
+		Renderer &renderer= Renderer::getInstance();
+		renderer.beginDeferredLoading(rsGame);
+		logger.setDeferAdds(true);
+
+		vector<FactionTypeLoadThread *> loadThreads;
+		for(int index = 0; index < threadCount; ++index) {
+			static string mutexOwnerId = string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+			FactionTypeLoadThread *loadThread = new FactionTypeLoadThread(&job);
+			loadThread->setUniqueID(mutexOwnerId);
+			loadThread->start();
+			loadThreads.push_back(loadThread);
+		}
+
+		for(;job.getFinishedThreadCount() < threadCount;) {
+			job.semTaskLoaded.waitTillSignalled(25);
+
+			logger.setProgress(progressBaseValue + (int)(job.getLoadedTaskCount() * progressPerTask));
+			logger.flushDeferredAdds();
+			SDL_PumpEvents();
+		}
+		for(unsigned int index = 0; index < (unsigned int)loadThreads.size(); ++index) {
+			FactionTypeLoadThread *loadThread = loadThreads[index];
+			if(loadThread->shutdownAndWait() == true) {
+				delete loadThread;
+			}
+		}
+		loadThreads.clear();
+
+		logger.setDeferAdds(false);
+		renderer.endDeferredLoading(rsGame);
+	}
+
+	for(unsigned int index = 0; index < (unsigned int)job.tasks.size(); ++index) {
+		FactionTypeLoadTask &task = job.tasks[index];
+		checksum->addFiles(task.checksum);
+		techtreeChecksum->addFiles(task.techtreeChecksum);
+
+		for(std::map<string,vector<pair<string, string> > >::iterator iterMap = task.loadedFileList.begin();
+			iterMap != task.loadedFileList.end(); ++iterMap) {
+			vector<pair<string, string> > &loadedFile = loadedFileList[iterMap->first];
+			loadedFile.insert(loadedFile.end(), iterMap->second.begin(), iterMap->second.end());
+		}
+	}
+
+	// errors are reported in type order, as if the types loaded one by one
+	for(unsigned int index = 0; index < (unsigned int)job.tasks.size(); ++index) {
+		FactionTypeLoadTask &task = job.tasks[index];
+		if(task.error == "") {
+			continue;
+		}
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,task.error.c_str());
+
+		if(task.errorIsRuntimeError == true && validationMode == true) {
+			continue;
+		}
+		if(task.unitType == NULL) {
+			throw megaglest_runtime_error("Error loading upgrades: "+ currentPath + "\n" + task.error);
+		}
+		if(task.errorIsRuntimeError == true) {
+			throw megaglest_runtime_error("Error loading units: "+ currentPath + "\nMessage: " + task.error,!task.errorWantsStackTrace);
+		}
+		throw megaglest_runtime_error("Error loading units: "+ currentPath + "\nMessage: " + task.error);
+	}
+
+	TechTree::addLoadTimeToLog("LogScreenGameLoadingFactionTypeTime", formatString(this->getName()), chrono.getMillis());
+}
+
 FactionType::~FactionType(){
 	delete music;
 	music = NULL;
@@ -96,6 +96,15 @@ private:
 
 	bool isLinked;
 
+	// threads loading the unit and upgrade types, -1 uses one per core and
+	// 0 or 1 loads them on the calling thread
+	static int typeLoadThreadCount;
+
+	void loadTypes(const string &currentPath, const string &techTreePath,
+			const TechTree *techTree, Checksum* checksum, Checksum *techtreeChecksum,
+			std::map<string,vector<pair<string, string> > > &loadedFileList,
+			bool validationMode);
+
 public:
 	//init
 	FactionType();
@@ -105,6 +114,9 @@ public:
     		bool validationMode=false);
 	virtual ~FactionType();
 
+	static void setTypeLoadThreadCount(int value)	{ typeLoadThreadCount = value; }
+	static int getTypeLoadThreadCount()				{ return typeLoadThreadCount; }
+
 	const std::vector<FactionType::PairPUnitTypeInt> getAIBehaviorUnits(AIBehaviorUnitCategory category) const;
 	const std::vector<const UpgradeType*> getAIBehaviorUpgrades() const { return vctAIBehaviorUpgrades; };
 	int getAIBehaviorStaticOverideValue(AIBehaviorStaticValueCategory type) const;
@@ -28,8 +28,6 @@ using namespace Shared::Graphics;
 
 namespace Glest{ namespace Game{
 
-int SkillType::nextAttackBoostId = 0;
-
 AttackBoost::AttackBoost() : boostUpgrade() {
 	enabled = false;
 	allowMultipleBoosts = false;
@@ -318,7 +316,10 @@ void SkillType::loadAttackBoost(const XmlNode *attackBoostsNode, const XmlNode *
         attackBoostNode = findAttackBoostDetails(attackBoost.name,attackBoostsNode,attackBoostNode);
     }
     else {
-        attackBoost.name = "attack-boost-autoname-" + intToStr(getNextAttackBoostId());
+        // Named after the faction, unit and skill defining it, boosts are
+        // matched by name so it can't depend on the order factions load in
+        attackBoost.name = "attack-boost-autoname-" + (ft != NULL ? ft->getName(false) : "") +
+        		"-" + cutLastExt(extractFileFromDirectoryPath(parentLoader)) + "-" + name;
     }
     string targetType = attackBoostNode->getChild("target")->getAttribute("value")->getValue();
 
@@ -748,8 +749,6 @@ void SkillType::saveGame(XmlNode *rootNode) {
 	skillTypeNode->addAttribute("random",intToStr(random.getLastNumber()), mapTagReplacements);
 //	AttackBoost attackBoost;
 	attackBoost.saveGame(skillTypeNode);
-//	static int nextAttackBoostId;
-	skillTypeNode->addAttribute("nextAttackBoostId",intToStr(nextAttackBoostId), mapTagReplacements);
 //	UnitParticleSystemTypes unitParticleSystemTypes;
 	for(UnitParticleSystemTypes::iterator it = unitParticleSystemTypes.begin(); it != unitParticleSystemTypes.end(); ++it) {
 		(*it)->saveGame(skillTypeNode);
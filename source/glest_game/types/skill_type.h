@@ -160,9 +160,6 @@ protected:
 	RandomGen random;
 	AttackBoost attackBoost;
 
-	static int nextAttackBoostId;
-	static int getNextAttackBoostId() { return ++nextAttackBoostId; }
-
 	const XmlNode * findAttackBoostDetails(string attackBoostName,
 			const XmlNode *attackBoostsNode,const XmlNode *attackBoostNode);
 	void loadAttackBoost(const XmlNode *attackBoostsNode,
@@ -182,8 +179,6 @@ public:
 		
     bool CanCycleNextRandomAnimation(const int *animationRandomCycleCount) const;
 
-    static void resetNextAttackBoostId() { nextAttackBoostId=0; }
-
     const AnimationAttributes getAnimationAttribute(int index) const;
     int getAnimationCount() const { return (int)animations.size(); }
 
@@ -32,9 +32,9 @@ namespace Glest{ namespace Game{
 // 	class TechTree
 // =====================================================
 
-TechTree::TechTree(const vector<string> pathList) {
-	SkillType::resetNextAttackBoostId();
+bool TechTree::xmlCacheEnabled = true;
 
+TechTree::TechTree(const vector<string> pathList) {
 	name="";
 	treePath="";
 	this->pathList.assign(pathList.begin(), pathList.end());
@@ -205,6 +205,16 @@ string TechTree::findPath(const string &techName, const vector<string> &pathTech
 }
 
 
+// Shows how long a part of loading the tech tree took on the log screen, the
+// lang string takes the name of the part and the milliseconds
+void TechTree::addLoadTimeToLog(const string &langKey, const string &name, int64 millis) {
+	char szBuf[8096]="";
+	snprintf(szBuf,8096,Lang::getInstance().getString(langKey,"",true).c_str(),name.c_str(),intToStr(millis).c_str());
+	Logger::getInstance().add(szBuf, true);
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,szBuf);
+}
+
 void TechTree::load(const string &dir, set<string> &factions, Checksum* checksum,
 		Checksum *techtreeChecksum,
 		std::map<string,vector<pair<string, string> > > &loadedFileList,
@@ -220,10 +230,28 @@ void TechTree::load(const string &dir, set<string> &factions, Checksum* checksum
     lang.loadTechTreeStrings(name, true);
     languageUsedForCache = lang.getLanguage();
 
+	// the xml files of the tech tree are served from the binary cache while
+	// it loads, the cache is rebuilt whenever one of them changed. The
+	// checksum is not taken from the crc cache files, they can be days old.
+	std::auto_ptr<XmlTreeCache> xmlTreeCache;
+	if(xmlCacheEnabled == true && getCRCCacheFilePath() != "") {
+		Chrono chronoCache;
+		chronoCache.start();
+		uint32 techCRC = getFolderTreeContentsCheckSumRecursively(currentPath + "*", ".xml", NULL, true);
+		xmlTreeCache.reset(new XmlTreeCache(currentPath, getCRCCacheFilePath() + "techtree_" + name + ".mgtc", techCRC));
+		bool cacheLoaded = xmlTreeCache->load();
+		xmlTreeCache->setActive(true);
+
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] xml cache for [%s] loaded = %d with %d files in " MG_I64_SPECIFIER " ms\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,name.c_str(),cacheLoaded,(int)xmlTreeCache->getFileCount(),chronoCache.getMillis());
+	}
+
 	char szBuf[8096]="";
 	snprintf(szBuf,8096,Lang::getInstance().getString("LogScreenGameLoadingTechtree","",true).c_str(),formatString(getName(true)).c_str());
 	Logger::getInstance().add(szBuf, true);
 
+	Chrono chrono;
+	chrono.start();
+
 	vector<string> filenames;
 	//load resources
 	string str= currentPath + "resources/*.";
@@ -250,6 +278,9 @@ void TechTree::load(const string &dir, set<string> &factions, Checksum* checksum
 		throw megaglest_runtime_error("Error loading Resource Types in: [" + currentPath + "]\n" + e.what(),isValidationModeEnabled);
     }
 
+    addLoadTimeToLog("LogScreenGameLoadingResourceTypesTime", formatString(getName(true)), chrono.getMillis());
+    chrono.start();
+
     // give CPU time to update other things to avoid apperance of hanging
     sleep(0);
     Window::handleEvent();
@@ -322,6 +353,9 @@ void TechTree::load(const string &dir, set<string> &factions, Checksum* checksum
 		throw megaglest_runtime_error("Error loading Tech Tree: "+ currentPath + "\n" + e.what(),isValidationModeEnabled);
     }
 
+    addLoadTimeToLog("LogScreenGameLoadingTechtreeTime", formatString(getName(true)), chrono.getMillis());
+    chrono.start();
+
     // give CPU time to update other things to avoid apperance of hanging
     sleep(0);
 	//SDL_PumpEvents();
@@ -362,6 +396,16 @@ void TechTree::load(const string &dir, set<string> &factions, Checksum* checksum
 		throw megaglest_runtime_error("Error loading Faction Types: "+ currentPath + "\nMessage: " + e.what(),isValidationModeEnabled);
     }
 
+    addLoadTimeToLog("LogScreenGameLoadingFactionTypesTime", formatString(getName(true)), chrono.getMillis());
+
+    if(xmlTreeCache.get() != NULL) {
+    	xmlTreeCache->setActive(false);
+    	// a warm load shows no parsed files, compare the times above with
+    	// those of the load that wrote the cache
+    	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] xml cache for [%s] served %d files, %d were parsed\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,name.c_str(),xmlTreeCache->getHitCount(),xmlTreeCache->getMissCount());
+    	xmlTreeCache->save();
+    }
+
     if(techtreeChecksum != NULL) {
         *techtreeChecksum = checksumValue;
     }
@@ -58,6 +58,9 @@ private:
 	std::map<string,std::map<string,string> > translatedTechFactionNames;
 	bool isValidationModeEnabled;
 
+	// keep the parsed xml of loaded tech trees in the binary cache
+	static bool xmlCacheEnabled;
+
 public:
     Checksum loadTech(const string &techName,
     		set<string> &factions, Checksum* checksum,
@@ -71,6 +74,9 @@ public:
 
     static string findPath(const string &techName, const vector<string> &pathTechList);
     static bool exists(const string &techName, const vector<string> &pathTechList);
+    static void addLoadTimeToLog(const string &langKey, const string &name, int64 millis);
+    static void setXmlCacheEnabled(bool value)	{ xmlCacheEnabled = value; }
+    static bool getXmlCacheEnabled()			{ return xmlCacheEnabled; }
 
     TechTree(const vector<string> pathList);
     ~TechTree();
@@ -28,6 +28,7 @@
 #include "map_preview.h"
 #include "world.h"
 #include "byte_order.h"
+#include "cluster_map.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Graphics;
@@ -131,11 +132,8 @@ SurfaceCell::SurfaceCell() {
 	surfaceTexture= NULL;
 	nearSubmerged = false;
 	cellChangedFromOriginalMapLoad = false;
-
-	for(int i = 0; i < GameConstants::maxPlayers + GameConstants::specialFactions; ++i) {
-		visible[i] = false;
-		explored[i] = false;
-	}
+	visibility= NULL;
+	visibilityIndex= 0;
 }
 
 SurfaceCell::~SurfaceCell() {
@@ -169,15 +167,6 @@ bool SurfaceCell::decAmount(int value) {
 
 	return object->getResource()->decAmount(value);
 }
-void SurfaceCell::setExplored(int teamIndex, bool explored) {
-	this->explored[teamIndex]= explored;
-	//printf("Setting explored to %d for teamIndex %d\n",explored,teamIndex);
-}
-
-void SurfaceCell::setVisible(int teamIndex, bool visible) {
-    this->visible[teamIndex]= visible;
-}
-
 void SurfaceCell::saveGame(XmlNode *rootNode,int index) const {
 	bool saveCell = (this->getCellChangedFromOriginalMapLoad() == true);
 
@@ -276,6 +265,71 @@ void SurfaceCell::loadGame(const XmlNode *rootNode, int index, World *world) {
 //		}
 	}
 }
+// =====================================================
+// 	class SurfaceVisibility
+// =====================================================
+
+void SurfaceVisibility::init(int cellCount) {
+	this->cellCount = cellCount;
+	this->wordCount = (cellCount + 31) / 32;
+	visible.clear();
+	visible.resize(teamCount * wordCount, 0);
+	explored.clear();
+	explored.resize(teamCount * wordCount, 0);
+	visibleRefs.clear();
+	visibleRefs.resize(teamCount * cellCount, 0);
+}
+
+void SurfaceVisibility::clearVisible(int teamIndex) {
+	if(wordCount > 0) {
+		memset(&visible[teamIndex * wordCount], 0, wordCount * sizeof(uint32));
+	}
+}
+
+void SurfaceVisibility::clearVisibleRefs() {
+	if(visibleRefs.empty() == false) {
+		memset(&visibleRefs[0], 0, visibleRefs.size() * sizeof(uint16));
+	}
+}
+
+// =====================================================
+// 	class UnitBuckets
+// =====================================================
+
+void UnitBuckets::init(int cellW, int cellH) {
+	bucketCountW = (cellW + bucketSize - 1) / bucketSize;
+	bucketCountH = (cellH + bucketSize - 1) / bucketSize;
+	counts.clear();
+	counts.resize(bucketCountW * bucketCountH * maxFactions, 0);
+	factionMasks.clear();
+	factionMasks.resize(bucketCountW * bucketCountH, 0);
+}
+
+void UnitBuckets::clear() {
+	counts.assign(counts.size(), 0);
+	factionMasks.assign(factionMasks.size(), 0);
+}
+
+void UnitBuckets::addUnitCell(const Vec2i &pos, int factionIndex) {
+	if(factionIndex < 0 || factionIndex >= maxFactions) {
+		throw megaglest_runtime_error("Invalid faction index for unit buckets: " + intToStr(factionIndex));
+	}
+	int bucketIndex = getBucketIndex(pos.x, pos.y);
+	if(counts[bucketIndex * maxFactions + factionIndex]++ == 0) {
+		factionMasks[bucketIndex] |= (1u << factionIndex);
+	}
+}
+
+void UnitBuckets::removeUnitCell(const Vec2i &pos, int factionIndex) {
+	if(factionIndex < 0 || factionIndex >= maxFactions) {
+		throw megaglest_runtime_error("Invalid faction index for unit buckets: " + intToStr(factionIndex));
+	}
+	int bucketIndex = getBucketIndex(pos.x, pos.y);
+	if(--counts[bucketIndex * maxFactions + factionIndex] == 0) {
+		factionMasks[bucketIndex] &= ~(1u << factionIndex);
+	}
+}
+
 // =====================================================
 // 	class Map
 // =====================================================
@@ -302,6 +356,8 @@ Map::Map() {
 	surfaceSize=(surfaceW * surfaceH);
 	maxPlayers=0;
 	maxMapHeight=0;
+	clusterMap=NULL;
+	staticObstaclesVersion=0;
 }
 
 Map::~Map() {
@@ -313,6 +369,8 @@ Map::~Map() {
 	surfaceCells = NULL;
 	delete [] startLocations;
 	startLocations = NULL;
+	delete clusterMap;
+	clusterMap = NULL;
 }
 
 void Map::end(){
@@ -428,7 +486,12 @@ Checksum Map::load(const string &path, TechTree *techTree, Tileset *tileset) {
 
 			//cells
 			cells= new Cell[getCellArraySize()];
+			unitBuckets.init(w, h);
 			surfaceCells= new SurfaceCell[getSurfaceCellArraySize()];
+			surfaceVisibility.init(getSurfaceCellArraySize());
+			for(int i = 0; i < getSurfaceCellArraySize(); ++i) {
+				surfaceCells[i].setVisibility(&surfaceVisibility, i);
+			}
 
 			//read heightmap
 			for(int j = 0; j < surfaceH; ++j) {
@@ -722,6 +785,18 @@ bool Map::isFreeCell(const Vec2i &pos, Field field) const {
 }
 
 
+//like isFreeCell but only buildings, objects and deep water block the cell
+bool Map::isStaticallyFreeCell(const Vec2i &pos, Field field) const {
+	if(isInside(pos) == false || isInsideSurface(toSurfCoords(pos)) == false) {
+		return false;
+	}
+	Unit *unit= getCell(pos)->getUnit(field);
+	return
+		(unit == NULL || unit->getType()->isMobile() == true) &&
+		(field==fAir || getSurfaceCell(toSurfCoords(pos))->isFree()) &&
+		(field!=fLand || getDeepSubmerged(getCell(pos)) == false);
+}
+
 bool Map::isFreeCellOrHasUnit(const Vec2i &pos, Field field, const Unit *unit) const{
 	if(isInside(pos)){
 		Cell *c= getCell(pos);
@@ -1347,11 +1422,11 @@ void Map::putUnitCellsPrivate(Unit *unit, const Vec2i &pos, const UnitType *ut,
 								   getCell(currPos)->getUnit(field) == unit) {
 					if(isMorph) {
 						// unit is beeing morphed to another unit with maybe other field.
-						getCell(currPos)->setUnit(field, unit);
+						setCellUnit(currPos, field, unit);
 						canPutInCell = false;
 					}
 					if(canPutInCell == true) {
-						getCell(currPos)->setUnit(unit->getCurrField(), unit);
+						setCellUnit(currPos, unit->getCurrField(), unit);
 					}
 				}
 				else if(canPutInCell == true) {
@@ -1375,6 +1450,26 @@ void Map::putUnitCellsPrivate(Unit *unit, const Vec2i &pos, const UnitType *ut,
 	if(canPutInCell == true) {
         unit->setPos(pos);
 	}
+
+	if(ut->isMobile() == false || unit->getType()->isMobile() == false) {
+		updateStaticObstacles(pos, ut->getSize());
+	}
+}
+
+// all unit changes of the cells go through here to keep the buckets current
+void Map::setCellUnit(const Vec2i &pos, int field, Unit *unit) {
+	Cell *cell = getCell(pos);
+	Unit *oldUnit = cell->getUnit(field);
+	if(oldUnit == unit) {
+		return;
+	}
+	if(oldUnit != NULL) {
+		unitBuckets.removeUnitCell(pos, oldUnit->getFactionIndex());
+	}
+	cell->setUnit(field, unit);
+	if(unit != NULL) {
+		unitBuckets.addUnitCell(pos, unit->getFactionIndex());
+	}
 }
 
 //removes a unit from cells
@@ -1425,7 +1520,7 @@ void Map::clearUnitCells(Unit *unit, const Vec2i &pos, bool ignoreSkill) {
 
                 // Only clear the cell if its the unit we expect to clear out of it
                 if(getCell(currPos)->getUnit(currentField) == unit) {
-                    getCell(currPos)->setUnit(currentField, NULL);
+                    setCellUnit(currPos, currentField, NULL);
                 }
 			}
 			else if(ut->hasCellMap() == true &&
@@ -1440,6 +1535,25 @@ void Map::clearUnitCells(Unit *unit, const Vec2i &pos, bool ignoreSkill) {
 			}
 		}
 	}
+
+	if(ut->isMobile() == false || unit->getType()->isMobile() == false) {
+		updateStaticObstacles(pos, ut->getSize());
+	}
+}
+
+void Map::initClusterMap(bool buildAbstractGraph, bool buildRegionLabels) {
+	delete clusterMap;
+	clusterMap = new ClusterMap(this);
+	clusterMap->init(buildAbstractGraph, buildRegionLabels);
+}
+
+// Called whenever buildings, objects or resources covering the given cells
+// change so the pathfinder abstractions can be repaired
+void Map::updateStaticObstacles(const Vec2i &pos, int size) {
+	staticObstaclesVersion++;
+	if(clusterMap != NULL) {
+		clusterMap->update(pos, size);
+	}
 }
 
 // ==================== misc ====================
@@ -1704,6 +1818,8 @@ void Map::computeCellColors(){
 void Map::saveGame(XmlNode *rootNode) const {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *mapNode = rootNode->addChild("Map");
+	// one node per surface cell, written out as they are done
+	mapNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 //	string title;
 	mapNode->addAttribute("title",title, mapTagReplacements);
@@ -47,6 +47,7 @@ class Resource;
 class TechTree;
 class GameSettings;
 class World;
+class ClusterMap;
 
 // =====================================================
 // 	class Cell
@@ -106,6 +107,126 @@ public:
 	void loadGame(const XmlNode *rootNode, int index, World *world);
 };
 
+// =====================================================
+// 	class SurfaceVisibility
+//
+///	Visible and explored flags of all surface cells, one bit plane per
+///	team. A team is cleared or combined a whole word at a time instead of
+///	touching every SurfaceCell. Next to the visible plane every team keeps
+///	a count of the unit sight circles covering each cell, so the world can
+///	add and remove single units instead of recomputing all of them.
+// =====================================================
+
+class SurfaceVisibility {
+public:
+	static const int teamCount = GameConstants::maxPlayers + GameConstants::specialFactions;
+
+private:
+	int cellCount;
+	int wordCount;
+	vector<uint32> visible;
+	vector<uint32> explored;
+	vector<uint16> visibleRefs;
+
+public:
+	SurfaceVisibility() {
+		cellCount = 0;
+		wordCount = 0;
+	}
+
+	void init(int cellCount);
+	void clearVisible(int teamIndex);
+	void clearVisibleRefs();
+
+	inline int getCellCount() const	{return cellCount;}
+	inline int getWordCount() const	{return wordCount;}
+	inline const uint32 *getVisiblePlane(int teamIndex) const	{return &visible[teamIndex * wordCount];}
+	inline const uint32 *getExploredPlane(int teamIndex) const	{return &explored[teamIndex * wordCount];}
+
+	inline bool isVisible(int teamIndex, int cellIndex) const {
+		return (visible[teamIndex * wordCount + (cellIndex >> 5)] & (1u << (cellIndex & 31))) != 0;
+	}
+	inline bool isExplored(int teamIndex, int cellIndex) const {
+		return (explored[teamIndex * wordCount + (cellIndex >> 5)] & (1u << (cellIndex & 31))) != 0;
+	}
+	inline void setVisible(int teamIndex, int cellIndex, bool value) {
+		setBit(visible, teamIndex, cellIndex, value);
+	}
+	inline void setExplored(int teamIndex, int cellIndex, bool value) {
+		setBit(explored, teamIndex, cellIndex, value);
+	}
+
+	inline int getVisibleRefs(int teamIndex, int cellIndex) const {
+		return visibleRefs[teamIndex * cellCount + cellIndex];
+	}
+	// both return the new count, a change to or from zero is a visibility change
+	inline int addVisibleRef(int teamIndex, int cellIndex) {
+		return ++visibleRefs[teamIndex * cellCount + cellIndex];
+	}
+	inline int removeVisibleRef(int teamIndex, int cellIndex) {
+		return --visibleRefs[teamIndex * cellCount + cellIndex];
+	}
+
+private:
+	inline void setBit(vector<uint32> &plane, int teamIndex, int cellIndex, bool value) {
+		uint32 &word = plane[teamIndex * wordCount + (cellIndex >> 5)];
+		if(value == true) {
+			word |= (1u << (cellIndex & 31));
+		}
+		else {
+			word &= ~(1u << (cellIndex & 31));
+		}
+	}
+};
+
+// =====================================================
+// 	class UnitBuckets
+//
+///	Coarse per faction occupancy of the unit cells. The map is split into
+///	square buckets and every bucket counts the cell fields the units of
+///	each faction occupy in it, so range queries can skip whole areas
+///	without a candidate instead of looking at every cell.
+// =====================================================
+
+class UnitBuckets {
+public:
+	static const int bucketShift = 3;
+	static const int bucketSize = 1 << bucketShift;
+	static const int maxFactions = GameConstants::maxPlayers + GameConstants::specialFactions;
+
+private:
+	int bucketCountW;
+	int bucketCountH;
+	vector<int> counts;
+	vector<uint32> factionMasks;
+
+public:
+	UnitBuckets() {
+		bucketCountW = 0;
+		bucketCountH = 0;
+	}
+
+	void init(int cellW, int cellH);
+	void clear();
+
+	inline int getBucketCountW() const	{return bucketCountW;}
+	inline int getBucketCountH() const	{return bucketCountH;}
+	inline int getBucketIndex(int x, int y) const {
+		return (y >> bucketShift) * bucketCountW + (x >> bucketShift);
+	}
+	// true if a unit of one of the factions in the mask has a cell in the
+	// bucket of the given cell
+	inline bool hasUnits(int x, int y, uint32 factionMask) const {
+		return (factionMasks[getBucketIndex(x, y)] & factionMask) != 0;
+	}
+	inline int getCount(int bucketIndex, int factionIndex) const {
+		return counts[bucketIndex * maxFactions + factionIndex];
+	}
+
+	void addUnitCell(const Vec2i &pos, int factionIndex);
+	void removeUnitCell(const Vec2i &pos, int factionIndex);
+};
+
 // =====================================================
 // 	class SurfaceCell
 //
@@ -130,9 +251,9 @@ private:
 	//object & resource
 	Object *object;
 
-	//visibility
-	bool visible[GameConstants::maxPlayers + GameConstants::specialFactions];
-    bool explored[GameConstants::maxPlayers + GameConstants::specialFactions];
+	//visibility, the flags live in the bit planes of the map
+	SurfaceVisibility *visibility;
+	int visibilityIndex;
 
 	//cache
 	bool nearSubmerged;
@@ -156,8 +277,9 @@ public:
 	inline const Vec2f &getSurfTexCoord() const		{return surfTexCoord;}
 	inline bool getNearSubmerged() const				{return nearSubmerged;}
 
-	inline bool isVisible(int teamIndex) const		{return visible[teamIndex];}
-	inline bool isExplored(int teamIndex) const		{return explored[teamIndex];}
+	inline bool isVisible(int teamIndex) const		{return visibility->isVisible(teamIndex, visibilityIndex);}
+	inline bool isExplored(int teamIndex) const		{return visibility->isExplored(teamIndex, visibilityIndex);}
+	inline int getVisibilityIndex() const			{return visibilityIndex;}
 
 	//set
 	inline void setVertex(const Vec3f &vertex)			{this->vertex= vertex;}
@@ -169,8 +291,12 @@ public:
 	inline void setObject(Object *object)				{this->object= object;}
 	inline void setFowTexCoord(const Vec2f &ftc)		{this->fowTexCoord= ftc;}
 	inline void setSurfTexCoord(const Vec2f &stc)		{this->surfTexCoord= stc;}
-	void setExplored(int teamIndex, bool explored);
-    void setVisible(int teamIndex, bool visible);
+	inline void setExplored(int teamIndex, bool explored)	{visibility->setExplored(teamIndex, visibilityIndex, explored);}
+	inline void setVisible(int teamIndex, bool visible)		{visibility->setVisible(teamIndex, visibilityIndex, visible);}
+	inline void setVisibility(SurfaceVisibility *visibility, int index) {
+		this->visibility= visibility;
+		this->visibilityIndex= index;
+	}
     inline void setNearSubmerged(bool nearSubmerged)	{this->nearSubmerged= nearSubmerged;}
 
 	//misc
@@ -226,10 +352,14 @@ private:
 	int maxPlayers;
 	Cell *cells;
 	SurfaceCell *surfaceCells;
+	SurfaceVisibility surfaceVisibility;
+	UnitBuckets unitBuckets;
 	Vec2i *startLocations;
 	Checksum checksumValue;
 	float maxMapHeight;
 	string mapFile;
+	ClusterMap *clusterMap;
+	uint32 staticObstaclesVersion;
 
 private:
 	Map(Map&);
@@ -290,6 +420,9 @@ public:
 	inline SurfaceCell *getSurfaceCell(const Vec2i &sPos) const {
 		return getSurfaceCell(sPos.x, sPos.y);
 	}
+	inline SurfaceVisibility *getSurfaceVisibility()				{return &surfaceVisibility;}
+	inline const SurfaceVisibility *getSurfaceVisibility() const	{return &surfaceVisibility;}
+	inline const UnitBuckets *getUnitBuckets() const				{return &unitBuckets;}
 
 	inline int getW() const											{return w;}
 	inline int getH() const											{return h;}
@@ -324,6 +457,7 @@ public:
 
 	//free cells
 	bool isFreeCell(const Vec2i &pos, Field field) const;
+	bool isStaticallyFreeCell(const Vec2i &pos, Field field) const;
 	bool isFreeCellOrHasUnit(const Vec2i &pos, Field field, const Unit *unit) const;
 	bool isAproxFreeCell(const Vec2i &pos, Field field, int teamIndex) const;
 	bool isFreeCells(const Vec2i &pos, int size, Field field) const;
@@ -338,6 +472,12 @@ public:
     void putUnitCells(Unit *unit, const Vec2i &pos,bool ignoreSkill = false);
 	void clearUnitCells(Unit *unit, const Vec2i &pos,bool ignoreSkill = false);
 
+	//static obstacle abstractions used by the pathfinder
+	void initClusterMap(bool buildAbstractGraph, bool buildRegionLabels);
+	inline ClusterMap * getClusterMap() const							{return clusterMap;}
+	void updateStaticObstacles(const Vec2i &pos, int size);
+	inline uint32 getStaticObstaclesVersion() const						{return staticObstaclesVersion;}
+
 	Vec2i computeRefPos(const Selection *selection) const;
 	Vec2i computeDestPos(	const Vec2i &refUnitPos, const Vec2i &unitPos,
 							const Vec2i &commandPos) const;
@@ -484,6 +624,7 @@ private:
 	void computeNearSubmerged();
 	void computeCellColors();
     void putUnitCellsPrivate(Unit *unit, const Vec2i &pos, const UnitType *ut, bool isMorph);
+    void setCellUnit(const Vec2i &pos, int field, Unit *unit);
 };
 
 
@@ -19,6 +19,7 @@
 #include "config.h"
 #include "object.h"
 #include "game_settings.h"
+#include "sight_stencil.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Graphics;
@@ -151,6 +152,82 @@ void Minimap::incFowTextureAlphaSurface(const Vec2i sPos, float alpha,
 	}
 }
 
+// raises the alpha of a run of pixels to the stencil values, written as a
+// plain loop over bytes so the compiler can vectorize it
+static void stampFowAlphaRun(uint8 *pixels, int components, const uint8 *alphas, int count) {
+	if(components == 1) {
+		for(int i = 0; i < count; ++i) {
+			pixels[i] = (pixels[i] < alphas[i] ? alphas[i] : pixels[i]);
+		}
+	}
+	else {
+		for(int i = 0; i < count; ++i) {
+			uint8 &pixel = pixels[i * components];
+			pixel = (pixel < alphas[i] ? alphas[i] : pixel);
+		}
+	}
+}
+
+static void stampFowAlpha(Pixmap2D *pixmap, const Vec2i &surfCenter, const SightStencil &stencil,
+		int surfaceW, int surfaceH) {
+	const vector<SightStencil::Row> &rows = stencil.getRows();
+	const uint8 *alphaBytes = stencil.getAlphaBytes().empty() ? NULL : &stencil.getAlphaBytes()[0];
+	const uint8 *edgeAlphaBytes = stencil.getEdgeAlphaBytes().empty() ? NULL : &stencil.getEdgeAlphaBytes()[0];
+	uint8 *pixels = pixmap->getPixels();
+	const int components = pixmap->getComponents();
+	const int pixmapW = pixmap->getW();
+
+	for(unsigned int rowIndex = 0; rowIndex < rows.size(); ++rowIndex) {
+		const SightStencil::Row &row = rows[rowIndex];
+
+		// the outer border of the surface always stays fully fogged, the
+		// next ring is capped at the edge alpha (see World::computeFow)
+		int y = surfCenter.y + row.y;
+		if(y < 1 || y > surfaceH - 2) {
+			continue;
+		}
+		int xBegin = max(surfCenter.x + row.xBegin, 1);
+		int xEnd = min(surfCenter.x + row.xBegin + row.count, surfaceW - 1);
+		if(xBegin >= xEnd) {
+			continue;
+		}
+		int alphaIndex = row.alphaIndex + xBegin - (surfCenter.x + row.xBegin);
+		uint8 *rowPixels = &pixels[(pixmapW * y) * components];
+
+		if(y == 1 || y == surfaceH - 2) {
+			stampFowAlphaRun(&rowPixels[xBegin * components], components, &edgeAlphaBytes[alphaIndex], xEnd - xBegin);
+			continue;
+		}
+
+		int innerBegin = max(xBegin, 2);
+		int innerEnd = min(xEnd, surfaceW - 2);
+		if(xBegin < innerBegin) {
+			stampFowAlphaRun(&rowPixels[xBegin * components], components, &edgeAlphaBytes[alphaIndex], innerBegin - xBegin);
+		}
+		if(innerBegin < innerEnd) {
+			stampFowAlphaRun(&rowPixels[innerBegin * components], components,
+					&alphaBytes[alphaIndex + innerBegin - xBegin], innerEnd - innerBegin);
+		}
+		if(max(innerEnd, xBegin) < xEnd) {
+			int edgeBegin = max(innerEnd, xBegin);
+			stampFowAlphaRun(&rowPixels[edgeBegin * components], components,
+					&edgeAlphaBytes[alphaIndex + edgeBegin - xBegin], xEnd - edgeBegin);
+		}
+	}
+}
+
+void Minimap::stampFowTextureAlphaSurface(const Vec2i &surfCenter, const SightStencil &stencil,
+		int surfaceW, int surfaceH, bool isIncrementalUpdate) {
+	if(fowPixmap1) {
+		assert(surfaceW <= fowPixmap1->getW() && surfaceH <= fowPixmap1->getH());
+
+		stampFowAlpha(fowPixmap1, surfCenter, stencil, surfaceW, surfaceH);
+		if(fowPixmap1Copy != NULL && isIncrementalUpdate == true) {
+			stampFowAlpha(fowPixmap1Copy, surfCenter, stencil, surfaceW, surfaceH);
+		}
+	}
+}
+
 void Minimap::copyFowTexAlphaSurface() {
 	if(fowPixmap1_default != NULL && fowPixmap1 != NULL) {
 		fowPixmap1_default->copy(fowPixmap1);
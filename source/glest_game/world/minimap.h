@@ -33,6 +33,7 @@ using Shared::Xml::XmlNode;
 
 class World;
 class GameSettings;
+class SightStencil;
 
 enum ExplorationState{
     esNotExplored,
@@ -72,6 +73,8 @@ public:
 	const Texture2D *getTexture() const		{return tex;}
 
 	void incFowTextureAlphaSurface(const Vec2i sPos, float alpha, bool isIncrementalUpdate=false);
+	void stampFowTextureAlphaSurface(const Vec2i &surfCenter, const SightStencil &stencil,
+			int surfaceW, int surfaceH, bool isIncrementalUpdate=false);
 	void resetFowTex();
 	void updateFowTex(float t);
 	void setFogOfWar(bool value);
@@ -0,0 +1,137 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "sight_stencil.h"
+
+#include "world.h"
+#include "map.h"
+#include "util.h"
+#include "conversion.h"
+#include "platform_util.h"
+#include "leak_dumper.h"
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+
+namespace Glest { namespace Game {
+
+// =====================================================
+// 	class SightStencil
+// =====================================================
+
+const float SightStencil::edgeAlpha= 0.3f;
+
+// stencils never change once built, they are keyed by sight range and by the
+// cell offset of the unit inside its surface cell
+static std::map<std::pair<int,Vec2i>, SightStencil> stencilCache;
+static Mutex mutexStencilCache;
+
+SightStencil::SightStencil() {
+	sightRange = -1;
+}
+
+// Same cells and alpha values a circular walk around a unit at a position
+// with the given offset inside its surface cell produces. Several
+// cells fall on one surface cell, the last one visited sets the alpha.
+void SightStencil::init(int sightRange, const Vec2i &cellOffset) {
+	this->sightRange = sightRange;
+
+	int radius = sightRange + World::indirectSightRange;
+	// keep all visited cells at positive coordinates so the surface cell
+	// division rounds the same way it does on the map
+	const Vec2i center = cellOffset + Vec2i((radius + 1) * Map::cellScale);
+	const Vec2i surfCenter = Map::toSurfCoords(center);
+
+	// keyed by (y, x) so every row of surface cells comes out in order
+	std::map<std::pair<int,int>,float> surfAlphas;
+	for(int y = center.y - radius; y <= center.y + radius; ++y) {
+		for(int x = center.x - radius; x <= center.x + radius; ++x) {
+			const Vec2i sightpos(x, y);
+#ifdef USE_STREFLOP
+			if(streflop::floor(static_cast<streflop::Simple>(sightpos.dist(center))) >= (radius+1)) {
+#else
+			if(floor(sightpos.dist(center)) >= (radius+1)) {
+#endif
+				continue;
+			}
+
+			float alpha = 1.f;
+			float dist = center.dist(sightpos);
+			if(dist > sightRange) {
+				alpha= clamp(1.f-(dist - sightRange) / (World::indirectSightRange), 0.f, 1.f);
+			}
+			const Vec2i surfPos = Map::toSurfCoords(sightpos) - surfCenter;
+			surfAlphas[std::make_pair(surfPos.y, surfPos.x)] = alpha;
+		}
+	}
+
+	// gaps inside a row get alpha 0 which never changes the texture
+	rows.clear();
+	alphas.clear();
+	for(std::map<std::pair<int,int>,float>::const_iterator iterMap = surfAlphas.begin();
+		iterMap != surfAlphas.end(); ++iterMap) {
+		const Vec2i surfPos(iterMap->first.second, iterMap->first.first);
+		if(rows.empty() == true || rows.back().y != surfPos.y) {
+			Row row;
+			row.y = surfPos.y;
+			row.xBegin = surfPos.x;
+			row.count = 0;
+			row.alphaIndex = (int)alphas.size();
+			rows.push_back(row);
+		}
+		Row &row = rows.back();
+		for(; row.xBegin + row.count < surfPos.x; ++row.count) {
+			alphas.push_back(0.f);
+		}
+		alphas.push_back(iterMap->second);
+		row.count++;
+	}
+
+	alphaBytes.resize(alphas.size());
+	edgeAlphaBytes.resize(alphas.size());
+	for(unsigned int i = 0; i < alphas.size(); ++i) {
+		alphaBytes[i] = static_cast<uint8>(alphas[i] * 255.f);
+		edgeAlphaBytes[i] = static_cast<uint8>((alphas[i] < edgeAlpha ? alphas[i] : edgeAlpha) * 255.f);
+	}
+}
+
+const SightStencil *SightStencil::getStencil(int sightRange, const Vec2i &unitPos) {
+	const Vec2i cellOffset(unitPos.x % Map::cellScale, unitPos.y % Map::cellScale);
+	const std::pair<int,Vec2i> key(sightRange, cellOffset);
+
+	static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+	MutexSafeWrapper safeMutex(&mutexStencilCache,mutexOwnerId);
+	std::map<std::pair<int,Vec2i>, SightStencil>::iterator iterFind = stencilCache.find(key);
+	if(iterFind == stencilCache.end()) {
+		iterFind = stencilCache.insert(std::make_pair(key, SightStencil())).first;
+		iterFind->second.init(sightRange, cellOffset);
+	}
+	return &iterFind->second;
+}
+
+string SightStencil::getCacheStats() {
+	static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+	MutexSafeWrapper safeMutex(&mutexStencilCache,mutexOwnerId);
+
+	int cellCount = 0;
+	for(std::map<std::pair<int,Vec2i>, SightStencil>::const_iterator iterMap = stencilCache.begin();
+		iterMap != stencilCache.end(); ++iterMap) {
+		cellCount += iterMap->second.getCellCount();
+	}
+	uint64 totalBytes = cellCount * (sizeof(float) + 2 * sizeof(uint8));
+	totalBytes /= 1000;
+
+	char szBuf[8096]="";
+	snprintf(szBuf,8096,"stencil count [%d] cell count [%d] total KB: %s",(int)stencilCache.size(),cellCount,formatNumber(totalBytes).c_str());
+	return szBuf;
+}
+
+}}//end namespace
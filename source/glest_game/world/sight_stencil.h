@@ -0,0 +1,82 @@
+// ==============================================================
+//	This file is part of Glest (www.glest.org)
+//
+//	Copyright (C) 2001-2008 Martiño Figueroa
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#ifndef _GLEST_GAME_SIGHTSTENCIL_H_
+#define _GLEST_GAME_SIGHTSTENCIL_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "vec.h"
+#include "data_types.h"
+#include <vector>
+#include <map>
+#include <string>
+#include "leak_dumper.h"
+
+using std::vector;
+using Shared::Graphics::Vec2i;
+using Shared::Platform::uint8;
+
+namespace Glest { namespace Game {
+
+// =====================================================
+// 	class SightStencil
+//
+///	Fog of war texture alpha around a unit, relative to the surface cell
+///	the unit stands on. The alpha only depends on the sight range and on
+///	which of the cells of its surface cell the unit stands on, so every
+///	combination is computed once and shared by all units. The cells are
+///	stored as horizontal runs so a stencil can be stamped into the fog of
+///	war texture a row at a time.
+// =====================================================
+
+class SightStencil {
+public:
+	class Row {
+	public:
+		int y;
+		int xBegin;
+		int count;
+		int alphaIndex;
+	};
+
+	// alpha of the cells next to the map edge is capped at this value
+	static const float edgeAlpha;
+
+private:
+	int sightRange;
+	vector<Row> rows;
+	vector<float> alphas;
+	vector<uint8> alphaBytes;
+	vector<uint8> edgeAlphaBytes;
+
+public:
+	SightStencil();
+
+	void init(int sightRange, const Vec2i &cellOffset);
+
+	int getSightRange() const						{return sightRange;}
+	const vector<Row> &getRows() const				{return rows;}
+	const vector<float> &getAlphas() const			{return alphas;}
+	const vector<uint8> &getAlphaBytes() const		{return alphaBytes;}
+	const vector<uint8> &getEdgeAlphaBytes() const	{return edgeAlphaBytes;}
+	int getCellCount() const						{return (int)alphas.size();}
+
+	static const SightStencil *getStencil(int sightRange, const Vec2i &unitPos);
+	static std::string getCacheStats();
+};
+
+}}//end namespace
+
+#endif
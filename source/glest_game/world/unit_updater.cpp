@@ -42,7 +42,7 @@ namespace Glest{ namespace Game{
 // ===================== PUBLIC ========================
 
 UnitUpdater::UnitUpdater() : mutexAttackWarnings(new Mutex(CODE_AT_LINE)),
-		mutexUnitRangeCellsLookupItemCache(new Mutex(CODE_AT_LINE)) {
+							 mutexRangeQueryStats(new Mutex(CODE_AT_LINE)) {
     this->game= NULL;
 	this->gui= NULL;
 	this->gameCamera= NULL;
@@ -53,6 +53,7 @@ UnitUpdater::UnitUpdater() : mutexAttackWarnings(new Mutex(CODE_AT_LINE)),
 	this->pathFinder = NULL;
 	//UnitRangeCellsLookupItemCacheTimerCount = 0;
 	attackWarnRange=0;
+	rangeQueryTimings = false;
 }
 
 void UnitUpdater::init(Game *game){
@@ -66,6 +67,12 @@ void UnitUpdater::init(Game *game){
 	this->scriptManager= game->getScriptManager();
 	this->pathFinder = NULL;
 	attackWarnRange=Config::getInstance().getFloat("AttackWarnRange","50.0");
+	rangeQueryTimings=Config::getInstance().getBool("UnitRangeQueryTimings","false");
+	MutexSafeWrapper safeMutex(mutexRangeQueryStats,string(__FILE__) + "_" + intToStr(__LINE__));
+	for(int i = 0; i < rqCount; ++i) {
+		rangeQueryStats[i] = RangeQueryStats();
+	}
+	safeMutex.ReleaseLock();
 	//UnitRangeCellsLookupItemCacheTimerCount = 0;
 
 	switch(this->game->getGameSettings()->getPathFinderType()) {
@@ -90,6 +97,12 @@ void UnitUpdater::removeUnitPrecache(Unit *unit) {
 	}
 }
 
+void UnitUpdater::processPathRequests(int frameIndex) {
+	if(pathFinder != NULL) {
+		pathFinder->processPathRequests(frameIndex);
+	}
+}
+
 UnitUpdater::~UnitUpdater() {
 	//UnitRangeCellsLookupItemCache.clear();
 
@@ -108,8 +121,8 @@ UnitUpdater::~UnitUpdater() {
 	delete mutexAttackWarnings;
 	mutexAttackWarnings = NULL;
 
-	delete mutexUnitRangeCellsLookupItemCache;
-	mutexUnitRangeCellsLookupItemCache = NULL;
+	delete mutexRangeQueryStats;
+	mutexRangeQueryStats = NULL;
 }
 
 // ==================== progress skills ====================
@@ -535,10 +548,17 @@ void UnitUpdater::updateMove(Unit *unit, int frameIndex) {
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugPerformance).enabled && chrono.getMillis() > 0) SystemFlags::OutputDebug(SystemFlags::debugPerformance,"In [%s::%s Line: %d] took msecs: %lld\n",__FILE__,__FUNCTION__,__LINE__,chrono.getMillis());
 
 
+	// units moved as a group share one flow field toward the target
+	int unitCommandGroupId = -1;
+	if(command->getUnit() == NULL &&
+		game->isFlagType1BitEnabled(ft1_flow_field_group_moves) == true) {
+		unitCommandGroupId = command->getUnitCommandGroupId();
+	}
+
 	TravelState tsValue = tsImpossible;
 	switch(this->game->getGameSettings()->getPathFinderType()) {
 		case pfBasic:
-			tsValue = pathFinder->findPath(unit, pos, NULL, frameIndex);
+			tsValue = pathFinder->findPath(unit, pos, NULL, frameIndex, unitCommandGroupId);
 			break;
 		default:
 			throw megaglest_runtime_error("detected unsupported pathfinder type!");
@@ -1728,6 +1748,7 @@ void UnitUpdater::updateHarvest(Unit *unit, int frameIndex) {
 								//const ResourceType *rt = r->getType();
 								sc->deleteResource();
 								world->removeResourceTargetFromCache(unitTargetPos);
+								map->updateStaticObstacles(Map::toUnitCoords(Map::toSurfCoords(unitTargetPos)),Map::cellScale);
 
 								switch(this->game->getGameSettings()->getPathFinderType()) {
 									case pfBasic:
@@ -2696,31 +2717,61 @@ bool UnitUpdater::attackableOnRange(Unit *unit, Unit **rangedPtr, const AttackSk
 	return unitOnRange(unit, range, rangedPtr, ast, evalMode);
 }
 
-bool UnitUpdater::findCachedCellsEnemies(Vec2i center, int range, int size, vector<Unit*> &enemies,
-										 const AttackSkillType *ast, const Unit *unit,
-										 const Unit *commandTarget) {
-	bool result = false;
-	MutexSafeWrapper safeMutex(mutexUnitRangeCellsLookupItemCache,string(__FILE__) + "_" + intToStr(__LINE__));
-	std::map<Vec2i, std::map<int, std::map<int, UnitRangeCellsLookupItem > > >::iterator iterFind = UnitRangeCellsLookupItemCache.find(center);
-
-	if(iterFind != UnitRangeCellsLookupItemCache.end()) {
-		std::map<int, std::map<int, UnitRangeCellsLookupItem > >::iterator iterFind3 = iterFind->second.find(size);
-		if(iterFind3 != iterFind->second.end()) {
-			std::map<int, UnitRangeCellsLookupItem>::iterator iterFind4 = iterFind3->second.find(range);
-			if(iterFind4 != iterFind3->second.end()) {
-				result = true;
-
-				std::vector<Cell *> &cellList = iterFind4->second.rangeCellList;
-				for(int idx = 0; idx < (int)cellList.size(); ++idx) {
-					Cell *cell = cellList[idx];
-
-					findEnemiesForCell(ast,cell,unit,commandTarget,enemies);
-				}
+// Factions whose units can count as enemies of the unit, with a command
+// target only the faction of the target counts
+uint32 UnitUpdater::getEnemyFactionMask(const Unit *unit, const Unit *commandTarget) const {
+	if(commandTarget != NULL) {
+		return (1u << commandTarget->getFactionIndex());
+	}
+	uint32 factionMask = 0;
+	for(int i = 0; i < world->getFactionCount(); ++i) {
+		const Faction *faction = world->getFaction(i);
+		if(unit->getFaction()->isAlly(faction) == false) {
+			factionMask |= (1u << faction->getIndex());
+		}
+	}
+	return factionMask;
+}
+
+// Collects the enemies in range in the same cell order (column by column)
+// the plain scan of the square around the unit produces, skipping the part
+// of a column that lies in a bucket without units of an enemy faction
+void UnitUpdater::findEnemiesInRange(const Unit *unit, const Vec2i &center, const Vec2f &floatCenter,
+									 int size, int range, const AttackSkillType *ast,
+									 const Unit *commandTarget, vector<Unit*> &enemies) {
+	const UnitBuckets *unitBuckets = map->getUnitBuckets();
+	uint32 factionMask = getEnemyFactionMask(unit, commandTarget);
+	if(factionMask == 0) {
+		return;
+	}
+
+	for(int i = center.x - range; i < center.x + range + size; ++i) {
+		for(int j = center.y - range; j < center.y + range + size; ++j) {
+			if(map->isInside(i, j) == false) {
+				continue;
+			}
+			if(unitBuckets->hasUnits(i, j, factionMask) == false) {
+				j |= UnitBuckets::bucketSize - 1;
+				continue;
+			}
+			//cells inside map and in range
+#ifdef USE_STREFLOP
+			if(streflop::floor(static_cast<streflop::Simple>(floatCenter.dist(Vec2f((float)i, (float)j)))) <= (range+1)){
+#else
+			if(floor(floatCenter.dist(Vec2f((float)i, (float)j))) <= (range+1)){
+#endif
+				Cell *cell = map->getCell(i,j);
+				findEnemiesForCell(ast,cell,unit,commandTarget,enemies);
 			}
 		}
 	}
+}
 
-	return result;
+void UnitUpdater::addRangeQueryTime(RangeQueryType queryType, Chrono &chrono) const {
+	int64 micros = chrono.getMicros();
+	MutexSafeWrapper safeMutex(mutexRangeQueryStats,string(__FILE__) + "_" + intToStr(__LINE__));
+	rangeQueryStats[queryType].count++;
+	rangeQueryStats[queryType].micros += micros;
 }
 
 void UnitUpdater::findEnemiesForCell(const AttackSkillType *ast, Cell *cell, const Unit *unit,
@@ -2746,8 +2797,19 @@ void UnitUpdater::findEnemiesForCell(const AttackSkillType *ast, Cell *cell, con
 }
 
 void UnitUpdater::findEnemiesForCell(const Vec2i pos, int size, int sightRange, const Faction *faction, vector<Unit*> &enemies, bool attackersOnly) const {
+	Chrono chrono;
+	if(rangeQueryTimings == true) chrono.start();
+
+	const UnitBuckets *unitBuckets = map->getUnitBuckets();
+	uint32 factionMask = 0;
+	for(int i = 0; i < world->getFactionCount(); ++i) {
+		if(world->getFaction(i)->getTeam() != faction->getTeam()) {
+			factionMask |= (1u << world->getFaction(i)->getIndex());
+		}
+	}
+
 	//all fields
-	for(int k = 0; k < fieldCount; k++) {
+	for(int k = 0; k < fieldCount && factionMask != 0; k++) {
 		Field f= static_cast<Field>(k);
 
 		for(int i = pos.x - sightRange; i < pos.x + size + sightRange; ++i) {
@@ -2755,6 +2817,10 @@ void UnitUpdater::findEnemiesForCell(const Vec2i pos, int size, int sightRange,
 				Vec2i testPos(i,j);
 				if( map->isInside(testPos) &&
 						map->isInsideSurface(map->toSurfCoords(testPos))) {
+					if(unitBuckets->hasUnits(i, j, factionMask) == false) {
+						j |= UnitBuckets::bucketSize - 1;
+						continue;
+					}
 					Cell *cell = map->getCell(testPos);
 					//check field
 					Unit *possibleEnemy = cell->getUnit(f);
@@ -2776,6 +2842,8 @@ void UnitUpdater::findEnemiesForCell(const Vec2i pos, int size, int sightRange,
 			}
 		}
 	}
+
+	if(rangeQueryTimings == true) addRangeQueryTime(rqFindEnemiesForCell, chrono);
 }
 
 //if the unit has any enemy on range
@@ -2800,37 +2868,12 @@ bool UnitUpdater::unitOnRange(Unit *unit, int range, Unit **rangedPtr,
 	Vec2i center 		= unit->getPos();
 	Vec2f floatCenter	= unit->getFloatCenteredPos();
 
-	//bool foundInCache = true;
-	if(findCachedCellsEnemies(center,range,size,enemies,ast,
-							  unit,commandTarget) == false) {
-
-		//foundInCache = false;
-		//nearby cells
-		UnitRangeCellsLookupItem cacheItem;
-		for(int i = center.x - range; i < center.x + range + size; ++i) {
-			for(int j = center.y - range; j < center.y + range + size; ++j) {
-				//cells inside map and in range
-#ifdef USE_STREFLOP
-				if(map->isInside(i, j) && streflop::floor(static_cast<streflop::Simple>(floatCenter.dist(Vec2f((float)i, (float)j)))) <= (range+1)){
-#else
-				if(map->isInside(i, j) && floor(floatCenter.dist(Vec2f((float)i, (float)j))) <= (range+1)){
-#endif
-					Cell *cell = map->getCell(i,j);
-					findEnemiesForCell(ast,cell,unit,commandTarget,enemies);
-
-					cacheItem.rangeCellList.push_back(cell);
-				}
-			}
-		}
-
+	Chrono chrono;
+	if(rangeQueryTimings == true) chrono.start();
 
-		// Ok update our caches with the latest info
-		if(cacheItem.rangeCellList.empty() == false) {
-			MutexSafeWrapper safeMutex(mutexUnitRangeCellsLookupItemCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	findEnemiesInRange(unit,center,floatCenter,size,range,ast,commandTarget,enemies);
 
-			UnitRangeCellsLookupItemCache[center][size][range] = cacheItem;
-		}
-	}
+	if(rangeQueryTimings == true) addRangeQueryTime(rqUnitOnRange, chrono);
 
 	//attack enemies that can attack first
 	float distToUnit= -1;
@@ -3035,36 +3078,12 @@ vector<Unit*> UnitUpdater::enemyUnitsOnRange(const Unit *unit,const AttackSkillT
 	Vec2i center 		= unit->getPosNotThreadSafe();
 	Vec2f floatCenter	= unit->getFloatCenteredPos();
 
-	//bool foundInCache = true;
-	if(findCachedCellsEnemies(center,range,size,enemies,ast,
-							  unit,commandTarget) == false) {
+	Chrono chrono;
+	if(rangeQueryTimings == true) chrono.start();
 
-		//foundInCache = false;
-		//nearby cells
-		UnitRangeCellsLookupItem cacheItem;
-		for(int i = center.x - range; i < center.x + range + size; ++i) {
-			for(int j = center.y - range; j < center.y + range + size; ++j) {
-				//cells inside map and in range
-#ifdef USE_STREFLOP
-				if(map->isInside(i, j) && streflop::floor(static_cast<streflop::Simple>(floatCenter.dist(Vec2f((float)i, (float)j)))) <= (range+1)){
-#else
-				if(map->isInside(i, j) && floor(floatCenter.dist(Vec2f((float)i, (float)j))) <= (range+1)){
-#endif
-					Cell *cell = map->getCell(i,j);
-					findEnemiesForCell(ast,cell,unit,commandTarget,enemies);
+	findEnemiesInRange(unit,center,floatCenter,size,range,ast,commandTarget,enemies);
 
-					cacheItem.rangeCellList.push_back(cell);
-				}
-			}
-		}
-
-		// Ok update our caches with the latest info
-		if(cacheItem.rangeCellList.empty() == false) {
-			MutexSafeWrapper safeMutex(mutexUnitRangeCellsLookupItemCache,string(__FILE__) + "_" + intToStr(__LINE__));
-
-			UnitRangeCellsLookupItemCache[center][size][range] = cacheItem;
-		}
-	}
+	if(rangeQueryTimings == true) addRangeQueryTime(rqEnemyUnitsOnRange, chrono);
 
 	}
 	catch(const exception &ex) {
@@ -3111,15 +3130,25 @@ vector<Unit*> UnitUpdater::findUnitsInRange(const Unit *unit, int radius) {
 	Vec2i center 		= unit->getPosNotThreadSafe();
 	Vec2f floatCenter	= unit->getFloatCenteredPos();
 
-	//nearby cells
-	//UnitRangeCellsLookupItem cacheItem;
+	Chrono chrono;
+	if(rangeQueryTimings == true) chrono.start();
+
+	//nearby cells, skipping buckets without any unit
+	const UnitBuckets *unitBuckets = map->getUnitBuckets();
 	for(int i = center.x - range; i < center.x + range + size; ++i) {
 		for(int j = center.y - range; j < center.y + range + size; ++j) {
+			if(map->isInside(i, j) == false) {
+				continue;
+			}
+			if(unitBuckets->hasUnits(i, j, 0xFFFFFFFF) == false) {
+				j |= UnitBuckets::bucketSize - 1;
+				continue;
+			}
 			//cells inside map and in range
 #ifdef USE_STREFLOP
-			if(map->isInside(i, j) && streflop::floor(static_cast<streflop::Simple>(floatCenter.dist(Vec2f((float)i, (float)j)))) <= (range+1)){
+			if(streflop::floor(static_cast<streflop::Simple>(floatCenter.dist(Vec2f((float)i, (float)j)))) <= (range+1)){
 #else
-			if(map->isInside(i, j) && floor(floatCenter.dist(Vec2f((float)i, (float)j))) <= (range+1)){
+			if(floor(floatCenter.dist(Vec2f((float)i, (float)j))) <= (range+1)){
 #endif
 				Cell *cell = map->getCell(i,j);
 				findUnitsForCell(cell,unit,units);
@@ -3127,47 +3156,36 @@ vector<Unit*> UnitUpdater::findUnitsInRange(const Unit *unit, int radius) {
 		}
 	}
 
+	if(rangeQueryTimings == true) addRangeQueryTime(rqFindUnitsInRange, chrono);
+
 	return units;
 }
 
-string UnitUpdater::getUnitRangeCellsLookupItemCacheStats() {
-	string result = "";
-
-	int posCount = 0;
-	int sizeCount = 0;
-	int rangeCount = 0;
-	int rangeCountCellCount = 0;
-
-	MutexSafeWrapper safeMutex(mutexUnitRangeCellsLookupItemCache,string(__FILE__) + "_" + intToStr(__LINE__));
-	for(std::map<Vec2i, std::map<int, std::map<int, UnitRangeCellsLookupItem > > >::iterator iterMap1 = UnitRangeCellsLookupItemCache.begin();
-		iterMap1 != UnitRangeCellsLookupItemCache.end(); ++iterMap1) {
-		posCount++;
+string UnitUpdater::getUnitRangeQueryStats() {
+	static const char *queryNames[rqCount] = {
+		"unitOnRange", "enemyUnitsOnRange", "findEnemiesForCell", "findUnitsInRange"
+	};
 
-		for(std::map<int, std::map<int, UnitRangeCellsLookupItem > >::iterator iterMap2 = iterMap1->second.begin();
-			iterMap2 != iterMap1->second.end(); ++iterMap2) {
-			sizeCount++;
-
-			for(std::map<int, UnitRangeCellsLookupItem>::iterator iterMap3 = iterMap2->second.begin();
-				iterMap3 != iterMap2->second.end(); ++iterMap3) {
-				rangeCount++;
-
-				rangeCountCellCount += (int)iterMap3->second.rangeCellList.size();
-			}
-		}
+	const UnitBuckets *unitBuckets = map->getUnitBuckets();
+	string result = "buckets [" + intToStr(unitBuckets->getBucketCountW()) + "x" + intToStr(unitBuckets->getBucketCountH()) + "]";
+	if(rangeQueryTimings == false) {
+		return result + " (set UnitRangeQueryTimings for timings)";
+	}
+	MutexSafeWrapper safeMutex(mutexRangeQueryStats,string(__FILE__) + "_" + intToStr(__LINE__));
+	for(int i = 0; i < rqCount; ++i) {
+		const RangeQueryStats &stats = rangeQueryStats[i];
+		char szBuf[8096]="";
+		snprintf(szBuf,8096," %s [" MG_I64_SPECIFIER "] avg usecs [%.2f]",queryNames[i],stats.count,
+				(stats.count > 0 ? (double)stats.micros / (double)stats.count : 0.0));
+		result += szBuf;
 	}
-
-	uint64 totalBytes = rangeCountCellCount * sizeof(Cell *);
-	totalBytes /= 1000;
-
-	char szBuf[8096]="";
-	snprintf(szBuf,8096,"pos [%d] size [%d] range [%d][%d] total KB: %s",posCount,sizeCount,rangeCount,rangeCountCellCount,formatNumber(totalBytes).c_str());
-	result = szBuf;
 	return result;
 }
 
 void UnitUpdater::saveGame(XmlNode *rootNode) {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *unitupdaterNode = rootNode->addChild("UnitUpdater");
+	unitupdaterNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 //	const GameCamera *gameCamera;
 //	Gui *gui;
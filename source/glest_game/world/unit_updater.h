@@ -44,13 +44,23 @@ class PathFinder;
 class ParticleDamager;
 class Cell;
 
-class UnitRangeCellsLookupItem {
-public:
+enum RangeQueryType {
+	rqUnitOnRange,
+	rqEnemyUnitsOnRange,
+	rqFindEnemiesForCell,
+	rqFindUnitsInRange,
 
-	//int UnitRangeCellsLookupItemCacheTimerCountIndex;
-	std::vector<Cell *> rangeCellList;
+	rqCount
+};
 
-	static time_t lastDebug;
+class RangeQueryStats {
+public:
+	RangeQueryStats() {
+		count = 0;
+		micros = 0;
+	}
+	int64 count;
+	int64 micros;
 };
 
 class AttackWarningData {
@@ -84,15 +94,16 @@ private:
 	float attackWarnRange;
 	AttackWarnings attackWarnings;
 
-	Mutex *mutexUnitRangeCellsLookupItemCache;
-	std::map<Vec2i, std::map<int, std::map<int, UnitRangeCellsLookupItem > > > UnitRangeCellsLookupItemCache;
-	//std::map<int,ExploredCellsLookupKey> ExploredCellsLookupItemCacheTimer;
-	//int UnitRangeCellsLookupItemCacheTimerCount;
+	bool rangeQueryTimings;
+	// range queries also run on the faction threads
+	Mutex *mutexRangeQueryStats;
+	mutable RangeQueryStats rangeQueryStats[rqCount];
 
-	bool findCachedCellsEnemies(Vec2i center, int range,
-								int size, vector<Unit*> &enemies,
-								const AttackSkillType *ast, const Unit *unit,
-								const Unit *commandTarget);
+	uint32 getEnemyFactionMask(const Unit *unit, const Unit *commandTarget) const;
+	void findEnemiesInRange(const Unit *unit, const Vec2i &center, const Vec2f &floatCenter,
+							int size, int range, const AttackSkillType *ast,
+							const Unit *commandTarget, vector<Unit*> &enemies);
+	void addRangeQueryTime(RangeQueryType queryType, Chrono &chrono) const;
 	void findEnemiesForCell(const AttackSkillType *ast, Cell *cell, const Unit *unit,
 							const Unit *commandTarget,vector<Unit*> &enemies);
 
@@ -121,6 +132,7 @@ public:
 
 	void clearUnitPrecache(Unit *unit);
 	void removeUnitPrecache(Unit *unit);
+	void processPathRequests(int frameIndex);
 
 	inline unsigned int getAttackWarningCount() const { return (unsigned int)attackWarnings.size(); }
 	std::pair<bool,Unit *> unitBeingAttacked(const Unit *unit);
@@ -131,7 +143,7 @@ public:
 	void findUnitsForCell(Cell *cell, const Unit *unit,vector<Unit*> &units);
 	vector<Unit*> findUnitsInRange(const Unit *unit, int radius);
 
-	string getUnitRangeCellsLookupItemCacheStats();
+	string getUnitRangeQueryStats();
 
 	void saveGame(XmlNode *rootNode);
 	void loadGame(const XmlNode *rootNode);
@@ -22,6 +22,7 @@
 #include "sound_renderer.h"
 #include "game_settings.h"
 #include "cache_manager.h"
+#include "sight_stencil.h"
 #include <iostream>
 #include "sound.h"
 #include "sound_renderer.h"
@@ -41,6 +42,71 @@ namespace Glest{ namespace Game{
 int MaxExploredCellsLookupItemCache = 9500;
 time_t ExploredCellsLookupItem::lastDebug = 0;
 
+// =====================================================
+// 	class UnitIndex
+// =====================================================
+
+UnitIndex::UnitIndex() {
+	unitCount = 0;
+	lookupCount = 0;
+	lookupMissCount = 0;
+	frameLookupCount = 0;
+	lastFrameLookupCount = 0;
+}
+
+void UnitIndex::clear() {
+	blocks.clear();
+	unitCount = 0;
+}
+
+void UnitIndex::add(Unit *unit) {
+	int id = unit->getId();
+	if(id < 0) {
+		throw megaglest_runtime_error("Invalid unit id for unit index: " + intToStr(id));
+	}
+	unsigned int blockIndex = (unsigned int)(id / blockSize);
+	unsigned int slot = (unsigned int)(id % blockSize);
+	if(blockIndex >= blocks.size()) {
+		blocks.resize(blockIndex + 1);
+	}
+	vector<Unit *> &block = blocks[blockIndex];
+	if(slot >= block.size()) {
+		// grow in steps so a faction producing units does not reallocate
+		// on every new one
+		block.resize(max<unsigned int>(slot + 1, (unsigned int)block.size() * 2), NULL);
+	}
+	if(block[slot] == NULL) {
+		unitCount++;
+	}
+	block[slot] = unit;
+}
+
+void UnitIndex::remove(const Unit *unit) {
+	int id = unit->getId();
+	if(id < 0) {
+		return;
+	}
+	unsigned int blockIndex = (unsigned int)(id / blockSize);
+	unsigned int slot = (unsigned int)(id % blockSize);
+	if(blockIndex < blocks.size() && slot < blocks[blockIndex].size() &&
+		blocks[blockIndex][slot] == unit) {
+		blocks[blockIndex][slot] = NULL;
+		unitCount--;
+	}
+}
+
+void UnitIndex::nextFrame() {
+	lastFrameLookupCount = lookupCount - frameLookupCount;
+	frameLookupCount = lookupCount;
+}
+
+string UnitIndex::getStats() const {
+	char szBuf[8096]="";
+	snprintf(szBuf,8096,"units [%d] main thread lookups last frame [" MG_I64_SPECIFIER "] total [" MG_I64_SPECIFIER "] misses [" MG_I64_SPECIFIER "]",
+			unitCount,lastFrameLookupCount,lookupCount,lookupMissCount);
+	return szBuf;
+}
+
 // ===================== PUBLIC ========================
 
 World::World() : mutexFactionNextUnitId(new Mutex(CODE_AT_LINE)) {
@@ -81,6 +147,13 @@ World::World() : mutexFactionNextUnitId(new Mutex(CODE_AT_LINE)) {
 	cacheFowAlphaTexture = false;
 	cacheFowAlphaTextureFogOfWarValue = false;
 
+	incrementalFogOfWar = config.getBool("EnableIncrementalFogOfWar","true");
+	verifyIncrementalFogOfWar = config.getBool("VerifyIncrementalFogOfWar","false");
+	fowRefreshAll = true;
+	fowUpdateCount = 0;
+	fowLastTeamIndex = -1;
+	fowTouchedCells.resize(SurfaceVisibility::teamCount);
+
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
 }
 
@@ -93,6 +166,9 @@ void World::cleanup() {
 	ExploredCellsLookupItemCacheTimer.clear();
 	//FowAlphaCellsLookupItemCache.clear();
 
+	unitSightContributions.clear();
+	fowRefreshAll = true;
+
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
 
 	for(int i= 0; i < (int)factions.size(); ++i){
@@ -105,6 +181,7 @@ void World::cleanup() {
 		delete factions[i];
 	}
 	factions.clear();
+	unitIndex.clear();
 
 #ifdef LEAK_CHECK_UNITS
 	printf("%s::%s\n",__FILE__,__FUNCTION__);
@@ -161,6 +238,8 @@ void World::endScenario() {
 	fogOfWarSkillTypeValue = -1;
 	cacheFowAlphaTexture = false;
 	cacheFowAlphaTextureFogOfWarValue = false;
+	unitSightContributions.clear();
+	fowRefreshAll = true;
 
 	map.end();
 
@@ -186,6 +265,7 @@ void World::end(){
 		delete factions[i];
 	}
 	factions.clear();
+	unitIndex.clear();
 
 #ifdef LEAK_CHECK_UNITS
 	printf("%s::%s\n",__FILE__,__FUNCTION__);
@@ -200,6 +280,8 @@ void World::end(){
 	map.end();
 	cacheFowAlphaTexture = false;
 	cacheFowAlphaTextureFogOfWarValue = false;
+	unitSightContributions.clear();
+	fowRefreshAll = true;
 
 	//stats will be deleted by BattleEnd
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
@@ -412,10 +494,17 @@ void World::init(Game *game, bool createUnits, bool initFactions){
 		else {
 			restoreExploredFogOfWarCells();
 		}
+		fowRefreshAll = true;
 
 		//minimap.loadGame(loadWorldNode);
 	}
 
+	bool hierarchicalPathfinding = game->isFlagType1BitEnabled(ft1_hierarchical_pathfinding);
+	bool pathfinderRegionChecks = game->isFlagType1BitEnabled(ft1_pathfinder_region_checks);
+	if(hierarchicalPathfinding == true || pathfinderRegionChecks == true) {
+		map.initClusterMap(hierarchicalPathfinding, pathfinderRegionChecks);
+	}
+
 	//initExplorationState(); ... was only for !fog-of-war, now handled in initCells()
 	computeFow();
 
@@ -665,6 +754,9 @@ void World::updateAllFactionUnits() {
 		if(SystemFlags::VERBOSE_MODE_ENABLED && chrono.getMillis() >= 10) printf("In [%s::%s Line: %d] *** Faction thread preprocessing took [%lld] msecs for %d factions for frameCount = %d.\n",__FILE__,__FUNCTION__,__LINE__,(long long int)chrono.getMillis(),factionCount,frameCount);
 	}
 
+	// Run the path searches the faction threads queued, spread over all cores
+	unitUpdater.processPathRequests(frameCount);
+
 	if(showPerfStats) {
 		sprintf(perfBuf,"In [%s::%s] Line: %d took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chronoPerf.getMillis());
 		perfList.push_back(perfBuf);
@@ -829,6 +921,7 @@ void World::update() {
 	Chrono chronoGamePerformanceCounts;
 
 	++frameCount;
+	unitIndex.nextFrame();
 
 	//time
 	timeFlow.update();
@@ -1077,17 +1170,6 @@ void World::tick() {
 	}
 }
 
-Unit* World::findUnitById(int id) const {
-	for(int i= 0; i<getFactionCount(); ++i) {
-		const Faction* faction= getFaction(i);
-		Unit* unit = faction->findUnit(id);
-		if(unit != NULL) {
-			return unit;
-		}
-	}
-	return NULL;
-}
-
 const UnitType* World::findUnitTypeById(const FactionType* factionType, int id) {
 	if(factionType == NULL) {
 		throw megaglest_runtime_error("factionType == NULL");
@@ -1953,6 +2035,9 @@ void World::initCells(bool fogOfWar) {
 			}
 		}
     }
+    // the visible flags were set directly, the next fog of war update has to
+    // rebuild the unit sight reference counts from scratch
+    fowRefreshAll = true;
     if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d]\n",__FILE__,__FUNCTION__,__LINE__);
 }
 
@@ -2312,6 +2397,12 @@ void World::exploreCells(int teamIndex, ExploredCellsLookupItem &exploredCellsCa
 		SurfaceCell* sc = cellList[idx2];
 		sc->setVisible(teamIndex, true);
 	}
+	if(incrementalFogOfWar == true) {
+		vector<int> &touchedCells = fowTouchedCells[teamIndex];
+		for (int idx2 = 0; idx2 < (int)cellList.size(); ++idx2) {
+			touchedCells.push_back(cellList[idx2]->getVisibilityIndex());
+		}
+	}
 }
 
 // ==================== exploration ====================
@@ -2405,6 +2496,9 @@ ExploredCellsLookupItem World::exploreCells(const Vec2i &newPos, int sightRange,
 				if(posLength < surfSightRange) {
 					sc->setVisible(teamIndex, true);
 					exploredCellsCache.visibleCellList.push_back(sc);
+					if(incrementalFogOfWar == true) {
+						fowTouchedCells[teamIndex].push_back(sc->getVisibilityIndex());
+					}
 				}
             }
         }
@@ -2510,15 +2604,18 @@ void World::computeFow() {
 				resetFowAlphaFactionCount++;
 			}
 
-			for(int indexSurfaceW = 0; indexSurfaceW < map.getSurfaceW(); ++indexSurfaceW) {
-				for(int indexSurfaceH = 0; indexSurfaceH < map.getSurfaceH(); ++indexSurfaceH) {
-					// set all cells to not visible
-					map.getSurfaceCell(indexSurfaceW, indexSurfaceH)->setVisible(indexFaction, false);
+			// set all cells to not visible, the incremental update only
+			// clears the cells no unit of the team sees anymore
+			if(incrementalFogOfWar == false) {
+				map.getSurfaceVisibility()->clearVisible(indexFaction);
+			}
 
-					// reset fog of ware texture alpha values
-					if(cacheFowAlphaTexture == false &&
-						showWorldForFaction == true &&
-							resetFowAlphaFactionCount <= 1) {
+			// reset fog of ware texture alpha values
+			if(cacheFowAlphaTexture == false &&
+				showWorldForFaction == true &&
+					resetFowAlphaFactionCount <= 1) {
+				for(int indexSurfaceW = 0; indexSurfaceW < map.getSurfaceW(); ++indexSurfaceW) {
+					for(int indexSurfaceH = 0; indexSurfaceH < map.getSurfaceH(); ++indexSurfaceH) {
 						const Vec2i surfPos(indexSurfaceW,indexSurfaceH);
 
 						//compute max alpha
@@ -2559,6 +2656,13 @@ void World::computeFow() {
 	//compute cells
 	if(this->game) chronoGamePerformanceCounts.start();
 
+	if(incrementalFogOfWar == true) {
+		updateIncrementalFow();
+		if(verifyIncrementalFogOfWar == true) {
+			verifyIncrementalFow();
+		}
+	}
+
 	for(int factionIndex = 0; factionIndex < getFactionCount(); ++factionIndex) {
 		Faction *faction = getFaction(factionIndex);
 		bool cellVisibleForFaction = showWorldForPlayer(thisFactionIndex);
@@ -2567,7 +2671,9 @@ void World::computeFow() {
 			Unit *unit= faction->getUnit(unitIndex);
 
 			// exploration
-			unit->exploreCells();
+			if(incrementalFogOfWar == false) {
+				unit->exploreCells();
+			}
 
 			// fire particle visible
 			ParticleSystem *fire = unit->getFire();
@@ -2589,13 +2695,10 @@ void World::computeFow() {
 				faction->getTeam() == thisTeamIndex &&
 					unit->isOperative() == true) {
 
-				const FowAlphaCellsLookupItem &cellList = unit->getCachedFow();
-				for(std::map<Vec2i,float>::const_iterator iterMap = cellList.surfPosAlphaList.begin();
-					iterMap != cellList.surfPosAlphaList.end(); ++iterMap) {
-					const Vec2i &surfPos = iterMap->first;
-					const float &alpha = iterMap->second;
-
-					minimap.incFowTextureAlphaSurface(surfPos, alpha, true);
+				const SightStencil *stencil = unit->getCachedFowStencil();
+				if(stencil != NULL) {
+					minimap.stampFowTextureAlphaSurface(Map::toSurfCoords(unit->getCachedFowPos()),
+							*stencil, map.getSurfaceW(), map.getSurfaceH(), true);
 				}
 			}
 		}
@@ -2604,6 +2707,156 @@ void World::computeFow() {
 	if(this->game) this->game->addPerformanceCount("world compute cells",chronoGamePerformanceCounts.getMillis());
 }
 
+// Brings the visible flags to the same state the full pass in computeFow
+// produces (every team that gets reset sees exactly the sight circles of its
+// operative units) while only touching units whose position, sight or team
+// changed since the last update
+void World::updateIncrementalFow() {
+	SurfaceVisibility *visibility = map.getSurfaceVisibility();
+
+	if(fowLastTeamIndex != thisTeamIndex) {
+		fowLastTeamIndex = thisTeamIndex;
+		fowRefreshAll = true;
+	}
+
+	if(fowRefreshAll == true) {
+		fowRefreshAll = false;
+		unitSightContributions.clear();
+		visibility->clearVisibleRefs();
+		for(int teamIndex = 0; teamIndex < SurfaceVisibility::teamCount; ++teamIndex) {
+			if(isFowResetForTeam(teamIndex) == true) {
+				visibility->clearVisible(teamIndex);
+			}
+			fowTouchedCells[teamIndex].clear();
+		}
+	}
+
+	fowUpdateCount++;
+	for(int factionIndex = 0; factionIndex < getFactionCount(); ++factionIndex) {
+		Faction *faction = getFaction(factionIndex);
+		for(int unitIndex = 0; unitIndex < faction->getUnitCount(); ++unitIndex) {
+			Unit *unit = faction->getUnit(unitIndex);
+			if(unit->isOperative() == false) {
+				continue;
+			}
+
+			const Vec2i &pos = unit->getCenteredPos();
+			int sightRange = unit->getType()->getSight();
+			int teamIndex = unit->getTeam();
+
+			UnitSightContribution &contribution = unitSightContributions[unit->getId()];
+			contribution.updateCount = fowUpdateCount;
+			if(contribution.teamIndex == teamIndex &&
+				contribution.sightRange == sightRange &&
+				contribution.pos == pos) {
+				continue;
+			}
+
+			removeSightContribution(contribution);
+
+			// explores and sets the new circle visible
+			ExploredCellsLookupItem exploredCells = exploreCells(pos, sightRange, teamIndex);
+
+			contribution.pos = pos;
+			contribution.sightRange = sightRange;
+			contribution.teamIndex = teamIndex;
+			contribution.visibleCells.resize(exploredCells.visibleCellList.size());
+			for(int cellIndex = 0; cellIndex < (int)exploredCells.visibleCellList.size(); ++cellIndex) {
+				int index = exploredCells.visibleCellList[cellIndex]->getVisibilityIndex();
+				contribution.visibleCells[cellIndex] = index;
+				visibility->addVisibleRef(teamIndex, index);
+			}
+		}
+	}
+
+	// units that died, were removed or stopped being operative
+	for(std::map<int,UnitSightContribution>::iterator iterMap = unitSightContributions.begin();
+		iterMap != unitSightContributions.end();) {
+		if(iterMap->second.updateCount != fowUpdateCount) {
+			removeSightContribution(iterMap->second);
+			unitSightContributions.erase(iterMap++);
+		}
+		else {
+			++iterMap;
+		}
+	}
+
+	// cells units made visible while moving between two updates stay visible
+	// only if a unit still sees them
+	for(int teamIndex = 0; teamIndex < SurfaceVisibility::teamCount; ++teamIndex) {
+		vector<int> &touchedCells = fowTouchedCells[teamIndex];
+		if(isFowResetForTeam(teamIndex) == true) {
+			for(int cellIndex = 0; cellIndex < (int)touchedCells.size(); ++cellIndex) {
+				int index = touchedCells[cellIndex];
+				visibility->setVisible(teamIndex, index, visibility->getVisibleRefs(teamIndex, index) > 0);
+			}
+		}
+		touchedCells.clear();
+	}
+}
+
+void World::removeSightContribution(UnitSightContribution &contribution) {
+	if(contribution.teamIndex < 0) {
+		return;
+	}
+	SurfaceVisibility *visibility = map.getSurfaceVisibility();
+	bool resetTeam = isFowResetForTeam(contribution.teamIndex);
+	for(int cellIndex = 0; cellIndex < (int)contribution.visibleCells.size(); ++cellIndex) {
+		int index = contribution.visibleCells[cellIndex];
+		if(visibility->removeVisibleRef(contribution.teamIndex, index) == 0 && resetTeam == true) {
+			visibility->setVisible(contribution.teamIndex, index, false);
+		}
+	}
+	contribution.visibleCells.clear();
+	contribution.teamIndex = -1;
+}
+
+// Runs the full fog of war pass on top of the incremental result and reports
+// any cell where the two disagree. The full pass result is kept.
+void World::verifyIncrementalFow() {
+	SurfaceVisibility *visibility = map.getSurfaceVisibility();
+	int wordCount = visibility->getWordCount();
+
+	vector<uint32> incrementalVisible(SurfaceVisibility::teamCount * wordCount);
+	vector<uint32> incrementalExplored(SurfaceVisibility::teamCount * wordCount);
+	for(int teamIndex = 0; teamIndex < SurfaceVisibility::teamCount && wordCount > 0; ++teamIndex) {
+		memcpy(&incrementalVisible[teamIndex * wordCount], visibility->getVisiblePlane(teamIndex), wordCount * sizeof(uint32));
+		memcpy(&incrementalExplored[teamIndex * wordCount], visibility->getExploredPlane(teamIndex), wordCount * sizeof(uint32));
+		if(isFowResetForTeam(teamIndex) == true) {
+			visibility->clearVisible(teamIndex);
+		}
+	}
+	for(int factionIndex = 0; factionIndex < getFactionCount(); ++factionIndex) {
+		Faction *faction = getFaction(factionIndex);
+		for(int unitIndex = 0; unitIndex < faction->getUnitCount(); ++unitIndex) {
+			faction->getUnit(unitIndex)->exploreCells();
+		}
+	}
+
+	int mismatchCount = 0;
+	for(int teamIndex = 0; teamIndex < SurfaceVisibility::teamCount; ++teamIndex) {
+		const uint32 *visiblePlane = visibility->getVisiblePlane(teamIndex);
+		const uint32 *exploredPlane = visibility->getExploredPlane(teamIndex);
+		for(int wordIndex = 0; wordIndex < wordCount; ++wordIndex) {
+			uint32 diff = (visiblePlane[wordIndex] ^ incrementalVisible[teamIndex * wordCount + wordIndex]) |
+						  (exploredPlane[wordIndex] ^ incrementalExplored[teamIndex * wordCount + wordIndex]);
+			for(; diff != 0; diff &= diff - 1) {
+				mismatchCount++;
+			}
+		}
+		fowTouchedCells[teamIndex].clear();
+	}
+
+	if(mismatchCount > 0) {
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"Incremental fog of war differs from the full pass in frame %d, mismatched cells: %d\n",frameCount,mismatchCount);
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("%s",szBuf);
+		SystemFlags::OutputDebug(SystemFlags::debugError,szBuf);
+
+		fowRefreshAll = true;
+	}
+}
+
 GameSettings * World::getGameSettingsPtr() {
     return (game != NULL ? game->getGameSettings() : NULL);
 }
@@ -2778,31 +3031,8 @@ string World::getExploredCellsLookupItemCacheStats() {
 	return result;
 }
 
-string World::getFowAlphaCellsLookupItemCacheStats() {
-	string result = "";
-
-	int surfPosAlphaCount = 0;
-
-	for(int factionIndex = 0; factionIndex < getFactionCount(); ++factionIndex) {
-		Faction *faction= getFaction(factionIndex);
-		if(faction->getTeam() == thisTeamIndex) {
-			for(int unitIndex = 0; unitIndex < faction->getUnitCount(); ++unitIndex) {
-				const Unit *unit= faction->getUnit(unitIndex);
-				const FowAlphaCellsLookupItem &cache = unit->getCachedFow();
-
-				surfPosAlphaCount += (int)cache.surfPosAlphaList.size();
-			}
-		}
-	}
-	uint64 totalBytes = surfPosAlphaCount * sizeof(Vec2i);
-	totalBytes += surfPosAlphaCount * sizeof(float);
-
-	totalBytes /= 1000;
-
-	char szBuf[8096]="";
-	snprintf(szBuf,8096,"surface count [%d] total KB: %s",surfPosAlphaCount,formatNumber(totalBytes).c_str());
-	result = szBuf;
-	return result;
+string World::getSightStencilCacheStats() {
+	return SightStencil::getCacheStats();
 }
 
 string World::getAllFactionsCacheStats() {
@@ -2927,6 +3157,7 @@ std::string World::DumpWorldToLog(bool consoleBasicInfoOnly) const {
 void World::saveGame(XmlNode *rootNode) {
 	std::map<string,string> mapTagReplacements;
 	XmlNode *worldNode = rootNode->addChild("World");
+	worldNode->setStreamChildren(true, rootNode->getStreamFormat());
 
 //	Map map;
 	map.saveGame(worldNode);
@@ -69,6 +69,78 @@ public:
 	int teamIndex;
 };
 
+// The visible cells one operative unit added to the team reference counts
+// at the last fog of war update, kept so they can be removed again when the
+// unit moves, changes its sight or stops being operative
+class UnitSightContribution {
+public:
+	UnitSightContribution() {
+		sightRange = -1;
+		teamIndex = -1;
+		updateCount = 0;
+	}
+
+	Vec2i pos;
+	int sightRange;
+	int teamIndex;
+	int updateCount;
+	vector<int> visibleCells;
+};
+
+// =====================================================
+// 	class UnitIndex
+//
+///	Dense id to unit lookup for all units of the world. Ids are handed
+///	out per faction in blocks (see World::getNextUnitId) and never reused,
+///	so the slot of a dead unit simply stays empty and a stale id finds
+///	nothing.
+// =====================================================
+
+class UnitIndex {
+public:
+	static const int blockSize = 100000;
+
+private:
+	vector<vector<Unit *> > blocks;
+	int unitCount;
+
+	mutable int64 lookupCount;
+	mutable int64 lookupMissCount;
+	int64 frameLookupCount;
+	int64 lastFrameLookupCount;
+
+public:
+	UnitIndex();
+
+	void clear();
+	void add(Unit *unit);
+	void remove(const Unit *unit);
+
+	// faction threads look units up too, only the main thread counts so
+	// the stats need no locking
+	inline Unit *find(int id) const {
+		bool countLookup = Thread::isCurrentThreadMainThread();
+		if(countLookup == true) {
+			lookupCount++;
+		}
+		if(id >= 0) {
+			unsigned int blockIndex = (unsigned int)(id / blockSize);
+			unsigned int slot = (unsigned int)(id % blockSize);
+			if(blockIndex < blocks.size() && slot < blocks[blockIndex].size() &&
+				blocks[blockIndex][slot] != NULL) {
+				return blocks[blockIndex][slot];
+			}
+		}
+		if(countLookup == true) {
+			lookupMissCount++;
+		}
+		return NULL;
+	}
+
+	void nextFrame();
+	string getStats() const;
+};
+
 class World {
 private:
 	typedef vector<Faction *> Factions;
@@ -96,6 +168,7 @@ private:
     Stats stats;	//BattleEnd will delete this object
 
 	Factions factions;
+	UnitIndex unitIndex;
 
 	RandomGen random;
 
@@ -142,6 +215,15 @@ private:
 	bool cacheFowAlphaTexture;
 	bool cacheFowAlphaTextureFogOfWarValue;
 
+	// incremental fog of war
+	bool incrementalFogOfWar;
+	bool verifyIncrementalFogOfWar;
+	bool fowRefreshAll;
+	int fowUpdateCount;
+	int fowLastTeamIndex;
+	std::map<int,UnitSightContribution> unitSightContributions;
+	vector<vector<int> > fowTouchedCells;
+
 	std::map<int, std::map<std::string, Resource > > TeamResources;
 
 public:
@@ -212,7 +294,10 @@ public:
 
 	//misc
 	void update();
-	Unit* findUnitById(int id) const;
+	Unit* findUnitById(int id) const { return unitIndex.find(id); }
+	void addUnitToIndex(Unit *unit)			{ unitIndex.add(unit); }
+	void removeUnitFromIndex(const Unit *unit)	{ unitIndex.remove(unit); }
+	string getUnitIndexStats() const		{ return unitIndex.getStats(); }
 	const UnitType* findUnitTypeById(const FactionType* factionType, int id);
 	const UnitType *findUnitTypeByName(const string factionName, const string unitTypeName);
 	bool placeUnit(const Vec2i &startLoc, int radius, Unit *unit, bool spaciated= false);
@@ -311,7 +396,7 @@ public:
 	void removeResourceTargetFromCache(const Vec2i &pos);
 
 	string getExploredCellsLookupItemCacheStats();
-	string getFowAlphaCellsLookupItemCacheStats();
+	string getSightStencilCacheStats();
 	string getAllFactionsCacheStats();
 
 	void placeUnitAtLocation(const Vec2i &location, int radius, Unit *unit, bool spaciated);
@@ -340,6 +425,10 @@ private:
 	//misc
 	void tick();
 	void computeFow();
+	bool isFowResetForTeam(int teamIndex) const { return fogOfWar || teamIndex != thisTeamIndex; }
+	void updateIncrementalFow();
+	void removeSightContribution(UnitSightContribution &contribution);
+	void verifyIncrementalFow();
 
 	void updateAllTilesetObjects();
 	void updateAllFactionUnits();
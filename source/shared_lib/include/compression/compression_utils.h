@@ -13,6 +13,7 @@
 #define _SHARED_COMPRESSION_UTIL_CHECKSUM_H_
 
 #include <string>
+#include <vector>
 
 using std::string;
 
@@ -21,6 +22,10 @@ namespace Shared{ namespace CompressionUtil{
 bool compressFileToZIPFile(string inFile, string outFile, int compressionLevel=5);
 bool extractFileFromZIPFile(string inFile, string outFile);
 
+// zlib streams held in memory, used for network messages
+bool compressMemoryBuffer(const unsigned char *data, unsigned int dataSize, std::vector<unsigned char> &compressedData, int compressionLevel=5);
+bool extractMemoryBuffer(const unsigned char *compressedData, unsigned int compressedSize, unsigned char *data, unsigned int dataSize);
+
 }};
 
 #endif
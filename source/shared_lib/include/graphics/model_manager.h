@@ -18,6 +18,10 @@
 
 using namespace std;
 
+namespace Shared{ namespace Platform{
+	class Mutex;
+}}
+
 namespace Shared{ namespace Graphics{
 
 class TextureManager;
@@ -33,6 +37,9 @@ protected:
 protected:
 	ModelContainer models;
 	TextureManager *textureManager;
+	// models may be created on loading threads while the texture manager
+	// defers its loading
+	Shared::Platform::Mutex *mutexModels;
 
 public:
 	ModelManager();
@@ -13,11 +13,16 @@
 #define _SHARED_GRAPHICS_TEXTUREMANAGER_H_
 
 #include <vector>
+#include <map>
 #include "texture.h"
 #include "leak_dumper.h"
 
 using std::vector;
 
+namespace Shared{ namespace Platform{
+	class Mutex;
+}}
+
 namespace Shared{ namespace Graphics{
 
 // =====================================================
@@ -34,6 +39,17 @@ protected:
 	Texture::Filter textureFilter;
 	int maxAnisotropy;
 
+	// while loading is deferred textures may be created and loaded on other
+	// threads, they are kept apart and only added to the list, and uploaded
+	// when requested, by endDeferredLoading on the thread owning the context
+	Shared::Platform::Mutex *mutexDeferred;
+	bool deferredLoading;
+	TextureContainer deferredTextures;
+	std::map<string,Texture *> deferredTexturesByPath;
+	vector<std::pair<Texture *,bool> > deferredInits;
+
+	void addTexture(Texture *texture);
+
 public:
 	TextureManager();
 	~TextureManager();
@@ -43,10 +59,15 @@ public:
 	void setFilter(Texture::Filter textureFilter);
 	void setMaxAnisotropy(int maxAnisotropy);
 	void initTexture(Texture *texture);
+	void initLoadedTexture(Texture *texture, bool deletePixels);
 	void endTexture(Texture *texture,bool mustExistInList=false);
 	void endLastTexture(bool mustExistInList=false);
 	void reinitTextures();
 
+	void beginDeferredLoading();
+	void endDeferredLoading();
+	bool isLoadingDeferred() const { return deferredLoading; }
+
 	Texture::Filter getTextureFilter() const {return textureFilter;}
 	int getMaxAnisotropy() const {return maxAnisotropy;}
 
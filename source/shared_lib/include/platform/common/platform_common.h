@@ -245,6 +245,7 @@ int getScreenW();
 int getScreenH();
 
 void sleep(int millis);
+int getCpuCount();
 
 bool isCursorShowing();
 void showCursor(bool b);
@@ -0,0 +1,261 @@
+// ==============================================================
+//	This file is part of MegaGlest Shared Library (www.glest.org)
+//
+//	Copyright (C) 2009-2010 Titus Tscharntke (info@titusgames.de) and
+//                          Mark Vejvoda (mark_vejvoda@hotmail.com)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+#ifndef _SHARED_PLATFORMCOMMON_CONTENTTRANSFER_H_
+#define _SHARED_PLATFORMCOMMON_CONTENTTRANSFER_H_
+
+#ifdef WIN32
+    #include <winsock2.h>
+    #include <winsock.h>
+#endif
+
+#include "socket.h"
+#include "base_thread.h"
+#include "data_types.h"
+#include "checksum.h"
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include "leak_dumper.h"
+
+using std::string;
+using std::vector;
+using std::map;
+using Shared::Platform::int64;
+using Shared::Platform::uint8;
+using Shared::Platform::uint16;
+using Shared::Platform::uint32;
+using Shared::Platform::Mutex;
+using Shared::Platform::Socket;
+using Shared::Platform::ServerSocket;
+using Shared::Platform::FTPClientValidationInterface;
+using Shared::Util::ChecksumFileIndexEntry;
+
+namespace Shared { namespace PlatformCommon {
+
+// Every connection starts with the id and version from the client, every
+// request with its type (uint8). Numbers are little endian and strings are
+// a uint16 length followed by the characters.
+enum ContentTransferRequestType {
+	ctrtList	= 1,	// root, item -> status, file count, files (path, size int64, crc)
+	ctrtChunk	= 2		// root, item, path, crc, offset int64, size -> status, plain size,
+						// data size, compressed (uint8) and the data
+};
+
+enum ContentTransferStatus {
+	ctsOk			= 0,
+	ctsNotFound		= 1,
+	ctsChanged		= 2,	// the file no longer has the crc the client asked for
+	ctsDenied		= 3,
+	ctsBadRequest	= 4
+};
+
+class ContentTransferFile {
+public:
+	// relative to the item, empty when the item is a single file
+	string path;
+	int64 size;
+	uint32 crc;
+};
+
+class ContentTransferServer;
+
+// =====================================================
+//	class ContentTransferConnectionThread
+// =====================================================
+
+/// Answers the requests of one client connection
+class ContentTransferConnectionThread : public BaseThread {
+protected:
+	ContentTransferServer *server;
+	Socket *socket;
+
+	bool handleList();
+	bool handleChunk();
+
+public:
+	ContentTransferConnectionThread(ContentTransferServer *server, Socket *socket);
+	virtual ~ContentTransferConnectionThread();
+	virtual void execute();
+};
+
+// =====================================================
+//	class ContentTransferServer
+//
+///	Serves maps, tilesets and techtrees to connected clients without the
+///	archive step of the ftp server. Files are listed with the crc the game
+///	already uses to compare content and handed out in chunks that are
+///	addressed by file crc and offset, compressed on the fly, so a client
+///	can pull one item over several connections at once and continue an
+///	interrupted download as long as the file did not change.
+// =====================================================
+
+class ContentTransferServer : public BaseThread {
+protected:
+	class Root {
+	public:
+		vector<string> paths;
+		bool allowInternet;
+	};
+
+	int portNumber;
+	int maxConnections;
+	ServerSocket *serverSocket;
+	FTPClientValidationInterface *validator;
+
+	Mutex mutexRoots;
+	map<string,Root> roots;
+	bool internetEnabled;
+
+	// crcs of listed files, a chunk request only hashes its file again
+	// when size, times or inode changed since
+	Mutex mutexFileCrcs;
+	map<string,ChecksumFileIndexEntry> fileCrcs;
+
+	// only used by the server thread
+	vector<ContentTransferConnectionThread *> connections;
+
+	void acceptConnections();
+	void cleanupConnections(bool waitForAll);
+	uint8 findItemPath(const string &root, const string &item, string &itemPath);
+	void setFileCrc(const string &file, uint32 crc);
+
+public:
+	ContentTransferServer(int portNumber, int maxConnections,
+			FTPClientValidationInterface *validator);
+	virtual ~ContentTransferServer();
+
+	void addRoot(const string &name, const vector<string> &paths, bool allowInternet);
+	void setInternetEnabled(bool value);
+
+	virtual void execute();
+
+	bool isListening() const { return serverSocket != NULL; }
+
+	// connection threads, these return a ContentTransferStatus
+	uint8 listItem(const string &root, const string &item, vector<ContentTransferFile> &files);
+	uint8 findFile(const string &root, const string &item, const string &path,
+			uint32 crc, string &file);
+
+	static bool isValidName(const string &name, bool allowSubfolders);
+	// the crc of a file as getFolderTreeContentsCheckSumListRecursively
+	// lists it, files are listed and checked with this one
+	static uint32 getFileCrc(const string &file);
+};
+
+// =====================================================
+//	class ContentTransferClient
+// =====================================================
+
+class ContentTransferClientCallbackInterface {
+public:
+	virtual ~ContentTransferClientCallbackInterface() {}
+
+	virtual void ContentTransfer_Progress(const string &itemName, int64 totalBytes, int64 receivedBytes) = 0;
+	virtual bool ContentTransfer_IsCancelled() = 0;
+};
+
+class ContentTransferClient;
+
+/// Pulls chunks from the shared queue over its own connection
+class ContentTransferStreamThread : public BaseThread {
+protected:
+	ContentTransferClient *client;
+	bool failed;
+
+public:
+	ContentTransferStreamThread(ContentTransferClient *client);
+	virtual void execute();
+
+	bool getFailed() const { return failed; }
+};
+
+///	Downloads an item from a content transfer server over several parallel
+///	connections. Files that already exist with the server's crc are kept,
+///	the others are written to a .part file next to their destination with
+///	a .part.chunks journal of the chunks already received, which a later
+///	download of the same file content picks up again.
+class ContentTransferClient {
+public:
+	static const char connectionId[4];
+	static const uint32 protocolVersion = 1;
+
+	static const int defaultStreamCount	= 4;
+	static const int defaultChunkSize	= 256 * 1024;
+	static const int maxChunkSize		= 1024 * 1024;
+
+protected:
+	friend class ContentTransferStreamThread;
+
+	class FileState {
+	public:
+		ContentTransferFile file;
+		string destFile;
+		int remainingChunks;
+	};
+
+	class Chunk {
+	public:
+		int fileIndex;
+		int64 offset;
+		uint32 size;
+	};
+
+	string serverUrl;
+	int portNumber;
+	int streamCount;
+	int chunkSize;
+	ContentTransferClientCallbackInterface *callback;
+
+	// the current download, shared with the stream threads
+	Mutex mutexDownload;
+	string rootName;
+	string itemName;
+	vector<FileState> files;
+	std::deque<Chunk> pendingChunks;
+	int activeChunks;
+	int64 totalBytes;
+	int64 receivedBytes;
+	bool aborted;
+	bool transferStarted;
+	string lastError;
+
+	Socket * connectToServer();
+	bool requestChunk(Socket *socket, const Chunk &chunk, vector<unsigned char> &data, uint8 &status);
+	bool takeChunk(Chunk &chunk);
+	void returnChunk(const Chunk &chunk);
+	bool storeChunk(const Chunk &chunk, const vector<unsigned char> &data);
+	bool finishFile(FileState &state);
+	void prepareFile(int fileIndex);
+	void abort(const string &reason);
+	bool isCancelled();
+
+public:
+	ContentTransferClient(const string &serverUrl, int portNumber,
+			int streamCount=defaultStreamCount, int chunkSize=defaultChunkSize);
+
+	void setCallbackObject(ContentTransferClientCallbackInterface *value) { callback = value; }
+
+	// downloads the item of the root to destPath, the item's folder or, for
+	// an item that is a single file, its file name
+	bool download(const string &root, const string &item, const string &destPath);
+	string getLastError() const { return lastError; }
+	// false when the server could not be reached or does not have the item
+	bool getTransferStarted() const { return transferStarted; }
+
+	static bool listItem(Socket *socket, const string &root, const string &item,
+			vector<ContentTransferFile> &files, uint8 &status);
+};
+
+}}//end namespace
+
+#endif
@@ -16,6 +16,7 @@
 #include <vector>
 #include <string>
 #include "platform_common.h"
+#include "content_transfer.h"
 #include "leak_dumper.h"
 
 using namespace std;
@@ -63,7 +64,8 @@ public:
     										 void *userdata) = 0;
 };
 
-class FTPClientThread : public BaseThread, public ShellCommandOutputCallbackInterface
+class FTPClientThread : public BaseThread, public ShellCommandOutputCallbackInterface,
+						public ContentTransferClientCallbackInterface
 {
 protected:
     int portNumber;
@@ -127,6 +129,18 @@ protected:
     virtual void * getShellCommandOutput_UserData(string cmd);
     virtual void ShellCommandOutput_CallbackEvent(string cmd,char *output,void *userdata);
 
+    // content transfer service of the game server, tried before ftp when
+    // the port is set
+    int contentTransferPort;
+    int contentTransferStreams;
+    string contentTransferItemName;
+    FTP_Client_CallbackType contentTransferType;
+
+    pair<FTP_Client_ResultType,string> getContentFromServer(FTP_Client_CallbackType downloadType,
+    		string itemName, string root, string item, string destPath);
+    virtual void ContentTransfer_Progress(const string &itemName, int64 totalBytes, int64 receivedBytes);
+    virtual bool ContentTransfer_IsCancelled();
+
 public:
 
     FTPClientThread(int portNumber,string serverUrl,
@@ -151,6 +165,8 @@ public:
     void addFileToRequests(string fileName,string URL="");
     void addTempFileToRequests(string fileName,string URL="");
 
+    void setContentTransfer(int portNumber, int streamCount);
+
     FTPClientCallbackInterface * getCallBackObject();
     void setCallBackObject(FTPClientCallbackInterface *value);
 
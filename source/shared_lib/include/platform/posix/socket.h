@@ -152,7 +152,25 @@ protected:
 	bool isSocketBlocking;
 	time_t lastSocketError;
 
+	// Optional read ahead buffer, one recv takes everything that is waiting
+	// and receive() / receiveView() are served from it until it runs empty
+	std::vector<char> receiveBuffer;
+	int receiveBufferBegin;
+	int receiveBufferEnd;
+
+	static bool ioStatsEnabled;
+
 public:
+	enum SocketIOStatType {
+		siostRecv,
+		siostPeek,
+		siostSend,
+		siostBufferedRead,
+		siostViewRead,
+
+		siostCount
+	};
+
 	Socket(PLATFORM_SOCKET sock);
 	Socket();
 	virtual ~Socket();
@@ -207,8 +225,32 @@ public:
 
 	uint32 getConnectedIPAddress(string IP="");
 
+	// Only meant for non blocking sockets, 0 turns the buffer off
+	void setReceiveBufferSize(int size);
+	int getReceiveBufferSize() const { return (int)receiveBuffer.size(); }
+	int getBufferedDataSize();
+	// Copies up to dataSize buffered bytes without consuming them
+	int peekBufferedData(void *data, int dataSize);
+	// Moves whatever the socket has waiting into the receive buffer without
+	// blocking. False if the socket failed or closed (it is then disconnected).
+	bool readAvailableData();
+	// Returns dataSize bytes read in place from the receive buffer, valid
+	// until the next read from this socket. NULL if the buffer is off or
+	// too small, or if the socket failed (it is then disconnected).
+	char * receiveView(int dataSize);
+
+	static void setIOStatsEnabled(bool value) { ioStatsEnabled = value; }
+	static bool getIOStatsEnabled() { return ioStatsEnabled; }
+	static void addIOStats(SocketIOStatType type, int64 bytes, int64 startMicros);
+	static int64 getIOStatsStartMicros();
+	static void resetIOStats();
+	static string getIOStats();
+
 protected:
 	static void throwException(string str);
+
+	int receiveBuffered(char *data, int dataSize, bool tryReceiveUntilDataSizeMet);
+	bool fillReceiveBuffer(int minimumSize);
 };
 
 class SafeSocketBlockToggleWrapper {
@@ -222,6 +264,48 @@ public:
 	void Restore();
 };
 
+// =====================================================
+//	class SocketReactor
+// =====================================================
+
+/// Reports sockets that have data to read, with one edge triggered epoll
+/// set on Linux. A reported socket is not reported again until whoever
+/// handles it calls setDataProcessed().
+class SocketReactor {
+protected:
+	enum SocketReactorState {
+		srsAdded,
+		srsIdle,
+		srsInFlight,
+		srsInFlightWithNewData
+	};
+
+	Mutex *mutexSockets;
+	std::map<PLATFORM_SOCKET,SocketReactorState> sockets;
+	int epollDescriptor;
+
+	bool registerSocket(PLATFORM_SOCKET socket, bool modify);
+
+public:
+	SocketReactor();
+	virtual ~SocketReactor();
+
+	static bool isSupported();
+	bool isValid() const { return epollDescriptor >= 0; }
+
+	bool addSocket(PLATFORM_SOCKET socket);
+	void removeSocket(PLATFORM_SOCKET socket);
+	bool hasSocket(PLATFORM_SOCKET socket);
+	int getSocketCount();
+
+	// Waits up to waitMilliseconds and returns the sockets that got data and
+	// are not already being handled
+	int waitForData(std::vector<PLATFORM_SOCKET> &readyList, int waitMilliseconds);
+	// Returns true when the socket still has data, it then stays handled by
+	// the caller, otherwise it goes back to being watched
+	bool setDataProcessed(PLATFORM_SOCKET socket);
+};
+
 class BroadCastClientSocketThread : public BaseThread
 {
 private:
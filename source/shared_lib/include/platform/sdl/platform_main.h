@@ -95,6 +95,12 @@ const char  *GAME_ARGS[] = {
 	"--debug-network-packet-sizes",
 	"--debug-network-packet-stats",
 	"--enable-new-protocol",
+	"--benchmark-command-list-sizes",
+	"--benchmark-server-sockets",
+	"--benchmark-network-jitter",
+	"--desync-bisect",
+	"--convert-saved-game",
+	"--benchmark-xml-load",
 
 	"--create-data-archives",
 
@@ -178,6 +184,12 @@ enum GAME_ARG_TYPE {
 	GAME_ARG_DEBUG_NETWORK_PACKET_SIZES,
 	GAME_ARG_DEBUG_NETWORK_PACKET_STATS,
 	GAME_ARG_ENABLE_NEW_PROTOCOL,
+	GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES,
+	GAME_ARG_BENCHMARK_SERVER_SOCKETS,
+	GAME_ARG_BENCHMARK_NETWORK_JITTER,
+	GAME_ARG_DESYNC_BISECT,
+	GAME_ARG_CONVERT_SAVED_GAME,
+	GAME_ARG_BENCHMARK_XML_LOAD,
 
 	GAME_ARG_CREATE_DATA_ARCHIVES,
 
@@ -477,6 +489,28 @@ void printParameterHelp(const char *argv0, bool foundInvalidArgs) {
 	printf("\n%s\t\tdisables opengl capability checks (for corrupt or flaky video drivers).",GAME_ARGS[GAME_ARG_DISABLE_OPENGL_CAPS_CHECK]);
 
 
+	printf("\n%s=x\tshow the network command list sizes for a recorded game.",GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]);
+	printf("\n                     \t\tWhere x is a .replay file saved with SaveCommandsForReplay.");
+	printf("\n                     \t\texample:");
+	printf("\n                     %s %s=saved/mysave.xml.replay",extractFileFromDirectoryPath(argv0).c_str(),GAME_ARGS[GAME_ARG_BENCHMARK_COMMAND_LIST_SIZES]);
+
+	printf("\n%s=x\tmeasure the server time per network frame with select() and the epoll socket reactor.",GAME_ARGS[GAME_ARG_BENCHMARK_SERVER_SOCKETS]);
+	printf("\n                     \t\tWhere x is the number of loopback clients (default 8).");
+
+	printf("\n%s=x,y\tcount client stalls with the legacy and the adaptive network frame scheduling.",GAME_ARGS[GAME_ARG_BENCHMARK_NETWORK_JITTER]);
+	printf("\n                     \t\tWhere x is the network delay and y the jitter in milliseconds (default 60,40).");
+
+	printf("\n%s=x,y\t\tfind the first unit that differs in the synch digest files of two players.",GAME_ARGS[GAME_ARG_DESYNC_BISECT]);
+	printf("\n                     \t\tWhere x and y are the debugCRCWorld.digests files written when the game ended.");
+
+	printf("\n%s=x,y\tconvert a saved game between the xml and the binary format and show the load and save times.",GAME_ARGS[GAME_ARG_CONVERT_SAVED_GAME]);
+	printf("\n                     \t\tWhere x is the saved game and y the file written in the other format.");
+
+	printf("\n%s=x\tload every xml file below a folder and show the load time and the peak memory.",GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]);
+	printf("\n                     \t\tWhere x is a folder like a tech tree.");
+	printf("\n                     \t\texample:");
+	printf("\n                     %s %s=techs/megapack",extractFileFromDirectoryPath(argv0).c_str(),GAME_ARGS[GAME_ARG_BENCHMARK_XML_LOAD]);
+
 	printf("\n%s=x=y\t\t\tcompress selected game data into archives for network sharing.",GAME_ARGS[GAME_ARG_CREATE_DATA_ARCHIVES]);
 	printf("\n                     \t\tWhere x is one of the following data items to compress.");
 	printf("\n                     \t\ttechtrees, tilesets or all.");
@@ -78,6 +78,7 @@ private:
 	static Mutex mutexthreadList;
 	static vector<Thread *> threadList;
 	static bool enableVerboseMode;
+	static Uint32 mainThreadId;
 
 protected:
 	void addThreadToList();
@@ -94,6 +95,9 @@ public:
 
 	static std::vector<Thread *> getThreadList();
 	static void shutdownThreads();
+	// called by the main thread at startup, before any other thread starts
+	static void initThreadMain() { mainThreadId = SDL_ThreadID(); }
+	static bool isCurrentThreadMainThread() { return SDL_ThreadID() == mainThreadId; }
 
 	void setDeleteAfterExecute(bool value) { deleteAfterExecute = value; }
 	bool getDeleteAfterExecute() const { return deleteAfterExecute; }
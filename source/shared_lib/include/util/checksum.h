@@ -14,6 +14,7 @@
 
 #include <string>
 #include <map>
+#include <ctime>
 #include "data_types.h"
 #include "thread.h"
 #include "leak_dumper.h"
@@ -23,6 +24,43 @@ using namespace Shared::Platform;
 
 namespace Shared{ namespace Util{
 
+// CRC32 implementations, they all produce the same values
+enum ChecksumCrcEngine {
+	crcEngineAuto,
+	crcEngineBytewise,
+	crcEngineSlicingBy8,
+	crcEnginePclmul
+};
+
+// =====================================================
+//	class ChecksumFileIndexEntry
+//
+///	Sum of one file in the persistent file index, it stays valid as long
+///	as the file keeps the same size, times and inode
+// =====================================================
+
+class ChecksumFileIndexEntry {
+public:
+	uint64 size;
+	int64 modifiedTime;
+	int64 changedTime;
+	uint64 inode;
+	uint32 crc;
+
+	ChecksumFileIndexEntry() {
+		size = 0;
+		modifiedTime = 0;
+		changedTime = 0;
+		inode = 0;
+		crc = 0;
+	}
+
+	bool isSameFile(const ChecksumFileIndexEntry &other) const {
+		return (size == other.size && modifiedTime == other.modifiedTime &&
+				changedTime == other.changedTime && inode == other.inode);
+	}
+};
+
 // =====================================================
 //	class Checksum
 // =====================================================
@@ -38,8 +76,24 @@ private:
 	static Mutex fileListCacheSynchAccessor;
 	static std::map<string,uint32> fileListCache;
 
+	static ChecksumCrcEngine crcEngine;
+	static int fileHashThreadCount;
+
+	// file sums kept between runs in the crc cache folder
+	static Mutex fileIndexSynchAccessor;
+	static std::map<string,ChecksumFileIndexEntry> fileIndex;
+	static bool fileIndexEnabled;
+	static bool fileIndexLoaded;
+	static int fileIndexChangeCount;
+	static time_t fileIndexLastSaved;
+
 	void addSum(uint32 value);
 	bool addFileToSum(const string &path);
+	void hashUncachedFiles();
+
+	static string getFileIndexPath();
+	static bool loadFileIndex();
+	static void writeFileIndex();
 
 public:
 	Checksum();
@@ -56,9 +110,29 @@ public:
 	uint32 addUInt(const uint32 &value);
 	uint32 addInt64(const int64 &value);
 	void addFile(const string &path);
+	void addFiles(const Checksum &checksum);
 
 	static void removeFileFromCache(const string file);
 	static void clearFileCache();
+
+	static void setCrcEngine(ChecksumCrcEngine engine);
+	static ChecksumCrcEngine getCrcEngine();
+	static bool isCrcEngineSupported(ChecksumCrcEngine engine);
+	static string getCrcEngineName(ChecksumCrcEngine engine);
+
+	// threads hashing the files of a file list, -1 uses one per core and
+	// 0 or 1 hashes them on the calling thread
+	static void setFileHashThreadCount(int value)	{ fileHashThreadCount = value; }
+	static int getFileHashThreadCount()				{ return fileHashThreadCount; }
+
+	static uint32 getFileSum(const string &path, bool *fileExists=NULL);
+	// size, times and inode of a file, the crc is left alone
+	static bool getFileFingerprint(const string &path, ChecksumFileIndexEntry &entry);
+
+	static void setFileIndexEnabled(bool value)		{ fileIndexEnabled = value; }
+	static bool getFileIndexEnabled()				{ return fileIndexEnabled; }
+	static void saveFileIndex();
+	static void removeFolderFromFileIndex(const string &folder);
 };
 
 }}//end namespace
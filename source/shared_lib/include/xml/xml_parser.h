@@ -15,6 +15,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <cstdio>
+#include <deque>
 
 #if defined(WANT_XERCES)
 
@@ -48,6 +50,10 @@ XERCES_CPP_NAMESPACE_USE
 
 #endif
 
+namespace Shared { namespace Platform {
+	class Mutex;
+}}
+
 namespace Shared { namespace Xml {
 
 enum xml_engine_parser_type {
@@ -64,6 +70,14 @@ class XmlIo;
 class XmlTree;
 class XmlNode;
 class XmlAttribute;
+class XmlTreeCache;
+class XmlBinarySection;
+class XmlSaveBuffer;
+
+enum XmlSaveFormat {
+	xsfXml,
+	xsfBinary
+};
 
 #if defined(WANT_XERCES)
 // =====================================================
@@ -149,30 +163,229 @@ public:
 
 	void init(const string &name);
 	void load(const string &path, const std::map<string,string> &mapTagReplacementValues, bool noValidation=false,bool skipStackCheck=false,bool skipStackTrace=false);
-	void save(const string &path);
+	void save(const string &path, XmlSaveFormat format=xsfXml);
 
 	XmlNode *getRootNode() const	{return rootNode;}
 };
 
+// =====================================================
+//	class XmlTreeCache
+//
+///	Parsed xml files below one folder, kept in a binary .mgtc file so the
+///	next load of the folder skips reading and parsing them. Files hold the
+///	values as written, the nodes built from them replace the tags of each
+///	load just like parsed ones, and every name and value is stored once in
+///	a string table the files refer to by index. The file belongs to one
+///	folder checksum and is rebuilt from scratch when the folder changed.
+///	While a cache is active XmlIoRapid::load serves and records the files
+///	below its folder, the owner keeps it alive until those loads are done.
+// =====================================================
+
+class XmlTreeCache {
+public:
+	static const char cacheId[4];
+	static const Shared::Platform::uint32 cacheVersion = 1;
+
+private:
+	// names and values point into the string table, which only grows while
+	// the cache is in use
+	class CachedNode {
+	public:
+		const string *name;
+		const string *text;
+		Shared::Platform::uint32 childCount;
+		Shared::Platform::uint32 attributeCount;
+	};
+
+	class CachedAttribute {
+	public:
+		const string *name;
+		const string *value;
+	};
+
+	// nodes in document order, each followed by its children
+	class CachedFile {
+	public:
+		vector<CachedNode> nodes;
+		vector<CachedAttribute> attributes;
+	};
+
+	string folder;
+	string cacheFile;
+	Shared::Platform::uint32 folderCRC;
+
+	Shared::Platform::Mutex *mutexCache;
+	std::deque<string> strings;
+	std::map<string,Shared::Platform::uint32> stringIndexes;
+	std::map<string,CachedFile> files;
+	bool changed;
+	int hitCount;
+	int missCount;
+
+	XmlTreeCache(const XmlTreeCache &obj);
+	XmlTreeCache &operator=(const XmlTreeCache &obj);
+
+	const string *internString(const string &value);
+	void addNode(CachedFile &file, xml_node<> *node);
+	static XmlNode *buildNode(const CachedFile &file, size_t &nodeIndex, size_t &attributeIndex,
+			const std::map<string,string> *tagValues);
+	bool getRelativePath(const string &path, string &relativePath) const;
+	void clear();
+
+public:
+	XmlTreeCache(const string &folder, const string &cacheFile, Shared::Platform::uint32 folderCRC);
+	~XmlTreeCache();
+
+	// false when there is no cache file for the folder's current checksum
+	bool load();
+	// writes the cache file when files were added since it was loaded
+	bool save();
+
+	// NULL when the file is not below the folder or not cached yet
+	XmlNode *loadFile(const string &path, const std::map<string,string> &mapTagReplacementValues);
+	void addFile(const string &path, xml_node<> *rootNode);
+
+	void setActive(bool value);
+
+	size_t getFileCount();
+	int getHitCount();
+	int getMissCount();
+
+	// used by XmlIoRapid::load for the active caches
+	static XmlNode *loadFromActiveCache(const string &path, const std::map<string,string> &mapTagReplacementValues);
+	static void addToActiveCache(const string &path, xml_node<> *rootNode);
+};
+
+// =====================================================
+//	class XmlBinaryIo
+//
+///	Compact binary form of an xml tree, used for saved games. The file is
+///	the id and version followed by the root section. A section is its byte
+///	length, a string table with every name, text and value once and the
+///	node it holds. A node is its name, its children (inline nodes or
+///	sections of their own, so a reader can skip them), text and attributes.
+///	Attribute values that are integers are stored as numbers and lists of
+///	0/1 flags, like the explored and visible cells of the map, as bits.
+///	XmlIoRapid::load reads these files as well, the nodes are the same as
+///	for the xml text and get their tags replaced the same way.
+// =====================================================
+
+class XmlBinaryIo {
+public:
+	static const char fileId[4];
+	static const Shared::Platform::uint32 fileVersion = 1;
+	// deepest node nesting a file may have, so bad data cannot run the
+	// recursive reader out of stack
+	static const int maxNodeDepth = 256;
+
+private:
+	class Reader;
+
+	static XmlNode *readSection(Reader &reader, const std::map<string,string> *tagValues, int depth);
+	static XmlNode *readNode(Reader &reader, const vector<string> &strings,
+			const std::map<string,string> *tagValues, int depth);
+
+public:
+	static bool isBinaryData(const char *data, size_t size);
+	static XmlNode *load(const char *data, size_t size, const std::map<string,string> &mapTagReplacementValues);
+	static void save(const string &path, const XmlNode *node);
+};
+
+/// Output of a streaming save. Bytes stay in memory up to a limit and go
+/// to a temporary file past it, or straight to the file being saved when
+/// the buffer is made for one.
+class XmlSaveBuffer {
+public:
+	static const size_t blockSize = 64 * 1024;
+	static const size_t defaultMemoryLimit = 1024 * 1024;
+
+private:
+	string data;
+	FILE *file;
+	bool ownsFile;
+	Shared::Platform::uint64 fileSize;
+	size_t memoryLimit;
+
+	XmlSaveBuffer(const XmlSaveBuffer &obj);
+	XmlSaveBuffer &operator=(const XmlSaveBuffer &obj);
+
+	void writeFile(const char *bytes, size_t size);
+
+public:
+	XmlSaveBuffer();
+	explicit XmlSaveBuffer(FILE *outputFile);
+	~XmlSaveBuffer();
+
+	// moves the bytes of out to the buffer, with onlyFullBlock only once
+	// they make up a block so small nodes are not written one by one
+	void append(string &out, bool onlyFullBlock=false);
+	// appends the buffered bytes to out, passing full blocks on to the sink
+	void copyTo(string &out, XmlSaveBuffer *sink) const;
+
+	Shared::Platform::uint64 size() const { return fileSize + data.size(); }
+	bool empty() const { return size() == 0; }
+};
+
+/// Encoding state of one section: its string table and the data of the
+/// nodes written to it so far
+class XmlBinarySection {
+private:
+	std::map<string,Shared::Platform::uint32> stringIndexes;
+	string stringData;
+
+public:
+	XmlSaveBuffer nodeData;
+
+	Shared::Platform::uint32 addString(const string &value);
+	// the section starts with the node name in head, followed by the
+	// streamed node data and the rest of the node in tail
+	void write(string &out, const string &head, const XmlSaveBuffer &tail, XmlSaveBuffer *sink) const;
+};
+
 // =====================================================
 //	class XmlNode
+//
+///	A parsed tree keeps a single copy of the tag replacement values in its
+///	root node. Texts and attribute values keep their tags until they are
+///	first read, so values that are never asked for are never replaced.
+///	That read changes the node, a tree is only used by one thread at a time.
 // =====================================================
 
 class XmlNode {
 private:
+	friend class XmlTreeCache;
+	friend class XmlBinaryIo;
+
 	string name;
-	string text;
+	mutable string text;
 	vector<XmlNode*> children;
 	vector<XmlAttribute*> attributes;
 	mutable const XmlNode* superNode;
 
+	// owned by the root node of a parsed tree
+	std::map<string,string> *tagValues;
+	// replaced in the text on the first read, NULL once that happened
+	mutable const std::map<string,string> *pendingTagValues;
+	// children already written as xml, only while the node streams them
+	XmlSaveBuffer *writtenChildren;
+	// the same for a node that streams its children in binary form
+	XmlBinarySection *writtenSection;
+
 private:
 	XmlNode(XmlNode&);
 	void operator =(XmlNode&);
 
+	XmlNode(xml_node<> *node, const std::map<string,string> *tagValues);
+	void init(xml_node<> *node, const std::map<string,string> *tagValues);
+
 	string getTreeString() const;
 	bool hasChildNoSuper(const string& childName) const;
 
+	void writeBinary(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const;
+	void writeBinarySection(string &out, XmlSaveBuffer *sink) const;
+	void writeBinaryNode(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const;
+	void writeBinaryNodeContent(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const;
+
 public:
 
 #if defined(WANT_XERCES)
@@ -191,7 +404,7 @@ public:
 	const string &getName() const	{return name;}
 	size_t getChildCount() const		{return children.size();}
 	size_t getAttributeCount() const	{return attributes.size();}
-	const string &getText() const	{return text;}
+	const string &getText() const;
 
 	XmlAttribute *getAttribute(unsigned int i) const;
 	XmlAttribute *getAttribute(const string &name,bool mustExist=true) const;
@@ -208,6 +421,12 @@ public:
 
 
 	XmlNode *addChild(const string &name, const string text = "");
+	// For nodes that are built to be saved: adding a child writes the one
+	// before it in the given format and frees it, so only the last child
+	// stays a node. The tree has to be saved in that format.
+	void setStreamChildren(bool value, XmlSaveFormat format=xsfXml);
+	XmlSaveFormat getStreamFormat() const { return (writtenSection != NULL ? xsfBinary : xsfXml); }
+	void writeXml(string &out, XmlSaveBuffer *sink) const;
 	XmlAttribute *addAttribute(const string &name, const string &value, const std::map<string,string> &mapTagReplacementValues);
 	xml_node<>* buildElement(xml_document<> *document) const;
 };
@@ -218,16 +437,24 @@ public:
 
 class XmlAttribute {
 private:
-	string value;
+	friend class XmlNode;
+	friend class XmlTreeCache;
+	friend class XmlBinaryIo;
+
+	mutable string value;
 	string name;
-	bool skipRestrictionCheck;
-	bool usesCommondata;
-	std::map<string,string> mapTagReplacementValues;
+	mutable bool skipRestrictionCheck;
+	mutable bool usesCommondata;
+	// replaced in the value on the first read, NULL once that happened
+	mutable const std::map<string,string> *pendingTagValues;
 
 private:
 	XmlAttribute(XmlAttribute&);
 	void operator =(XmlAttribute&);
 
+	XmlAttribute(const string &name, const string &value, const std::map<string,string> *tagValues);
+	void applyPendingTags() const;
+
 public:
 
 #if defined(WANT_XERCES)
@@ -324,4 +324,28 @@ bool extractFileFromZIPFile(string inFile, string outFile) {
 	return(result == EXIT_SUCCESS ? true : false);
 }
 
+bool compressMemoryBuffer(const unsigned char *data, unsigned int dataSize, std::vector<unsigned char> &compressedData, int compressionLevel) {
+	mz_ulong compressedSize = mz_compressBound(dataSize);
+	compressedData.resize(compressedSize);
+	int status = mz_compress2(&compressedData[0], &compressedSize, data, dataSize, compressionLevel);
+	if(status != MZ_OK) {
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("mz_compress2() failed, status: %d\n", status);
+		compressedData.clear();
+		return false;
+	}
+	compressedData.resize(compressedSize);
+	return true;
+}
+
+// dataSize has to be the exact size the buffer had before compression
+bool extractMemoryBuffer(const unsigned char *compressedData, unsigned int compressedSize, unsigned char *data, unsigned int dataSize) {
+	mz_ulong extractedSize = dataSize;
+	int status = mz_uncompress(data, &extractedSize, compressedData, compressedSize);
+	if(status != MZ_OK || extractedSize != dataSize) {
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("mz_uncompress() failed, status: %d size: %u expected: %u\n", status, (unsigned int)extractedSize, dataSize);
+		return false;
+	}
+	return true;
+}
+
 }}
@@ -484,10 +484,7 @@ void Mesh::loadV2(int meshIndex, const string &dir, FILE *f, TextureManager *tex
 					(*loadedFileList)[texPath].push_back(make_pair(sourceLoader,sourceLoader));
 				}
 				texturesOwned[mtDiffuse]=true;
-				textures[mtDiffuse]->init(textureManager->getTextureFilter(),textureManager->getMaxAnisotropy());
-				if(deletePixMapAfterLoad == true) {
-					textures[mtDiffuse]->deletePixels();
-				}
+				textureManager->initLoadedTexture(textures[mtDiffuse],deletePixMapAfterLoad);
 			}
 			else {
 				SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error v2 model is missing texture [%s] meshIndex = %d modelFile [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,texPath.c_str(),meshIndex,modelFile.c_str());
@@ -627,10 +624,7 @@ void Mesh::loadV3(int meshIndex, const string &dir, FILE *f,
 				}
 
 				texturesOwned[mtDiffuse]=true;
-				textures[mtDiffuse]->init(textureManager->getTextureFilter(),textureManager->getMaxAnisotropy());
-				if(deletePixMapAfterLoad == true) {
-					textures[mtDiffuse]->deletePixels();
-				}
+				textureManager->initLoadedTexture(textures[mtDiffuse],deletePixMapAfterLoad);
 			}
 			else {
 				SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error v3 model is missing texture [%s] meshHeader.properties = %d meshIndex = %d modelFile [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,texPath.c_str(),meshHeader.properties,meshIndex,modelFile.c_str());
@@ -735,10 +729,7 @@ Texture2D* Mesh::loadMeshTexture(int meshIndex, int textureIndex,
 			//if(SystemFlags::VERBOSE_MODE_ENABLED) printf("In [%s] texture loaded [%s]\n",__FUNCTION__,textureFile.c_str());
 
 			textureOwned = true;
-			texture->init(textureManager->getTextureFilter(),textureManager->getMaxAnisotropy());
-			if(deletePixMapAfterLoad == true) {
-				texture->deletePixels();
-			}
+			textureManager->initLoadedTexture(texture,deletePixMapAfterLoad);
 
 			//if(SystemFlags::VERBOSE_MODE_ENABLED) printf("In [%s] texture inited [%s]\n",__FUNCTION__,textureFile.c_str());
 		}
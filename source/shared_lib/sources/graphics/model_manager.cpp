@@ -17,6 +17,7 @@
 #include <stdexcept>
 #include "util.h"
 #include "platform_util.h"
+#include "thread.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Util;
@@ -34,14 +35,19 @@ ModelManager::ModelManager(){
 	}
 
 	textureManager= NULL;
+	mutexModels= new Mutex(CODE_AT_LINE);
 }
 
 ModelManager::~ModelManager(){
 	end();
+
+	delete mutexModels;
+	mutexModels= NULL;
 }
 
 Model *ModelManager::newModel(const string &path,bool deletePixMapAfterLoad,std::map<string,vector<pair<string, string> > > *loadedFileList, string *sourceLoader){
 	Model *model= GraphicsInterface::getInstance().getFactory()->newModel(path,textureManager,deletePixMapAfterLoad,loadedFileList,sourceLoader);
+	MutexSafeWrapper safeMutex(mutexModels,CODE_AT_LINE);
 	models.push_back(model);
 	return model;
 }
@@ -67,6 +73,7 @@ void ModelManager::end(){
 
 void ModelManager::endModel(Model *model,bool mustExistInList) {
 	if(model != NULL) {
+		MutexSafeWrapper safeMutex(mutexModels,CODE_AT_LINE);
 		bool found = false;
 		for(unsigned int idx = 0; idx < models.size(); idx++) {
 			Model *curModel = models[idx];
@@ -19,6 +19,7 @@
 
 #include "util.h"
 #include "platform_util.h"
+#include "thread.h"
 #include "leak_dumper.h"
 
 using namespace Shared::Util;
@@ -38,10 +39,19 @@ TextureManager::TextureManager() {
 
 	textureFilter= Texture::fBilinear;
 	maxAnisotropy= 1;
+
+	mutexDeferred= new Mutex(CODE_AT_LINE);
+	deferredLoading= false;
 }
 
 TextureManager::~TextureManager(){
+	if(deferredLoading == true) {
+		endDeferredLoading();
+	}
 	end();
+
+	delete mutexDeferred;
+	mutexDeferred= NULL;
 }
 
 void TextureManager::initTexture(Texture *texture) {
@@ -50,9 +60,75 @@ void TextureManager::initTexture(Texture *texture) {
 	}
 }
 
+// Uploads a texture that was just loaded, or queues it for
+// endDeferredLoading when that must not happen on this thread. The
+// texture can be found by its path from then on.
+void TextureManager::initLoadedTexture(Texture *texture, bool deletePixels) {
+	if(texture == NULL) {
+		return;
+	}
+	if(deferredLoading == true) {
+		MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+		deferredInits.push_back(std::make_pair(texture,deletePixels));
+		deferredTexturesByPath[texture->getPath()]= texture;
+		return;
+	}
+	texture->init(textureFilter, maxAnisotropy);
+	if(deletePixels == true) {
+		texture->deletePixels();
+	}
+}
+
+void TextureManager::beginDeferredLoading() {
+	MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+	deferredLoading= true;
+}
+
+// Called once no other thread creates textures anymore
+void TextureManager::endDeferredLoading() {
+	MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+	deferredLoading= false;
+
+	textures.insert(textures.end(), deferredTextures.begin(), deferredTextures.end());
+	deferredTextures.clear();
+	deferredTexturesByPath.clear();
+
+	for(unsigned int i = 0; i < deferredInits.size(); ++i) {
+		Texture *texture= deferredInits[i].first;
+		texture->init(textureFilter, maxAnisotropy);
+		if(deferredInits[i].second == true) {
+			texture->deletePixels();
+		}
+	}
+	deferredInits.clear();
+}
+
 void TextureManager::endTexture(Texture *texture,bool mustExistInList) {
 	if(texture != NULL) {
 		bool found = false;
+		if(deferredLoading == true) {
+			MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+			for(unsigned int idx = 0; idx < deferredTextures.size(); idx++) {
+				if(deferredTextures[idx] == texture) {
+					found = true;
+					deferredTextures.erase(deferredTextures.begin() + idx);
+					break;
+				}
+			}
+			for(unsigned int idx = 0; idx < deferredInits.size(); idx++) {
+				if(deferredInits[idx].first == texture) {
+					deferredInits.erase(deferredInits.begin() + idx);
+					break;
+				}
+			}
+			for(std::map<string,Texture *>::iterator iterMap = deferredTexturesByPath.begin();
+				iterMap != deferredTexturesByPath.end(); ++iterMap) {
+				if(iterMap->second == texture) {
+					deferredTexturesByPath.erase(iterMap);
+					break;
+				}
+			}
+		}
 		for(unsigned int idx = 0; idx < textures.size(); idx++) {
 			Texture *curTexture = textures[idx];
 			if(curTexture == texture) {
@@ -125,26 +201,44 @@ Texture *TextureManager::getTexture(const string &path){
 			return textures[i];
 		}
 	}
+	if(deferredLoading == true) {
+		// only textures that finished loading, the others are still written
+		MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+		std::map<string,Texture *>::iterator iterFind = deferredTexturesByPath.find(path);
+		if(iterFind != deferredTexturesByPath.end()) {
+			return iterFind->second;
+		}
+	}
 	return NULL;
 }
 
+void TextureManager::addTexture(Texture *texture) {
+	if(deferredLoading == true) {
+		MutexSafeWrapper safeMutex(mutexDeferred,CODE_AT_LINE);
+		deferredTextures.push_back(texture);
+	}
+	else {
+		textures.push_back(texture);
+	}
+}
+
 Texture1D *TextureManager::newTexture1D(){
 	Texture1D *texture1D= GraphicsInterface::getInstance().getFactory()->newTexture1D();
-	textures.push_back(texture1D);
+	addTexture(texture1D);
 
 	return texture1D;
 }
 
 Texture2D *TextureManager::newTexture2D(){
 	Texture2D *texture2D= GraphicsInterface::getInstance().getFactory()->newTexture2D();
-	textures.push_back(texture2D);
+	addTexture(texture2D);
 
 	return texture2D;
 }
 
 Texture3D *TextureManager::newTexture3D(){
 	Texture3D *texture3D= GraphicsInterface::getInstance().getFactory()->newTexture3D();
-	textures.push_back(texture3D);
+	addTexture(texture3D);
 
 	return texture3D;
 }
@@ -152,7 +246,7 @@ Texture3D *TextureManager::newTexture3D(){
 
 TextureCube *TextureManager::newTextureCube(){
 	TextureCube *textureCube= GraphicsInterface::getInstance().getFactory()->newTextureCube();
-	textures.push_back(textureCube);
+	addTexture(textureCube);
 
 	return textureCube;
 }
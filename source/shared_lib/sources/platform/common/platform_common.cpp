@@ -852,6 +852,13 @@ void clearFolderTreeContentsCheckSum(vector<string> paths, string pathSearchStri
 	for(unsigned int idx = 0; idx < paths.size(); ++idx) {
 		string path = paths[idx];
 		clearFolderTreeContentsCheckSum(path, filterFileExt);
+
+		// the content was removed or replaced, its file sums are of no use
+		string folder = paths[idx] + pathSearchString;
+		if(EndsWith(folder, "*") == true) {
+			folder.erase(folder.size() - 1);
+		}
+		Checksum::removeFolderFromFileIndex(folder);
 	}
 
 	string crcCacheFile = getFormattedCRCCacheFileName(cacheKeys);
@@ -1803,6 +1810,22 @@ void sleep(int millis) {
 	SDL_Delay(millis);
 }
 
+// Number of online processors, at least 1
+int getCpuCount() {
+	int result = 1;
+#ifdef WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	result = (int)systemInfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	result = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(result < 1) {
+		result = 1;
+	}
+	return result;
+}
+
 bool isCursorShowing() {
 	int state = SDL_ShowCursor(SDL_QUERY);
 	return (state == SDL_ENABLE);
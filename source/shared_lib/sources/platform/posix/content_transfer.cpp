@@ -0,0 +1,1027 @@
+// ==============================================================
+//	This file is part of MegaGlest Shared Library (www.glest.org)
+//
+//	Copyright (C) 2009-2010 Titus Tscharntke (info@titusgames.de) and
+//                          Mark Vejvoda (mark_vejvoda@hotmail.com)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include "content_transfer.h"
+
+#include "util.h"
+#include "checksum.h"
+#include "conversion.h"
+#include "byte_order.h"
+#include "platform_common.h"
+#include "platform_util.h"
+#include "compression_utils.h"
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "leak_dumper.h"
+
+using namespace Shared::Util;
+using namespace Shared::Platform;
+using namespace Shared::CompressionUtil;
+
+namespace Shared { namespace PlatformCommon {
+
+// seconds without any data before a transfer gives up, and before the
+// server drops an idle connection
+static const int transferTimeoutSeconds		= 30;
+static const int idleConnectionSeconds		= 60;
+static const int maxStreamFailures			= 3;
+static const unsigned int maxNameLength		= 4096;
+
+static const char chunkJournalId[4] = { 'M', 'G', 'C', 'J' };
+
+template<class T> static void writeTransferValue(vector<unsigned char> &data, T value) {
+	value = ::Shared::PlatformByteOrder::toCommonEndian(value);
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+static void writeTransferString(vector<unsigned char> &data, const string &value) {
+	writeTransferValue<uint16>(data, (uint16)value.size());
+	data.insert(data.end(), value.begin(), value.end());
+}
+
+// Sent in pieces, Socket::send() only waits a few seconds for all of the
+// data it gets to go out, too short for a whole chunk on a slow line
+static bool sendTransferData(Socket *socket, const vector<unsigned char> &data) {
+	const size_t sendPieceSize = 16 * 1024;
+	for(size_t offset = 0; offset < data.size();) {
+		int pieceSize = (int)min(sendPieceSize, data.size() - offset);
+		int bytesSent = socket->send(&data[offset], pieceSize);
+		if(bytesSent <= 0) {
+			return false;
+		}
+		offset += bytesSent;
+	}
+	return (data.empty() == false);
+}
+
+// Waits for data instead of letting receive() drop the connection after
+// its own short timeout, a large chunk can take a while on a slow line
+static bool receiveTransferData(Socket *socket, void *data, int dataSize, BaseThread *owner) {
+	char *buffer = reinterpret_cast<char *>(data);
+	int receivedBytes = 0;
+	time_t lastDataTime = time(NULL);
+	for(;receivedBytes < dataSize;) {
+		if(socket->isSocketValid() == false || (owner != NULL && owner->getQuitStatus() == true)) {
+			return false;
+		}
+		if(socket->hasDataToReadWithWait(100000) == true) {
+			int bytes = socket->receive(&buffer[receivedBytes], dataSize - receivedBytes, false);
+			if(bytes <= 0) {
+				return false;
+			}
+			receivedBytes += bytes;
+			lastDataTime = time(NULL);
+		}
+		else if(difftime((long int)time(NULL),lastDataTime) > transferTimeoutSeconds) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<class T> static bool receiveTransferValue(Socket *socket, T &value, BaseThread *owner) {
+	if(receiveTransferData(socket, &value, sizeof(T), owner) == false) {
+		return false;
+	}
+	value = ::Shared::PlatformByteOrder::fromCommonEndian(value);
+	return true;
+}
+
+static bool receiveTransferString(Socket *socket, string &value, BaseThread *owner) {
+	uint16 length = 0;
+	if(receiveTransferValue<uint16>(socket, length, owner) == false || length > maxNameLength) {
+		return false;
+	}
+	value = "";
+	if(length > 0) {
+		vector<char> buffer(length);
+		if(receiveTransferData(socket, &buffer[0], length, owner) == false) {
+			return false;
+		}
+		value.assign(&buffer[0], length);
+	}
+	return true;
+}
+
+static void shutdownTransferThread(BaseThread *thread) {
+	time_t elapsed = time(NULL);
+	thread->signalQuit();
+	for(;thread->canShutdown(false) == false &&
+		difftime((long int)time(NULL),elapsed) <= 15;) {
+		sleep(10);
+	}
+	if(thread->canShutdown(true)) {
+		delete thread;
+	}
+}
+
+static bool isTransferThreadDone(BaseThread *thread) {
+	return (thread->getHasBeginExecution() == true && thread->getRunningStatus() == false);
+}
+
+// chunks of files past 2 GB need more than the long fseek takes
+static bool seekTransferFile(FILE *fp, int64 offset) {
+#ifdef WIN32
+	return (_fseeki64(fp, offset, SEEK_SET) == 0);
+#else
+	if((int64)(off_t)offset != offset) {
+		return false;
+	}
+	return (fseeko(fp, (off_t)offset, SEEK_SET) == 0);
+#endif
+}
+
+// =====================================================
+//	class ContentTransferConnectionThread
+// =====================================================
+
+ContentTransferConnectionThread::ContentTransferConnectionThread(
+		ContentTransferServer *server, Socket *socket) : BaseThread() {
+	this->server = server;
+	this->socket = socket;
+	uniqueID = "ContentTransferConnectionThread";
+}
+
+ContentTransferConnectionThread::~ContentTransferConnectionThread() {
+	delete socket;
+	socket = NULL;
+}
+
+void ContentTransferConnectionThread::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	try {
+		char id[4];
+		uint32 version = 0;
+		if(receiveTransferData(socket, id, sizeof(id), this) == false ||
+			receiveTransferValue<uint32>(socket, version, this) == false) {
+			return;
+		}
+		uint8 status = ctsOk;
+		if(memcmp(id, ContentTransferClient::connectionId, sizeof(id)) != 0 ||
+			version != ContentTransferClient::protocolVersion) {
+			status = ctsBadRequest;
+		}
+		vector<unsigned char> reply;
+		writeTransferValue<uint8>(reply, status);
+		if(sendTransferData(socket, reply) == false || status != ctsOk) {
+			return;
+		}
+
+		time_t lastRequestTime = time(NULL);
+		for(;getQuitStatus() == false;) {
+			if(socket->hasDataToReadWithWait(100000) == false) {
+				if(socket->isSocketValid() == false ||
+					difftime((long int)time(NULL),lastRequestTime) > idleConnectionSeconds) {
+					break;
+				}
+				continue;
+			}
+
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			uint8 requestType = 0;
+			if(receiveTransferValue<uint8>(socket, requestType, this) == false) {
+				break;
+			}
+
+			bool handled = false;
+			switch(requestType) {
+				case ctrtList:
+					handled = handleList();
+					break;
+				case ctrtChunk:
+					handled = handleChunk();
+					break;
+				default:
+					SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] unknown content transfer request %d from [%s]\n",__FILE__,__FUNCTION__,__LINE__,requestType,socket->getIpAddress().c_str());
+					break;
+			}
+			if(handled == false) {
+				break;
+			}
+			lastRequestTime = time(NULL);
+		}
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+	}
+}
+
+bool ContentTransferConnectionThread::handleList() {
+	string root = "";
+	string item = "";
+	if(receiveTransferString(socket, root, this) == false ||
+		receiveTransferString(socket, item, this) == false) {
+		return false;
+	}
+
+	vector<ContentTransferFile> files;
+	uint8 status = server->listItem(root, item, files);
+
+	vector<unsigned char> reply;
+	writeTransferValue<uint8>(reply, status);
+	if(status == ctsOk) {
+		writeTransferValue<uint32>(reply, (uint32)files.size());
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			writeTransferString(reply, files[index].path);
+			writeTransferValue<int64>(reply, files[index].size);
+			writeTransferValue<uint32>(reply, files[index].crc);
+		}
+	}
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] list [%s] [%s] status = %d files = %d\n",__FILE__,__FUNCTION__,__LINE__,root.c_str(),item.c_str(),status,(int)files.size());
+	return sendTransferData(socket, reply);
+}
+
+bool ContentTransferConnectionThread::handleChunk() {
+	string root = "";
+	string item = "";
+	string path = "";
+	uint32 crc = 0;
+	int64 offset = 0;
+	uint32 size = 0;
+	if(receiveTransferString(socket, root, this) == false ||
+		receiveTransferString(socket, item, this) == false ||
+		receiveTransferString(socket, path, this) == false ||
+		receiveTransferValue<uint32>(socket, crc, this) == false ||
+		receiveTransferValue<int64>(socket, offset, this) == false ||
+		receiveTransferValue<uint32>(socket, size, this) == false) {
+		return false;
+	}
+
+	string file = "";
+	uint8 status = ctsBadRequest;
+	if(offset >= 0 && size > 0 && size <= (uint32)ContentTransferClient::maxChunkSize) {
+		status = server->findFile(root, item, path, crc, file);
+	}
+
+	vector<unsigned char> plainData;
+	if(status == ctsOk) {
+		// the crc matched, a short read means the file changed since
+		status = ctsChanged;
+#ifdef WIN32
+		FILE *fp = _wfopen(utf8_decode(file).c_str(), L"rb");
+#else
+		FILE *fp = fopen(file.c_str(),"rb");
+#endif
+		if(fp != NULL) {
+			plainData.resize(size);
+			if(seekTransferFile(fp, offset) == true &&
+				fread(&plainData[0], 1, size, fp) == size) {
+				status = ctsOk;
+			}
+			fclose(fp);
+		}
+	}
+
+	vector<unsigned char> reply;
+	writeTransferValue<uint8>(reply, status);
+	if(status == ctsOk) {
+		vector<unsigned char> compressedData;
+		bool compressed = (compressMemoryBuffer(&plainData[0], size, compressedData) == true &&
+							compressedData.size() < plainData.size());
+		const vector<unsigned char> &data = (compressed == true ? compressedData : plainData);
+
+		writeTransferValue<uint32>(reply, size);
+		writeTransferValue<uint32>(reply, (uint32)data.size());
+		writeTransferValue<uint8>(reply, (compressed == true ? 1 : 0));
+		reply.insert(reply.end(), data.begin(), data.end());
+	}
+	return sendTransferData(socket, reply);
+}
+
+// =====================================================
+//	class ContentTransferServer
+// =====================================================
+
+ContentTransferServer::ContentTransferServer(int portNumber, int maxConnections,
+		FTPClientValidationInterface *validator) : BaseThread(), mutexRoots(CODE_AT_LINE),
+		mutexFileCrcs(CODE_AT_LINE) {
+	uniqueID = "ContentTransferServer";
+	this->portNumber		= portNumber;
+	this->maxConnections	= maxConnections;
+	this->validator			= validator;
+	this->internetEnabled	= false;
+
+	serverSocket = NULL;
+	try {
+		serverSocket = new ServerSocket(true);
+		serverSocket->setBlock(false);
+		serverSocket->setBindPort(portNumber);
+		serverSocket->listen(SOMAXCONN);
+	}
+	catch(const std::exception &ex) {
+		char szBuf[8096]="";
+		snprintf(szBuf,8096,"In [%s::%s Line: %d] Warning content transfer port %d bind/listen error:\n%s\n",__FILE__,__FUNCTION__,__LINE__,portNumber,ex.what());
+		SystemFlags::OutputDebug(SystemFlags::debugError,szBuf);
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("%s",szBuf);
+
+		delete serverSocket;
+		serverSocket = NULL;
+	}
+}
+
+ContentTransferServer::~ContentTransferServer() {
+	cleanupConnections(true);
+
+	delete serverSocket;
+	serverSocket = NULL;
+}
+
+void ContentTransferServer::addRoot(const string &name, const vector<string> &paths, bool allowInternet) {
+	MutexSafeWrapper safeMutex(&mutexRoots,CODE_AT_LINE);
+	Root &root = roots[name];
+	root.allowInternet = allowInternet;
+	for(unsigned int index = 0; index < paths.size(); ++index) {
+		if(paths[index] != "") {
+			string path = paths[index];
+			endPathWithSlash(path);
+			root.paths.push_back(path);
+		}
+	}
+}
+
+void ContentTransferServer::setInternetEnabled(bool value) {
+	MutexSafeWrapper safeMutex(&mutexRoots,CODE_AT_LINE);
+	internetEnabled = value;
+}
+
+bool ContentTransferServer::isValidName(const string &name, bool allowSubfolders) {
+	if(name == "" || name.size() > maxNameLength ||
+		name[0] == '/' || name[0] == '\\' ||
+		name.find("..") != string::npos || name.find(':') != string::npos) {
+		return false;
+	}
+	if(allowSubfolders == false && name.find_first_of("/\\") != string::npos) {
+		return false;
+	}
+	return true;
+}
+
+uint8 ContentTransferServer::findItemPath(const string &root, const string &item, string &itemPath) {
+	if(isValidName(item, false) == false) {
+		return ctsBadRequest;
+	}
+
+	MutexSafeWrapper safeMutex(&mutexRoots,CODE_AT_LINE);
+	map<string,Root>::const_iterator iterMap = roots.find(root);
+	if(iterMap == roots.end()) {
+		return ctsNotFound;
+	}
+	if(internetEnabled == true && iterMap->second.allowInternet == false) {
+		return ctsDenied;
+	}
+	for(unsigned int index = 0; index < iterMap->second.paths.size(); ++index) {
+		string candidate = iterMap->second.paths[index] + item;
+		if(isdir(candidate.c_str()) == true || fileExists(candidate) == true) {
+			itemPath = candidate;
+			return ctsOk;
+		}
+	}
+	return ctsNotFound;
+}
+
+uint8 ContentTransferServer::listItem(const string &root, const string &item,
+		vector<ContentTransferFile> &files) {
+	files.clear();
+
+	string itemPath = "";
+	uint8 status = findItemPath(root, item, itemPath);
+	if(status != ctsOk) {
+		return status;
+	}
+
+	// folders take the crcs the game already keeps for their files
+	vector<std::pair<string,uint32> > checksumFiles;
+	if(isdir(itemPath.c_str()) == true) {
+		checksumFiles = getFolderTreeContentsCheckSumListRecursively(itemPath + "/*", "", NULL);
+	}
+	else {
+		checksumFiles.push_back(std::pair<string,uint32>(itemPath,getFileCrc(itemPath)));
+	}
+
+	for(unsigned int index = 0; index < checksumFiles.size(); ++index) {
+		const string &filePath = checksumFiles[index].first;
+		ContentTransferFile file;
+		file.path = "";
+		if(filePath != itemPath) {
+			file.path = filePath.substr(itemPath.size() + 1);
+			replaceAll(file.path, "\\", "/");
+		}
+		file.size = getFileSize(filePath);
+		file.crc = checksumFiles[index].second;
+		files.push_back(file);
+
+		setFileCrc(filePath, file.crc);
+	}
+	return ctsOk;
+}
+
+void ContentTransferServer::setFileCrc(const string &file, uint32 crc) {
+	ChecksumFileIndexEntry entry;
+	if(Checksum::getFileFingerprint(file, entry) == false) {
+		return;
+	}
+	entry.crc = crc;
+
+	MutexSafeWrapper safeMutex(&mutexFileCrcs,CODE_AT_LINE);
+	fileCrcs[file] = entry;
+}
+
+uint32 ContentTransferServer::getFileCrc(const string &file) {
+	// the sum cached for the path may be from before the file changed
+	Checksum::removeFileFromCache(file);
+	Checksum checksum;
+	checksum.addFile(file);
+	return checksum.getSum();
+}
+
+uint8 ContentTransferServer::findFile(const string &root, const string &item,
+		const string &path, uint32 crc, string &file) {
+	string itemPath = "";
+	uint8 status = findItemPath(root, item, itemPath);
+	if(status != ctsOk) {
+		return status;
+	}
+
+	file = itemPath;
+	if(path != "") {
+		if(isValidName(path, true) == false || isdir(itemPath.c_str()) == false) {
+			return ctsBadRequest;
+		}
+		file = itemPath + "/" + path;
+	}
+
+	ChecksumFileIndexEntry fingerprint;
+	if(isdir(file.c_str()) == true || Checksum::getFileFingerprint(file, fingerprint) == false) {
+		return ctsNotFound;
+	}
+
+	bool knownFile = false;
+	uint32 fileCrc = 0;
+	{
+		MutexSafeWrapper safeMutex(&mutexFileCrcs,CODE_AT_LINE);
+		map<string,ChecksumFileIndexEntry>::iterator iterFind = fileCrcs.find(file);
+		if(iterFind != fileCrcs.end() && iterFind->second.isSameFile(fingerprint) == true) {
+			knownFile = true;
+			fileCrc = iterFind->second.crc;
+		}
+	}
+	if(knownFile == false) {
+		fileCrc = getFileCrc(file);
+		setFileCrc(file, fileCrc);
+	}
+	return (fileCrc == crc ? ctsOk : ctsChanged);
+}
+
+void ContentTransferServer::acceptConnections() {
+	for(Socket *socket = serverSocket->accept(false); socket != NULL;
+		socket = serverSocket->accept(false)) {
+		uint32 clientIp = socket->getConnectedIPAddress(socket->getIpAddress());
+		if(validator != NULL && validator->isValidClientType(clientIp) == 0) {
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] refused content transfer connection from [%s]\n",__FILE__,__FUNCTION__,__LINE__,socket->getIpAddress().c_str());
+			delete socket;
+			continue;
+		}
+		if((int)connections.size() >= maxConnections) {
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] too many content transfer connections, refused [%s]\n",__FILE__,__FUNCTION__,__LINE__,socket->getIpAddress().c_str());
+			delete socket;
+			continue;
+		}
+
+		static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+		ContentTransferConnectionThread *connection = new ContentTransferConnectionThread(this, socket);
+		connection->setUniqueID(mutexOwnerId);
+		connection->start();
+		connections.push_back(connection);
+	}
+}
+
+void ContentTransferServer::cleanupConnections(bool waitForAll) {
+	for(int index = (int)connections.size() - 1; index >= 0; --index) {
+		ContentTransferConnectionThread *connection = connections[index];
+		if(waitForAll == true) {
+			shutdownTransferThread(connection);
+		}
+		else if(isTransferThreadDone(connection) == true && connection->canShutdown(true) == true) {
+			delete connection;
+		}
+		else {
+			continue;
+		}
+		connections.erase(connections.begin() + index);
+	}
+}
+
+void ContentTransferServer::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	if(serverSocket == NULL) {
+		return;
+	}
+	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("===> Content transfer server listening on port %d\n",portNumber);
+
+	try {
+		for(;getQuitStatus() == false;) {
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			acceptConnections();
+			cleanupConnections(false);
+			safeExecutingTaskMutex.Disable();
+			sleep(25);
+		}
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+	}
+}
+
+// =====================================================
+//	class ContentTransferStreamThread
+// =====================================================
+
+ContentTransferStreamThread::ContentTransferStreamThread(ContentTransferClient *client) : BaseThread() {
+	this->client = client;
+	this->failed = false;
+	uniqueID = "ContentTransferStreamThread";
+}
+
+void ContentTransferStreamThread::execute() {
+	RunningStatusSafeWrapper runningStatus(this);
+	Socket *socket = NULL;
+	try {
+		int failures = 0;
+		ContentTransferClient::Chunk chunk;
+		for(;getQuitStatus() == false && client->takeChunk(chunk) == true;) {
+			ExecutingTaskSafeWrapper safeExecutingTaskMutex(this);
+			if(socket == NULL) {
+				socket = client->connectToServer();
+			}
+
+			vector<unsigned char> data;
+			uint8 status = ctsBadRequest;
+			if(socket != NULL && client->requestChunk(socket, chunk, data, status) == true) {
+				if(status == ctsOk) {
+					failures = 0;
+					if(client->storeChunk(chunk, data) == false) {
+						break;
+					}
+					continue;
+				}
+				client->returnChunk(chunk);
+				client->abort("server refused a chunk of [" + client->files[chunk.fileIndex].file.path +
+								"] with status " + intToStr(status));
+				break;
+			}
+
+			// the connection is gone, put the chunk back and reconnect
+			client->returnChunk(chunk);
+			delete socket;
+			socket = NULL;
+			if(++failures >= maxStreamFailures) {
+				failed = true;
+				break;
+			}
+			safeExecutingTaskMutex.Disable();
+			sleep(250 * failures);
+		}
+	}
+	catch(const exception &ex) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+		failed = true;
+	}
+	delete socket;
+}
+
+// =====================================================
+//	class ContentTransferClient
+// =====================================================
+
+const char ContentTransferClient::connectionId[4] = { 'M', 'G', 'C', 'T' };
+
+ContentTransferClient::ContentTransferClient(const string &serverUrl, int portNumber,
+		int streamCount, int chunkSize) : mutexDownload(CODE_AT_LINE) {
+	this->serverUrl		= serverUrl;
+	this->portNumber	= portNumber;
+	this->streamCount	= max(streamCount,1);
+	this->chunkSize		= max(min(chunkSize,(int)maxChunkSize),4096);
+	this->callback		= NULL;
+
+	activeChunks	= 0;
+	totalBytes		= 0;
+	receivedBytes	= 0;
+	aborted			= false;
+	transferStarted	= false;
+	lastError		= "";
+}
+
+Socket * ContentTransferClient::connectToServer() {
+	ClientSocket *socket = new ClientSocket();
+	try {
+		socket->connect(Ip(serverUrl), portNumber);
+	}
+	catch(const exception &ex) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+		delete socket;
+		return NULL;
+	}
+	if(socket->isConnected() == false) {
+		delete socket;
+		return NULL;
+	}
+
+	vector<unsigned char> hello;
+	hello.insert(hello.end(), connectionId, connectionId + sizeof(connectionId));
+	writeTransferValue<uint32>(hello, protocolVersion);
+	uint8 status = ctsBadRequest;
+	if(sendTransferData(socket, hello) == false ||
+		receiveTransferValue<uint8>(socket, status, NULL) == false || status != ctsOk) {
+		delete socket;
+		return NULL;
+	}
+	return socket;
+}
+
+bool ContentTransferClient::listItem(Socket *socket, const string &root, const string &item,
+		vector<ContentTransferFile> &files, uint8 &status) {
+	files.clear();
+
+	vector<unsigned char> request;
+	writeTransferValue<uint8>(request, ctrtList);
+	writeTransferString(request, root);
+	writeTransferString(request, item);
+	if(sendTransferData(socket, request) == false ||
+		receiveTransferValue<uint8>(socket, status, NULL) == false) {
+		return false;
+	}
+	if(status != ctsOk) {
+		return true;
+	}
+
+	uint32 fileCount = 0;
+	if(receiveTransferValue<uint32>(socket, fileCount, NULL) == false) {
+		return false;
+	}
+	for(uint32 index = 0; index < fileCount; ++index) {
+		ContentTransferFile file;
+		if(receiveTransferString(socket, file.path, NULL) == false ||
+			receiveTransferValue<int64>(socket, file.size, NULL) == false ||
+			receiveTransferValue<uint32>(socket, file.crc, NULL) == false) {
+			return false;
+		}
+		files.push_back(file);
+	}
+	return true;
+}
+
+bool ContentTransferClient::requestChunk(Socket *socket, const Chunk &chunk,
+		vector<unsigned char> &data, uint8 &status) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	const ContentTransferFile file = files[chunk.fileIndex].file;
+	safeMutex.ReleaseLock();
+
+	vector<unsigned char> request;
+	writeTransferValue<uint8>(request, ctrtChunk);
+	writeTransferString(request, rootName);
+	writeTransferString(request, itemName);
+	writeTransferString(request, file.path);
+	writeTransferValue<uint32>(request, file.crc);
+	writeTransferValue<int64>(request, chunk.offset);
+	writeTransferValue<uint32>(request, chunk.size);
+	if(sendTransferData(socket, request) == false ||
+		receiveTransferValue<uint8>(socket, status, NULL) == false) {
+		return false;
+	}
+	if(status != ctsOk) {
+		return true;
+	}
+
+	uint32 plainSize = 0;
+	uint32 dataSize = 0;
+	uint8 compressed = 0;
+	if(receiveTransferValue<uint32>(socket, plainSize, NULL) == false ||
+		receiveTransferValue<uint32>(socket, dataSize, NULL) == false ||
+		receiveTransferValue<uint8>(socket, compressed, NULL) == false ||
+		plainSize != chunk.size || dataSize == 0 || dataSize > plainSize) {
+		return false;
+	}
+
+	vector<unsigned char> received(dataSize);
+	if(receiveTransferData(socket, &received[0], dataSize, NULL) == false) {
+		return false;
+	}
+	if(compressed == 0) {
+		data.swap(received);
+		return (dataSize == plainSize);
+	}
+	data.resize(plainSize);
+	return extractMemoryBuffer(&received[0], dataSize, &data[0], plainSize);
+}
+
+bool ContentTransferClient::takeChunk(Chunk &chunk) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	if(aborted == true || pendingChunks.empty() == true) {
+		return false;
+	}
+	chunk = pendingChunks.front();
+	pendingChunks.pop_front();
+	activeChunks++;
+	return true;
+}
+
+void ContentTransferClient::returnChunk(const Chunk &chunk) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	activeChunks--;
+	pendingChunks.push_front(chunk);
+}
+
+void ContentTransferClient::abort(const string &reason) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	if(aborted == false) {
+		aborted = true;
+		lastError = reason;
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] content transfer of [%s] aborted: %s\n",__FILE__,__FUNCTION__,__LINE__,itemName.c_str(),reason.c_str());
+	}
+}
+
+bool ContentTransferClient::isCancelled() {
+	return (callback != NULL && callback->ContentTransfer_IsCancelled() == true);
+}
+
+// The journal is the id, the file's crc, size and the chunk size, followed
+// by the offset of every chunk written to the .part file so far
+static bool loadChunkJournal(const string &file, uint32 crc, int64 size, uint32 chunkSize,
+		std::set<int64> &offsets) {
+	offsets.clear();
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(file).c_str(), L"rb");
+#else
+	FILE *fp = fopen(file.c_str(),"rb");
+#endif
+	if(fp == NULL) {
+		return false;
+	}
+
+	char id[4];
+	uint32 journalCrc = 0;
+	int64 journalSize = 0;
+	uint32 journalChunkSize = 0;
+	bool valid = (fread(id, sizeof(id), 1, fp) == 1 &&
+				fread(&journalCrc, sizeof(journalCrc), 1, fp) == 1 &&
+				fread(&journalSize, sizeof(journalSize), 1, fp) == 1 &&
+				fread(&journalChunkSize, sizeof(journalChunkSize), 1, fp) == 1 &&
+				memcmp(id, chunkJournalId, sizeof(id)) == 0 &&
+				::Shared::PlatformByteOrder::fromCommonEndian(journalCrc) == crc &&
+				::Shared::PlatformByteOrder::fromCommonEndian(journalSize) == size &&
+				::Shared::PlatformByteOrder::fromCommonEndian(journalChunkSize) == chunkSize);
+	if(valid == true) {
+		// a partly written last entry is ignored, that chunk is fetched again
+		int64 offset = 0;
+		for(;fread(&offset, sizeof(offset), 1, fp) == 1;) {
+			offsets.insert(::Shared::PlatformByteOrder::fromCommonEndian(offset));
+		}
+	}
+	fclose(fp);
+	return valid;
+}
+
+static bool appendChunkJournal(const string &file, const vector<unsigned char> &data, bool create) {
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(file).c_str(), (create == true ? L"wb" : L"ab"));
+#else
+	FILE *fp = fopen(file.c_str(),(create == true ? "wb" : "ab"));
+#endif
+	if(fp == NULL) {
+		return false;
+	}
+	bool result = (fwrite(&data[0], 1, data.size(), fp) == data.size());
+	fclose(fp);
+	return result;
+}
+
+void ContentTransferClient::prepareFile(int fileIndex) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	FileState &state = files[fileIndex];
+	state.remainingChunks = 0;
+
+	string folder = extractDirectoryPathFromFile(state.destFile);
+	if(folder != "") {
+		createDirectoryPaths(folder);
+	}
+
+	if(fileExists(state.destFile) == true &&
+		ContentTransferServer::getFileCrc(state.destFile) == state.file.crc) {
+		receivedBytes += state.file.size;
+		return;
+	}
+
+	string partFile = state.destFile + ".part";
+	string journalFile = partFile + ".chunks";
+	std::set<int64> doneOffsets;
+	if(fileExists(partFile) == false ||
+		loadChunkJournal(journalFile, state.file.crc, state.file.size, chunkSize, doneOffsets) == false) {
+		doneOffsets.clear();
+
+		vector<unsigned char> header;
+		header.insert(header.end(), chunkJournalId, chunkJournalId + sizeof(chunkJournalId));
+		writeTransferValue<uint32>(header, state.file.crc);
+		writeTransferValue<int64>(header, state.file.size);
+		writeTransferValue<uint32>(header, (uint32)chunkSize);
+
+#ifdef WIN32
+		FILE *fp = _wfopen(utf8_decode(partFile).c_str(), L"wb");
+#else
+		FILE *fp = fopen(partFile.c_str(),"wb");
+#endif
+		if(fp == NULL || appendChunkJournal(journalFile, header, true) == false) {
+			if(fp != NULL) {
+				fclose(fp);
+			}
+			safeMutex.ReleaseLock();
+			abort("cannot write [" + partFile + "]");
+			return;
+		}
+		fclose(fp);
+	}
+	else if(doneOffsets.empty() == false) {
+		if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Resuming [%s], %d chunks already received\n",state.destFile.c_str(),(int)doneOffsets.size());
+	}
+
+	for(int64 offset = 0; offset < state.file.size; offset += chunkSize) {
+		uint32 size = (uint32)min((int64)chunkSize, state.file.size - offset);
+		if(doneOffsets.find(offset) != doneOffsets.end()) {
+			receivedBytes += size;
+			continue;
+		}
+		Chunk chunk;
+		chunk.fileIndex = fileIndex;
+		chunk.offset = offset;
+		chunk.size = size;
+		pendingChunks.push_back(chunk);
+		state.remainingChunks++;
+	}
+
+	if(state.remainingChunks == 0) {
+		safeMutex.ReleaseLock();
+		finishFile(state);
+	}
+}
+
+bool ContentTransferClient::storeChunk(const Chunk &chunk, const vector<unsigned char> &data) {
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	activeChunks--;
+	FileState &state = files[chunk.fileIndex];
+	string partFile = state.destFile + ".part";
+
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(partFile).c_str(), L"r+b");
+#else
+	FILE *fp = fopen(partFile.c_str(),"r+b");
+#endif
+	bool written = false;
+	if(fp != NULL) {
+		written = (seekTransferFile(fp, chunk.offset) == true &&
+					fwrite(&data[0], 1, data.size(), fp) == data.size());
+		fclose(fp);
+	}
+
+	vector<unsigned char> entry;
+	writeTransferValue<int64>(entry, chunk.offset);
+	if(written == false || appendChunkJournal(partFile + ".chunks", entry, false) == false) {
+		safeMutex.ReleaseLock();
+		abort("cannot write [" + partFile + "]");
+		return false;
+	}
+
+	receivedBytes += chunk.size;
+	state.remainingChunks--;
+	if(state.remainingChunks > 0) {
+		return true;
+	}
+	safeMutex.ReleaseLock();
+	return finishFile(state);
+}
+
+bool ContentTransferClient::finishFile(FileState &state) {
+	string partFile = state.destFile + ".part";
+	if(fileExists(state.destFile) == true) {
+		removeFile(state.destFile);
+	}
+	if(renameFile(partFile, state.destFile) == false) {
+		abort("cannot rename [" + partFile + "]");
+		return false;
+	}
+	removeFile(partFile + ".chunks");
+
+	if(ContentTransferServer::getFileCrc(state.destFile) != state.file.crc) {
+		removeFile(state.destFile);
+		abort("crc of [" + state.destFile + "] does not match the server's");
+		return false;
+	}
+	return true;
+}
+
+bool ContentTransferClient::download(const string &root, const string &item, const string &destPath) {
+	lastError = "";
+	transferStarted = false;
+
+	Socket *socket = connectToServer();
+	if(socket == NULL) {
+		lastError = "cannot connect to " + serverUrl + ":" + intToStr(portNumber);
+		return false;
+	}
+	vector<ContentTransferFile> fileList;
+	uint8 status = ctsBadRequest;
+	bool listed = listItem(socket, root, item, fileList, status);
+	delete socket;
+	if(listed == false || status != ctsOk) {
+		lastError = "cannot list [" + item + "], status " + intToStr(status);
+		return false;
+	}
+
+	transferStarted = true;
+
+	string destFolder = destPath;
+	endPathWithSlash(destFolder);
+
+	MutexSafeWrapper safeMutex(&mutexDownload,CODE_AT_LINE);
+	rootName		= root;
+	itemName		= item;
+	files.clear();
+	pendingChunks.clear();
+	activeChunks	= 0;
+	totalBytes		= 0;
+	receivedBytes	= 0;
+	aborted			= false;
+	for(unsigned int index = 0; index < fileList.size(); ++index) {
+		if(fileList[index].path != "" && ContentTransferServer::isValidName(fileList[index].path, true) == false) {
+			lastError = "invalid file name [" + fileList[index].path + "]";
+			return false;
+		}
+		FileState state;
+		state.file = fileList[index];
+		state.destFile = (state.file.path == "" ? destPath : destFolder + state.file.path);
+		state.remainingChunks = 0;
+		files.push_back(state);
+		totalBytes += state.file.size;
+	}
+	safeMutex.ReleaseLock();
+
+	for(unsigned int index = 0; index < files.size() && aborted == false; ++index) {
+		prepareFile(index);
+	}
+
+	vector<ContentTransferStreamThread *> streams;
+	int streamsToStart = min(streamCount, (int)pendingChunks.size());
+	for(int index = 0; index < streamsToStart && aborted == false; ++index) {
+		static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+		ContentTransferStreamThread *stream = new ContentTransferStreamThread(this);
+		stream->setUniqueID(mutexOwnerId);
+		stream->start();
+		streams.push_back(stream);
+	}
+
+	for(bool done = false; done == false;) {
+		done = true;
+		for(unsigned int index = 0; index < streams.size(); ++index) {
+			if(isTransferThreadDone(streams[index]) == false) {
+				done = false;
+			}
+		}
+		if(isCancelled() == true) {
+			abort("cancelled");
+		}
+		if(callback != NULL) {
+			MutexSafeWrapper safeMutexProgress(&mutexDownload,CODE_AT_LINE);
+			int64 progressTotal = totalBytes;
+			int64 progressReceived = receivedBytes;
+			safeMutexProgress.ReleaseLock();
+			callback->ContentTransfer_Progress(item, progressTotal, progressReceived);
+		}
+		if(done == false) {
+			sleep(25);
+		}
+	}
+	for(unsigned int index = 0; index < streams.size(); ++index) {
+		shutdownTransferThread(streams[index]);
+	}
+	streams.clear();
+
+	MutexSafeWrapper safeMutexResult(&mutexDownload,CODE_AT_LINE);
+	if(aborted == false && (pendingChunks.empty() == false || activeChunks > 0)) {
+		aborted = true;
+		lastError = "lost the connection to " + serverUrl + ":" + intToStr(portNumber) +
+					", the download continues where it stopped next time";
+	}
+	return (aborted == false);
+}
+
+}}//end namespace
@@ -259,9 +259,19 @@ FTPClientThread::FTPClientThread(int portNumber, string serverUrl,
     this->fileArchiveExtractCommandSuccessResult = fileArchiveExtractCommandSuccessResult;
     this->tempFilesPath = tempFilesPath;
 
+    this->contentTransferPort = 0;
+    this->contentTransferStreams = ContentTransferClient::defaultStreamCount;
+    this->contentTransferItemName = "";
+    this->contentTransferType = ftp_cct_File;
+
     if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line %d] Using FTP port #: %d, serverUrl [%s]\n",__FILE__,__FUNCTION__,__LINE__,portNumber,serverUrl.c_str());
 }
 
+void FTPClientThread::setContentTransfer(int portNumber, int streamCount) {
+	this->contentTransferPort = portNumber;
+	this->contentTransferStreams = streamCount;
+}
+
 void FTPClientThread::signalQuit() {
     if(SystemFlags::VERBOSE_MODE_ENABLED) printf("===> FTP Client: signalQuit\n");
     if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"===> FTP Client: signalQuit\n");
@@ -277,6 +287,63 @@ bool FTPClientThread::shutdownAndWait() {
 }
 
 
+// Downloads an item from the server's content transfer service, a FAIL
+// result means the service or the item is not there and ftp can be tried,
+// PARTIALFAIL that the transfer broke off and continues on the next try
+pair<FTP_Client_ResultType,string> FTPClientThread::getContentFromServer(FTP_Client_CallbackType downloadType,
+		string itemName, string root, string item, string destPath) {
+	pair<FTP_Client_ResultType,string> result = make_pair(ftp_crt_FAIL,"");
+	if(this->contentTransferPort <= 0 || destPath == "") {
+		return result;
+	}
+
+	this->contentTransferItemName = itemName;
+	this->contentTransferType = downloadType;
+
+	ContentTransferClient client(this->serverUrl, this->contentTransferPort, this->contentTransferStreams);
+	client.setCallbackObject(this);
+
+	if(client.download(root, item, destPath) == true) {
+		result.first = ftp_crt_SUCCESS;
+	}
+	else {
+		result.second = client.getLastError();
+		if(client.getTransferStarted() == true) {
+			result.first = ftp_crt_PARTIALFAIL;
+		}
+	}
+
+    if(SystemFlags::VERBOSE_MODE_ENABLED) printf("===> Content transfer of [%s] into [%s] result = %d [%s]\n",item.c_str(),destPath.c_str(),result.first,result.second.c_str());
+    if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"===> Content transfer of [%s] into [%s] result = %d [%s]\n",item.c_str(),destPath.c_str(),result.first,result.second.c_str());
+	return result;
+}
+
+void FTPClientThread::ContentTransfer_Progress(const string &itemName, int64 totalBytes, int64 receivedBytes) {
+	if(this->pCBObject == NULL) {
+		return;
+	}
+    FTPClientCallbackInterface::FtpProgressStats stats;
+    stats.download_total   = (double)totalBytes;
+    stats.download_now     = (double)receivedBytes;
+    stats.upload_total     = 0;
+    stats.upload_now       = 0;
+    stats.currentFilename  = this->contentTransferItemName;
+    stats.downloadType     = this->contentTransferType;
+
+    static string mutexOwnerId = string(__FILE__) + string("_") + intToStr(__LINE__);
+    MutexSafeWrapper safeMutex(this->getProgressMutex(),mutexOwnerId);
+    this->getProgressMutex()->setOwnerId(mutexOwnerId);
+    this->pCBObject->FTPClient_CallbackEvent(
+    		this->contentTransferItemName,
+    		ftp_cct_DownloadProgress,
+    		make_pair(ftp_crt_SUCCESS,""),
+    		&stats);
+}
+
+bool FTPClientThread::ContentTransfer_IsCancelled() {
+	return this->getQuitStatus();
+}
+
 pair<FTP_Client_ResultType,string> FTPClientThread::getMapFromServer(pair<string,string> mapFileName, string ftpUser, string ftpUserPassword) {
 	pair<FTP_Client_ResultType,string> result = make_pair(ftp_crt_FAIL,"");
 
@@ -376,6 +443,16 @@ void FTPClientThread::getMapFromServer(pair<string,string> mapFileName) {
 		result = getMapFromServer(mapFileName, "", "");
 	}
 	else {
+		string destFolder = this->mapsPath.second;
+		endPathWithSlash(destFolder);
+		result = getContentFromServer(ftp_cct_Map, mapFileName.first, "maps",
+				mapFileName.first + ".mgm", destFolder + mapFileName.first + ".mgm");
+		if(result.first == ftp_crt_FAIL && this->getQuitStatus() == false) {
+			result = getContentFromServer(ftp_cct_Map, mapFileName.first, "maps",
+					mapFileName.first + ".gbm", destFolder + mapFileName.first + ".gbm");
+		}
+	}
+	if(mapFileName.second == "" && result.first == ftp_crt_FAIL && this->getQuitStatus() == false) {
 		pair<string,string> findMapFileName = mapFileName;
 		findMapFileName.first += + ".mgm";
 
@@ -470,11 +547,19 @@ void FTPClientThread::addTempFileToRequests(string fileName,string URL) {
 }
 
 void FTPClientThread::getTilesetFromServer(pair<string,string> tileSetName) {
-	bool findArchive = executeShellCommand(
+	pair<FTP_Client_ResultType,string> result = make_pair(ftp_crt_FAIL,"");
+	if(tileSetName.second == "") {
+		string destFolder = this->tilesetsPath.second;
+		endPathWithSlash(destFolder);
+		result = getContentFromServer(ftp_cct_Tileset, tileSetName.first, "tilesets",
+				tileSetName.first, destFolder + tileSetName.first);
+	}
+
+	bool findArchive = (result.first == ftp_crt_FAIL && this->getQuitStatus() == false &&
+			executeShellCommand(
 			this->fileArchiveExtractCommand,
-			this->fileArchiveExtractCommandSuccessResult);
+			this->fileArchiveExtractCommandSuccessResult));
 
-	pair<FTP_Client_ResultType,string> result = make_pair(ftp_crt_FAIL,"");
 	if(findArchive == true) {
 		if(tileSetName.second != "") {
 			//result = getTilesetFromServer(tileSetName, "", "", "", findArchive);
@@ -660,9 +745,17 @@ pair<FTP_Client_ResultType,string> FTPClientThread::getTilesetFromServer(
 
 void FTPClientThread::getTechtreeFromServer(pair<string,string> techtreeName) {
 	pair<FTP_Client_ResultType,string> result = make_pair(ftp_crt_FAIL,"");
-	bool findArchive = executeShellCommand(
+	if(techtreeName.second == "") {
+		string destFolder = this->techtreesPath.second;
+		endPathWithSlash(destFolder);
+		result = getContentFromServer(ftp_cct_Techtree, techtreeName.first, "techs",
+				techtreeName.first, destFolder + techtreeName.first);
+	}
+
+	bool findArchive = (result.first == ftp_crt_FAIL && this->getQuitStatus() == false &&
+			executeShellCommand(
 			this->fileArchiveExtractCommand,
-			this->fileArchiveExtractCommandSuccessResult);
+			this->fileArchiveExtractCommandSuccessResult));
 	if(findArchive == true) {
 		if(techtreeName.second != "") {
 			result = getTechtreeFromServer(techtreeName, "", "");
@@ -20,6 +20,9 @@
 #if defined(HAVE_SYS_FILIO_H) /* needed for FIONREAD on Solaris 2.5 */
   #include <sys/filio.h>
 #endif
+#if defined(__linux__)
+  #include <sys/epoll.h>
+#endif
 
 #include "conversion.h"
 #include "util.h"
@@ -47,6 +50,7 @@
   #include <netinet/in.h>
   #include <net/if.h>
   #include <netinet/tcp.h>
+  #include <sys/time.h>
 #endif
 
 
@@ -69,6 +73,12 @@ bool Socket::disableNagle = false;
 int Socket::DEFAULT_SOCKET_SENDBUF_SIZE = -1;
 int Socket::DEFAULT_SOCKET_RECVBUF_SIZE = -1;
 
+bool Socket::ioStatsEnabled = false;
+static Mutex mutexSocketIOStats;
+static int64 socketIOStatCalls[Socket::siostCount];
+static int64 socketIOStatBytes[Socket::siostCount];
+static int64 socketIOStatMicros[Socket::siostCount];
+
 int Socket::broadcast_portno    = 61357;
 int ServerSocket::ftpServerPort = 61358;
 int ServerSocket::maxPlayerCount = -1;
@@ -807,6 +817,8 @@ Socket::Socket(PLATFORM_SOCKET sock) {
 	this->sock= sock;
 	this->isSocketBlocking = true;
 	this->connectedIpAddress = "";
+	this->receiveBufferBegin = 0;
+	this->receiveBufferEnd = 0;
 }
 
 Socket::Socket() {
@@ -827,6 +839,8 @@ Socket::Socket() {
 	//this->pingThread = NULL;
 
 	this->connectedIpAddress = "";
+	this->receiveBufferBegin = 0;
+	this->receiveBufferEnd = 0;
 
 	sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if(isSocketValid() == false) {
@@ -981,6 +995,9 @@ void Socket::disconnectSocket() {
         sock = INVALID_SOCKET;
 #endif
         }
+        // whatever was read ahead goes away with the connection
+        receiveBufferBegin = 0;
+        receiveBufferEnd = 0;
         safeMutex.ReleaseLock();
         safeMutex1.ReleaseLock();
     }
@@ -1053,6 +1070,9 @@ bool Socket::hasDataToRead(std::map<PLATFORM_SOCKET,bool> &socketTriggeredList)
 bool Socket::hasDataToRead()
 {
 	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	if(receiveBufferEnd > receiveBufferBegin) {
+		return true;
+	}
     return Socket::hasDataToRead(sock) ;
 }
 
@@ -1096,6 +1116,9 @@ bool Socket::hasDataToRead(PLATFORM_SOCKET socket)
 
 bool Socket::hasDataToReadWithWait(int waitMicroseconds) {
 	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	if(receiveBufferEnd > receiveBufferBegin) {
+		return true;
+	}
     return Socket::hasDataToReadWithWait(sock,waitMicroseconds) ;
 }
 
@@ -1143,6 +1166,12 @@ bool Socket::hasDataToReadWithWait(PLATFORM_SOCKET socket,int waitMicroseconds)
 int Socket::getDataToRead(bool wantImmediateReply) {
 	unsigned long size = 0;
 
+	// don't wait for more when there is buffered data already
+	int bufferedDataSize = getBufferedDataSize();
+	if(bufferedDataSize > 0) {
+		wantImmediateReply = true;
+	}
+
     //fd_set rfds;
     //struct timeval tv;
     //int retval;
@@ -1203,7 +1232,7 @@ int Socket::getDataToRead(bool wantImmediateReply) {
     	}
     }
 
-	return static_cast<int>(size);
+	return static_cast<int>(size) + bufferedDataSize;
 }
 
 int Socket::send(const void *data, int dataSize) {
@@ -1224,11 +1253,13 @@ int Socket::send(const void *data, int dataSize) {
 		MutexSafeWrapper safeMutex(dataSynchAccessorWrite,CODE_AT_LINE);
 
 		if(isSocketValid() == true)	{
+			int64 ioStartMicros = getIOStatsStartMicros();
 #ifdef __APPLE__
         bytesSent = ::send(sock, (const char *)data, dataSize, SO_NOSIGPIPE);
 #else
         bytesSent = ::send(sock, (const char *)data, dataSize, MSG_NOSIGNAL | MSG_DONTWAIT);
 #endif
+			addIOStats(siostSend, bytesSent, ioStartMicros);
 		}
         safeMutex.ReleaseLock();
 	}
@@ -1268,13 +1299,14 @@ int Socket::send(const void *data, int dataSize) {
 //	        	inSocketDestructorSynchAccessor->setOwnerId(CODE_AT_LINE);
 //	        	safeMutexSocketDestructorFlag.ReleaseLock();
 
-
+				int64 ioStartMicros = getIOStatsStartMicros();
 #ifdef __APPLE__
                 bytesSent = ::send(sock, (const char *)data, dataSize, SO_NOSIGPIPE);
 #else
                 bytesSent = ::send(sock, (const char *)data, dataSize, MSG_NOSIGNAL | MSG_DONTWAIT);
 #endif
 				lastSocketError = getLastSocketError();
+				addIOStats(siostSend, bytesSent, ioStartMicros);
                 if(bytesSent < 0 && lastSocketError != PLATFORM_SOCKET_TRY_AGAIN) {
                     break;
                 }
@@ -1331,12 +1363,14 @@ int Socket::send(const void *data, int dataSize) {
 
 
 	        	const char *sendBuf = (const char *)data;
+	        	int64 ioStartMicros = getIOStatsStartMicros();
 #ifdef __APPLE__
 			    bytesSent = ::send(sock, &sendBuf[totalBytesSent], dataSize - totalBytesSent, SO_NOSIGPIPE);
 #else
 			    bytesSent = ::send(sock, &sendBuf[totalBytesSent], dataSize - totalBytesSent, MSG_NOSIGNAL | MSG_DONTWAIT);
 #endif
 				lastSocketError = getLastSocketError();
+				addIOStats(siostSend, bytesSent, ioStartMicros);
                 if(bytesSent > 0) {
                 	totalBytesSent += bytesSent;
                 }
@@ -1382,6 +1416,13 @@ int Socket::send(const void *data, int dataSize) {
 }
 
 int Socket::receive(void *data, int dataSize, bool tryReceiveUntilDataSizeMet) {
+	if(receiveBuffer.empty() == false) {
+		int bufferedBytes = receiveBuffered(reinterpret_cast<char *>(data), dataSize, tryReceiveUntilDataSizeMet);
+		if(bufferedBytes != 0) {
+			return bufferedBytes;
+		}
+	}
+
 	ssize_t bytesReceived = 0;
 
 	if(isSocketValid() == true)	{
@@ -1395,7 +1436,9 @@ int Socket::receive(void *data, int dataSize, bool tryReceiveUntilDataSizeMet) {
 
 		MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
 		if(isSocketValid() == true)	{
+			int64 ioStartMicros = getIOStatsStartMicros();
 			bytesReceived = recv(sock, reinterpret_cast<char*>(data), dataSize, 0);
+			addIOStats(siostRecv, bytesReceived, ioStartMicros);
 		}
 	    safeMutex.ReleaseLock();
 	}
@@ -1427,8 +1470,10 @@ int Socket::receive(void *data, int dataSize, bool tryReceiveUntilDataSizeMet) {
 //	        	safeMutexSocketDestructorFlag.ReleaseLock();
 
 	        	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	        	int64 ioStartMicros = getIOStatsStartMicros();
                 bytesReceived = recv(sock, reinterpret_cast<char*>(data), dataSize, 0);
 				lastSocketError = getLastSocketError();
+				addIOStats(siostRecv, bytesReceived, ioStartMicros);
                 safeMutex.ReleaseLock();
 
                 if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] #2 EAGAIN during receive, trying again returned: %d\n",__FILE__,__FUNCTION__,__LINE__,bytesReceived);
@@ -1471,6 +1516,220 @@ int Socket::receive(void *data, int dataSize, bool tryReceiveUntilDataSizeMet) {
 	return static_cast<int>(bytesReceived);
 }
 
+void Socket::setReceiveBufferSize(int size) {
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	if(receiveBufferEnd > receiveBufferBegin) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] receive buffer still holds %d bytes, size not changed\n",__FILE__,__FUNCTION__,__LINE__,receiveBufferEnd - receiveBufferBegin);
+		return;
+	}
+	std::vector<char>(size > 0 ? size : 0).swap(receiveBuffer);
+	receiveBufferBegin = 0;
+	receiveBufferEnd = 0;
+}
+
+int Socket::getBufferedDataSize() {
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	return receiveBufferEnd - receiveBufferBegin;
+}
+
+int Socket::peekBufferedData(void *data, int dataSize) {
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	int bytesAvailable = min(receiveBufferEnd - receiveBufferBegin, dataSize);
+	if(bytesAvailable > 0) {
+		memcpy(data, &receiveBuffer[receiveBufferBegin], bytesAvailable);
+	}
+	return max(bytesAvailable,0);
+}
+
+bool Socket::readAvailableData() {
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	if(receiveBuffer.empty() == true || isSocketValid() == false) {
+		return isSocketValid();
+	}
+
+	if(receiveBufferBegin > 0) {
+		memmove(&receiveBuffer[0], &receiveBuffer[receiveBufferBegin], receiveBufferEnd - receiveBufferBegin);
+		receiveBufferEnd -= receiveBufferBegin;
+		receiveBufferBegin = 0;
+	}
+
+	// a full buffer is left for the reader to drain, whatever is still
+	// waiting stays in the socket until then
+	while(receiveBufferEnd < (int)receiveBuffer.size()) {
+		int64 ioStartMicros = getIOStatsStartMicros();
+		ssize_t bytesReceived = recv(sock, &receiveBuffer[receiveBufferEnd], (int)receiveBuffer.size() - receiveBufferEnd, MSG_DONTWAIT);
+		int lastSocketError = getLastSocketError();
+		addIOStats(siostRecv, bytesReceived, ioStartMicros);
+		if(bytesReceived > 0) {
+			receiveBufferEnd += (int)bytesReceived;
+			continue;
+		}
+		if(bytesReceived < 0 && lastSocketError == PLATFORM_SOCKET_TRY_AGAIN) {
+			break;
+		}
+		safeMutex.ReleaseLock();
+
+		disconnectSocket();
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"[%s::%s Line: %d] DISCONNECTED SOCKET error while reading available socket data, bytesReceived = %d, error = %s\n",__FILE__,__FUNCTION__,__LINE__,(int)bytesReceived,getLastSocketErrorFormattedText(&lastSocketError).c_str());
+		return false;
+	}
+	return true;
+}
+
+// Reads until at least minimumSize bytes are buffered, waiting for the rest
+// of a message up to three seconds like receive() does. The socket is
+// disconnected if that fails.
+bool Socket::fillReceiveBuffer(int minimumSize) {
+	const int MAX_RECV_WAIT_SECONDS = 3;
+	time_t tStartTimer = time(NULL);
+	for(;;) {
+		MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+		if(receiveBufferEnd - receiveBufferBegin >= minimumSize) {
+			return true;
+		}
+		if(isSocketValid() == false) {
+			return false;
+		}
+
+		// move what is left of a partly read message to the front so
+		// one recv can take everything that is waiting
+		if(receiveBufferBegin > 0) {
+			memmove(&receiveBuffer[0], &receiveBuffer[receiveBufferBegin], receiveBufferEnd - receiveBufferBegin);
+			receiveBufferEnd -= receiveBufferBegin;
+			receiveBufferBegin = 0;
+		}
+
+		int64 ioStartMicros = getIOStatsStartMicros();
+		ssize_t bytesReceived = recv(sock, &receiveBuffer[receiveBufferEnd], (int)receiveBuffer.size() - receiveBufferEnd, MSG_DONTWAIT);
+		int lastSocketError = getLastSocketError();
+		addIOStats(siostRecv, bytesReceived, ioStartMicros);
+		if(bytesReceived > 0) {
+			receiveBufferEnd += (int)bytesReceived;
+			continue;
+		}
+		safeMutex.ReleaseLock();
+
+		if(bytesReceived < 0 && lastSocketError == PLATFORM_SOCKET_TRY_AGAIN &&
+			difftime((long int)time(NULL),tStartTimer) <= MAX_RECV_WAIT_SECONDS &&
+			isConnected() == true) {
+			Socket::hasDataToReadWithWait(sock, 1000);
+			continue;
+		}
+
+		disconnectSocket();
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"[%s::%s Line: %d] DISCONNECTED SOCKET error while buffering socket data, bytesReceived = %d, error = %s, minimumSize = %d\n",__FILE__,__FUNCTION__,__LINE__,(int)bytesReceived,getLastSocketErrorFormattedText(&lastSocketError).c_str(),minimumSize);
+		return false;
+	}
+}
+
+// Returns 0 when the read should go to the socket directly, which is the
+// case for reads larger than the buffer once it is empty
+int Socket::receiveBuffered(char *data, int dataSize, bool tryReceiveUntilDataSizeMet) {
+	const int bufferSize = (int)receiveBuffer.size();
+	if(dataSize > bufferSize && getBufferedDataSize() == 0) {
+		return 0;
+	}
+	if(dataSize <= bufferSize &&
+		fillReceiveBuffer(tryReceiveUntilDataSizeMet == true ? dataSize : 1) == false) {
+		return -1;
+	}
+
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	int bytesReceived = min(receiveBufferEnd - receiveBufferBegin, dataSize);
+	memcpy(data, &receiveBuffer[receiveBufferBegin], bytesReceived);
+	receiveBufferBegin += bytesReceived;
+	if(receiveBufferBegin == receiveBufferEnd) {
+		receiveBufferBegin = 0;
+		receiveBufferEnd = 0;
+	}
+	safeMutex.ReleaseLock();
+	addIOStats(siostBufferedRead, bytesReceived, 0);
+
+	if(tryReceiveUntilDataSizeMet == true && bytesReceived < dataSize) {
+		int additionalBytes = receive(&data[bytesReceived], dataSize - bytesReceived, true);
+		if(additionalBytes > 0) {
+			bytesReceived += additionalBytes;
+		}
+	}
+	return bytesReceived;
+}
+
+char * Socket::receiveView(int dataSize) {
+	if(dataSize <= 0 || dataSize > getReceiveBufferSize()) {
+		return NULL;
+	}
+	if(fillReceiveBuffer(dataSize) == false) {
+		return NULL;
+	}
+
+	MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+	char *data = &receiveBuffer[receiveBufferBegin];
+	receiveBufferBegin += dataSize;
+	// the bytes stay where they are until the next read fills the buffer
+	if(receiveBufferBegin == receiveBufferEnd) {
+		receiveBufferBegin = 0;
+		receiveBufferEnd = 0;
+	}
+	safeMutex.ReleaseLock();
+	addIOStats(siostViewRead, dataSize, 0);
+	return data;
+}
+
+int64 Socket::getIOStatsStartMicros() {
+	if(ioStatsEnabled == false) {
+		return 0;
+	}
+#ifndef WIN32
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (int64)now.tv_sec * 1000000 + now.tv_usec;
+#else
+	return Chrono::getCurMillis() * 1000;
+#endif
+}
+
+void Socket::addIOStats(SocketIOStatType type, int64 bytes, int64 startMicros) {
+	if(ioStatsEnabled == false) {
+		return;
+	}
+	int64 elapsedMicros = (startMicros > 0 ? getIOStatsStartMicros() - startMicros : 0);
+
+	MutexSafeWrapper safeMutex(&mutexSocketIOStats,CODE_AT_LINE);
+	socketIOStatCalls[type]++;
+	if(bytes > 0) {
+		socketIOStatBytes[type] += bytes;
+	}
+	socketIOStatMicros[type] += elapsedMicros;
+}
+
+void Socket::resetIOStats() {
+	MutexSafeWrapper safeMutex(&mutexSocketIOStats,CODE_AT_LINE);
+	for(int type = 0; type < siostCount; ++type) {
+		socketIOStatCalls[type] = 0;
+		socketIOStatBytes[type] = 0;
+		socketIOStatMicros[type] = 0;
+	}
+}
+
+string Socket::getIOStats() {
+	const char *statNames[siostCount] = { "recv", "peek", "send", "buffered read", "in place read" };
+
+	MutexSafeWrapper safeMutex(&mutexSocketIOStats,CODE_AT_LINE);
+	string result = "";
+	for(int type = 0; type < siostCount; ++type) {
+		if(socketIOStatCalls[type] == 0) {
+			continue;
+		}
+		result += string("socket ") + statNames[type] + ": " + intToStr(socketIOStatCalls[type]) +
+				  " calls " + intToStr(socketIOStatBytes[type]) + " bytes";
+		if(type == siostRecv || type == siostPeek || type == siostSend) {
+			result += " avg usec: " + intToStr(socketIOStatMicros[type] / socketIOStatCalls[type]);
+		}
+		result += "\n";
+	}
+	return result;
+}
+
 SafeSocketBlockToggleWrapper::SafeSocketBlockToggleWrapper(Socket *socket, bool toggle) {
 	this->socket = socket;
 
@@ -1501,7 +1760,178 @@ SafeSocketBlockToggleWrapper::~SafeSocketBlockToggleWrapper() {
 	Restore();
 }
 
+// =====================================================
+//	class SocketReactor
+// =====================================================
+
+SocketReactor::SocketReactor() {
+	mutexSockets = new Mutex(CODE_AT_LINE);
+	epollDescriptor = -1;
+#if defined(__linux__)
+	epollDescriptor = epoll_create(16);
+	if(epollDescriptor < 0) {
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] epoll_create failed, error = %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,Socket::getLastSocketErrorFormattedText().c_str());
+	}
+#endif
+}
+
+SocketReactor::~SocketReactor() {
+#if defined(__linux__)
+	if(epollDescriptor >= 0) {
+		::close(epollDescriptor);
+		epollDescriptor = -1;
+	}
+#endif
+	delete mutexSockets;
+	mutexSockets = NULL;
+}
+
+bool SocketReactor::isSupported() {
+#if defined(__linux__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool SocketReactor::registerSocket(PLATFORM_SOCKET socket, bool modify) {
+#if defined(__linux__)
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+	event.data.fd = socket;
+	int result = epoll_ctl(epollDescriptor, (modify == true ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), socket, &event);
+	if(result != 0 && modify == false && errno == EEXIST) {
+		result = epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, socket, &event);
+	}
+	return (result == 0);
+#else
+	return false;
+#endif
+}
+
+bool SocketReactor::addSocket(PLATFORM_SOCKET socket) {
+	if(isValid() == false || Socket::isSocketValid(&socket) == false) {
+		return false;
+	}
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	if(registerSocket(socket, false) == false) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] could not watch socket = " PLATFORM_SOCKET_FORMAT_TYPE ", error = %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,socket,Socket::getLastSocketErrorFormattedText().c_str());
+		return false;
+	}
+	// data that came in before the socket was added has no edge left, so
+	// the first wait reports it
+	sockets[socket] = srsAdded;
+	return true;
+}
+
+void SocketReactor::removeSocket(PLATFORM_SOCKET socket) {
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	if(sockets.erase(socket) > 0) {
+#if defined(__linux__)
+		// closed sockets have already left the epoll set
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, socket, &event);
+#endif
+	}
+}
+
+bool SocketReactor::hasSocket(PLATFORM_SOCKET socket) {
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	return (sockets.find(socket) != sockets.end());
+}
+
+int SocketReactor::getSocketCount() {
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	return (int)sockets.size();
+}
+
+int SocketReactor::waitForData(std::vector<PLATFORM_SOCKET> &readyList, int waitMilliseconds) {
+	readyList.clear();
+	if(isValid() == false) {
+		return 0;
+	}
+
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	// newly added sockets are reported without waiting for an edge
+	for(std::map<PLATFORM_SOCKET,SocketReactorState>::iterator iterMap = sockets.begin();
+		iterMap != sockets.end(); ++iterMap) {
+		if(iterMap->second == srsAdded) {
+			if(Socket::hasDataToRead(iterMap->first) == true) {
+				iterMap->second = srsInFlight;
+				readyList.push_back(iterMap->first);
+			}
+			else {
+				iterMap->second = srsIdle;
+			}
+		}
+	}
+	safeMutex.ReleaseLock();
+
+#if defined(__linux__)
+	const int maxEvents = 64;
+	struct epoll_event events[maxEvents];
+	int eventCount = epoll_wait(epollDescriptor, events, maxEvents, (readyList.empty() == true ? waitMilliseconds : 0));
+	if(eventCount < 0) {
+		if(errno != EINTR) {
+			if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) SystemFlags::OutputDebug(SystemFlags::debugNetwork,"In [%s::%s Line: %d] epoll_wait failed, error = %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,Socket::getLastSocketErrorFormattedText().c_str());
+		}
+		eventCount = 0;
+	}
+
+	safeMutex.Lock();
+	for(int index = 0; index < eventCount; ++index) {
+		std::map<PLATFORM_SOCKET,SocketReactorState>::iterator iterFind = sockets.find(events[index].data.fd);
+		if(iterFind == sockets.end()) {
+			continue;
+		}
+		// hang ups are passed on as well so the owner notices the closed socket
+		if(iterFind->second == srsIdle || iterFind->second == srsAdded) {
+			iterFind->second = srsInFlight;
+			readyList.push_back(iterFind->first);
+		}
+		else {
+			iterFind->second = srsInFlightWithNewData;
+		}
+	}
+	safeMutex.ReleaseLock();
+#endif
+
+	return (int)readyList.size();
+}
+
+bool SocketReactor::setDataProcessed(PLATFORM_SOCKET socket) {
+	MutexSafeWrapper safeMutex(mutexSockets,CODE_AT_LINE);
+	std::map<PLATFORM_SOCKET,SocketReactorState>::iterator iterFind = sockets.find(socket);
+	if(iterFind == sockets.end()) {
+		return false;
+	}
+
+	// edge triggered: data left unread gives no new event, so check for it
+	// while holding the lock, data arriving after the check gives an edge
+	bool result = (iterFind->second == srsInFlightWithNewData ||
+				   Socket::hasDataToRead(socket) == true);
+	iterFind->second = (result == true ? srsInFlight : srsIdle);
+	return result;
+}
+
 int Socket::peek(void *data, int dataSize,bool mustGetData,int *pLastSocketError) {
+	// buffered data comes before anything the socket still holds, only an
+	// empty buffer asks the socket (which also notices closed connections)
+	if(receiveBuffer.empty() == false) {
+		MutexSafeWrapper safeMutex(dataSynchAccessorRead,CODE_AT_LINE);
+		int bufferedSize = receiveBufferEnd - receiveBufferBegin;
+		if(bufferedSize > 0) {
+			int peekSize = min(bufferedSize, dataSize);
+			memcpy(data, &receiveBuffer[receiveBufferBegin], peekSize);
+			if(pLastSocketError != NULL) {
+				*pLastSocketError = 0;
+			}
+			return peekSize;
+		}
+	}
+
 	Chrono chrono;
 	if(SystemFlags::getSystemSettingType(SystemFlags::debugNetwork).enabled) chrono.start();
 
@@ -1526,8 +1956,10 @@ int Socket::peek(void *data, int dataSize,bool mustGetData,int *pLastSocketError
 //			Chrono recvTimer(true);
 			SafeSocketBlockToggleWrapper safeUnblock(this, false);
 			errno = 0;
+			int64 ioStartMicros = getIOStatsStartMicros();
 			err = recv(sock, reinterpret_cast<char*>(data), dataSize, MSG_PEEK);
 			lastSocketError = getLastSocketError();
+			addIOStats(siostPeek, err, ioStartMicros);
 			if(pLastSocketError != NULL) {
 				*pLastSocketError = lastSocketError;
 			}
@@ -1590,8 +2022,10 @@ int Socket::peek(void *data, int dataSize,bool mustGetData,int *pLastSocketError
 //	        	Chrono recvTimer(true);
 	        	SafeSocketBlockToggleWrapper safeUnblock(this, false);
 	        	errno = 0;
+	        	int64 ioStartMicros = getIOStatsStartMicros();
                 err = recv(sock, reinterpret_cast<char*>(data), dataSize, MSG_PEEK);
 				lastSocketError = getLastSocketError();
+				addIOStats(siostPeek, err, ioStartMicros);
 				if(pLastSocketError != NULL) {
 					*pLastSocketError = lastSocketError;
 				}
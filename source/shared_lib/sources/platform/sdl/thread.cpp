@@ -27,6 +27,7 @@ namespace Shared { namespace Platform {
 bool Thread::enableVerboseMode = false;
 Mutex Thread::mutexthreadList;
 vector<Thread *> Thread::threadList;
+Uint32 Thread::mainThreadId = 0;
 
 auto_ptr<Mutex> Mutex::mutexMutexList(new Mutex(CODE_AT_LINE));
 vector<Mutex *> Mutex::mutexList;
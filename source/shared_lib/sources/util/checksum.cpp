@@ -13,6 +13,7 @@
 
 #include <cassert>
 #include <stdexcept>
+#include <cstring>
 #include <fcntl.h> // for open()
 
 #ifdef WIN32
@@ -25,6 +26,8 @@
 #include "platform_common.h"
 #include "conversion.h"
 #include "platform_util.h"
+#include "base_thread.h"
+#include "byte_order.h"
 #include "leak_dumper.h"
 
 using namespace std;
@@ -39,6 +42,12 @@ namespace Shared{ namespace Util{
 
 Mutex Checksum::fileListCacheSynchAccessor;
 std::map<string,uint32> Checksum::fileListCache;
+Mutex Checksum::fileIndexSynchAccessor;
+std::map<string,ChecksumFileIndexEntry> Checksum::fileIndex;
+bool Checksum::fileIndexEnabled = true;
+bool Checksum::fileIndexLoaded = false;
+int Checksum::fileIndexChangeCount = 0;
+time_t Checksum::fileIndexLastSaved = 0;
 
 unsigned int crc_table[256] =
 {
@@ -76,6 +85,373 @@ unsigned int crc_table[256] =
 	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+// crc_table followed by the seven tables slicing-by-8 needs to fold in
+// eight bytes per step
+static uint32 crc_slice_table[8][256];
+
+static void initCrcSliceTable() {
+	for(unsigned int i = 0; i < 256; ++i) {
+		crc_slice_table[0][i] = crc_table[i];
+	}
+	for(unsigned int i = 0; i < 256; ++i) {
+		for(unsigned int slice = 1; slice < 8; ++slice) {
+			uint32 crc = crc_slice_table[slice-1][i];
+			crc_slice_table[slice][i] = (crc >> 8) ^ crc_slice_table[0][crc & 0xff];
+		}
+	}
+}
+
+// The engines update the raw crc register, addBytes inverts it before and after
+typedef uint32 (*CrcUpdateFunc)(uint32 crc, const unsigned char *data, size_t size);
+
+static uint32 crcUpdateBytewise(uint32 crc, const unsigned char *data, size_t size) {
+	while (size--) {
+		crc = (crc >> 8) ^ crc_table[*data++ ^ (crc & 0xff)];
+	}
+	return crc;
+}
+
+static uint32 crcUpdateSlicingBy8(uint32 crc, const unsigned char *data, size_t size) {
+	while (size >= 8) {
+		// assembled byte by byte so it neither depends on alignment nor on
+		// the byte order of the cpu
+		uint32 one = crc ^ ( (uint32)data[0] | ((uint32)data[1] << 8) |
+							((uint32)data[2] << 16) | ((uint32)data[3] << 24));
+		uint32 two = (uint32)data[4] | ((uint32)data[5] << 8) |
+					((uint32)data[6] << 16) | ((uint32)data[7] << 24);
+		crc = 	crc_slice_table[7][one & 0xff] ^
+				crc_slice_table[6][(one >> 8) & 0xff] ^
+				crc_slice_table[5][(one >> 16) & 0xff] ^
+				crc_slice_table[4][one >> 24] ^
+				crc_slice_table[3][two & 0xff] ^
+				crc_slice_table[2][(two >> 8) & 0xff] ^
+				crc_slice_table[1][(two >> 16) & 0xff] ^
+				crc_slice_table[0][two >> 24];
+		data += 8;
+		size -= 8;
+	}
+	return crcUpdateBytewise(crc, data, size);
+}
+
+#if (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__i386__))
+	#define CHECKSUM_HAVE_PCLMUL
+	#define CHECKSUM_PCLMUL_TARGET __attribute__((target("pclmul,sse2")))
+	#include <cpuid.h>
+	#include <immintrin.h>
+#elif defined(_MSC_VER) && _MSC_VER >= 1600 && (defined(_M_X64) || defined(_M_IX86))
+	#define CHECKSUM_HAVE_PCLMUL
+	#define CHECKSUM_PCLMUL_TARGET
+	#include <intrin.h>
+	#include <wmmintrin.h>
+#endif
+
+#ifdef CHECKSUM_HAVE_PCLMUL
+
+static bool isPclmulCpu() {
+	unsigned int ecx = 0;
+#if defined(_MSC_VER)
+	int info[4] = { 0, 0, 0, 0 };
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+#else
+	unsigned int eax = 0, ebx = 0, edx = 0;
+	if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+		return false;
+	}
+#endif
+	const unsigned int pclmulBit = (1 << 1);
+	return (ecx & pclmulBit) != 0;
+}
+
+// Carry-less multiplication folding from Intel's "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ Instruction" with the bit reflected
+// constants of the CRC32 polynomial. Needs size >= 64 and a multiple of 16.
+CHECKSUM_PCLMUL_TARGET
+static uint32 crcUpdatePclmulBlocks(uint32 crc, const unsigned char *data, size_t size) {
+	static const uint64 k1k2[2] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64 k3k4[2] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64 k5k0[2] = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64 poly[2] = { 0x01db710641ULL, 0x01f7011641ULL };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+	x0 = _mm_loadu_si128((const __m128i *)k1k2);
+	data += 64;
+	size -= 64;
+
+	// fold four 128 bit lanes in parallel
+	while (size >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		data += 64;
+		size -= 64;
+	}
+
+	// fold the four lanes into one
+	x0 = _mm_loadu_si128((const __m128i *)k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// remaining 16 byte blocks
+	while (size >= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)data);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		data += 16;
+		size -= 16;
+	}
+
+	// 128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_loadu_si128((const __m128i *)poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return (uint32)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static uint32 crcUpdatePclmul(uint32 crc, const unsigned char *data, size_t size) {
+	if(size >= 64) {
+		size_t blockSize = size & ~(size_t)15;
+		crc = crcUpdatePclmulBlocks(crc, data, blockSize);
+		data += blockSize;
+		size -= blockSize;
+	}
+	return crcUpdateSlicingBy8(crc, data, size);
+}
+
+#endif
+
+static CrcUpdateFunc getCrcUpdateFunc(ChecksumCrcEngine engine) {
+	switch(engine) {
+		case crcEngineBytewise:
+			return &crcUpdateBytewise;
+		case crcEngineSlicingBy8:
+			return &crcUpdateSlicingBy8;
+#ifdef CHECKSUM_HAVE_PCLMUL
+		case crcEnginePclmul:
+			return &crcUpdatePclmul;
+#endif
+		default:
+			break;
+	}
+	return NULL;
+}
+
+static CrcUpdateFunc getBestCrcUpdateFunc() {
+#ifdef CHECKSUM_HAVE_PCLMUL
+	if(isPclmulCpu() == true) {
+		return &crcUpdatePclmul;
+	}
+#endif
+	return &crcUpdateSlicingBy8;
+}
+
+// starts out bytewise so checksums built during static initialization
+// of other files are still right
+static CrcUpdateFunc crcUpdate = &crcUpdateBytewise;
+
+static bool initCrcEngine() {
+	initCrcSliceTable();
+	crcUpdate = getBestCrcUpdateFunc();
+	return true;
+}
+static const bool crcEngineReady = initCrcEngine();
+
+ChecksumCrcEngine Checksum::crcEngine = crcEngineAuto;
+int Checksum::fileHashThreadCount = -1;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CHECKSUM_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+// =====================================================
+//	class XmlChecksumFilter
+//
+///	Drops the formatting whitespace and the comments of an xml file before
+///	it goes into the checksum. The file can be passed in chunks of any
+///	size, the result is the same as filtering the whole file at once.
+// =====================================================
+
+class XmlChecksumFilter {
+private:
+	// bytes the filter has to look at, everything else is kept as is
+	static bool specialByte[256];
+	static bool specialByteReady;
+
+	uint64 fileSize;
+	uint64 filePos;
+	bool inCommentTag;
+	// last two bytes before the current chunk, [0] is the one right before it
+	char lastBytes[2];
+	vector<char> kept;
+
+	static bool initSpecialBytes() {
+		memset(specialByte, 0, sizeof(specialByte));
+		specialByte[(unsigned char)' '] = true;
+		specialByte[(unsigned char)'\t'] = true;
+		specialByte[(unsigned char)'\n'] = true;
+		specialByte[(unsigned char)'\r'] = true;
+		specialByte[(unsigned char)'<'] = true;
+		return true;
+	}
+
+	static size_t findSpecialByte(const char *data, size_t pos, size_t end) {
+#ifdef CHECKSUM_HAVE_SSE2
+		const __m128i space = _mm_set1_epi8(' ');
+		const __m128i tab = _mm_set1_epi8('\t');
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lt = _mm_set1_epi8('<');
+		for(; pos + 16 <= end; pos += 16) {
+			__m128i bytes = _mm_loadu_si128((const __m128i *)(data + pos));
+			__m128i found = _mm_or_si128(
+								_mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+								_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, lf), _mm_cmpeq_epi8(bytes, cr)),
+								_mm_cmpeq_epi8(bytes, lt)));
+			if(_mm_movemask_epi8(found) != 0) {
+				break;
+			}
+		}
+#endif
+		for(; pos < end && specialByte[(unsigned char)data[pos]] == false; ++pos) {
+		}
+		return pos;
+	}
+
+	char getByte(const char *data, size_t pos, size_t back) const {
+		return (pos >= back ? data[pos - back] : lastBytes[back - pos - 1]);
+	}
+
+public:
+	XmlChecksumFilter(uint64 fileSize) {
+		this->fileSize = fileSize;
+		filePos = 0;
+		inCommentTag = false;
+		lastBytes[0] = 0;
+		lastBytes[1] = 0;
+	}
+
+	// A comment start is only detected with three more bytes to look at, so
+	// unless this is the end of the file the last three bytes are left over.
+	// Returns how many bytes were used, the rest has to be passed again.
+	size_t filter(const char *data, size_t size, bool endOfFile, Checksum &checksum) {
+		size_t end = size;
+		if(endOfFile == false) {
+			end = (size > 3 ? size - 3 : 0);
+		}
+
+		kept.clear();
+		size_t pos = 0;
+		while(pos < end) {
+			if(inCommentTag == true) {
+				const char *commentEnd = static_cast<const char *>(memchr(data + pos, '>', end - pos));
+				if(commentEnd == NULL) {
+					pos = end;
+					break;
+				}
+				pos = commentEnd - data;
+				if(filePos + pos >= 3 && getByte(data, pos, 1) == '-' && getByte(data, pos, 2) == '-') {
+					inCommentTag = false;
+				}
+				++pos;
+				continue;
+			}
+
+			size_t runEnd = findSpecialByte(data, pos, end);
+			kept.insert(kept.end(), data + pos, data + runEnd);
+			pos = runEnd;
+			if(pos >= end) {
+				break;
+			}
+
+			if(data[pos] == '<') {
+				if(filePos + pos + 4 < fileSize && data[pos+1] == '!' && data[pos+2] == '-' && data[pos+3] == '-') {
+					inCommentTag = true;
+				}
+				else {
+					kept.push_back(data[pos]);
+				}
+			}
+			// whitespace is only for formatting
+			++pos;
+		}
+
+		if(pos >= 2) {
+			lastBytes[0] = data[pos - 1];
+			lastBytes[1] = data[pos - 2];
+		}
+		else if(pos == 1) {
+			lastBytes[1] = lastBytes[0];
+			lastBytes[0] = data[0];
+		}
+		filePos += pos;
+
+		if(kept.empty() == false) {
+			checksum.addBytes(&kept[0], kept.size());
+		}
+		return pos;
+	}
+};
+
+bool XmlChecksumFilter::specialByte[256];
+bool XmlChecksumFilter::specialByteReady = XmlChecksumFilter::initSpecialBytes();
+
 Checksum::Checksum() {
 	sum= 0;
 	r= 55665;
@@ -100,13 +476,7 @@ uint32 Checksum::addByte(const char value) {
 }
 
 uint32 Checksum::addBytes(const void *_data, size_t _size) {
-	const unsigned char *rVal = reinterpret_cast<const unsigned char *>(_data);
-	sum = ~sum;
-	while (_size--) {
-		sum = (sum >> 8) ^ crc_table[*rVal++ ^ (sum & 0xff)];
-	}
-	sum = ~sum;
-
+	sum = ~crcUpdate(~sum, reinterpret_cast<const unsigned char *>(_data), _size);
 	return sum;
 }
 
@@ -174,6 +544,15 @@ void Checksum::addFile(const string &path) {
 	}
 }
 
+// Adds the files another checksum collected, so parts loaded separately
+// end up with the same file list as when loaded into this one
+void Checksum::addFiles(const Checksum &checksum) {
+	for(std::map<string,uint32>::const_iterator iterMap = checksum.fileList.begin();
+		iterMap != checksum.fileList.end(); ++iterMap) {
+		fileList[iterMap->first] = 0;
+	}
+}
+
 bool Checksum::addFileToSum(const string &path) {
 
 // OLD SLOW FILE I/O
@@ -301,55 +680,48 @@ bool Checksum::addFileToSum(const string &path) {
 		std::streamoff size=ifs.tellg();
 		ifs.seekg(0, ios::beg);
 
-		unsigned int bufSize = (unsigned int)size / sizeof(char);
-		// Create a vector to store the data
-		std::vector<char> buf(bufSize);
-		// Load the data
-		ifs.read((char*)&buf[0], buf.size());
-
-		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] buf.size() = %d, path [%s], isXMLFile = %d\n",__FILE__,__FUNCTION__,__LINE__,buf.size(), path.c_str(),isXMLFile);
-
-		if(isXMLFile == true) {
-			bool inCommentTag=false;
-			for(std::size_t i = 0; i < buf.size(); ++i) {
-				// Ignore Spaces in XML files as they are
-				// ONLY for formatting
-				//if(isXMLFile == true) {
-					if(inCommentTag == true) {
-						if(buf[i] == '>' && i >= 3 && buf[i-1] == '-' && buf[i-2] == '-') {
-							inCommentTag = false;
-							//printf("TURNING OFF comment TAG, i = %d [%c]",i,buf[i]);
-							if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] i = %d\n",__FILE__,__FUNCTION__,__LINE__,i);
-						}
-						else {
-							//printf("SKIPPING XML comment character, i = %d [%c]",i,buf[i]);
-							if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] i = %d\n",__FILE__,__FUNCTION__,__LINE__,i);
-						}
-						continue;
-					}
-					//else if(buf[i] == '-' && i >= 4 && buf[i-1] == '-' && buf[i-2] == '!' && buf[i-3] == '<') {
-					else if(buf[i] == '<' && i+4 < bufSize && buf[i+1] == '!' && buf[i+2] == '-' && buf[i+3] == '-') {
-						inCommentTag = true;
-						//printf("TURNING ON comment TAG, i = %d [%c]",i,buf[i]);
-						if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] i = %d\n",__FILE__,__FUNCTION__,__LINE__,i);
-						continue;
-					}
-					else if(buf[i] == ' ' || buf[i] == '\t' || buf[i] == '\n' || buf[i] == '\r') {
-						//printf("SKIPPING special character, i = %d [%c]",i,buf[i]);
-						if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] i = %d\n",__FILE__,__FUNCTION__,__LINE__,i);
-						continue;
-					}
-				//}
-				uint32 cipher = addByte(buf[i]);
-
-				if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] %d / %d, cipher = %u\n",__FILE__,__FUNCTION__,__LINE__,i,buf.size(), cipher);
+		// The sum always covers exactly the file length. When fewer bytes
+		// can be read (text mode line ending conversion) the rest counts
+		// as zeros, the same as the old whole file buffer did.
+		uint64 fileSize = (size > 0 ? (uint64)size : 0);
+		uint64 remainingBytes = fileSize;
+
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] fileSize = " MG_I64U_SPECIFIER ", path [%s], isXMLFile = %d\n",__FILE__,__FUNCTION__,__LINE__,fileSize, path.c_str(),isXMLFile);
+
+		const size_t chunkSize = 64 * 1024;
+		std::vector<char> buf(chunkSize);
+		XmlChecksumFilter xmlFilter(fileSize);
+		size_t leftOver = 0;
+		for(bool endOfFile = false; endOfFile == false;) {
+			size_t readSize = buf.size() - leftOver;
+			if(readSize > remainingBytes) {
+				readSize = (size_t)remainingBytes;
+			}
+			if(readSize > 0) {
+				ifs.read(&buf[leftOver], readSize);
+				size_t readBytes = (size_t)ifs.gcount();
+				if(readBytes < readSize) {
+					memset(&buf[leftOver + readBytes], 0, readSize - readBytes);
+				}
+			}
+			remainingBytes -= readSize;
+			endOfFile = (remainingBytes == 0);
+
+			size_t bufferedBytes = leftOver + readSize;
+			if(isXMLFile == true) {
+				size_t usedBytes = xmlFilter.filter(&buf[0], bufferedBytes, endOfFile, *this);
+				leftOver = bufferedBytes - usedBytes;
+				if(leftOver > 0) {
+					memmove(&buf[0], &buf[usedBytes], leftOver);
+				}
+			}
+			else if(bufferedBytes > 0) {
+				addBytes(&buf[0], bufferedBytes);
 			}
-		}
-		else {
-			uint32 cipher = addBytes(&buf[0],buf.size());
-			if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] %d, cipher = %u\n",__FILE__,__FUNCTION__,__LINE__,buf.size(), cipher);
 		}
 
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] path [%s], cipher = %u\n",__FILE__,__FUNCTION__,__LINE__,path.c_str(), sum);
+
 		// Close the file
 		ifs.close();
     }
@@ -362,11 +734,440 @@ bool Checksum::addFileToSum(const string &path) {
     return fileExists;
 }
 
+// =====================================================
+//	class ChecksumFileHashJob
+//
+///	Files of a file list that are not in the cache yet, shared by the
+///	threads hashing them. Each sum has a fixed slot so the result does not
+///	depend on which thread hashed which file.
+// =====================================================
+
+class ChecksumFileHashJob {
+public:
+	vector<string> paths;
+	vector<uint32> sums;
+	unsigned int nextPath;
+	string error;
+	Mutex mutex;
+	Semaphore semThreadDone;
+
+	ChecksumFileHashJob() : mutex(CODE_AT_LINE) {
+		nextPath = 0;
+	}
+
+	bool hashNextFile() {
+		unsigned int index = 0;
+		{
+			MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+			if(nextPath >= (unsigned int)paths.size() || error != "") {
+				return false;
+			}
+			index = nextPath++;
+		}
+		sums[index] = Checksum::getFileSum(paths[index]);
+		return true;
+	}
+
+	void setError(const string &value) {
+		MutexSafeWrapper safeMutex(&mutex,CODE_AT_LINE);
+		error = value;
+	}
+};
+
+// =====================================================
+//	class ChecksumFileHashThread
+// =====================================================
+
+class ChecksumFileHashThread : public BaseThread {
+protected:
+	ChecksumFileHashJob *job;
+
+public:
+	ChecksumFileHashThread(ChecksumFileHashJob *job) : BaseThread() {
+		this->job = job;
+		uniqueID = "ChecksumFileHashThread";
+	}
+
+	virtual void execute() {
+		RunningStatusSafeWrapper runningStatus(this);
+		try {
+			for(;getQuitStatus() == false && job->hashNextFile() == true;) {
+			}
+		}
+		catch(const exception &ex) {
+			SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Error [%s]\n",__FILE__,__FUNCTION__,__LINE__,ex.what());
+			job->setError(ex.what());
+		}
+		job->semThreadDone.signal();
+	}
+};
+
+uint32 Checksum::getFileSum(const string &path, bool *fileExists) {
+	Checksum fileResult;
+	bool fileAddedOk = fileResult.addFileToSum(path);
+	if(fileExists != NULL) {
+		*fileExists = fileAddedOk;
+	}
+	return fileResult.getSum();
+}
+
+// Puts the sums of all files of the list that are not cached yet into the
+// cache. Files that did not change since the persistent index saw them take
+// their sum from there, the others are hashed, on several threads when
+// there is more than one of them.
+void Checksum::hashUncachedFiles() {
+	vector<string> paths;
+	{
+		MutexSafeWrapper safeMutex(&Checksum::fileListCacheSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+		for(std::map<string,uint32>::iterator iterMap = fileList.begin();
+			iterMap != fileList.end(); ++iterMap) {
+			if(Checksum::fileListCache.find(iterMap->first) == Checksum::fileListCache.end()) {
+				paths.push_back(iterMap->first);
+			}
+		}
+	}
+	if(paths.empty() == true) {
+		return;
+	}
+
+	// fingerprints are taken before hashing, a file changing while it is
+	// hashed then just gets hashed again next time
+	vector<ChecksumFileIndexEntry> fingerprints;
+	vector<bool> hasFingerprint;
+	time_t fingerprintTime = time(NULL);
+	if(fileIndexEnabled == true) {
+		fingerprints.resize(paths.size());
+		hasFingerprint.resize(paths.size(), false);
+		for(unsigned int index = 0; index < (unsigned int)paths.size(); ++index) {
+			hasFingerprint[index] = getFileFingerprint(paths[index], fingerprints[index]);
+		}
+	}
+
+	ChecksumFileHashJob job;
+	vector<ChecksumFileIndexEntry> jobFingerprints;
+	std::map<string,uint32> indexedSums;
+	{
+		MutexSafeWrapper safeMutex(&Checksum::fileIndexSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+		bool useIndex = (fileIndexEnabled == true && loadFileIndex() == true);
+		for(unsigned int index = 0; index < (unsigned int)paths.size(); ++index) {
+			if(useIndex == true && hasFingerprint[index] == true) {
+				std::map<string,ChecksumFileIndexEntry>::iterator iterFind = fileIndex.find(paths[index]);
+				if(iterFind != fileIndex.end() && iterFind->second.isSameFile(fingerprints[index]) == true) {
+					indexedSums[paths[index]] = iterFind->second.crc;
+					continue;
+				}
+				jobFingerprints.push_back(fingerprints[index]);
+			}
+			else {
+				// never goes into the index
+				jobFingerprints.push_back(ChecksumFileIndexEntry());
+				jobFingerprints.back().inode = (uint64)-1;
+			}
+			job.paths.push_back(paths[index]);
+		}
+	}
+	job.sums.resize(job.paths.size(), 0);
+
+	int threadCount = fileHashThreadCount;
+	if(threadCount < 0) {
+		threadCount = getCpuCount();
+	}
+	if(threadCount > (int)job.paths.size()) {
+		threadCount = (int)job.paths.size();
+	}
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] %d files from the file index, hashing %d files with %d threads\n",__FILE__,__FUNCTION__,__LINE__,(int)indexedSums.size(),(int)job.paths.size(),threadCount);
+
+	// the calling thread hashes files too
+	vector<ChecksumFileHashThread *> hashThreads;
+	for(int index = 1; index < threadCount; ++index) {
+		static string mutexOwnerId = string(extractFileFromDirectoryPath(__FILE__).c_str()) + string("_") + intToStr(__LINE__);
+		ChecksumFileHashThread *hashThread = new ChecksumFileHashThread(&job);
+		hashThread->setUniqueID(mutexOwnerId);
+		hashThread->start();
+		hashThreads.push_back(hashThread);
+	}
+
+	try {
+		for(;job.hashNextFile() == true;) {
+		}
+	}
+	catch(const exception &ex) {
+		job.setError(ex.what());
+	}
+
+	for(unsigned int index = 0; index < (unsigned int)hashThreads.size(); ++index) {
+		job.semThreadDone.waitTillSignalled();
+	}
+	for(unsigned int index = 0; index < (unsigned int)hashThreads.size(); ++index) {
+		ChecksumFileHashThread *hashThread = hashThreads[index];
+		if(hashThread->shutdownAndWait() == true) {
+			delete hashThread;
+		}
+	}
+	hashThreads.clear();
+
+	if(job.error != "") {
+		throw megaglest_runtime_error(job.error);
+	}
+
+	MutexSafeWrapper safeMutex(&Checksum::fileListCacheSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+	for(std::map<string,uint32>::iterator iterMap = indexedSums.begin();
+		iterMap != indexedSums.end(); ++iterMap) {
+		Checksum::fileListCache[iterMap->first] = iterMap->second;
+	}
+	for(unsigned int index = 0; index < (unsigned int)job.paths.size(); ++index) {
+		Checksum::fileListCache[job.paths[index]] = job.sums[index];
+	}
+	safeMutex.ReleaseLock();
+
+	if(fileIndexEnabled == true && job.paths.empty() == false) {
+		MutexSafeWrapper safeMutexIndex(&Checksum::fileIndexSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+		if(fileIndexLoaded == true) {
+			for(unsigned int index = 0; index < (unsigned int)job.paths.size(); ++index) {
+				// a file written in the same second it was hashed could change
+				// again without its times changing, those are not kept
+				const ChecksumFileIndexEntry &fingerprint = jobFingerprints[index];
+				if(fingerprint.inode != (uint64)-1 &&
+					fingerprint.modifiedTime < (int64)fingerprintTime - 1 &&
+					fingerprint.changedTime < (int64)fingerprintTime - 1) {
+					ChecksumFileIndexEntry &entry = fileIndex[job.paths[index]];
+					entry = fingerprint;
+					entry.crc = job.sums[index];
+					fileIndexChangeCount++;
+				}
+			}
+			// many small lists (one per map or per file) are hashed in a row, so
+			// the index is written at most every few seconds, saveFileIndex at
+			// shutdown writes the rest
+			const int fileIndexSaveSeconds = 10;
+			if(fileIndexChangeCount > 0 && difftime(time(NULL),fileIndexLastSaved) >= fileIndexSaveSeconds) {
+				writeFileIndex();
+			}
+		}
+	}
+}
+
+bool Checksum::getFileFingerprint(const string &path, ChecksumFileIndexEntry &entry) {
+#ifdef WIN32
+  #if defined(__MINGW32__)
+	struct _stat stbuf;
+  #else
+	struct _stat64i32 stbuf;
+  #endif
+	if(_wstat(utf8_decode(path).c_str(), &stbuf) == -1) {
+		return false;
+	}
+#else
+	struct stat stbuf;
+	if(stat(path.c_str(), &stbuf) == -1) {
+		return false;
+	}
+#endif
+	entry.size = (uint64)stbuf.st_size;
+	entry.modifiedTime = (int64)stbuf.st_mtime;
+	// the change time can not be set back by archive tools that restore
+	// the modified time of extracted files
+	entry.changedTime = (int64)stbuf.st_ctime;
+	entry.inode = (uint64)stbuf.st_ino;
+	return true;
+}
+
+string Checksum::getFileIndexPath() {
+	string cachePath = getCRCCacheFilePath();
+	if(cachePath == "") {
+		return "";
+	}
+	return cachePath + "CRC_FILE_INDEX";
+}
+
+// Layout of the index file, all values little endian:
+//	header:		char[4] id, uint32 version, uint32 entry count, uint32 path bytes
+//	entries:	uint64 size, int64 modified, int64 changed, uint64 inode,
+//				uint32 crc, uint32 path offset, uint32 path length, uint32 unused
+//	paths:		all paths one after another without terminators
+// The entries have a fixed size so the file can be used straight from memory.
+static const char fileIndexId[4] = { 'M', 'G', 'F', 'I' };
+// raise when the file sums change in any way
+static const uint32 fileIndexVersion = 1;
+static const unsigned int fileIndexHeaderSize = 16;
+static const unsigned int fileIndexEntrySize = 48;
+
+template<class T> static T readFileIndexValue(const char *data) {
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return Shared::PlatformByteOrder::fromCommonEndian(value);
+}
+
+template<class T> static void writeFileIndexValue(vector<char> &data, T value) {
+	value = Shared::PlatformByteOrder::toCommonEndian(value);
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+// Loads the index once, call with fileIndexSynchAccessor locked
+bool Checksum::loadFileIndex() {
+	if(fileIndexLoaded == true) {
+		return true;
+	}
+	string indexFile = getFileIndexPath();
+	if(indexFile == "") {
+		// the cache folder is not known yet
+		return false;
+	}
+	fileIndexLoaded = true;
+	fileIndex.clear();
+	fileIndexChangeCount = 0;
+
+	if(fileExists(indexFile) == false) {
+		return true;
+	}
+
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(indexFile).c_str(), L"rb");
+#else
+	FILE *fp = fopen(indexFile.c_str(),"rb");
+#endif
+	if(fp == NULL) {
+		return true;
+	}
+	vector<char> data;
+	char buf[64 * 1024];
+	for(size_t readBytes = 0; (readBytes = fread(buf, 1, sizeof(buf), fp)) > 0;) {
+		data.insert(data.end(), buf, buf + readBytes);
+	}
+	fclose(fp);
+
+	bool validIndex = (data.size() >= fileIndexHeaderSize && memcmp(&data[0], fileIndexId, sizeof(fileIndexId)) == 0);
+	uint32 entryCount = 0;
+	uint32 pathBytes = 0;
+	if(validIndex == true) {
+		validIndex = (readFileIndexValue<uint32>(&data[4]) == fileIndexVersion);
+		entryCount = readFileIndexValue<uint32>(&data[8]);
+		pathBytes = readFileIndexValue<uint32>(&data[12]);
+		validIndex = validIndex && ((uint64)data.size() == (uint64)fileIndexHeaderSize + (uint64)entryCount * fileIndexEntrySize + pathBytes);
+	}
+	if(validIndex == false) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] ignoring invalid file index [%s]\n",__FILE__,__FUNCTION__,__LINE__,indexFile.c_str());
+		return true;
+	}
+
+	const char *paths = &data[0] + fileIndexHeaderSize + (size_t)entryCount * fileIndexEntrySize;
+	for(uint32 index = 0; index < entryCount; ++index) {
+		const char *record = &data[0] + fileIndexHeaderSize + (size_t)index * fileIndexEntrySize;
+		uint32 pathOffset = readFileIndexValue<uint32>(record + 36);
+		uint32 pathLength = readFileIndexValue<uint32>(record + 40);
+		if((uint64)pathOffset + pathLength > pathBytes) {
+			fileIndex.clear();
+			return true;
+		}
+
+		ChecksumFileIndexEntry &entry = fileIndex[string(paths + pathOffset, pathLength)];
+		entry.size = readFileIndexValue<uint64>(record);
+		entry.modifiedTime = readFileIndexValue<int64>(record + 8);
+		entry.changedTime = readFileIndexValue<int64>(record + 16);
+		entry.inode = readFileIndexValue<uint64>(record + 24);
+		entry.crc = readFileIndexValue<uint32>(record + 32);
+	}
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] loaded %d entries from file index [%s]\n",__FILE__,__FUNCTION__,__LINE__,(int)fileIndex.size(),indexFile.c_str());
+	return true;
+}
+
+// Call with fileIndexSynchAccessor locked
+void Checksum::writeFileIndex() {
+	string indexFile = getFileIndexPath();
+	if(fileIndexLoaded == false || indexFile == "") {
+		return;
+	}
+
+	vector<char> data;
+	data.reserve(fileIndexHeaderSize + fileIndex.size() * (fileIndexEntrySize + 64));
+	data.insert(data.end(), fileIndexId, fileIndexId + sizeof(fileIndexId));
+	writeFileIndexValue<uint32>(data, fileIndexVersion);
+	writeFileIndexValue<uint32>(data, (uint32)fileIndex.size());
+	writeFileIndexValue<uint32>(data, 0);
+
+	uint32 pathOffset = 0;
+	for(std::map<string,ChecksumFileIndexEntry>::const_iterator iterMap = fileIndex.begin();
+		iterMap != fileIndex.end(); ++iterMap) {
+		const ChecksumFileIndexEntry &entry = iterMap->second;
+		writeFileIndexValue<uint64>(data, entry.size);
+		writeFileIndexValue<int64>(data, entry.modifiedTime);
+		writeFileIndexValue<int64>(data, entry.changedTime);
+		writeFileIndexValue<uint64>(data, entry.inode);
+		writeFileIndexValue<uint32>(data, entry.crc);
+		writeFileIndexValue<uint32>(data, pathOffset);
+		writeFileIndexValue<uint32>(data, (uint32)iterMap->first.size());
+		writeFileIndexValue<uint32>(data, 0);
+		pathOffset += (uint32)iterMap->first.size();
+	}
+	for(std::map<string,ChecksumFileIndexEntry>::const_iterator iterMap = fileIndex.begin();
+		iterMap != fileIndex.end(); ++iterMap) {
+		data.insert(data.end(), iterMap->first.begin(), iterMap->first.end());
+	}
+	uint32 pathBytes = Shared::PlatformByteOrder::toCommonEndian(pathOffset);
+	memcpy(&data[12], &pathBytes, sizeof(pathBytes));
+
+	// written next to the index and then moved over it so a crash never
+	// leaves half an index behind
+	string tempFile = indexFile + ".tmp";
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(tempFile).c_str(), L"wb");
+#else
+	FILE *fp = fopen(tempFile.c_str(),"wb");
+#endif
+	if(fp == NULL) {
+		return;
+	}
+	size_t writeBytes = fwrite(&data[0], 1, data.size(), fp);
+	fclose(fp);
+	if(writeBytes != data.size()) {
+		removeFile(tempFile);
+		return;
+	}
+	if(renameFile(tempFile, indexFile) == false) {
+		removeFile(indexFile);
+		renameFile(tempFile, indexFile);
+	}
+
+	fileIndexChangeCount = 0;
+	fileIndexLastSaved = time(NULL);
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] wrote %d entries to file index [%s]\n",__FILE__,__FUNCTION__,__LINE__,(int)fileIndex.size(),indexFile.c_str());
+}
+
+void Checksum::saveFileIndex() {
+	MutexSafeWrapper safeMutex(&Checksum::fileIndexSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(fileIndexChangeCount > 0) {
+		writeFileIndex();
+	}
+}
+
+// Forgets the files below a folder, for content that was removed or
+// replaced as a whole
+void Checksum::removeFolderFromFileIndex(const string &folder) {
+	MutexSafeWrapper safeMutex(&Checksum::fileIndexSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(loadFileIndex() == false || folder == "") {
+		return;
+	}
+	std::map<string,ChecksumFileIndexEntry>::iterator iterBegin = fileIndex.lower_bound(folder);
+	std::map<string,ChecksumFileIndexEntry>::iterator iterEnd = iterBegin;
+	for(; iterEnd != fileIndex.end() && StartsWith(iterEnd->first, folder) == true; ++iterEnd) {
+		fileIndexChangeCount++;
+	}
+	fileIndex.erase(iterBegin, iterEnd);
+}
+
 uint32 Checksum::getSum() {
 	//printf("Getting checksum for files [%d]\n",fileList.size());
 	if(fileList.size() > 0) {
 		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] fileList.size() = %d\n",__FILE__,__FUNCTION__,__LINE__,fileList.size());
 
+		hashUncachedFiles();
+
+		// the file sums are added in the sorted order of the list no matter
+		// which thread hashed them
 		Checksum newResult;
 
 		{
@@ -376,14 +1177,7 @@ uint32 Checksum::getSum() {
 
 			MutexSafeWrapper safeMutexSocketDestructorFlag(&Checksum::fileListCacheSynchAccessor,string(__FILE__) + "_" + intToStr(__LINE__));
 			if(Checksum::fileListCache.find(iterMap->first) == Checksum::fileListCache.end()) {
-				Checksum fileResult;
-				//bool fileAddedOk = fileResult.addFileToSum(iterMap->first);
-				fileResult.addFileToSum(iterMap->first);
-				Checksum::fileListCache[iterMap->first] = fileResult.getSum();
-				//printf("fileAddedOk = %d for file [%s] CRC [%d]\n",fileAddedOk,iterMap->first.c_str(),Checksum::fileListCache[iterMap->first]);
-			}
-			else {
-				//printf("Getting checksum from CACHE for file [%s] CRC [%d]\n",iterMap->first.c_str(),Checksum::fileListCache[iterMap->first]);
+				Checksum::fileListCache[iterMap->first] = getFileSum(iterMap->first);
 			}
 			newResult.addSum(Checksum::fileListCache[iterMap->first]);
 		}
@@ -429,4 +1223,42 @@ void Checksum::clearFileCache() {
     Checksum::fileListCache.clear();
 }
 
+void Checksum::setCrcEngine(ChecksumCrcEngine engine) {
+	if(isCrcEngineSupported(engine) == false) {
+		throw megaglest_runtime_error("CRC engine not supported on this cpu: " + getCrcEngineName(engine));
+	}
+	crcEngine = engine;
+	crcUpdate = (engine == crcEngineAuto ? getBestCrcUpdateFunc() : getCrcUpdateFunc(engine));
+}
+
+ChecksumCrcEngine Checksum::getCrcEngine() {
+	return crcEngine;
+}
+
+bool Checksum::isCrcEngineSupported(ChecksumCrcEngine engine) {
+	if(engine == crcEngineAuto) {
+		return true;
+	}
+#ifdef CHECKSUM_HAVE_PCLMUL
+	if(engine == crcEnginePclmul && isPclmulCpu() == false) {
+		return false;
+	}
+#endif
+	return (getCrcUpdateFunc(engine) != NULL);
+}
+
+string Checksum::getCrcEngineName(ChecksumCrcEngine engine) {
+	switch(engine) {
+		case crcEngineAuto:
+			return "auto";
+		case crcEngineBytewise:
+			return "bytewise";
+		case crcEngineSlicingBy8:
+			return "slicing-by-8";
+		case crcEnginePclmul:
+			return "pclmul";
+	}
+	return "unknown";
+}
+
 }}//end namespace
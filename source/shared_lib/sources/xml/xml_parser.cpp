@@ -32,8 +32,8 @@
 #include "platform_common.h"
 #include "platform_util.h"
 #include "cache_manager.h"
+#include "byte_order.h"
 
-#include "rapidxml/rapidxml_print.hpp"
 #include "leak_dumper.h"
 
 #if defined(WANT_XERCES)
@@ -339,6 +339,46 @@ XmlIoRapid::~XmlIoRapid() {
 	cleanup();
 }
 
+// Removes the comments in place, the way replaceAllBetweenTokens did on a
+// string copy of the buffer: each comment goes with the character after it
+// and a comment without an end is left alone. The terminating 0 is kept.
+static void removeXmlComments(vector<char> &buffer) {
+	static const char startToken[] = "<!--";
+	static const char endToken[] = "-->";
+	const size_t startTokenSize = sizeof(startToken) - 1;
+	const size_t endTokenSize = sizeof(endToken) - 1;
+
+	if(buffer.size() <= 1) {
+		return;
+	}
+	char *data = &buffer[0];
+	char *dataEnd = data + buffer.size() - 1;
+	char *readPos = data;
+	char *writePos = data;
+	for(;;) {
+		char *foundHere = std::search(readPos, dataEnd, startToken, startToken + startTokenSize);
+		if(foundHere == dataEnd) {
+			break;
+		}
+		char *foundHereEnd = std::search(foundHere + 1, dataEnd, endToken, endToken + endTokenSize);
+		if(foundHereEnd == dataEnd) {
+			break;
+		}
+		if(writePos != readPos) {
+			memmove(writePos, readPos, foundHere - readPos);
+		}
+		writePos += foundHere - readPos;
+		readPos = std::min(foundHereEnd + endTokenSize + 1, dataEnd);
+	}
+	if(writePos == readPos) {
+		return;
+	}
+	memmove(writePos, readPos, dataEnd - readPos);
+	writePos += dataEnd - readPos;
+	*writePos = 0;
+	buffer.resize(writePos - data + 1);
+}
+
 XmlNode *XmlIoRapid::load(const string &path, const std::map<string,string> &mapTagReplacementValues,bool noValidation,bool skipStackTrace) {
 	bool showPerfStats = SystemFlags::VERBOSE_MODE_ENABLED;
 	Chrono chrono;
@@ -346,7 +386,10 @@ XmlNode *XmlIoRapid::load(const string &path, const std::map<string,string> &map
 	if(SystemFlags::VERBOSE_MODE_ENABLED || showPerfStats) printf("Using RapidXml to load file [%s]\n",path.c_str());
 	//printf("Using RapidXml to load file [%s]\n",path.c_str());
 
-	XmlNode *rootNode = NULL;
+	XmlNode *rootNode = XmlTreeCache::loadFromActiveCache(path, mapTagReplacementValues);
+	if(rootNode != NULL) {
+		return rootNode;
+	}
 	try {
 
 		if(folderExists(path) == true) {
@@ -394,18 +437,24 @@ XmlNode *XmlIoRapid::load(const string &path, const std::map<string,string> &map
 
         if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
 
-        // This is required because rapidxml seems to choke when we load lua
-        // scenarios that have lua + xml style comments
-        replaceAllBetweenTokens(buffer, "<!--","-->", "", true);
+		if(XmlBinaryIo::isBinaryData(&buffer.front(), (size_t)file_size) == true) {
+			rootNode = XmlBinaryIo::load(&buffer.front(), (size_t)file_size, mapTagReplacementValues);
+		}
+		else {
+			// This is required because rapidxml seems to choke when we load lua
+			// scenarios that have lua + xml style comments
+			removeXmlComments(buffer);
 
-        if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
+			if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
 
-        xml_document<> doc;
-        doc.parse<parse_no_data_nodes>(&buffer.front());
+			xml_document<> doc;
+			doc.parse<parse_no_data_nodes>(&buffer.front());
 
-        if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
+			if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
 
-		rootNode= new XmlNode(doc.first_node(),mapTagReplacementValues);
+			rootNode= new XmlNode(doc.first_node(),mapTagReplacementValues);
+			XmlTreeCache::addToActiveCache(path, doc.first_node());
+		}
 
 		if(showPerfStats) printf("In [%s::%s Line: %d] took msecs: " MG_I64_SPECIFIER "\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,chrono.getMillis());
 
@@ -441,60 +490,30 @@ void XmlIoRapid::save(const string &path, const XmlNode *node){
 			throw megaglest_runtime_error("node == NULL during save!");
 		}
 
-		xml_document<> doc;
-
-		// xml declaration
-		xml_node<>* decl = doc.allocate_node(node_declaration);
-		decl->append_attribute(doc.allocate_attribute(doc.allocate_string("version"), doc.allocate_string("1.0")));
-		decl->append_attribute(doc.allocate_attribute(doc.allocate_string("encoding"), doc.allocate_string("utf-8")));
-		decl->append_attribute(doc.allocate_attribute(doc.allocate_string("standalone"), doc.allocate_string("no")));
-		doc.append_node(decl);
-
-		// root node
-		xml_node<>* root = doc.allocate_node(node_element, doc.allocate_string(node->getName().c_str()));
-		for(unsigned int i = 0; i < node->getAttributeCount() ; ++i){
-			XmlAttribute *attr = node->getAttribute(i);
-			root->append_attribute(doc.allocate_attribute(
-					doc.allocate_string(attr->getName().c_str()),
-					doc.allocate_string(attr->getValue("",false).c_str())));
-		}
-		doc.append_node(root);
-
-		// child nodes
-		for(unsigned int i = 0; i < node->getChildCount(); ++i) {
-			root->append_node(node->getChild(i)->buildElement(&doc));
-		}
-
-//		std::string xml_as_string;
-//		// watch for name collisions here, print() is a very common function name!
-//		print(std::back_inserter(xml_as_string), doc);
-//		// xml_as_string now contains the XML in string form, indented
-//		// (in all its angle bracket glory)
-//
-//		std::string xml_no_indent;
-//		// print_no_indenting is the only flag that print() knows about
-//		print(std::back_inserter(xml_no_indent), doc, print_no_indenting);
-//		// xml_no_indent now contains non-indented XML
-
-#if defined(WIN32) && !defined(__MINGW32__)
+		// written straight from the nodes, building a rapidxml document
+		// first would copy the whole tree once more
+#ifdef WIN32
 		FILE *fp = _wfopen(utf8_decode(path).c_str(), L"wb");
-		ofstream xmlFile(fp);
 #else
-		ofstream xmlFile(path.c_str(),ios::binary);
+		FILE *fp = fopen(path.c_str(),"wb");
 #endif
-		if(xmlFile.is_open() == false) {
+		if(fp == NULL) {
 			throw megaglest_runtime_error("Can not open file: [" + path + "]");
 		}
 
-		//xmlFile << xml_no_indent;
-//		xmlFile << xml_as_string;
-		xmlFile << doc;
-
-#if defined(WIN32) && !defined(__MINGW32__)
-		if(fp) {
+		string out = "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"no\"?>\n";
+		try {
+			XmlSaveBuffer fileBuffer(fp);
+			node->writeXml(out, &fileBuffer);
+			fileBuffer.append(out);
+		}
+		catch(...) {
 			fclose(fp);
+			throw;
+		}
+		if(fclose(fp) != 0) {
+			throw megaglest_runtime_error("Error writing file: [" + path + "]");
 		}
-#endif
 	}
 	catch(const exception &e){
 		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Exception while saving: [%s], %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,path.c_str(),e.what());
@@ -571,7 +590,11 @@ void XmlTree::load(const string &path, const std::map<string,string> &mapTagRepl
 	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("In [%s::%s Line: %d] about to load [%s]\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,path.c_str());
 }
 
-void XmlTree::save(const string &path) {
+void XmlTree::save(const string &path, XmlSaveFormat format) {
+	if(format == xsfBinary) {
+		XmlBinaryIo::save(path, rootNode);
+		return;
+	}
 
 #if defined(WANT_XERCES)
 	if(this->engine_type == XML_XERCES_ENGINE) {
@@ -606,13 +629,882 @@ XmlTree::~XmlTree() {
 	clearRootNode();
 }
 
+// =====================================================
+//	class XmlTreeCache
+// =====================================================
+
+// The cache file is the header (id, version, folder crc and the string,
+// file, node and attribute counts as uint32), the string lengths and
+// characters, per file its path string, node and attribute count and then
+// the nodes (name, text, child count, attribute count) and attributes
+// (name, value) of all files. Numbers are little endian uint32.
+const char XmlTreeCache::cacheId[4] = { 'M', 'G', 'T', 'C' };
+static const unsigned int xmlTreeCacheHeaderSize = 28;
+
+// caches XmlIoRapid::load currently serves files from
+static Mutex mutexActiveXmlTreeCaches(CODE_AT_LINE);
+static vector<XmlTreeCache *> activeXmlTreeCaches;
+
+template<class T> static T readXmlTreeCacheValue(const char *data) {
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return ::Shared::PlatformByteOrder::fromCommonEndian(value);
+}
+
+template<class T> static void writeXmlTreeCacheValue(vector<char> &data, T value) {
+	value = ::Shared::PlatformByteOrder::toCommonEndian(value);
+	const char *bytes = reinterpret_cast<const char *>(&value);
+	data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+XmlTreeCache::XmlTreeCache(const string &folder, const string &cacheFile, uint32 folderCRC) {
+	this->folder = folder;
+	this->cacheFile = cacheFile;
+	this->folderCRC = folderCRC;
+	mutexCache = new Mutex(CODE_AT_LINE);
+	changed = false;
+	hitCount = 0;
+	missCount = 0;
+}
+
+XmlTreeCache::~XmlTreeCache() {
+	setActive(false);
+	delete mutexCache;
+	mutexCache = NULL;
+}
+
+// Call with mutexCache locked
+void XmlTreeCache::clear() {
+	strings.clear();
+	stringIndexes.clear();
+	files.clear();
+	changed = false;
+}
+
+// Call with mutexCache locked
+const string *XmlTreeCache::internString(const string &value) {
+	std::map<string,uint32>::iterator iterFind = stringIndexes.find(value);
+	if(iterFind != stringIndexes.end()) {
+		return &strings[iterFind->second];
+	}
+	stringIndexes[value] = (uint32)strings.size();
+	strings.push_back(value);
+	return &strings.back();
+}
+
+bool XmlTreeCache::getRelativePath(const string &path, string &relativePath) const {
+	if(folder == "" || path.size() <= folder.size() ||
+		path.compare(0, folder.size(), folder) != 0) {
+		return false;
+	}
+	relativePath = path.substr(folder.size());
+	return true;
+}
+
+bool XmlTreeCache::load() {
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	clear();
+
+	if(fileExists(cacheFile) == false) {
+		return false;
+	}
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(cacheFile).c_str(), L"rb");
+#else
+	FILE *fp = fopen(cacheFile.c_str(),"rb");
+#endif
+	if(fp == NULL) {
+		return false;
+	}
+	// the whole file is read in one go and the strings are taken straight
+	// from that block
+	vector<char> data;
+	char buf[64 * 1024];
+	for(size_t readBytes = 0; (readBytes = fread(buf, 1, sizeof(buf), fp)) > 0;) {
+		data.insert(data.end(), buf, buf + readBytes);
+	}
+	fclose(fp);
+
+	if(data.size() < xmlTreeCacheHeaderSize || memcmp(&data[0], cacheId, sizeof(cacheId)) != 0 ||
+		readXmlTreeCacheValue<uint32>(&data[4]) != cacheVersion) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] ignoring invalid xml cache [%s]\n",__FILE__,__FUNCTION__,__LINE__,cacheFile.c_str());
+		return false;
+	}
+	if(readXmlTreeCacheValue<uint32>(&data[8]) != folderCRC) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] xml cache [%s] is outdated\n",__FILE__,__FUNCTION__,__LINE__,cacheFile.c_str());
+		return false;
+	}
+	uint32 stringCount = readXmlTreeCacheValue<uint32>(&data[12]);
+	uint32 fileCount = readXmlTreeCacheValue<uint32>(&data[16]);
+	uint32 nodeCount = readXmlTreeCacheValue<uint32>(&data[20]);
+	uint32 attributeCount = readXmlTreeCacheValue<uint32>(&data[24]);
+
+	uint64 offset = xmlTreeCacheHeaderSize;
+	uint64 stringBytes = 0;
+	if(offset + (uint64)stringCount * 4 > data.size()) {
+		return false;
+	}
+	for(uint32 index = 0; index < stringCount; ++index) {
+		stringBytes += readXmlTreeCacheValue<uint32>(&data[offset + index * 4]);
+	}
+	uint64 stringsOffset = offset + (uint64)stringCount * 4;
+	uint64 filesOffset = stringsOffset + stringBytes;
+	uint64 nodesOffset = filesOffset + (uint64)fileCount * 12;
+	uint64 attributesOffset = nodesOffset + (uint64)nodeCount * 16;
+	if(attributesOffset + (uint64)attributeCount * 8 != data.size()) {
+		return false;
+	}
+
+	for(uint32 index = 0; index < stringCount; ++index) {
+		uint32 length = readXmlTreeCacheValue<uint32>(&data[offset + index * 4]);
+		strings.push_back(string(&data[0] + stringsOffset, length));
+		stringIndexes[strings.back()] = index;
+		stringsOffset += length;
+	}
+
+	bool validCache = true;
+	uint64 nodeIndex = 0;
+	uint64 attributeIndex = 0;
+	for(uint32 fileIndex = 0; validCache == true && fileIndex < fileCount; ++fileIndex) {
+		const char *record = &data[0] + filesOffset + fileIndex * 12;
+		uint32 path = readXmlTreeCacheValue<uint32>(record);
+		uint32 fileNodes = readXmlTreeCacheValue<uint32>(record + 4);
+		uint32 fileAttributes = readXmlTreeCacheValue<uint32>(record + 8);
+		if(path >= stringCount || fileNodes == 0 ||
+			nodeIndex + fileNodes > nodeCount || attributeIndex + fileAttributes > attributeCount) {
+			validCache = false;
+			break;
+		}
+
+		CachedFile &file = files[strings[path]];
+		file.nodes.resize(fileNodes);
+		file.attributes.resize(fileAttributes);
+		// the child counts have to describe exactly one tree
+		uint64 openNodes = 1;
+		uint64 usedAttributes = 0;
+		for(uint32 index = 0; index < fileNodes; ++index, ++nodeIndex) {
+			const char *nodeRecord = &data[0] + nodesOffset + nodeIndex * 16;
+			CachedNode &node = file.nodes[index];
+			uint32 name = readXmlTreeCacheValue<uint32>(nodeRecord);
+			uint32 text = readXmlTreeCacheValue<uint32>(nodeRecord + 4);
+			node.childCount = readXmlTreeCacheValue<uint32>(nodeRecord + 8);
+			node.attributeCount = readXmlTreeCacheValue<uint32>(nodeRecord + 12);
+			usedAttributes += node.attributeCount;
+			if(openNodes == 0 || name >= stringCount || text >= stringCount) {
+				validCache = false;
+				break;
+			}
+			node.name = &strings[name];
+			node.text = &strings[text];
+			openNodes += node.childCount;
+			openNodes--;
+		}
+		if(validCache == false || openNodes != 0 || usedAttributes != fileAttributes) {
+			validCache = false;
+			break;
+		}
+		for(uint32 index = 0; index < fileAttributes; ++index, ++attributeIndex) {
+			const char *attributeRecord = &data[0] + attributesOffset + attributeIndex * 8;
+			CachedAttribute &attribute = file.attributes[index];
+			uint32 name = readXmlTreeCacheValue<uint32>(attributeRecord);
+			uint32 value = readXmlTreeCacheValue<uint32>(attributeRecord + 4);
+			if(name >= stringCount || value >= stringCount) {
+				validCache = false;
+				break;
+			}
+			attribute.name = &strings[name];
+			attribute.value = &strings[value];
+		}
+	}
+	if(validCache == false) {
+		if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] ignoring invalid xml cache [%s]\n",__FILE__,__FUNCTION__,__LINE__,cacheFile.c_str());
+		clear();
+		return false;
+	}
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] loaded %d files from xml cache [%s]\n",__FILE__,__FUNCTION__,__LINE__,(int)files.size(),cacheFile.c_str());
+	return true;
+}
+
+bool XmlTreeCache::save() {
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(changed == false) {
+		return true;
+	}
+
+	uint32 nodeCount = 0;
+	uint32 attributeCount = 0;
+	for(std::map<string,CachedFile>::iterator iterMap = files.begin();
+		iterMap != files.end(); ++iterMap) {
+		internString(iterMap->first);
+		nodeCount += (uint32)iterMap->second.nodes.size();
+		attributeCount += (uint32)iterMap->second.attributes.size();
+	}
+
+	vector<char> data;
+	data.insert(data.end(), cacheId, cacheId + sizeof(cacheId));
+	writeXmlTreeCacheValue<uint32>(data, cacheVersion);
+	writeXmlTreeCacheValue<uint32>(data, folderCRC);
+	writeXmlTreeCacheValue<uint32>(data, (uint32)strings.size());
+	writeXmlTreeCacheValue<uint32>(data, (uint32)files.size());
+	writeXmlTreeCacheValue<uint32>(data, nodeCount);
+	writeXmlTreeCacheValue<uint32>(data, attributeCount);
+
+	for(unsigned int index = 0; index < strings.size(); ++index) {
+		writeXmlTreeCacheValue<uint32>(data, (uint32)strings[index].size());
+	}
+	for(unsigned int index = 0; index < strings.size(); ++index) {
+		data.insert(data.end(), strings[index].begin(), strings[index].end());
+	}
+	for(std::map<string,CachedFile>::iterator iterMap = files.begin();
+		iterMap != files.end(); ++iterMap) {
+		writeXmlTreeCacheValue<uint32>(data, stringIndexes[iterMap->first]);
+		writeXmlTreeCacheValue<uint32>(data, (uint32)iterMap->second.nodes.size());
+		writeXmlTreeCacheValue<uint32>(data, (uint32)iterMap->second.attributes.size());
+	}
+	for(std::map<string,CachedFile>::iterator iterMap = files.begin();
+		iterMap != files.end(); ++iterMap) {
+		const vector<CachedNode> &nodes = iterMap->second.nodes;
+		for(unsigned int index = 0; index < nodes.size(); ++index) {
+			writeXmlTreeCacheValue<uint32>(data, stringIndexes[*nodes[index].name]);
+			writeXmlTreeCacheValue<uint32>(data, stringIndexes[*nodes[index].text]);
+			writeXmlTreeCacheValue<uint32>(data, nodes[index].childCount);
+			writeXmlTreeCacheValue<uint32>(data, nodes[index].attributeCount);
+		}
+	}
+	for(std::map<string,CachedFile>::iterator iterMap = files.begin();
+		iterMap != files.end(); ++iterMap) {
+		const vector<CachedAttribute> &attributes = iterMap->second.attributes;
+		for(unsigned int index = 0; index < attributes.size(); ++index) {
+			writeXmlTreeCacheValue<uint32>(data, stringIndexes[*attributes[index].name]);
+			writeXmlTreeCacheValue<uint32>(data, stringIndexes[*attributes[index].value]);
+		}
+	}
+
+	// written next to the cache and then moved over it so a crash never
+	// leaves half a cache behind
+	string tempFile = cacheFile + ".tmp";
+#ifdef WIN32
+	FILE *fp = _wfopen(utf8_decode(tempFile).c_str(), L"wb");
+#else
+	FILE *fp = fopen(tempFile.c_str(),"wb");
+#endif
+	if(fp == NULL) {
+		return false;
+	}
+	size_t writeBytes = fwrite(&data[0], 1, data.size(), fp);
+	fclose(fp);
+	if(writeBytes != data.size()) {
+		removeFile(tempFile);
+		return false;
+	}
+	if(renameFile(tempFile, cacheFile) == false) {
+		removeFile(cacheFile);
+		if(renameFile(tempFile, cacheFile) == false) {
+			removeFile(tempFile);
+			return false;
+		}
+	}
+	changed = false;
+
+	if(SystemFlags::getSystemSettingType(SystemFlags::debugSystem).enabled) SystemFlags::OutputDebug(SystemFlags::debugSystem,"In [%s::%s Line: %d] wrote %d files to xml cache [%s]\n",__FILE__,__FUNCTION__,__LINE__,(int)files.size(),cacheFile.c_str());
+	return true;
+}
+
+// Call with mutexCache locked, records the node the way XmlNode takes it
+// from rapidxml: element children only and the text of leaf elements
+void XmlTreeCache::addNode(CachedFile &file, xml_node<> *node) {
+	size_t index = file.nodes.size();
+	file.nodes.push_back(CachedNode());
+	file.nodes[index].name = internString(node->name());
+	file.nodes[index].childCount = 0;
+	file.nodes[index].attributeCount = 0;
+
+	for(xml_node<> *currentNode = node->first_node();
+			currentNode; currentNode = currentNode->next_sibling()) {
+		if(currentNode->type() == node_element) {
+			addNode(file, currentNode);
+			file.nodes[index].childCount++;
+		}
+	}
+	// attributes of a node follow those of its children, the order it is
+	// built in again
+	for(xml_attribute<> *attr = node->first_attribute();
+			attr; attr = attr->next_attribute()) {
+		CachedAttribute attribute;
+		attribute.name = internString(attr->name());
+		attribute.value = internString(attr->value());
+		file.attributes.push_back(attribute);
+		file.nodes[index].attributeCount++;
+	}
+	file.nodes[index].text = internString(file.nodes[index].childCount == 0 ? node->value() : "");
+}
+
+XmlNode *XmlTreeCache::buildNode(const CachedFile &file, size_t &nodeIndex, size_t &attributeIndex,
+		const std::map<string,string> *tagValues) {
+	const CachedNode &cachedNode = file.nodes[nodeIndex++];
+	XmlNode *node = new XmlNode(*cachedNode.name);
+
+	node->children.reserve(cachedNode.childCount);
+	for(uint32 index = 0; index < cachedNode.childCount; ++index) {
+		node->children.push_back(buildNode(file, nodeIndex, attributeIndex, tagValues));
+	}
+
+	node->attributes.reserve(cachedNode.attributeCount);
+	for(uint32 index = 0; index < cachedNode.attributeCount; ++index) {
+		const CachedAttribute &attribute = file.attributes[attributeIndex++];
+		node->attributes.push_back(new XmlAttribute(*attribute.name, *attribute.value, tagValues));
+	}
+
+	if(cachedNode.childCount == 0) {
+		node->text = *cachedNode.text;
+		node->pendingTagValues = tagValues;
+	}
+	return node;
+}
+
+XmlNode *XmlTreeCache::loadFile(const string &path, const std::map<string,string> &mapTagReplacementValues) {
+	string relativePath;
+	if(getRelativePath(path, relativePath) == false) {
+		return NULL;
+	}
+
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	std::map<string,CachedFile>::const_iterator iterFind = files.find(relativePath);
+	if(iterFind == files.end()) {
+		missCount++;
+		return NULL;
+	}
+	hitCount++;
+	// entries and the strings they point to are never changed once added,
+	// so the nodes can be built without holding up the other loading threads
+	const CachedFile &file = iterFind->second;
+	safeMutex.ReleaseLock();
+
+	// the tags are replaced as for a parsed tree, with one copy of the
+	// values kept by the root node
+	std::map<string,string> *tagValues = new std::map<string,string>(mapTagReplacementValues);
+	size_t nodeIndex = 0;
+	size_t attributeIndex = 0;
+	XmlNode *rootNode = buildNode(file, nodeIndex, attributeIndex, tagValues);
+	rootNode->tagValues = tagValues;
+	return rootNode;
+}
+
+void XmlTreeCache::addFile(const string &path, xml_node<> *rootNode) {
+	string relativePath;
+	if(rootNode == NULL || getRelativePath(path, relativePath) == false) {
+		return;
+	}
+
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	if(files.find(relativePath) != files.end()) {
+		return;
+	}
+	addNode(files[relativePath], rootNode);
+	changed = true;
+}
+
+void XmlTreeCache::setActive(bool value) {
+	MutexSafeWrapper safeMutex(&mutexActiveXmlTreeCaches,string(__FILE__) + "_" + intToStr(__LINE__));
+	vector<XmlTreeCache *>::iterator iterFind = find(activeXmlTreeCaches.begin(), activeXmlTreeCaches.end(), this);
+	if(value == true && iterFind == activeXmlTreeCaches.end()) {
+		activeXmlTreeCaches.push_back(this);
+	}
+	else if(value == false && iterFind != activeXmlTreeCaches.end()) {
+		activeXmlTreeCaches.erase(iterFind);
+	}
+}
+
+size_t XmlTreeCache::getFileCount() {
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	return files.size();
+}
+
+int XmlTreeCache::getHitCount() {
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	return hitCount;
+}
+
+int XmlTreeCache::getMissCount() {
+	MutexSafeWrapper safeMutex(mutexCache,string(__FILE__) + "_" + intToStr(__LINE__));
+	return missCount;
+}
+
+XmlNode *XmlTreeCache::loadFromActiveCache(const string &path, const std::map<string,string> &mapTagReplacementValues) {
+	MutexSafeWrapper safeMutex(&mutexActiveXmlTreeCaches,string(__FILE__) + "_" + intToStr(__LINE__));
+	for(unsigned int index = 0; index < activeXmlTreeCaches.size(); ++index) {
+		string relativePath;
+		if(activeXmlTreeCaches[index]->getRelativePath(path, relativePath) == true) {
+			XmlTreeCache *cache = activeXmlTreeCaches[index];
+			safeMutex.ReleaseLock();
+			return cache->loadFile(path, mapTagReplacementValues);
+		}
+	}
+	return NULL;
+}
+
+void XmlTreeCache::addToActiveCache(const string &path, xml_node<> *rootNode) {
+	MutexSafeWrapper safeMutex(&mutexActiveXmlTreeCaches,string(__FILE__) + "_" + intToStr(__LINE__));
+	for(unsigned int index = 0; index < activeXmlTreeCaches.size(); ++index) {
+		string relativePath;
+		if(activeXmlTreeCaches[index]->getRelativePath(path, relativePath) == true) {
+			XmlTreeCache *cache = activeXmlTreeCaches[index];
+			safeMutex.ReleaseLock();
+			cache->addFile(path, rootNode);
+			return;
+		}
+	}
+}
+
+// =====================================================
+//	class XmlBinaryIo
+// =====================================================
+
+// The header is the id and the version as little endian uint32, all other
+// numbers are stored 7 bits per byte with the high bit set on every byte
+// but the last.
+const char XmlBinaryIo::fileId[4] = { 'M', 'G', 'X', 'B' };
+static const unsigned int xmlBinaryHeaderSize = 8;
+
+// entries of the child list of a node
+enum XmlBinaryEntry {
+	xbeEnd		= 0,
+	xbeNode		= 1,	// the child node
+	xbeSection	= 2		// a section holding the child node
+};
+
+// kinds of attribute values
+enum XmlBinaryValue {
+	xbvString	= 0,	// string index
+	xbvInteger	= 1,	// the number, zigzag encoded
+	xbvFlags	= 2		// group size, group count and the flags as bits
+};
+
+// shorter flag lists are as small as a string index
+static const size_t xmlBinaryMinFlagCount = 16;
+
+static void appendXmlBinaryNumber(string &out, uint64 value) {
+	while(value >= 0x80) {
+		out += (char)((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += (char)value;
+}
+
+// only numbers that are written back exactly the same, without a sign or
+// leading zeros
+static bool getXmlBinaryInteger(const string &value, int64 &number) {
+	size_t start = (value.empty() == false && value[0] == '-' ? 1 : 0);
+	size_t digitCount = value.size() - start;
+	if(digitCount == 0 || digitCount > 18 ||
+		(value[start] == '0' && (digitCount > 1 || start > 0))) {
+		return false;
+	}
+	number = 0;
+	for(size_t i = start; i < value.size(); ++i) {
+		if(value[i] < '0' || value[i] > '9') {
+			return false;
+		}
+		number = number * 10 + (value[i] - '0');
+	}
+	if(start > 0) {
+		number = -number;
+	}
+	return true;
+}
+
+// lists like "0|1|0,1|1|0": 0/1 flags split by '|' into groups of the same
+// size, which are split by ','
+static bool getXmlBinaryFlags(const string &value, size_t &groupSize) {
+	if(value.size() < xmlBinaryMinFlagCount * 2 - 1 || value.size() % 2 == 0) {
+		return false;
+	}
+	size_t flagCount = (value.size() + 1) / 2;
+	size_t groupEnd = value.find(',');
+	if(groupEnd == string::npos) {
+		groupSize = flagCount;
+	}
+	else if(groupEnd % 2 == 1) {
+		groupSize = (groupEnd + 1) / 2;
+	}
+	else {
+		return false;
+	}
+	if(flagCount % groupSize != 0) {
+		return false;
+	}
+
+	size_t groupFlag = 0;
+	for(size_t i = 0; i < value.size(); i += 2) {
+		if(value[i] != '0' && value[i] != '1') {
+			return false;
+		}
+		if(++groupFlag == groupSize) {
+			groupFlag = 0;
+		}
+		if(i + 1 < value.size() && value[i + 1] != (groupFlag == 0 ? ',' : '|')) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void appendXmlBinaryValue(XmlBinarySection &section, string &out, const string &value) {
+	int64 number = 0;
+	size_t groupSize = 0;
+	if(getXmlBinaryInteger(value, number) == true) {
+		out += (char)xbvInteger;
+		appendXmlBinaryNumber(out, ((uint64)number << 1) ^ (uint64)(number >> 63));
+	}
+	else if(getXmlBinaryFlags(value, groupSize) == true) {
+		size_t flagCount = (value.size() + 1) / 2;
+		out += (char)xbvFlags;
+		appendXmlBinaryNumber(out, groupSize);
+		appendXmlBinaryNumber(out, flagCount / groupSize);
+
+		string bits((flagCount + 7) / 8, (char)0);
+		for(size_t i = 0; i < flagCount; ++i) {
+			if(value[i * 2] == '1') {
+				bits[i >> 3] |= (char)(1 << (i & 7));
+			}
+		}
+		out += bits;
+	}
+	else {
+		out += (char)xbvString;
+		appendXmlBinaryNumber(out, section.addString(value));
+	}
+}
+
+uint32 XmlBinarySection::addString(const string &value) {
+	std::map<string,uint32>::iterator iterFind = stringIndexes.find(value);
+	if(iterFind != stringIndexes.end()) {
+		return iterFind->second;
+	}
+	uint32 index = (uint32)stringIndexes.size();
+	stringIndexes[value] = index;
+	appendXmlBinaryNumber(stringData, value.size());
+	stringData += value;
+	return index;
+}
+
+// the section size, string count, strings (length and characters) and the
+// data of the section's node
+void XmlBinarySection::write(string &out, const string &head, const XmlSaveBuffer &tail, XmlSaveBuffer *sink) const {
+	string stringCount;
+	appendXmlBinaryNumber(stringCount, stringIndexes.size());
+	appendXmlBinaryNumber(out, stringCount.size() + stringData.size() + head.size() + nodeData.size() + tail.size());
+	out += stringCount;
+	out += stringData;
+	out += head;
+	if(sink != NULL) {
+		sink->append(out, true);
+	}
+	nodeData.copyTo(out, sink);
+	tail.copyTo(out, sink);
+}
+
+// =====================================================
+//	class XmlSaveBuffer
+// =====================================================
+
+XmlSaveBuffer::XmlSaveBuffer() : file(NULL), ownsFile(true), fileSize(0), memoryLimit(defaultMemoryLimit) {
+}
+
+XmlSaveBuffer::XmlSaveBuffer(FILE *outputFile) : file(outputFile), ownsFile(false), fileSize(0), memoryLimit(0) {
+}
+
+XmlSaveBuffer::~XmlSaveBuffer() {
+	if(ownsFile == true && file != NULL) {
+		fclose(file);
+	}
+	file = NULL;
+}
+
+void XmlSaveBuffer::writeFile(const char *bytes, size_t size) {
+	if(size > 0 && fwrite(bytes, 1, size, file) != size) {
+		throw megaglest_runtime_error("Error writing saved xml data");
+	}
+	fileSize += size;
+}
+
+void XmlSaveBuffer::append(string &out, bool onlyFullBlock) {
+	if(out.empty() == true || (onlyFullBlock == true && out.size() < blockSize)) {
+		return;
+	}
+	if(data.empty() == true && file != NULL) {
+		writeFile(out.data(), out.size());
+		out.clear();
+		return;
+	}
+
+	data += out;
+	out.clear();
+	if(data.size() > memoryLimit) {
+		if(file == NULL) {
+			file = tmpfile();
+		}
+		if(file == NULL) {
+			// no temporary file, the data stays in memory
+			memoryLimit = data.max_size();
+			return;
+		}
+		writeFile(data.data(), data.size());
+		string().swap(data);
+	}
+}
+
+void XmlSaveBuffer::copyTo(string &out, XmlSaveBuffer *sink) const {
+	if(ownsFile == true && file != NULL && fileSize > 0) {
+		if(fflush(file) != 0) {
+			throw megaglest_runtime_error("Error reading saved xml data");
+		}
+		rewind(file);
+
+		vector<char> block(blockSize);
+		for(uint64 remaining = fileSize; remaining > 0;) {
+			size_t readSize = (size_t)min((uint64)blockSize, remaining);
+			if(fread(&block[0], 1, readSize, file) != readSize) {
+				throw megaglest_runtime_error("Error reading saved xml data");
+			}
+			out.append(&block[0], readSize);
+			remaining -= readSize;
+			if(sink != NULL) {
+				sink->append(out, true);
+			}
+		}
+		// further appends go to the end again
+		if(fseek(file, 0, SEEK_END) != 0) {
+			throw megaglest_runtime_error("Error reading saved xml data");
+		}
+	}
+	out += data;
+	if(sink != NULL) {
+		sink->append(out, true);
+	}
+}
+
+class XmlBinaryIo::Reader {
+public:
+	const unsigned char *data;
+	size_t size;
+	size_t pos;
+
+	Reader(const char *data, size_t size, size_t pos) {
+		this->data = reinterpret_cast<const unsigned char *>(data);
+		this->size = size;
+		this->pos = pos;
+	}
+
+	size_t getRemaining() const { return size - pos; }
+
+	uint8 readByte() {
+		if(pos >= size) {
+			throw megaglest_runtime_error("Binary xml data is truncated");
+		}
+		return data[pos++];
+	}
+
+	uint64 readNumber() {
+		uint64 value = 0;
+		for(unsigned int shift = 0;; shift += 7) {
+			if(shift > 63) {
+				throw megaglest_runtime_error("Binary xml data has an invalid number");
+			}
+			uint8 byte = readByte();
+			value |= (uint64)(byte & 0x7f) << shift;
+			if((byte & 0x80) == 0) {
+				break;
+			}
+		}
+		return value;
+	}
+
+	// a count of items that take at least a byte each
+	size_t readCount() {
+		uint64 value = readNumber();
+		if(value > getRemaining()) {
+			throw megaglest_runtime_error("Binary xml data is truncated");
+		}
+		return (size_t)value;
+	}
+
+	const string &readString(const vector<string> &strings) {
+		uint64 index = readNumber();
+		if(index >= strings.size()) {
+			throw megaglest_runtime_error("Binary xml data has an invalid string index: " + uIntToStr(index));
+		}
+		return strings[(size_t)index];
+	}
+};
+
+bool XmlBinaryIo::isBinaryData(const char *data, size_t size) {
+	return (size >= xmlBinaryHeaderSize && memcmp(data, fileId, sizeof(fileId)) == 0);
+}
+
+XmlNode *XmlBinaryIo::readSection(Reader &reader, const std::map<string,string> *tagValues, int depth) {
+	size_t sectionSize = reader.readCount();
+	size_t sectionEnd = reader.pos + sectionSize;
+
+	vector<string> strings(reader.readCount());
+	for(unsigned int index = 0; index < strings.size(); ++index) {
+		size_t length = reader.readCount();
+		strings[index].assign(reinterpret_cast<const char *>(reader.data) + reader.pos, length);
+		reader.pos += length;
+	}
+
+	XmlNode *node = readNode(reader, strings, tagValues, depth);
+	if(reader.pos != sectionEnd) {
+		delete node;
+		throw megaglest_runtime_error("Binary xml section has the wrong size");
+	}
+	return node;
+}
+
+XmlNode *XmlBinaryIo::readNode(Reader &reader, const vector<string> &strings,
+		const std::map<string,string> *tagValues, int depth) {
+	if(depth > maxNodeDepth) {
+		throw megaglest_runtime_error("Binary xml data nests nodes deeper than " + intToStr(maxNodeDepth));
+	}
+	XmlNode *node = new XmlNode(reader.readString(strings));
+	try {
+		for(uint8 entry = reader.readByte(); entry != xbeEnd; entry = reader.readByte()) {
+			if(entry == xbeNode) {
+				node->children.push_back(readNode(reader, strings, tagValues, depth + 1));
+			}
+			else if(entry == xbeSection) {
+				node->children.push_back(readSection(reader, tagValues, depth + 1));
+			}
+			else {
+				throw megaglest_runtime_error("Binary xml data has an unknown entry: " + intToStr(entry));
+			}
+		}
+
+		node->text = reader.readString(strings);
+		if(node->children.empty() == true) {
+			node->pendingTagValues = tagValues;
+		}
+
+		size_t attributeCount = reader.readCount();
+		node->attributes.reserve(attributeCount);
+		for(unsigned int index = 0; index < attributeCount; ++index) {
+			const string &attributeName = reader.readString(strings);
+			string value;
+			uint8 valueKind = reader.readByte();
+			if(valueKind == xbvString) {
+				value = reader.readString(strings);
+			}
+			else if(valueKind == xbvInteger) {
+				uint64 number = reader.readNumber();
+				value = intToStr((int64)(number >> 1) ^ -(int64)(number & 1));
+			}
+			else if(valueKind == xbvFlags) {
+				uint64 groupSize = reader.readNumber();
+				uint64 groupCount = reader.readNumber();
+				uint64 maxFlagCount = (uint64)reader.getRemaining() * 8;
+				if(groupSize == 0 || groupCount == 0 || groupSize > maxFlagCount ||
+					groupCount > maxFlagCount / groupSize) {
+					throw megaglest_runtime_error("Binary xml data has an invalid flag list");
+				}
+				size_t flagCount = (size_t)(groupSize * groupCount);
+				value.assign(flagCount * 2 - 1, '|');
+				for(size_t i = (size_t)groupSize * 2 - 1; i < value.size(); i += (size_t)groupSize * 2) {
+					value[i] = ',';
+				}
+				const unsigned char *bits = reader.data + reader.pos;
+				for(size_t i = 0; i < flagCount; ++i) {
+					value[i * 2] = (char)('0' + ((bits[i >> 3] >> (i & 7)) & 1));
+				}
+				reader.pos += (flagCount + 7) / 8;
+			}
+			else {
+				throw megaglest_runtime_error("Binary xml data has an unknown value kind: " + intToStr(valueKind));
+			}
+			node->attributes.push_back(new XmlAttribute(attributeName, value, tagValues));
+		}
+	}
+	catch(...) {
+		delete node;
+		throw;
+	}
+	return node;
+}
+
+XmlNode *XmlBinaryIo::load(const char *data, size_t size, const std::map<string,string> &mapTagReplacementValues) {
+	if(isBinaryData(data, size) == false) {
+		throw megaglest_runtime_error("Not a binary xml file");
+	}
+	uint32 version = readXmlTreeCacheValue<uint32>(data + sizeof(fileId));
+	if(version != fileVersion) {
+		throw megaglest_runtime_error("Unsupported binary xml version: " + uIntToStr(version));
+	}
+
+	// one copy of the tag values for the whole tree, as for parsed xml
+	std::map<string,string> *tagValues = new std::map<string,string>(mapTagReplacementValues);
+	Reader reader(data, size, xmlBinaryHeaderSize);
+	XmlNode *rootNode = NULL;
+	try {
+		rootNode = readSection(reader, tagValues, 1);
+	}
+	catch(...) {
+		delete tagValues;
+		throw;
+	}
+	rootNode->tagValues = tagValues;
+
+	if(reader.pos != size) {
+		delete rootNode;
+		throw megaglest_runtime_error("Binary xml file has data after the root section");
+	}
+	return rootNode;
+}
+
+void XmlBinaryIo::save(const string &path, const XmlNode *node) {
+	try {
+		if(node == NULL) {
+			throw megaglest_runtime_error("node == NULL during save!");
+		}
+
+#ifdef WIN32
+		FILE *fp = _wfopen(utf8_decode(path).c_str(), L"wb");
+#else
+		FILE *fp = fopen(path.c_str(),"wb");
+#endif
+		if(fp == NULL) {
+			throw megaglest_runtime_error("Can not open file: [" + path + "]");
+		}
+
+		string out(fileId, sizeof(fileId));
+		uint32 version = fileVersion;
+		version = ::Shared::PlatformByteOrder::toCommonEndian(version);
+		out.append(reinterpret_cast<const char *>(&version), sizeof(version));
+		try {
+			XmlSaveBuffer fileBuffer(fp);
+			node->writeBinarySection(out, &fileBuffer);
+			fileBuffer.append(out);
+		}
+		catch(...) {
+			fclose(fp);
+			throw;
+		}
+		if(fclose(fp) != 0) {
+			throw megaglest_runtime_error("Error writing file: [" + path + "]");
+		}
+	}
+	catch(const exception &e){
+		SystemFlags::OutputDebug(SystemFlags::debugError,"In [%s::%s Line: %d] Exception while saving: [%s], %s\n",extractFileFromDirectoryPath(__FILE__).c_str(),__FUNCTION__,__LINE__,path.c_str(),e.what());
+		throw megaglest_runtime_error("Exception while saving [" + path + "] msg: " + e.what());
+	}
+}
+
 // =====================================================
 //	class XmlNode
 // =====================================================
 
 #if defined(WANT_XERCES)
 
-XmlNode::XmlNode(DOMNode *node, const std::map<string,string> &mapTagReplacementValues): superNode(NULL) {
+XmlNode::XmlNode(DOMNode *node, const std::map<string,string> &mapTagReplacementValues): superNode(NULL), tagValues(NULL), pendingTagValues(NULL), writtenChildren(NULL), writtenSection(NULL) {
     if(node == NULL || node->getNodeName() == NULL) {
         throw megaglest_runtime_error("XML structure seems to be corrupt!");
     }
@@ -661,15 +1553,27 @@ XmlNode::XmlNode(DOMNode *node, const std::map<string,string> &mapTagReplacement
 
 #endif
 
-XmlNode::XmlNode(xml_node<> *node, const std::map<string,string> &mapTagReplacementValues) : superNode(NULL) {
+XmlNode::XmlNode(xml_node<> *node, const std::map<string,string> &mapTagReplacementValues) : superNode(NULL), tagValues(NULL), pendingTagValues(NULL), writtenChildren(NULL), writtenSection(NULL) {
+	if(node == NULL || node->name() == NULL) {
+        throw megaglest_runtime_error("XML structure seems to be corrupt!");
+    }
+
+	// the whole tree shares this copy of the tag values
+	tagValues = new std::map<string,string>(mapTagReplacementValues);
+	init(node, tagValues);
+}
+
+XmlNode::XmlNode(xml_node<> *node, const std::map<string,string> *tagValues) : superNode(NULL), tagValues(NULL), pendingTagValues(NULL), writtenChildren(NULL), writtenSection(NULL) {
+	init(node, tagValues);
+}
+
+void XmlNode::init(xml_node<> *node, const std::map<string,string> *tagValues) {
 	if(node == NULL || node->name() == NULL) {
         throw megaglest_runtime_error("XML structure seems to be corrupt!");
     }
 
 	//get name
 	name = node->name();
-	children.reserve(1000);
-	attributes.reserve(1000);
 
 	//check document
 	if(node->type() == node_document) {
@@ -678,11 +1582,26 @@ XmlNode::XmlNode(xml_node<> *node, const std::map<string,string> &mapTagReplacem
 
 	if(SystemFlags::VERBOSE_MODE_ENABLED) printf("Found XML Node\nName [%s]\nValue [%s]\n",name.c_str(),node->value());
 
+	size_t childCount = 0;
+	for(xml_node<> *currentNode = node->first_node();
+			currentNode; currentNode = currentNode->next_sibling()) {
+		if(currentNode->type() == node_element) {
+			childCount++;
+		}
+	}
+	size_t attributeCount = 0;
+	for (xml_attribute<> *attr = node->first_attribute();
+			attr; attr = attr->next_attribute()) {
+		attributeCount++;
+	}
+	children.reserve(childCount);
+	attributes.reserve(attributeCount);
+
 	//check children
 	for(xml_node<> *currentNode = node->first_node();
 			currentNode; currentNode = currentNode->next_sibling()) {
-		if(currentNode != NULL && currentNode->type() == node_element) {
-			XmlNode *xmlNode= new XmlNode(currentNode, mapTagReplacementValues);
+		if(currentNode->type() == node_element) {
+			XmlNode *xmlNode= new XmlNode(currentNode, tagValues);
 			children.push_back(xmlNode);
 		}
     }
@@ -690,18 +1609,18 @@ XmlNode::XmlNode(xml_node<> *node, const std::map<string,string> &mapTagReplacem
 	//check attributes
 	for (xml_attribute<> *attr = node->first_attribute();
 			attr; attr = attr->next_attribute()) {
-		XmlAttribute *xmlAttribute= new XmlAttribute(attr, mapTagReplacementValues);
+		XmlAttribute *xmlAttribute= new XmlAttribute(attr->name(), attr->value(), tagValues);
 		attributes.push_back(xmlAttribute);
 	}
 
 	//get value
 	if(node->type() == node_element && children.size() == 0) {
 		text = node->value();
-		Properties::applyTagsToValue(this->text,&mapTagReplacementValues);
+		pendingTagValues = tagValues;
 	}
 }
 
-XmlNode::XmlNode(const string &name): superNode(NULL) {
+XmlNode::XmlNode(const string &name): superNode(NULL), tagValues(NULL), pendingTagValues(NULL), writtenChildren(NULL), writtenSection(NULL) {
 	this->name= name;
 }
 
@@ -714,6 +1633,22 @@ XmlNode::~XmlNode() {
 		delete attributes[i];
 	}
 	attributes.clear();
+
+	// after the nodes and attributes that point to it
+	delete tagValues;
+	tagValues = NULL;
+	delete writtenChildren;
+	writtenChildren = NULL;
+	delete writtenSection;
+	writtenSection = NULL;
+}
+
+const string &XmlNode::getText() const {
+	if(pendingTagValues != NULL) {
+		Properties::applyTagsToValue(text,pendingTagValues);
+		pendingTagValues = NULL;
+	}
+	return text;
 }
 
 XmlAttribute *XmlNode::getAttribute(unsigned int i) const {
@@ -867,6 +1802,21 @@ bool XmlNode::hasChildWithAliases(vector<string> childNameList) const {
 
 XmlNode *XmlNode::addChild(const string &name, const string text) {
 	assert(!superNode);
+	if((writtenChildren != NULL || writtenSection != NULL) && children.empty() == false) {
+		// the previous child is complete once the next one is added, past a
+		// limit the written children go to a temporary file
+		string out;
+		if(writtenSection != NULL) {
+			children.back()->writeBinary(*writtenSection, out, &writtenSection->nodeData);
+			writtenSection->nodeData.append(out);
+		}
+		else {
+			children.back()->writeXml(out, writtenChildren);
+			writtenChildren->append(out);
+		}
+		delete children.back();
+		children.pop_back();
+	}
 	XmlNode *node= new XmlNode(name);
 	node->text = text;
 	children.push_back(node);
@@ -906,6 +1856,144 @@ DOMElement *XmlNode::buildElement(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument *do
 
 #endif
 
+void XmlNode::setStreamChildren(bool value, XmlSaveFormat format) {
+	bool hasWrittenChildren = ((writtenChildren != NULL && writtenChildren->empty() == false) ||
+								(writtenSection != NULL && writtenSection->nodeData.empty() == false));
+	if(value == true && format != getStreamFormat() && hasWrittenChildren == true) {
+		throw megaglest_runtime_error("Node [" + name + "] already streamed children in another format");
+	}
+
+	if(value == true && format == xsfBinary) {
+		if(writtenSection == NULL) {
+			writtenSection = new XmlBinarySection();
+		}
+		delete writtenChildren;
+		writtenChildren = NULL;
+	}
+	else if(value == true) {
+		if(writtenChildren == NULL) {
+			writtenChildren = new XmlSaveBuffer();
+		}
+		delete writtenSection;
+		writtenSection = NULL;
+	}
+	else if(hasWrittenChildren == false) {
+		delete writtenChildren;
+		writtenChildren = NULL;
+		delete writtenSection;
+		writtenSection = NULL;
+	}
+}
+
+static void appendXmlEscaped(string &out, const string &value) {
+	for(unsigned int i = 0; i < value.size(); ++i) {
+		switch(value[i]) {
+			case '<':	out += "&lt;";		break;
+			case '>':	out += "&gt;";		break;
+			case '&':	out += "&amp;";		break;
+			case '"':	out += "&quot;";	break;
+			default:	out += value[i];	break;
+		}
+	}
+}
+
+// Writes the node the way XmlIoRapid::save wrote it through rapidxml, the
+// texts are left out, one element per line. The output goes to the sink
+// in blocks when one is given.
+void XmlNode::writeXml(string &out, XmlSaveBuffer *sink) const {
+	if(writtenSection != NULL && writtenSection->nodeData.empty() == false) {
+		throw megaglest_runtime_error("Node [" + name + "] streamed its children in binary form and can not be saved as xml");
+	}
+
+	out += '<';
+	out += name;
+	for(unsigned int i = 0; i < attributes.size(); ++i) {
+		out += ' ';
+		out += attributes[i]->getName();
+		out += "=\"";
+		appendXmlEscaped(out, attributes[i]->getValue("",false));
+		out += '"';
+	}
+	if(children.empty() == true && (writtenChildren == NULL || writtenChildren->empty() == true)) {
+		out += "/>\n";
+	}
+	else {
+		out += ">\n";
+		if(writtenChildren != NULL) {
+			writtenChildren->copyTo(out, sink);
+		}
+		for(unsigned int i = 0; i < children.size(); ++i) {
+			children[i]->writeXml(out, sink);
+		}
+		out += "</";
+		out += name;
+		out += ">\n";
+	}
+
+	if(sink != NULL) {
+		sink->append(out, true);
+	}
+}
+
+// Appends the node as an entry of the section, as a section of its own
+// when it streamed its children in binary form
+void XmlNode::writeBinary(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const {
+	if(writtenSection != NULL) {
+		out += (char)xbeSection;
+		writeBinarySection(out, sink);
+	}
+	else {
+		out += (char)xbeNode;
+		writeBinaryNode(section, out, sink);
+	}
+}
+
+void XmlNode::writeBinarySection(string &out, XmlSaveBuffer *sink) const {
+	if(writtenChildren != NULL && writtenChildren->empty() == false) {
+		throw megaglest_runtime_error("Node [" + name + "] streamed its children as xml and can not be saved in binary form");
+	}
+
+	XmlBinarySection localSection;
+	XmlBinarySection &section = (writtenSection != NULL ? *writtenSection : localSection);
+	string head;
+	appendXmlBinaryNumber(head, section.addString(name));
+
+	// the string table is only complete once the rest of the node was
+	// encoded, that part waits in its own buffer until the size is known
+	XmlSaveBuffer tail;
+	string tailOut;
+	writeBinaryNodeContent(section, tailOut, &tail);
+	tail.append(tailOut);
+	section.write(out, head, tail, sink);
+}
+
+void XmlNode::writeBinaryNode(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const {
+	if(writtenChildren != NULL && writtenChildren->empty() == false) {
+		throw megaglest_runtime_error("Node [" + name + "] streamed its children as xml and can not be saved in binary form");
+	}
+
+	appendXmlBinaryNumber(out, section.addString(name));
+	writeBinaryNodeContent(section, out, sink);
+}
+
+// the children after the streamed ones, text and attributes of the node
+void XmlNode::writeBinaryNodeContent(XmlBinarySection &section, string &out, XmlSaveBuffer *sink) const {
+	for(unsigned int i = 0; i < children.size(); ++i) {
+		children[i]->writeBinary(section, out, sink);
+	}
+	out += (char)xbeEnd;
+
+	appendXmlBinaryNumber(out, section.addString(getText()));
+	appendXmlBinaryNumber(out, attributes.size());
+	for(unsigned int i = 0; i < attributes.size(); ++i) {
+		appendXmlBinaryNumber(out, section.addString(attributes[i]->getName()));
+		appendXmlBinaryValue(section, out, attributes[i]->getValue("",false));
+	}
+	if(sink != NULL) {
+		sink->append(out, true);
+	}
+}
+
 xml_node<>* XmlNode::buildElement(xml_document<> *document) const {
 	xml_node<>* node = document->allocate_node(node_element, document->allocate_string(name.c_str()));
 
@@ -953,13 +2041,13 @@ XmlAttribute::XmlAttribute(DOMNode *attribute, const std::map<string,string> &ma
 
 	skipRestrictionCheck 			= false;
 	usesCommondata 					= false;
-	this->mapTagReplacementValues 	= mapTagReplacementValues;
+	pendingTagValues				= NULL;
 	char str[strSize]				= "";
 
 	XMLString::transcode(attribute->getNodeValue(), str, strSize-1);
 	value= str;
 	usesCommondata = ((value.find("$COMMONDATAPATH") != string::npos) || (value.find("%%COMMONDATAPATH%%") != string::npos));
-	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&this->mapTagReplacementValues);
+	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&mapTagReplacementValues);
 
 	XMLString::transcode(attribute->getNodeName(), str, strSize-1);
 	name= str;
@@ -974,15 +2062,13 @@ XmlAttribute::XmlAttribute(xml_attribute<> *attribute, const std::map<string,str
 
 	skipRestrictionCheck 			= false;
 	usesCommondata 					= false;
-	if(mapTagReplacementValues.size() > 0) {
-		this->mapTagReplacementValues 	= mapTagReplacementValues;
-	}
+	pendingTagValues				= NULL;
 	//char str[strSize]				= "";
 
 	//XMLString::transcode(attribute->getNodeValue(), str, strSize-1);
 	value= attribute->value();
 	usesCommondata = ((value.find("$COMMONDATAPATH") != string::npos) || (value.find("%%COMMONDATAPATH%%") != string::npos));
-	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&this->mapTagReplacementValues);
+	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&mapTagReplacementValues);
 
 	//XMLString::transcode(attribute->getNodeName(), str, strSize-1);
 	name= attribute->name();
@@ -991,17 +2077,33 @@ XmlAttribute::XmlAttribute(xml_attribute<> *attribute, const std::map<string,str
 XmlAttribute::XmlAttribute(const string &name, const string &value, const std::map<string,string> &mapTagReplacementValues) {
 	skipRestrictionCheck 			= false;
 	usesCommondata 					= false;
-	if(mapTagReplacementValues.size() > 0) {
-		this->mapTagReplacementValues 	= mapTagReplacementValues;
-	}
+	pendingTagValues				= NULL;
 	this->name						= name;
 	this->value						= value;
 
 	usesCommondata = ((value.find("$COMMONDATAPATH") != string::npos) || (value.find("%%COMMONDATAPATH%%") != string::npos));
-	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&this->mapTagReplacementValues);
+	skipRestrictionCheck = Properties::applyTagsToValue(this->value,&mapTagReplacementValues);
+}
+
+// The tags are replaced with the values of the tree on the first read
+XmlAttribute::XmlAttribute(const string &name, const string &value, const std::map<string,string> *tagValues) {
+	skipRestrictionCheck 			= false;
+	usesCommondata 					= false;
+	pendingTagValues				= tagValues;
+	this->name						= name;
+	this->value						= value;
+}
+
+void XmlAttribute::applyPendingTags() const {
+	if(pendingTagValues != NULL) {
+		usesCommondata = ((value.find("$COMMONDATAPATH") != string::npos) || (value.find("%%COMMONDATAPATH%%") != string::npos));
+		skipRestrictionCheck = Properties::applyTagsToValue(value,pendingTagValues);
+		pendingTagValues = NULL;
+	}
 }
 
 bool XmlAttribute::getBoolValue() const {
+	applyPendingTags();
 	if(value == "true") {
 		return true;
 	}
@@ -1014,14 +2116,17 @@ bool XmlAttribute::getBoolValue() const {
 }
 
 int XmlAttribute::getIntValue() const {
+	applyPendingTags();
 	return strToInt(value);
 }
 
 uint32 XmlAttribute::getUIntValue() const {
+	applyPendingTags();
 	return strToUInt(value);
 }
 
 int XmlAttribute::getIntValue(int min, int max) const {
+	applyPendingTags();
 	int i= strToInt(value);
 	if(i<min || i>max){
 		throw megaglest_runtime_error("Xml Attribute int out of range: " + getName() + ": " + value);
@@ -1030,10 +2135,12 @@ int XmlAttribute::getIntValue(int min, int max) const {
 }
 
 float XmlAttribute::getFloatValue() const{
+	applyPendingTags();
 	return strToFloat(value);
 }
 
 float XmlAttribute::getFloatValue(float min, float max) const{
+	applyPendingTags();
 	float f= strToFloat(value);
 	//printf("getFloatValue f = %.10f [%s]\n",f,value.c_str());
 	if(f<min || f>max){
@@ -1043,6 +2150,7 @@ float XmlAttribute::getFloatValue(float min, float max) const{
 }
 
 const string XmlAttribute::getValue(string prefixValue, bool trimValueWithStartingSlash) const {
+	applyPendingTags();
 	string result = value;
 	if(skipRestrictionCheck == false && usesCommondata == false) {
 		if(trimValueWithStartingSlash == true) {
@@ -1054,6 +2162,7 @@ const string XmlAttribute::getValue(string prefixValue, bool trimValueWithStarti
 }
 
 const string XmlAttribute::getRestrictedValue(string prefixValue, bool trimValueWithStartingSlash) const {
+	applyPendingTags();
 	if(skipRestrictionCheck == false && usesCommondata == false) {
 		const string allowedCharacters = "abcdefghijklmnopqrstuvwxyz1234567890._-/";
 
@@ -1077,6 +2186,7 @@ const string XmlAttribute::getRestrictedValue(string prefixValue, bool trimValue
 }
 
 void XmlAttribute::setValue(string val) {
+	applyPendingTags();
 	value = val;
 }
 
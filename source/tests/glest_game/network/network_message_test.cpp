@@ -0,0 +1,457 @@
+// ==============================================================
+//	This file is part of MegaGlest Unit Tests (www.megaglest.org)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "network_message.h"
+#include "byte_order.h"
+#include <cstring>
+#include <vector>
+
+using namespace Glest::Game;
+
+//
+// Tests for the intro message, peers of every version have to be able to
+// read the intro the others send before they can tell each other apart
+//
+
+// The intro as releases before NetworkMessageCapabilities put it on the
+// wire: the packed struct with little endian numbers
+enum OldIntroLayout {
+	oilMessageType		= 0,
+	oilSessionId		= 1,
+	oilVersionString	= 5,
+	oilName				= 133,
+	oilPlayerIndex		= 165,
+	oilGameState		= 167,
+	oilExternalIp		= 168,
+	oilFtpPort			= 172,
+	oilLanguage			= 176,
+	oilGameInProgress	= 236,
+	oilPlayerUUID		= 237,
+	oilPlatform			= 297,
+
+	oilSize				= 357
+};
+
+static void writeOldIntroValue(std::vector<unsigned char> &buf, int offset, uint32 value, int size) {
+	for(int index = 0; index < size; ++index) {
+		buf[offset + index] = static_cast<unsigned char>((value >> (index * 8)) & 0xFF);
+	}
+}
+
+static void writeOldIntroString(std::vector<unsigned char> &buf, int offset, const char *value) {
+	memcpy(&buf[offset], value, strlen(value));
+}
+
+static std::vector<unsigned char> createOldIntro() {
+	std::vector<unsigned char> buf(oilSize, 0);
+	writeOldIntroValue(buf, oilMessageType, nmtIntro, 1);
+	writeOldIntroValue(buf, oilSessionId, 424336, 4);
+	writeOldIntroString(buf, oilVersionString, "v3.10.0-dev-gcc-Rev: 1a8673f");
+	writeOldIntroString(buf, oilName, "player_x");
+	writeOldIntroValue(buf, oilPlayerIndex, 3, 2);
+	writeOldIntroValue(buf, oilGameState, nmgstOk, 1);
+	writeOldIntroValue(buf, oilExternalIp, 0x0A000001, 4);
+	writeOldIntroValue(buf, oilFtpPort, 61358, 4);
+	writeOldIntroString(buf, oilLanguage, "english");
+	writeOldIntroValue(buf, oilGameInProgress, 1, 1);
+	writeOldIntroString(buf, oilPlayerUUID, "a7b0c1d2-uuid");
+	writeOldIntroString(buf, oilPlatform, "Linux");
+	return buf;
+}
+
+class NetworkMessageIntroTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( NetworkMessageIntroTest );
+
+	CPPUNIT_TEST( test_old_intro_size );
+	CPPUNIT_TEST( test_decode_old_intro );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+public:
+
+	void test_old_intro_size() {
+		CPPUNIT_ASSERT_EQUAL( (size_t)oilSize, sizeof(NetworkMessageIntro::Data) );
+	}
+
+	void test_decode_old_intro() {
+		std::vector<unsigned char> buf = createOldIntro();
+
+		NetworkMessageIntro::Data data;
+		memcpy(&data, &buf[0], sizeof(data));
+		data.sessionId = Shared::PlatformByteOrder::fromCommonEndian(data.sessionId);
+		data.playerIndex = Shared::PlatformByteOrder::fromCommonEndian(data.playerIndex);
+		data.externalIp = Shared::PlatformByteOrder::fromCommonEndian(data.externalIp);
+		data.ftpPort = Shared::PlatformByteOrder::fromCommonEndian(data.ftpPort);
+
+		CPPUNIT_ASSERT_EQUAL( (int)nmtIntro, (int)data.messageType );
+		CPPUNIT_ASSERT_EQUAL( (int32)424336, data.sessionId );
+		CPPUNIT_ASSERT_EQUAL( string("v3.10.0-dev-gcc-Rev: 1a8673f"), data.versionString.getString() );
+		CPPUNIT_ASSERT_EQUAL( string("player_x"), data.name.getString() );
+		CPPUNIT_ASSERT_EQUAL( (int16)3, data.playerIndex );
+		CPPUNIT_ASSERT_EQUAL( (int)nmgstOk, (int)data.gameState );
+		CPPUNIT_ASSERT_EQUAL( (uint32)0x0A000001, data.externalIp );
+		CPPUNIT_ASSERT_EQUAL( (uint32)61358, data.ftpPort );
+		CPPUNIT_ASSERT_EQUAL( string("english"), data.language.getString() );
+		CPPUNIT_ASSERT_EQUAL( (int)1, (int)data.gameInProgress );
+		CPPUNIT_ASSERT_EQUAL( string("a7b0c1d2-uuid"), data.playerUUID.getString() );
+		CPPUNIT_ASSERT_EQUAL( string("Linux"), data.platform.getString() );
+	}
+};
+
+
+//
+// Tests for telling the size of a message from its first bytes, the server's
+// socket reactor thread only reads messages that are fully buffered
+//
+
+class NetworkMessageFramingTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( NetworkMessageFramingTest );
+
+	CPPUNIT_TEST( test_empty_needs_more_data );
+	CPPUNIT_TEST( test_compressed_envelope_size );
+	CPPUNIT_TEST( test_compact_command_list_size );
+	CPPUNIT_TEST( test_fixed_size_message );
+	CPPUNIT_TEST( test_unframed_type );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+public:
+
+	void test_empty_needs_more_data() {
+		unsigned char buf[1] = { nmtPing };
+		CPPUNIT_ASSERT_EQUAL( 0, NetworkMessage::getFramedSize(buf, 0, nclpFixedSize) );
+	}
+
+	void test_compressed_envelope_size() {
+		unsigned char buf[NetworkMessage::compressedHeaderSize] = {
+			nmtCommandList | NetworkMessage::compressedMessageFlag, nmctZlib,
+			0x00, 0x10, 0x00, 0x00,
+			0x2C, 0x01, 0x00, 0x00 };
+
+		CPPUNIT_ASSERT_EQUAL( 0, NetworkMessage::getFramedSize(buf, NetworkMessage::compressedHeaderSize - 1, nclpCompact) );
+		CPPUNIT_ASSERT_EQUAL( NetworkMessage::compressedHeaderSize + 300, NetworkMessage::getFramedSize(buf, NetworkMessage::compressedHeaderSize, nclpCompact) );
+	}
+
+	void test_compact_command_list_size() {
+		unsigned char buf[5] = { nmtCommandList, 0x14, 0x00, 0x00, 0x00 };
+		CPPUNIT_ASSERT_EQUAL( 0, NetworkMessage::getFramedSize(buf, 4, nclpCompact) );
+		CPPUNIT_ASSERT_EQUAL( 25, NetworkMessage::getFramedSize(buf, 5, nclpCompact) );
+
+		buf[1] = 0;
+		CPPUNIT_ASSERT_EQUAL( -1, NetworkMessage::getFramedSize(buf, 5, nclpCompact) );
+	}
+
+	void test_fixed_size_message() {
+		bool oldProtocol = NetworkMessage::useOldProtocol;
+		NetworkMessage::useOldProtocol = true;
+
+		unsigned char buf[1] = { nmtPing };
+		NetworkMessagePing ping;
+		int framedSize = NetworkMessage::getFramedSize(buf, 1, nclpFixedSize);
+
+		NetworkMessage::useOldProtocol = oldProtocol;
+		CPPUNIT_ASSERT_EQUAL( (int)ping.getDataSize(), framedSize );
+	}
+
+	void test_unframed_type() {
+		unsigned char buf[1] = { nmtLaunch };
+		CPPUNIT_ASSERT_EQUAL( -1, NetworkMessage::getFramedSize(buf, 1, nclpFixedSize) );
+	}
+};
+
+//
+// Tests for the compact command list format, the bytes come from a peer so
+// any buffer has to be rejected or decoded without reading past its end
+//
+
+static const int compactPrefixSize = 5;
+
+static NetworkCommand createCommand(int32 unitId, int16 positionX, int16 positionY) {
+	NetworkCommand command;
+	command.networkCommandType = nctGiveCommand;
+	command.unitId = unitId;
+	command.unitTypeId = 3;
+	command.commandTypeId = 7;
+	command.positionX = positionX;
+	command.positionY = positionY;
+	command.targetId = -1;
+	command.unitCommandGroupId = -1;
+	command.commandStateValue = -1;
+	return command;
+}
+
+static bool isSameCommand(const NetworkCommand &expected, const NetworkCommand &actual) {
+	return (expected.networkCommandType == actual.networkCommandType &&
+			expected.unitId == actual.unitId &&
+			expected.unitTypeId == actual.unitTypeId &&
+			expected.commandTypeId == actual.commandTypeId &&
+			expected.positionX == actual.positionX &&
+			expected.positionY == actual.positionY &&
+			expected.targetId == actual.targetId &&
+			expected.wantQueue == actual.wantQueue &&
+			expected.fromFactionIndex == actual.fromFactionIndex &&
+			expected.unitFactionUnitCount == actual.unitFactionUnitCount &&
+			expected.unitFactionIndex == actual.unitFactionIndex &&
+			expected.commandStateType == actual.commandStateType &&
+			expected.commandStateValue == actual.commandStateValue &&
+			expected.unitCommandGroupId == actual.unitCommandGroupId);
+}
+
+// Packs the list and unpacks it from a buffer of exactly its size
+static bool roundTrip(const NetworkMessageCommandList &message, NetworkMessageCommandList &result) {
+	std::vector<unsigned char> buf;
+	message.packCompact(buf);
+	std::vector<unsigned char> received(buf.begin(), buf.end());
+	return result.unpackCompact(&received[0], (unsigned int)received.size());
+}
+
+static bool isSameCommandList(const NetworkMessageCommandList &expected, const NetworkMessageCommandList &actual) {
+	if(expected.getFrameCount() != actual.getFrameCount() ||
+		expected.getCommandCount() != actual.getCommandCount()) {
+		return false;
+	}
+	for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+		if(expected.getNetworkPlayerFactionCRC(index) != actual.getNetworkPlayerFactionCRC(index)) {
+			return false;
+		}
+	}
+	for(int index = 0; index < expected.getCommandCount(); ++index) {
+		if(isSameCommand(*expected.getCommand(index), *actual.getCommand(index)) == false) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void setBodySize(std::vector<unsigned char> &buf) {
+	uint32 bodySize = (uint32)buf.size() - compactPrefixSize;
+	for(int byteIndex = 0; byteIndex < 4; ++byteIndex) {
+		buf[1 + byteIndex] = static_cast<unsigned char>(bodySize >> (byteIndex * 8));
+	}
+}
+
+static void unpackCopy(const std::vector<unsigned char> &buf, unsigned int size, bool &result) {
+	// a buffer of exactly the given size so reads past it are caught
+	std::vector<unsigned char> received(buf.begin(), buf.begin() + size);
+	NetworkMessageCommandList message;
+	result = message.unpackCompact(received.empty() == true ? NULL : &received[0], size);
+}
+
+class NetworkMessageCommandListCompactTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( NetworkMessageCommandListCompactTest );
+
+	CPPUNIT_TEST( test_empty_list );
+	CPPUNIT_TEST( test_max_command_count );
+	CPPUNIT_TEST( test_negative_and_large_deltas );
+	CPPUNIT_TEST( test_each_field_mask );
+	CPPUNIT_TEST( test_each_crc_mask );
+	CPPUNIT_TEST( test_truncated_buffers );
+	CPPUNIT_TEST( test_corrupted_buffers );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+public:
+
+	void test_empty_list() {
+		NetworkMessageCommandList message(42);
+		std::vector<unsigned char> buf;
+		message.packCompact(buf);
+		// type, body size, frame, command count and an empty CRC mask
+		CPPUNIT_ASSERT_EQUAL( (size_t)(compactPrefixSize + 3), buf.size() );
+
+		NetworkMessageCommandList result;
+		CPPUNIT_ASSERT( roundTrip(message, result) );
+		CPPUNIT_ASSERT( isSameCommandList(message, result) );
+		CPPUNIT_ASSERT_EQUAL( 0, result.getCommandCount() );
+	}
+
+	void test_max_command_count() {
+		NetworkMessageCommandList message(1000);
+		for(int index = 0; index < 0xffff; ++index) {
+			NetworkCommand command = createCommand(index * 3, (int16)(index % 256), (int16)(index / 256));
+			message.addCommand(&command);
+		}
+
+		NetworkMessageCommandList result;
+		CPPUNIT_ASSERT( roundTrip(message, result) );
+		CPPUNIT_ASSERT_EQUAL( 0xffff, result.getCommandCount() );
+		CPPUNIT_ASSERT( isSameCommandList(message, result) );
+	}
+
+	void test_negative_and_large_deltas() {
+		const int32 unitIds[] = { 2147483647, (-2147483647 - 1), -1, 0, 123456789, -98765, 2147483647 };
+		const int16 positions[] = { -32768, 32767, -1, 0, 32767, -32768, 1 };
+
+		NetworkMessageCommandList message(-1);
+		for(int index = 0; index < 7; ++index) {
+			NetworkCommand command = createCommand(unitIds[index], positions[index], positions[6 - index]);
+			command.targetId = unitIds[6 - index];
+			command.commandStateValue = (index % 2 == 0 ? (-2147483647 - 1) : 2147483647);
+			command.unitCommandGroupId = unitIds[index];
+			command.unitFactionUnitCount = (index % 2 == 0 ? 65535 : 0);
+			message.addCommand(&command);
+		}
+
+		NetworkMessageCommandList result;
+		CPPUNIT_ASSERT( roundTrip(message, result) );
+		CPPUNIT_ASSERT( isSameCommandList(message, result) );
+	}
+
+	void test_each_field_mask() {
+		// every command changes one more field than the one before it,
+		// ending with all of them changed at once
+		NetworkMessageCommandList message(7);
+		NetworkCommand command = createCommand(10, 5, 5);
+		message.addCommand(&command);
+		for(int fieldIndex = 0; fieldIndex < 14; ++fieldIndex) {
+			NetworkCommand next = command;
+			switch(fieldIndex) {
+				case 0:  next.networkCommandType = nctSetMeetingPoint; break;
+				case 1:  next.unitTypeId = -7; break;
+				case 2:  next.commandTypeId = 300; break;
+				case 3:  next.positionX = -200; break;
+				case 4:  next.positionY = 200; break;
+				case 5:  next.targetId = 77777; break;
+				case 6:  next.unitCommandGroupId = 12; break;
+				case 7:  next.wantQueue = 1; break;
+				case 8:  next.fromFactionIndex = 7; break;
+				case 9:  next.unitFactionUnitCount = 300; break;
+				case 10: next.unitFactionIndex = 3; break;
+				case 11: next.commandStateType = 1; break;
+				case 12: next.commandStateValue = 99; break;
+				case 13: next = createCommand(-10, -5, -5); break;
+			}
+			message.addCommand(&next);
+			command = next;
+
+			NetworkMessageCommandList result;
+			CPPUNIT_ASSERT( roundTrip(message, result) );
+			CPPUNIT_ASSERT( isSameCommandList(message, result) );
+		}
+	}
+
+	void test_each_crc_mask() {
+		for(int crcMask = 0; crcMask < (1 << GameConstants::maxPlayers); ++crcMask) {
+			NetworkMessageCommandList message(crcMask);
+			for(int index = 0; index < GameConstants::maxPlayers; ++index) {
+				if((crcMask & (1 << index)) != 0) {
+					message.setNetworkPlayerFactionCRC(index, 0xF0000000u + crcMask * 16 + index);
+				}
+			}
+			NetworkCommand command = createCommand(crcMask, 1, 2);
+			message.addCommand(&command);
+
+			NetworkMessageCommandList result;
+			CPPUNIT_ASSERT( roundTrip(message, result) );
+			CPPUNIT_ASSERT( isSameCommandList(message, result) );
+		}
+	}
+
+	void test_truncated_buffers() {
+		NetworkMessageCommandList message(5000);
+		message.setNetworkPlayerFactionCRC(2, 0x12345678);
+		for(int index = 0; index < 4; ++index) {
+			NetworkCommand command = createCommand(100000 + index, (int16)(-index), 9);
+			command.commandStateValue = 1 << (index * 8);
+			message.addCommand(&command);
+		}
+		std::vector<unsigned char> buf;
+		message.packCompact(buf);
+
+		for(unsigned int size = 0; size < buf.size(); ++size) {
+			bool result = true;
+			unpackCopy(buf, size, result);
+			CPPUNIT_ASSERT( result == false );
+
+			// with a body size that matches, so the body itself is cut short
+			if(size >= (unsigned int)compactPrefixSize) {
+				std::vector<unsigned char> truncated(buf.begin(), buf.begin() + size);
+				setBodySize(truncated);
+				unpackCopy(truncated, size, result);
+				CPPUNIT_ASSERT( result == false );
+			}
+		}
+	}
+
+	void test_corrupted_buffers() {
+		NetworkMessageCommandList message(5000);
+		message.setNetworkPlayerFactionCRC(0, 0xCAFEBABE);
+		for(int index = 0; index < 4; ++index) {
+			NetworkCommand command = createCommand(-index, (int16)(index * 1000), 9);
+			message.addCommand(&command);
+		}
+		std::vector<unsigned char> buf;
+		message.packCompact(buf);
+
+		// every byte flipped in turn, decoding may succeed but must stay
+		// within the buffer
+		for(unsigned int pos = 0; pos < buf.size(); ++pos) {
+			std::vector<unsigned char> corrupted(buf);
+			corrupted[pos] ^= 0xFF;
+			bool result = false;
+			unpackCopy(corrupted, (unsigned int)corrupted.size(), result);
+		}
+
+		// a varint that never ends
+		std::vector<unsigned char> endless(compactPrefixSize + 16, 0xFF);
+		endless[0] = nmtCommandList;
+		setBodySize(endless);
+		bool result = true;
+		unpackCopy(endless, (unsigned int)endless.size(), result);
+		CPPUNIT_ASSERT( result == false );
+
+		// more commands than there are bytes for them
+		std::vector<unsigned char> tooMany(buf.begin(), buf.begin() + compactPrefixSize);
+		tooMany.push_back(0);
+		tooMany.push_back(0xFF);
+		tooMany.push_back(0xFF);
+		tooMany.push_back(0x03);
+		tooMany.push_back(0);
+		setBodySize(tooMany);
+		unpackCopy(tooMany, (unsigned int)tooMany.size(), result);
+		CPPUNIT_ASSERT( result == false );
+
+		// a field mask with bits past the last field
+		std::vector<unsigned char> badMask(buf.begin(), buf.begin() + compactPrefixSize);
+		badMask.push_back(0);
+		badMask.push_back(1);
+		badMask.push_back(0);
+		badMask.push_back(0x80);
+		badMask.push_back(0x40);
+		badMask.push_back(0);
+		setBodySize(badMask);
+		unpackCopy(badMask, (unsigned int)badMask.size(), result);
+		CPPUNIT_ASSERT( result == false );
+
+		// bytes left over after the last command
+		std::vector<unsigned char> trailing(buf);
+		trailing.push_back(0);
+		setBodySize(trailing);
+		unpackCopy(trailing, (unsigned int)trailing.size(), result);
+		CPPUNIT_ASSERT( result == false );
+
+		// a body size that doesn't match the buffer
+		std::vector<unsigned char> wrongSize(buf);
+		wrongSize[1]++;
+		unpackCopy(wrongSize, (unsigned int)wrongSize.size(), result);
+		CPPUNIT_ASSERT( result == false );
+	}
+};
+
+// Suite registrations
+CPPUNIT_TEST_SUITE_REGISTRATION( NetworkMessageIntroTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( NetworkMessageFramingTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( NetworkMessageCommandListCompactTest );
@@ -0,0 +1,268 @@
+// ==============================================================
+//	This file is part of MegaGlest Unit Tests (www.megaglest.org)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "spectator_relay.h"
+#include "network_message.h"
+#include "byte_order.h"
+#include "platform_common.h"
+#include "platform_util.h"
+#include <fstream>
+#include <vector>
+
+using namespace Glest::Game;
+using namespace Shared::Platform;
+using namespace Shared::PlatformCommon;
+
+//
+// Tests for the spectator relay, over loopback. The tests call update()
+// themselves with the time records are released by instead of running the
+// relay thread.
+//
+
+static const int spectatorRelayTestPort = 61397;
+static const string spectatorRelayTestSavedGame = "spectator_relay_test_saved_game.xml";
+
+// stream id, version, command list protocol and delay
+static const size_t spectatorRelayHeaderSize = 13;
+// type, world frame and payload size
+static const size_t spectatorRelayRecordHeaderSize = 9;
+
+template<class T> static T readSpectatorRelayTestValue(const unsigned char *data) {
+	T value;
+	memcpy(&value, data, sizeof(T));
+	return ::Shared::PlatformByteOrder::fromCommonEndian(value);
+}
+
+// types of the complete records after the stream header
+static vector<int> getSpectatorRelayRecordTypes(const vector<unsigned char> &data) {
+	vector<int> types;
+	for(size_t pos = spectatorRelayHeaderSize; pos + spectatorRelayRecordHeaderSize <= data.size();) {
+		uint32 payloadSize = readSpectatorRelayTestValue<uint32>(&data[pos + 5]);
+		if(pos + spectatorRelayRecordHeaderSize + payloadSize > data.size()) {
+			break;
+		}
+		types.push_back(data[pos]);
+		pos += spectatorRelayRecordHeaderSize + payloadSize;
+	}
+	return types;
+}
+
+class SpectatorRelayTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( SpectatorRelayTest );
+
+	CPPUNIT_TEST( test_records_wait_for_the_delay );
+	CPPUNIT_TEST( test_slow_spectator_is_dropped );
+	CPPUNIT_TEST( test_spectators_are_removed );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+	vector<ClientSocket *> spectators;
+
+	ClientSocket *connectSpectator(SpectatorRelay &relay) {
+		ClientSocket *socket = new ClientSocket();
+		spectators.push_back(socket);
+		socket->connect(Ip("127.0.0.1"), spectatorRelayTestPort);
+		socket->setBlock(false);
+
+		int subscriberCount = relay.getSubscriberCount();
+		for(int attempt = 0; attempt < 200 && relay.getSubscriberCount() == subscriberCount; ++attempt) {
+			relay.update(Chrono::getCurMillis());
+			sleep(5);
+		}
+		return socket;
+	}
+
+	void disconnectSpectator(ClientSocket *socket) {
+		spectators.erase(std::find(spectators.begin(), spectators.end(), socket));
+		delete socket;
+	}
+
+	// reads whatever arrived, waits a little for at least minimumSize bytes
+	void receiveSpectatorData(ClientSocket *socket, vector<unsigned char> &data, size_t minimumSize=0) {
+		for(int attempt = 0; attempt < 200; ++attempt) {
+			for(int dataSize = socket->getDataToRead(); dataSize > 0; dataSize = socket->getDataToRead()) {
+				vector<unsigned char> buf(dataSize);
+				int receivedSize = socket->receive(&buf[0], dataSize, false);
+				if(receivedSize <= 0) {
+					break;
+				}
+				data.insert(data.end(), buf.begin(), buf.begin() + receivedSize);
+			}
+			if(data.size() >= minimumSize) {
+				break;
+			}
+			sleep(5);
+		}
+	}
+
+	void publishTestCommandList(SpectatorRelay &relay, int frameCount, int commandCount) {
+		NetworkMessageCommandList commandList(frameCount);
+		for(int index = 0; index < commandCount; ++index) {
+			NetworkCommand command;
+			command.networkCommandType = 1;
+			command.unitId = frameCount * commandCount + index;
+			command.positionX = (int16)(index % 128);
+			command.positionY = (int16)(frameCount % 128);
+			commandList.addCommand(&command);
+		}
+		relay.publishCommandList(&commandList);
+	}
+
+public:
+
+	void setUp() {
+		std::ofstream out(spectatorRelayTestSavedGame.c_str(), std::ios::binary);
+		out << "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"no\"?>\n<megaglest-saved-game/>\n";
+	}
+
+	void tearDown() {
+		for(unsigned int index = 0; index < spectators.size(); ++index) {
+			delete spectators[index];
+		}
+		spectators.clear();
+		removeFile(spectatorRelayTestSavedGame);
+	}
+
+	void test_records_wait_for_the_delay() {
+		const int delaySeconds = 2;
+		SpectatorRelay relay(spectatorRelayTestPort, delaySeconds, 16, false);
+		CPPUNIT_ASSERT_EQUAL( true, relay.isListening() );
+
+		ClientSocket *spectator = connectSpectator(relay);
+		CPPUNIT_ASSERT_EQUAL( 1, relay.getSubscriberCount() );
+		CPPUNIT_ASSERT_EQUAL( true, relay.getSavedGameRequested() );
+
+		int64 publishMillis = Chrono::getCurMillis();
+		relay.publishSavedGame(10, spectatorRelayTestSavedGame);
+		CPPUNIT_ASSERT_EQUAL( false, relay.getSavedGameRequested() );
+		publishTestCommandList(relay, 11, 3);
+		relay.publishGameOver(12);
+
+		// only the stream header goes out before the delay passed
+		vector<unsigned char> data;
+		receiveSpectatorData(spectator, data, spectatorRelayHeaderSize);
+		CPPUNIT_ASSERT_EQUAL( spectatorRelayHeaderSize, data.size() );
+		CPPUNIT_ASSERT_EQUAL( delaySeconds, readSpectatorRelayTestValue<int32>(&data[9]) );
+		for(int index = 0; index < 10; ++index) {
+			CPPUNIT_ASSERT_EQUAL( false, relay.update(publishMillis + delaySeconds * 1000 - 1000) );
+		}
+		receiveSpectatorData(spectator, data);
+		CPPUNIT_ASSERT_EQUAL( spectatorRelayHeaderSize, data.size() );
+
+		// then every record in order and the stream ends after game over
+		int64 releaseMillis = Chrono::getCurMillis() + delaySeconds * 1000;
+		for(int index = 0; index < 100 && relay.getSubscriberCount() > 0; ++index) {
+			relay.update(releaseMillis);
+		}
+		CPPUNIT_ASSERT_EQUAL( 0, relay.getSubscriberCount() );
+
+		vector<int> types;
+		for(int attempt = 0; attempt < 10 && types.size() < 3; ++attempt) {
+			receiveSpectatorData(spectator, data, data.size() + 1);
+			types = getSpectatorRelayRecordTypes(data);
+		}
+		CPPUNIT_ASSERT_EQUAL( (size_t)3, types.size() );
+		CPPUNIT_ASSERT_EQUAL( (int)srrtSavedGame, types[0] );
+		CPPUNIT_ASSERT_EQUAL( (int)srrtCommandList, types[1] );
+		CPPUNIT_ASSERT_EQUAL( (int)srrtGameOver, types[2] );
+	}
+
+	void test_slow_spectator_is_dropped() {
+		SpectatorRelay relay(spectatorRelayTestPort, 0, 1, false);
+		CPPUNIT_ASSERT_EQUAL( true, relay.isListening() );
+
+		// the slow spectator never reads anything
+		connectSpectator(relay);
+		ClientSocket *fastSpectator = connectSpectator(relay);
+		CPPUNIT_ASSERT_EQUAL( 2, relay.getSubscriberCount() );
+		relay.publishSavedGame(0, spectatorRelayTestSavedGame);
+
+		// once the slow spectator's socket takes no more its records pile
+		// up, it stays until they pass the limit and is then dropped
+		// while the relay keeps sending to the other one
+		vector<unsigned char> fastData;
+		bool slowSpectatorStalled = false;
+		int frameCount = 1;
+		for(;frameCount <= 5000 && relay.getSubscriberCount() == 2; ++frameCount) {
+			publishTestCommandList(relay, frameCount, 2000);
+			for(int index = 0; index < 4; ++index) {
+				relay.update(Chrono::getCurMillis());
+			}
+			receiveSpectatorData(fastSpectator, fastData);
+
+			if(relay.getSubscriberCount() == 2 && relay.getBufferedBytes() > 512 * 1024) {
+				slowSpectatorStalled = true;
+			}
+		}
+		CPPUNIT_ASSERT_EQUAL( true, slowSpectatorStalled );
+		CPPUNIT_ASSERT_EQUAL( 1, relay.getSubscriberCount() );
+
+		relay.publishGameOver(frameCount);
+		for(int index = 0; index < 1000 && relay.getSubscriberCount() > 0; ++index) {
+			relay.update(Chrono::getCurMillis());
+			receiveSpectatorData(fastSpectator, fastData);
+		}
+		CPPUNIT_ASSERT_EQUAL( 0, relay.getSubscriberCount() );
+
+		vector<int> types;
+		for(int attempt = 0; attempt < 10 && (types.empty() == true || types.back() != srrtGameOver); ++attempt) {
+			receiveSpectatorData(fastSpectator, fastData, fastData.size() + 1);
+			types = getSpectatorRelayRecordTypes(fastData);
+		}
+		CPPUNIT_ASSERT_EQUAL( (size_t)(frameCount + 1), types.size() );
+		CPPUNIT_ASSERT_EQUAL( (int)srrtSavedGame, types.front() );
+		CPPUNIT_ASSERT_EQUAL( (int)srrtGameOver, types.back() );
+		CPPUNIT_ASSERT_EQUAL( (int64)0, relay.getBufferedBytes() );
+	}
+
+	void test_spectators_are_removed() {
+		SpectatorRelay relay(spectatorRelayTestPort, 0, 16, false);
+		CPPUNIT_ASSERT_EQUAL( true, relay.isListening() );
+
+		ClientSocket *spectator1 = connectSpectator(relay);
+		ClientSocket *spectator2 = connectSpectator(relay);
+		CPPUNIT_ASSERT_EQUAL( 2, relay.getSubscriberCount() );
+
+		// a closed connection is removed without anything to send to it
+		disconnectSpectator(spectator1);
+		for(int index = 0; index < 200 && relay.getSubscriberCount() == 2; ++index) {
+			relay.update(Chrono::getCurMillis());
+			sleep(5);
+		}
+		CPPUNIT_ASSERT_EQUAL( 1, relay.getSubscriberCount() );
+
+		// nothing is kept for the spectators that are gone
+		relay.publishSavedGame(0, spectatorRelayTestSavedGame);
+		relay.publishGameOver(1);
+		for(int index = 0; index < 100 && relay.getSubscriberCount() > 0; ++index) {
+			relay.update(Chrono::getCurMillis());
+		}
+		CPPUNIT_ASSERT_EQUAL( 0, relay.getSubscriberCount() );
+		CPPUNIT_ASSERT_EQUAL( (int64)0, relay.getBufferedBytes() );
+
+		vector<unsigned char> data;
+		vector<int> types;
+		for(int attempt = 0; attempt < 10 && types.size() < 2; ++attempt) {
+			receiveSpectatorData(spectator2, data, data.size() + 1);
+			types = getSpectatorRelayRecordTypes(data);
+		}
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, types.size() );
+
+		// without spectators nothing is published
+		publishTestCommandList(relay, 2, 3);
+		relay.publishGameOver(3);
+		CPPUNIT_ASSERT_EQUAL( (int64)0, relay.getBufferedBytes() );
+	}
+};
+
+// Test Suite Registrations
+CPPUNIT_TEST_SUITE_REGISTRATION( SpectatorRelayTest );
@@ -0,0 +1,227 @@
+// ==============================================================
+//	This file is part of MegaGlest Unit Tests (www.megaglest.org)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "content_transfer.h"
+#include "checksum.h"
+#include "byte_order.h"
+#include "util.h"
+#include "platform_common.h"
+#include "conversion.h"
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+
+//
+// Tests for the content transfer server and client, over loopback
+//
+
+static const int contentTransferTestPort = 61399;
+static const string contentTransferServerRoot = "content_transfer_test_server/";
+static const string contentTransferClientRoot = "content_transfer_test_client/";
+
+static void createContentTransferTestFile(const string &file, const vector<char> &data) {
+	createDirectoryPaths(extractDirectoryPathFromFile(file));
+	std::ofstream out(file.c_str(), std::ios::binary);
+	if(data.empty() == false) {
+		out.write(&data[0], data.size());
+	}
+}
+
+static vector<char> readContentTransferTestFile(const string &file) {
+	vector<char> data;
+	std::ifstream in(file.c_str(), std::ios::binary);
+	char buf[4096];
+	for(;in.read(buf, sizeof(buf)) || in.gcount() > 0;) {
+		data.insert(data.end(), buf, buf + in.gcount());
+	}
+	return data;
+}
+
+// half random, half repeating so chunks go out both compressed and plain
+static vector<char> getContentTransferTestData(unsigned int size, unsigned int seed) {
+	vector<char> data(size);
+	srand(seed);
+	for(unsigned int index = 0; index < size; ++index) {
+		data[index] = (index < size / 2 ? (char)(rand() % 256) : (char)('a' + index % 7));
+	}
+	return data;
+}
+
+template<class T> static void writeContentTransferTestValue(std::ofstream &out, T value) {
+	value = ::Shared::PlatformByteOrder::toCommonEndian(value);
+	out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+class ContentTransferTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( ContentTransferTest );
+
+	CPPUNIT_TEST( test_unsafe_names_are_rejected );
+	CPPUNIT_TEST( test_folder_download_over_parallel_streams );
+	CPPUNIT_TEST( test_single_file_download );
+	CPPUNIT_TEST( test_missing_item_is_not_started );
+	CPPUNIT_TEST( test_download_resumes_from_chunk_journal );
+	CPPUNIT_TEST( test_stale_chunk_journal_is_discarded );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+	ContentTransferServer *server;
+
+	static const int testChunkSize = 64 * 1024;
+
+public:
+
+	void setUp() {
+		removeFolder(contentTransferServerRoot);
+		removeFolder(contentTransferClientRoot);
+		createDirectoryPaths(contentTransferServerRoot + "tilesets/");
+		createDirectoryPaths(contentTransferServerRoot + "maps/");
+		createDirectoryPaths(contentTransferClientRoot);
+
+		server = new ContentTransferServer(contentTransferTestPort, 16, NULL);
+		vector<string> paths;
+		paths.push_back(contentTransferServerRoot + "tilesets");
+		server->addRoot("tilesets", paths, true);
+		paths.clear();
+		paths.push_back(contentTransferServerRoot + "maps");
+		server->addRoot("maps", paths, true);
+		server->start();
+	}
+
+	void tearDown() {
+		server->shutdownAndWait();
+		delete server;
+		server = NULL;
+
+		Checksum::clearFileCache();
+		removeFolder(contentTransferServerRoot);
+		removeFolder(contentTransferClientRoot);
+	}
+
+	void test_unsafe_names_are_rejected() {
+		CPPUNIT_ASSERT_EQUAL( true,ContentTransferServer::isValidName("forest",false) );
+		CPPUNIT_ASSERT_EQUAL( true,ContentTransferServer::isValidName("sounds/wind.ogg",true) );
+		CPPUNIT_ASSERT_EQUAL( false,ContentTransferServer::isValidName("sounds/wind.ogg",false) );
+		CPPUNIT_ASSERT_EQUAL( false,ContentTransferServer::isValidName("",false) );
+		CPPUNIT_ASSERT_EQUAL( false,ContentTransferServer::isValidName("../config.ini",true) );
+		CPPUNIT_ASSERT_EQUAL( false,ContentTransferServer::isValidName("/etc/passwd",true) );
+		CPPUNIT_ASSERT_EQUAL( false,ContentTransferServer::isValidName("c:/windows",true) );
+	}
+
+	void test_folder_download_over_parallel_streams() {
+		CPPUNIT_ASSERT_EQUAL( true,server->isListening() );
+
+		vector<string> files;
+		files.push_back("forest/forest.xml");
+		files.push_back("forest/textures/grass.png");
+		files.push_back("forest/sounds/wind.ogg");
+		files.push_back("forest/empty.txt");
+		vector<unsigned int> sizes;
+		sizes.push_back(1000);
+		sizes.push_back(testChunkSize * 3 + 1234);
+		sizes.push_back(testChunkSize * 2);
+		sizes.push_back(0);
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			createContentTransferTestFile(contentTransferServerRoot + "tilesets/" + files[index],
+					getContentTransferTestData(sizes[index], index + 1));
+		}
+
+		ContentTransferClient client("127.0.0.1", contentTransferTestPort, 3, testChunkSize);
+		bool result = client.download("tilesets", "forest", contentTransferClientRoot + "forest");
+		CPPUNIT_ASSERT_EQUAL( true,result );
+
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			string file = contentTransferClientRoot + files[index];
+			CPPUNIT_ASSERT_EQUAL( true,fileExists(file) );
+			CPPUNIT_ASSERT( readContentTransferTestFile(contentTransferServerRoot + "tilesets/" + files[index]) ==
+							readContentTransferTestFile(file) );
+			CPPUNIT_ASSERT_EQUAL( false,fileExists(file + ".part") );
+			CPPUNIT_ASSERT_EQUAL( false,fileExists(file + ".part.chunks") );
+		}
+	}
+
+	void test_single_file_download() {
+		vector<char> data = getContentTransferTestData(testChunkSize + 100, 11);
+		createContentTransferTestFile(contentTransferServerRoot + "maps/island.mgm", data);
+
+		ContentTransferClient client("127.0.0.1", contentTransferTestPort, 2, testChunkSize);
+		string destFile = contentTransferClientRoot + "maps/island.mgm";
+		bool result = client.download("maps", "island.mgm", destFile);
+		CPPUNIT_ASSERT_EQUAL( true,result );
+		CPPUNIT_ASSERT( data == readContentTransferTestFile(destFile) );
+	}
+
+	void test_missing_item_is_not_started() {
+		ContentTransferClient client("127.0.0.1", contentTransferTestPort);
+		CPPUNIT_ASSERT_EQUAL( false,client.download("tilesets", "desert", contentTransferClientRoot + "desert") );
+		CPPUNIT_ASSERT_EQUAL( false,client.getTransferStarted() );
+		CPPUNIT_ASSERT_EQUAL( false,client.download("techs", "megapack", contentTransferClientRoot + "megapack") );
+		CPPUNIT_ASSERT_EQUAL( false,client.download("tilesets", "../maps", contentTransferClientRoot + "maps") );
+	}
+
+	// A .part file whose journal says the first chunk arrived: that chunk
+	// is kept as is and only the rest is fetched
+	void test_download_resumes_from_chunk_journal() {
+		string serverFile = contentTransferServerRoot + "maps/valley.mgm";
+		vector<char> data = getContentTransferTestData(testChunkSize * 2 + 10, 21);
+		createContentTransferTestFile(serverFile, data);
+		uint32 crc = ContentTransferServer::getFileCrc(serverFile);
+
+		string destFile = contentTransferClientRoot + "maps/valley.mgm";
+		vector<char> partData(data.begin(), data.begin() + testChunkSize);
+		createContentTransferTestFile(destFile + ".part", partData);
+		writeJournal(destFile + ".part.chunks", crc, data.size(), true);
+
+		ContentTransferClient client("127.0.0.1", contentTransferTestPort, 2, testChunkSize);
+		bool result = client.download("maps", "valley.mgm", destFile);
+		CPPUNIT_ASSERT_EQUAL( true,result );
+		CPPUNIT_ASSERT( data == readContentTransferTestFile(destFile) );
+		CPPUNIT_ASSERT_EQUAL( false,fileExists(destFile + ".part.chunks") );
+	}
+
+	// A journal written for another version of the file must not be used,
+	// the chunk it claims would be wrong
+	void test_stale_chunk_journal_is_discarded() {
+		string serverFile = contentTransferServerRoot + "maps/river.mgm";
+		vector<char> data = getContentTransferTestData(testChunkSize * 2, 31);
+		createContentTransferTestFile(serverFile, data);
+		uint32 crc = ContentTransferServer::getFileCrc(serverFile);
+
+		string destFile = contentTransferClientRoot + "maps/river.mgm";
+		createContentTransferTestFile(destFile + ".part", getContentTransferTestData(testChunkSize, 99));
+		writeJournal(destFile + ".part.chunks", crc + 1, data.size(), true);
+
+		ContentTransferClient client("127.0.0.1", contentTransferTestPort, 2, testChunkSize);
+		bool result = client.download("maps", "river.mgm", destFile);
+		CPPUNIT_ASSERT_EQUAL( true,result );
+		CPPUNIT_ASSERT( data == readContentTransferTestFile(destFile) );
+	}
+
+private:
+
+	void writeJournal(const string &file, uint32 crc, int64 size, bool firstChunkDone) {
+		std::ofstream out(file.c_str(), std::ios::binary);
+		out.write("MGCJ", 4);
+		writeContentTransferTestValue<uint32>(out, crc);
+		writeContentTransferTestValue<int64>(out, size);
+		writeContentTransferTestValue<uint32>(out, (uint32)testChunkSize);
+		if(firstChunkDone == true) {
+			writeContentTransferTestValue<int64>(out, 0);
+		}
+	}
+};
+
+// Test Suite Registrations
+CPPUNIT_TEST_SUITE_REGISTRATION( ContentTransferTest );
+//
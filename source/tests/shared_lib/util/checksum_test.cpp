@@ -0,0 +1,310 @@
+// ==============================================================
+//	This file is part of MegaGlest Unit Tests (www.megaglest.org)
+//
+//	You can redistribute this code and/or modify it under
+//	the terms of the GNU General Public License as published
+//	by the Free Software Foundation; either version 2 of the
+//	License, or (at your option) any later version
+// ==============================================================
+
+#include <cppunit/extensions/HelperMacros.h>
+#include "checksum.h"
+#include "util.h"
+#include "platform_common.h"
+#include "conversion.h"
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Shared::Util;
+using namespace Shared::PlatformCommon;
+
+//
+// Tests for the Checksum class, every crc engine and the streaming file
+// reader have to give the same values as the original byte at a time code
+//
+
+static bool removeChecksumTestFile(const string &file) {
+#ifdef WIN32
+	int result = _unlink(file.c_str());
+#else
+	int result = unlink(file.c_str());
+#endif
+	return (result == 0);
+}
+
+static void createChecksumTestFile(const string &file, const vector<char> &data) {
+	std::ofstream out(file.c_str(), std::ios::binary);
+	if(data.empty() == false) {
+		out.write(&data[0], data.size());
+	}
+}
+
+// The original file checksum code: file name first, then the content one
+// byte at a time, for xml files the whole file is buffered and formatting
+// whitespace and comments are left out
+static uint32 getReferenceFileSum(const string &file, const vector<char> &data) {
+	Checksum checksum;
+	checksum.addString(lastFile(file));
+
+	bool isXMLFile = (EndsWith(file, ".xml") == true);
+	bool inCommentTag = false;
+	unsigned int bufSize = (unsigned int)data.size();
+	for(unsigned int i = 0; i < bufSize; ++i) {
+		if(isXMLFile == true) {
+			if(inCommentTag == true) {
+				if(data[i] == '>' && i >= 3 && data[i-1] == '-' && data[i-2] == '-') {
+					inCommentTag = false;
+				}
+				continue;
+			}
+			else if(data[i] == '<' && i+4 < bufSize && data[i+1] == '!' && data[i+2] == '-' && data[i+3] == '-') {
+				inCommentTag = true;
+				continue;
+			}
+			else if(data[i] == ' ' || data[i] == '\t' || data[i] == '\n' || data[i] == '\r') {
+				continue;
+			}
+		}
+		checksum.addByte(data[i]);
+	}
+	return checksum.getSum();
+}
+
+static vector<char> createTestData(unsigned int size, bool xmlLike) {
+	const char xmlChars[] = "<!-> \t\n\rab";
+	vector<char> data(size);
+	for(unsigned int i = 0; i < size; ++i) {
+		if(xmlLike == true && (rand() % 4) != 0) {
+			data[i] = xmlChars[rand() % (sizeof(xmlChars) - 1)];
+		}
+		else {
+			data[i] = (char)(rand() % 256);
+		}
+	}
+	return data;
+}
+
+class ChecksumTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( ChecksumTest );
+
+	CPPUNIT_TEST( test_crc_engines_match_bytewise );
+	CPPUNIT_TEST( test_xml_file_sum_matches_reference );
+	CPPUNIT_TEST( test_threaded_file_list_sum_matches_single_thread );
+	CPPUNIT_TEST( test_merged_file_lists_match_single_list );
+	CPPUNIT_TEST( test_file_index_notices_changed_files );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+public:
+
+	void test_crc_engines_match_bytewise() {
+		const ChecksumCrcEngine engines[] = { crcEngineBytewise, crcEngineSlicingBy8, crcEnginePclmul, crcEngineAuto };
+		const ChecksumCrcEngine oldEngine = Checksum::getCrcEngine();
+
+		srand(7);
+		for(unsigned int engineIndex = 0; engineIndex < sizeof(engines) / sizeof(engines[0]); ++engineIndex) {
+			if(Checksum::isCrcEngineSupported(engines[engineIndex]) == false) {
+				continue;
+			}
+			Checksum::setCrcEngine(engines[engineIndex]);
+
+			// standard CRC32 check value
+			Checksum check;
+			check.addBytes("123456789", 9);
+			CPPUNIT_ASSERT_EQUAL( (uint32)0xCBF43926,check.getSum() );
+
+			for(unsigned int size = 0; size < 1200; size += 1 + size / 8) {
+				vector<char> data = createTestData(size, false);
+
+				Checksum reference;
+				for(unsigned int i = 0; i < size; ++i) {
+					reference.addByte(data[i]);
+				}
+
+				// odd split points to hit the unaligned head and tail code
+				Checksum checksum;
+				unsigned int split = (size > 0 ? (unsigned int)rand() % size : 0);
+				checksum.addBytes(size > 0 ? &data[0] : NULL, split);
+				checksum.addBytes(size > 0 ? &data[split] : NULL, size - split);
+				CPPUNIT_ASSERT_EQUAL( reference.getSum(),checksum.getSum() );
+			}
+		}
+		Checksum::setCrcEngine(oldEngine);
+	}
+
+	void test_xml_file_sum_matches_reference() {
+		srand(11);
+		// sizes around the reader chunk size so comments get cut in half
+		const unsigned int sizes[] = { 0, 1, 4, 5, 6, 100, 65533, 65536, 65539, 200000 };
+		for(unsigned int sizeIndex = 0; sizeIndex < sizeof(sizes) / sizeof(sizes[0]); ++sizeIndex) {
+			for(int xmlFile = 0; xmlFile <= 1; ++xmlFile) {
+				const string file = (xmlFile == 1 ? "checksum_test.xml" : "checksum_test.bin");
+				vector<char> data = createTestData(sizes[sizeIndex], true);
+				createChecksumTestFile(file, data);
+
+				uint32 referenceSum = getReferenceFileSum(file, data);
+
+				bool fileExists = false;
+				uint32 fileSum = Checksum::getFileSum(file, &fileExists);
+				removeChecksumTestFile(file);
+
+				CPPUNIT_ASSERT_EQUAL( true,fileExists );
+				CPPUNIT_ASSERT_EQUAL( referenceSum,fileSum );
+			}
+		}
+	}
+
+	void test_threaded_file_list_sum_matches_single_thread() {
+		srand(13);
+		const int oldThreadCount = Checksum::getFileHashThreadCount();
+
+		vector<string> files;
+		for(int index = 0; index < 12; ++index) {
+			string file = "checksum_test_" + intToStr(index) + (index % 2 == 0 ? ".xml" : ".bin");
+			createChecksumTestFile(file, createTestData(1000 + index * 5000, true));
+			files.push_back(file);
+		}
+
+		Checksum::setFileHashThreadCount(0);
+		Checksum::clearFileCache();
+		Checksum single;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			single.addFile(files[index]);
+		}
+		uint32 singleSum = single.getSum();
+
+		Checksum::setFileHashThreadCount(4);
+		Checksum::clearFileCache();
+		Checksum threaded;
+		// added in a different order, the list is sorted anyway
+		for(int index = (int)files.size() - 1; index >= 0; --index) {
+			threaded.addFile(files[index]);
+		}
+		uint32 threadedSum = threaded.getSum();
+
+		Checksum::setFileHashThreadCount(oldThreadCount);
+		Checksum::clearFileCache();
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			removeChecksumTestFile(files[index]);
+		}
+
+		CPPUNIT_ASSERT_EQUAL( singleSum,threadedSum );
+	}
+
+	// parts loaded into their own checksums and merged afterwards, with a
+	// file both parts use, sum up like one list
+	void test_merged_file_lists_match_single_list() {
+		srand(17);
+		vector<string> files;
+		for(int index = 0; index < 5; ++index) {
+			string file = "checksum_test_merge_" + intToStr(index) + ".xml";
+			createChecksumTestFile(file, createTestData(500 + index * 300, true));
+			files.push_back(file);
+		}
+
+		Checksum::clearFileCache();
+		Checksum single;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			single.addFile(files[index]);
+		}
+		uint32 singleSum = single.getSum();
+
+		Checksum::clearFileCache();
+		Checksum firstPart;
+		Checksum secondPart;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			if(index <= 2) {
+				firstPart.addFile(files[index]);
+			}
+			if(index >= 2) {
+				secondPart.addFile(files[index]);
+			}
+		}
+		Checksum merged;
+		merged.addFiles(secondPart);
+		merged.addFiles(firstPart);
+		uint32 mergedFileCount = merged.getFileCount();
+		uint32 mergedSum = merged.getSum();
+
+		Checksum::clearFileCache();
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			removeChecksumTestFile(files[index]);
+		}
+
+		CPPUNIT_ASSERT_EQUAL( (uint32)files.size(),mergedFileCount );
+		CPPUNIT_ASSERT_EQUAL( singleSum,mergedSum );
+	}
+
+	void test_file_index_notices_changed_files() {
+		srand(17);
+		const string oldCachePath = getCRCCacheFilePath();
+		const bool oldIndexEnabled = Checksum::getFileIndexEnabled();
+		setCRCCacheFilePath("checksum_test_");
+		Checksum::setFileIndexEnabled(true);
+
+		vector<string> files;
+		vector<vector<char> > contents;
+		for(int index = 0; index < 4; ++index) {
+			string file = "checksum_test_index_" + intToStr(index) + ".xml";
+			contents.push_back(createTestData(2000, true));
+			createChecksumTestFile(file, contents.back());
+			files.push_back(file);
+		}
+		// files written in the last seconds are never put in the index
+		sleep(2500);
+
+		Checksum::clearFileCache();
+		Checksum first;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			first.addFile(files[index]);
+		}
+		uint32 firstSum = first.getSum();
+		Checksum::saveFileIndex();
+		CPPUNIT_ASSERT_EQUAL( true,fileExists("checksum_test_CRC_FILE_INDEX") );
+
+		// same size, different content
+		contents[1] = createTestData(2000, true);
+		createChecksumTestFile(files[1], contents[1]);
+
+		Checksum::clearFileCache();
+		Checksum second;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			second.addFile(files[index]);
+		}
+		uint32 secondSum = second.getSum();
+
+		Checksum::setFileIndexEnabled(false);
+		Checksum::clearFileCache();
+		Checksum expected;
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			expected.addFile(files[index]);
+		}
+		uint32 expectedSum = expected.getSum();
+
+		Checksum::removeFolderFromFileIndex("checksum_test_index_");
+		Checksum::saveFileIndex();
+		Checksum::setFileIndexEnabled(oldIndexEnabled);
+		setCRCCacheFilePath(oldCachePath);
+		Checksum::clearFileCache();
+		for(unsigned int index = 0; index < files.size(); ++index) {
+			removeChecksumTestFile(files[index]);
+		}
+		removeChecksumTestFile("checksum_test_CRC_FILE_INDEX");
+
+		CPPUNIT_ASSERT( firstSum != secondSum );
+		CPPUNIT_ASSERT_EQUAL( expectedSum,secondSum );
+	}
+};
+
+// Test Suite Registrations
+CPPUNIT_TEST_SUITE_REGISTRATION( ChecksumTest );
+//
@@ -14,6 +14,7 @@
 #include <fstream>
 #include "xml_parser.h"
 #include "platform_util.h"
+#include "conversion.h"
 
 #if defined(WANT_XERCES)
 
@@ -32,6 +33,7 @@
 
 using namespace Shared::Xml;
 using namespace Shared::Platform;
+using namespace Shared::Util;
 
 //
 // Utility methods for tests
@@ -171,6 +173,7 @@ class XmlIoRapidTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST_EXCEPTION( test_load_file_malformed_content,  megaglest_runtime_error );
 	CPPUNIT_TEST_EXCEPTION( test_save_file_null_node,  megaglest_runtime_error );
 	CPPUNIT_TEST(test_save_file_valid_node );
+	CPPUNIT_TEST( test_load_file_comments_and_tags );
 
 	CPPUNIT_TEST_SUITE_END();
 	// End of Fixture registration
@@ -230,6 +233,36 @@ public:
 
 		delete rootNode;
 	}
+
+	void test_load_file_comments_and_tags() {
+		const string test_filename = "xml_test_comments_tags.xml";
+		std::ofstream xmlFile(test_filename.c_str());
+		xmlFile << "<?xml version=\"1.0\"?>" << std::endl
+				<< "<!-- <removed value=\"1\"/> -->" << std::endl
+				<< "<menu model=\"{TESTPATH}menu.g3d\" size=\"2\">" << std::endl
+				<< "<!-- first comment -->" << std::endl
+				<< "<music>{TESTPATH}menu.ogg</music>" << std::endl
+				<< "<!-- second comment --> <sound/>" << std::endl
+				<< "</menu>" << std::endl;
+		xmlFile.close();
+		SafeRemoveTestFile deleteFile(test_filename);
+
+		std::map<string,string> mapTagReplacementValues;
+		mapTagReplacementValues["{TESTPATH}"] = "data/";
+		XmlNode *rootNode = XmlIoRapid::getInstance().load(test_filename, mapTagReplacementValues);
+		// the tree has its own copy of the tag values
+		mapTagReplacementValues.clear();
+
+		CPPUNIT_ASSERT( rootNode != NULL );
+		CPPUNIT_ASSERT_EQUAL( string("menu"), rootNode->getName() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, rootNode->getChildCount() );
+		CPPUNIT_ASSERT_EQUAL( string("data/menu.g3d"), rootNode->getAttribute("model")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( 2, rootNode->getAttribute("size")->getIntValue() );
+		CPPUNIT_ASSERT_EQUAL( string("data/menu.ogg"), rootNode->getChild("music")->getText() );
+		CPPUNIT_ASSERT_EQUAL( true, rootNode->hasChild("sound") );
+
+		delete rootNode;
+	}
 };
 
 //
@@ -317,6 +350,403 @@ public:
 };
 
 
+//
+// Tests for XmlTreeCache
+//
+class XmlTreeCacheTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( XmlTreeCacheTest );
+
+	CPPUNIT_TEST( test_cached_tree_matches_parsed_tree );
+	CPPUNIT_TEST( test_outdated_cache_is_not_used );
+	CPPUNIT_TEST( test_invalid_cache_is_not_used );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+	static const Shared::Platform::uint32 testFolderCRC = 1234;
+
+	// the cache folder is just the start of the file names here
+	string getTestFolder() const	{ return "xml_tree_cache_"; }
+	string getTestFile() const		{ return "xml_tree_cache_unit.xml"; }
+	string getTestCacheFile() const	{ return "xml_tree_cache_test.mgtc"; }
+
+	void createTestFile() {
+		std::ofstream xmlFile(getTestFile().c_str());
+		xmlFile << "<?xml version=\"1.0\"?>" << std::endl
+				<< "<!-- unit used by the cache tests -->" << std::endl
+				<< "<unit name=\"worker\" model=\"{TESTPATH}worker.g3d\">" << std::endl
+				<< "<skills count=\"2\">" << std::endl
+				<< "<skill name=\"move\"/>" << std::endl
+				<< "<skill name=\"attack\">{TESTPATH}attack.wav</skill>" << std::endl
+				<< "</skills>" << std::endl
+				<< "<size value=\"1\"/>" << std::endl
+				<< "</unit>" << std::endl;
+		xmlFile.close();
+	}
+
+	std::map<string,string> getTagValues(const string &testPath) const {
+		std::map<string,string> mapTagReplacementValues;
+		mapTagReplacementValues["{TESTPATH}"] = testPath;
+		return mapTagReplacementValues;
+	}
+
+	void checkTestTree(const XmlNode *rootNode, const string &testPath) {
+		CPPUNIT_ASSERT( rootNode != NULL );
+		CPPUNIT_ASSERT_EQUAL( string("unit"), rootNode->getName() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, rootNode->getAttributeCount() );
+		CPPUNIT_ASSERT_EQUAL( string("worker"), rootNode->getAttribute("name")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( testPath + "worker.g3d", rootNode->getAttribute("model")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, rootNode->getChildCount() );
+
+		const XmlNode *skillsNode = rootNode->getChild("skills");
+		CPPUNIT_ASSERT_EQUAL( 2, skillsNode->getAttribute("count")->getIntValue() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, skillsNode->getChildCount() );
+		CPPUNIT_ASSERT_EQUAL( string("move"), skillsNode->getChild("skill",0)->getAttribute("name")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( string(""), skillsNode->getChild("skill",0)->getText() );
+		CPPUNIT_ASSERT_EQUAL( testPath + "attack.wav", skillsNode->getChild("skill",1)->getText() );
+		CPPUNIT_ASSERT_EQUAL( 1, rootNode->getChild("size")->getAttribute("value")->getIntValue() );
+	}
+
+public:
+
+	void test_cached_tree_matches_parsed_tree() {
+		createTestFile();
+		SafeRemoveTestFile deleteFile(getTestFile());
+		SafeRemoveTestFile deleteCacheFile(getTestCacheFile());
+
+		XmlTreeCache *cache = new XmlTreeCache(getTestFolder(), getTestCacheFile(), testFolderCRC);
+		CPPUNIT_ASSERT_EQUAL( false, cache->load() );
+		cache->setActive(true);
+		{
+			XmlTree xmlTree;
+			xmlTree.load(getTestFile(), getTagValues("first/"));
+			checkTestTree(xmlTree.getRootNode(), "first/");
+		}
+		CPPUNIT_ASSERT_EQUAL( 1, cache->getMissCount() );
+		CPPUNIT_ASSERT_EQUAL( true, cache->save() );
+		delete cache;
+
+		// without the xml file the tree can only come from the cache, with
+		// the tags replaced for this load
+		removeTestFile(getTestFile());
+		cache = new XmlTreeCache(getTestFolder(), getTestCacheFile(), testFolderCRC);
+		CPPUNIT_ASSERT_EQUAL( true, cache->load() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)1, cache->getFileCount() );
+		cache->setActive(true);
+		{
+			XmlTree xmlTree;
+			xmlTree.load(getTestFile(), getTagValues("second/"));
+			checkTestTree(xmlTree.getRootNode(), "second/");
+		}
+		CPPUNIT_ASSERT_EQUAL( 1, cache->getHitCount() );
+		CPPUNIT_ASSERT_EQUAL( 0, cache->getMissCount() );
+		delete cache;
+	}
+
+	void test_outdated_cache_is_not_used() {
+		createTestFile();
+		SafeRemoveTestFile deleteFile(getTestFile());
+		SafeRemoveTestFile deleteCacheFile(getTestCacheFile());
+
+		XmlTreeCache cache(getTestFolder(), getTestCacheFile(), testFolderCRC);
+		cache.setActive(true);
+		XmlTree xmlTree;
+		xmlTree.load(getTestFile(), getTagValues(""));
+		cache.setActive(false);
+		CPPUNIT_ASSERT_EQUAL( true, cache.save() );
+
+		XmlTreeCache changedCache(getTestFolder(), getTestCacheFile(), testFolderCRC + 1);
+		CPPUNIT_ASSERT_EQUAL( false, changedCache.load() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)0, changedCache.getFileCount() );
+	}
+
+	void test_invalid_cache_is_not_used() {
+		SafeRemoveTestFile deleteCacheFile(getTestCacheFile());
+		std::ofstream cacheFile(getTestCacheFile().c_str(), std::ios::binary);
+		cacheFile << "MGTC this is not a cache file";
+		cacheFile.close();
+
+		XmlTreeCache cache(getTestFolder(), getTestCacheFile(), testFolderCRC);
+		CPPUNIT_ASSERT_EQUAL( false, cache.load() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)0, cache.getFileCount() );
+	}
+};
+
+//
+// Tests for XmlBinaryIo
+//
+class XmlBinaryIoTest : public CppUnit::TestFixture {
+	// Register the suite of tests for this fixture
+	CPPUNIT_TEST_SUITE( XmlBinaryIoTest );
+
+	CPPUNIT_TEST( test_binary_tree_matches_saved_tree );
+	CPPUNIT_TEST( test_streamed_children_are_sections );
+	CPPUNIT_TEST( test_converted_tree_saves_same_xml );
+	CPPUNIT_TEST( test_invalid_binary_file_is_rejected );
+	CPPUNIT_TEST( test_deeply_nested_binary_file_is_rejected );
+	CPPUNIT_TEST( test_large_streamed_tree_is_saved );
+
+	CPPUNIT_TEST_SUITE_END();
+	// End of Fixture registration
+
+	// the explored list of a map cell batch, 3 cells of 8 players
+	string getFlagList() const {
+		return "1|0|0|1|0|0|0|0,1|1|1|1|1|1|1|1,0|0|0|0|0|0|0|1";
+	}
+
+	void addTestUnits(XmlNode *factionNode) {
+		std::map<string,string> mapTagReplacementValues;
+		for(int i = 0; i < 3; ++i) {
+			XmlNode *unitNode = factionNode->addChild("Unit");
+			unitNode->addAttribute("id", intToStr(i * 1000 - 1), mapTagReplacementValues);
+			unitNode->addAttribute("type", "{TECHTREEPATH}/units/worker", mapTagReplacementValues);
+			unitNode->addAttribute("hp", "007", mapTagReplacementValues);
+			unitNode->addChild("Command")->addAttribute("text", "<\"a & b\">", mapTagReplacementValues);
+		}
+	}
+
+	void checkTestUnits(const XmlNode *factionNode, const string &techTreePath) {
+		CPPUNIT_ASSERT_EQUAL( (size_t)3, factionNode->getChildCount() );
+		for(int i = 0; i < 3; ++i) {
+			const XmlNode *unitNode = factionNode->getChild("Unit", i);
+			CPPUNIT_ASSERT_EQUAL( i * 1000 - 1, unitNode->getAttribute("id")->getIntValue() );
+			CPPUNIT_ASSERT_EQUAL( techTreePath + "/units/worker", unitNode->getAttribute("type")->getValue() );
+			CPPUNIT_ASSERT_EQUAL( string("007"), unitNode->getAttribute("hp")->getValue() );
+			CPPUNIT_ASSERT_EQUAL( string("<\"a & b\">"), unitNode->getChild("Command")->getAttribute("text")->getValue() );
+		}
+	}
+
+	void createTestTree(XmlTree &xmlTree, bool streamChildren, XmlSaveFormat streamFormat=xsfXml) {
+		std::map<string,string> mapTagReplacementValues;
+		xmlTree.init("megaglest-saved-game");
+		XmlNode *gameNode = xmlTree.getRootNode()->addChild("Game");
+		gameNode->setStreamChildren(streamChildren, streamFormat);
+
+		XmlNode *mapNode = gameNode->addChild("Map");
+		mapNode->addAttribute("exploredList", getFlagList(), mapTagReplacementValues);
+		mapNode->addAttribute("shortList", "1|0", mapTagReplacementValues);
+		mapNode->addAttribute("waterLevel", "-1.500000", mapTagReplacementValues);
+
+		XmlNode *factionNode = gameNode->addChild("Faction");
+		factionNode->setStreamChildren(streamChildren, gameNode->getStreamFormat());
+		addTestUnits(factionNode);
+		gameNode->addAttribute("frameCount", "-0", mapTagReplacementValues);
+	}
+
+	void checkTestTree(const XmlNode *rootNode, const string &techTreePath) {
+		CPPUNIT_ASSERT_EQUAL( string("megaglest-saved-game"), rootNode->getName() );
+		const XmlNode *gameNode = rootNode->getChild("Game");
+		CPPUNIT_ASSERT_EQUAL( (size_t)2, gameNode->getChildCount() );
+		CPPUNIT_ASSERT_EQUAL( string("-0"), gameNode->getAttribute("frameCount")->getValue() );
+
+		const XmlNode *mapNode = gameNode->getChild("Map");
+		CPPUNIT_ASSERT_EQUAL( getFlagList(), mapNode->getAttribute("exploredList")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( string("1|0"), mapNode->getAttribute("shortList")->getValue() );
+		CPPUNIT_ASSERT_EQUAL( -1.5f, mapNode->getAttribute("waterLevel")->getFloatValue() );
+		checkTestUnits(gameNode->getChild("Faction"), techTreePath);
+	}
+
+	std::map<string,string> getTagValues() const {
+		std::map<string,string> mapTagReplacementValues;
+		mapTagReplacementValues["{TECHTREEPATH}"] = "techs/megapack";
+		return mapTagReplacementValues;
+	}
+
+	vector<char> readTestFile(const string &file) {
+		vector<char> data;
+		std::ifstream in(file.c_str(), std::ios::binary);
+		char buf[4096];
+		for(;in.read(buf, sizeof(buf)) || in.gcount() > 0;) {
+			data.insert(data.end(), buf, buf + in.gcount());
+		}
+		return data;
+	}
+
+public:
+
+	void test_binary_tree_matches_saved_tree() {
+		const string test_filename = "xml_test_binary_tree.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		{
+			XmlTree xmlTree;
+			createTestTree(xmlTree, false);
+			xmlTree.save(test_filename, xsfBinary);
+		}
+		vector<char> data = readTestFile(test_filename);
+		CPPUNIT_ASSERT_EQUAL( true, XmlBinaryIo::isBinaryData(&data[0], data.size()) );
+
+		XmlTree xmlTree;
+		xmlTree.load(test_filename, getTagValues());
+		checkTestTree(xmlTree.getRootNode(), "techs/megapack");
+	}
+
+	void test_streamed_children_are_sections() {
+		const string test_filename = "xml_test_binary_streamed.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		{
+			XmlTree xmlTree;
+			createTestTree(xmlTree, true, xsfBinary);
+			CPPUNIT_ASSERT_EQUAL( (size_t)1, xmlTree.getRootNode()->getChild("Game")->getChildCount() );
+
+			// streamed binary children can not go into an xml file
+			bool savedAsXml = true;
+			try {
+				xmlTree.save(test_filename, xsfXml);
+			}
+			catch(const megaglest_runtime_error &ex) {
+				savedAsXml = false;
+			}
+			CPPUNIT_ASSERT_EQUAL( false, savedAsXml );
+			xmlTree.save(test_filename, xsfBinary);
+		}
+
+		XmlTree xmlTree;
+		xmlTree.load(test_filename, getTagValues());
+		checkTestTree(xmlTree.getRootNode(), "techs/megapack");
+	}
+
+	void test_converted_tree_saves_same_xml() {
+		const string xml_filename = "xml_test_binary_convert.xml";
+		const string binary_filename = "xml_test_binary_convert.bin";
+		const string xml_filename2 = "xml_test_binary_convert2.xml";
+		SafeRemoveTestFile deleteFile(xml_filename);
+		SafeRemoveTestFile deleteFile2(binary_filename);
+		SafeRemoveTestFile deleteFile3(xml_filename2);
+		{
+			XmlTree xmlTree;
+			createTestTree(xmlTree, false);
+			xmlTree.save(xml_filename);
+		}
+
+		// without tag values the tags stay in the values
+		std::map<string,string> mapTagReplacementValues;
+		{
+			XmlTree xmlTree;
+			xmlTree.load(xml_filename, mapTagReplacementValues);
+			xmlTree.save(binary_filename, xsfBinary);
+		}
+		vector<char> xmlData = readTestFile(xml_filename);
+		vector<char> binaryData = readTestFile(binary_filename);
+		CPPUNIT_ASSERT( binaryData.size() < xmlData.size() );
+
+		XmlTree xmlTree;
+		xmlTree.load(binary_filename, mapTagReplacementValues);
+		checkTestTree(xmlTree.getRootNode(), "{TECHTREEPATH}");
+		xmlTree.save(xml_filename2);
+		CPPUNIT_ASSERT( xmlData == readTestFile(xml_filename2) );
+	}
+
+	void test_invalid_binary_file_is_rejected() {
+		const string test_filename = "xml_test_binary_invalid.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		{
+			XmlTree xmlTree;
+			createTestTree(xmlTree, true, xsfBinary);
+			xmlTree.save(test_filename, xsfBinary);
+		}
+		vector<char> data = readTestFile(test_filename);
+
+		// cut off and with more attributes than there is data left
+		for(int index = 0; index < 2; ++index) {
+			vector<char> invalidData = data;
+			if(index == 0) {
+				invalidData.resize(data.size() - 5);
+			}
+			else {
+				invalidData.back() = (char)0x7f;
+			}
+			std::ofstream out(test_filename.c_str(), std::ios::binary);
+			out.write(&invalidData[0], invalidData.size());
+			out.close();
+
+			bool loaded = true;
+			try {
+				XmlTree xmlTree;
+				xmlTree.load(test_filename, getTagValues());
+			}
+			catch(const megaglest_runtime_error &ex) {
+				loaded = false;
+			}
+			CPPUNIT_ASSERT_EQUAL( false, loaded );
+		}
+	}
+
+	void test_deeply_nested_binary_file_is_rejected() {
+		const string test_filename = "xml_test_binary_nested.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		std::map<string,string> mapTagReplacementValues;
+		for(int depth = XmlBinaryIo::maxNodeDepth; depth <= XmlBinaryIo::maxNodeDepth + 1; ++depth) {
+			{
+				XmlTree xmlTree;
+				xmlTree.init("megaglest-saved-game");
+				XmlNode *node = xmlTree.getRootNode();
+				for(int i = 1; i < depth; ++i) {
+					node = node->addChild("Node");
+				}
+				node->addAttribute("depth", intToStr(depth), mapTagReplacementValues);
+				xmlTree.save(test_filename, xsfBinary);
+			}
+
+			bool loaded = true;
+			try {
+				XmlTree xmlTree;
+				xmlTree.load(test_filename, mapTagReplacementValues);
+			}
+			catch(const megaglest_runtime_error &ex) {
+				loaded = false;
+			}
+			CPPUNIT_ASSERT_EQUAL( depth <= XmlBinaryIo::maxNodeDepth, loaded );
+		}
+	}
+
+	void test_large_streamed_tree_is_saved() {
+		const string test_filename = "xml_test_large_streamed.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		// the streamed children are bigger than the memory limit of their
+		// buffers and get moved to temporary files, in binary form as well
+		// where the explored flags take a bit each
+		const int unitCount = 1500;
+		string exploredList = "1";
+		for(int i = 1; i < 8192; ++i) {
+			exploredList += (i % 3 == 0 ? "|1" : "|0");
+		}
+		std::map<string,string> mapTagReplacementValues;
+		for(int index = 0; index < 2; ++index) {
+			XmlSaveFormat format = (index == 0 ? xsfXml : xsfBinary);
+			{
+				XmlTree xmlTree;
+				xmlTree.init("megaglest-saved-game");
+				XmlNode *gameNode = xmlTree.getRootNode()->addChild("Game");
+				gameNode->setStreamChildren(true, format);
+				XmlNode *factionNode = gameNode->addChild("Faction");
+				factionNode->setStreamChildren(true, format);
+				for(int i = 0; i < unitCount; ++i) {
+					XmlNode *unitNode = factionNode->addChild("Unit");
+					unitNode->addAttribute("id", intToStr(i), mapTagReplacementValues);
+					unitNode->addAttribute("exploredList", exploredList, mapTagReplacementValues);
+				}
+				gameNode->addChild("Map")->addAttribute("shortList", "1|0", mapTagReplacementValues);
+				gameNode->addAttribute("frameCount", "10", mapTagReplacementValues);
+				xmlTree.save(test_filename, format);
+			}
+
+			XmlTree xmlTree;
+			xmlTree.load(test_filename, mapTagReplacementValues);
+			const XmlNode *gameNode = xmlTree.getRootNode()->getChild("Game");
+			CPPUNIT_ASSERT_EQUAL( 10, gameNode->getAttribute("frameCount")->getIntValue() );
+			CPPUNIT_ASSERT_EQUAL( string("1|0"), gameNode->getChild("Map")->getAttribute("shortList")->getValue() );
+			const XmlNode *factionNode = gameNode->getChild("Faction");
+			CPPUNIT_ASSERT_EQUAL( (size_t)unitCount, factionNode->getChildCount() );
+			for(int i = 0; i < unitCount; ++i) {
+				const XmlNode *unitNode = factionNode->getChild(i);
+				CPPUNIT_ASSERT_EQUAL( i, unitNode->getAttribute("id")->getIntValue() );
+				CPPUNIT_ASSERT_EQUAL( exploredList, unitNode->getAttribute("exploredList")->getValue() );
+			}
+		}
+	}
+};
+
 //
 // Tests for XmlNode
 //
@@ -335,6 +765,7 @@ class XmlNodeTest : public CppUnit::TestFixture {
 	CPPUNIT_TEST( test_valid_named_node );
 	CPPUNIT_TEST( test_child_nodes );
 	CPPUNIT_TEST( test_node_attributes );
+	CPPUNIT_TEST( test_streamed_children_are_saved );
 
 	CPPUNIT_TEST_SUITE_END();
 	// End of Fixture registration
@@ -471,6 +902,37 @@ public:
 		CPPUNIT_ASSERT_EQUAL( true, node.hasAttribute("some-attribute") );
 	}
 
+	void test_streamed_children_are_saved() {
+		const string test_filename = "xml_test_streamed_children.xml";
+		SafeRemoveTestFile deleteFile(test_filename);
+		std::map<string,string> mapTagReplacementValues;
+		{
+			XmlNode node("saved-game");
+			node.setStreamChildren(true);
+			for(int i = 0; i < 3; ++i) {
+				XmlNode *unitNode = node.addChild("Unit");
+				unitNode->addAttribute("id", intToStr(i), mapTagReplacementValues);
+				unitNode->addChild("Command")->addAttribute("text", "<\"a & b\">", mapTagReplacementValues);
+			}
+			// only the last child is still a node
+			CPPUNIT_ASSERT_EQUAL( (size_t)1, node.getChildCount() );
+			node.addAttribute("frameCount", "10", mapTagReplacementValues);
+			XmlIoRapid::getInstance().save(test_filename, &node);
+		}
+
+		XmlTree xmlTree;
+		xmlTree.load(test_filename, mapTagReplacementValues);
+		const XmlNode *rootNode = xmlTree.getRootNode();
+		CPPUNIT_ASSERT_EQUAL( string("saved-game"), rootNode->getName() );
+		CPPUNIT_ASSERT_EQUAL( 10, rootNode->getAttribute("frameCount")->getIntValue() );
+		CPPUNIT_ASSERT_EQUAL( (size_t)3, rootNode->getChildCount() );
+		for(int i = 0; i < 3; ++i) {
+			const XmlNode *unitNode = rootNode->getChild("Unit", i);
+			CPPUNIT_ASSERT_EQUAL( i, unitNode->getAttribute("id")->getIntValue() );
+			CPPUNIT_ASSERT_EQUAL( string("<\"a & b\">"), unitNode->getChild("Command")->getAttribute("text")->getValue() );
+		}
+	}
+
 };
 
 #if defined(WANT_XERCES)
@@ -624,6 +1086,8 @@ public:
 
 CPPUNIT_TEST_SUITE_REGISTRATION( XmlIoRapidTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( XmlTreeTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( XmlTreeCacheTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( XmlBinaryIoTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( XmlNodeTest );
 
 #if defined(WANT_XERCES)